@@ -97,6 +97,8 @@ public:
     bool insertShapes(const ObjectConstPtr& object);
     bool removeShapes(const ObjectConstPtr& object);
     bool processCollisionObject(const moveit_msgs::CollisionObject& object);
+    bool processCollisionObjects(
+        const std::vector<moveit_msgs::CollisionObject>& objects);
     bool processOctomapMsg(const octomap_msgs::OctomapWithPose& octomap);
     ///@}
 
@@ -177,6 +179,18 @@ public:
         const motion::RobotState& finish,
         std::vector<motion::RobotState>& path) override;
 
+    bool appendInterpolatedPath(
+        const motion::RobotState& start,
+        const motion::RobotState& finish,
+        motion::FlatPath& path,
+        bool& valid) override;
+
+    bool isStateToStateAffected(
+        const motion::RobotState& start,
+        const motion::RobotState& finish) override;
+
+    void clearEnvironmentChanges() override;
+
     visualization_msgs::MarkerArray
     getCollisionModelVisualization(const motion::RobotState& vals) override;
 
@@ -200,6 +214,10 @@ private:
     WorldCollisionModelPtr          m_wcm;
     SelfCollisionModelPtr           m_scm;
 
+    // whether the robot state, attached bodies, padding, or allowed collision
+    // matrix have changed since the last call to clearEnvironmentChanges()
+    bool                            m_robot_changed;
+
     // Collision Group
     std::string                     m_group_name;
     int                             m_gidx;
@@ -348,6 +366,22 @@ public:
         const RobotCollisionModelConstPtr& rcm,
         const std::string& group_name,
         const std::vector<std::string>& planning_joints);
+
+    /// \brief Update a collision space from a planning scene, caching the
+    ///     distance field of the scene's world on disk.
+    ///
+    /// If the file at cache_path holds a distance field computed from the same
+    /// collision objects and octomap, it is loaded into the occupancy grid and
+    /// the objects are registered with the world collision model without being
+    /// added to the grid again. Otherwise, the scene is applied as usual and
+    /// the resulting distance field is saved to cache_path. The cache is only
+    /// consulted when the collision space's world holds no objects, since the
+    /// cache key does not describe any prior contents of the grid. Loading
+    /// the cache marks the whole grid as changed.
+    bool setPlanningScene(
+        CollisionSpace& cspace,
+        const moveit_msgs::PlanningScene& scene,
+        const std::string& cache_path);
 };
 
 } // namespace collision
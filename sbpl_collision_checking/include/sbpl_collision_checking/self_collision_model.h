@@ -72,6 +72,11 @@ public:
 
     void setPadding(double padding);
 
+    /// Enable or disable batched (SIMD) traversal of sphere hierarchies for
+    /// sphere-sphere self collision checks. Enabled by default.
+    void setBatchedSphereChecks(bool enabled);
+    bool batchedSphereChecks() const;
+
     void setWorldToModelTransform(const Eigen::Affine3d& transform);
 
     bool checkCollision(
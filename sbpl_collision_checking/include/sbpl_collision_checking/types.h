@@ -34,11 +34,13 @@
 
 // standrad includes
 #include <stdio.h>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 // system includes
 #include <Eigen/Dense>
@@ -46,6 +48,7 @@
 #include <moveit/collision_detection/collision_matrix.h>
 #include <moveit/collision_detection/world.h>
 #include <moveit_msgs/CollisionObject.h>
+#include <moveit_msgs/PlanningSceneWorld.h>
 
 namespace sbpl {
 namespace collision {
@@ -91,6 +94,9 @@ std::string AffineToString(const Eigen::Affine3d& t)
 ObjectConstPtr ConvertCollisionObjectToObject(
     const moveit_msgs::CollisionObject& co);
 
+std::uint64_t HashPlanningSceneWorld(
+    const moveit_msgs::PlanningSceneWorld& world);
+
 struct CollisionDetail
 {
     std::string first_link;
@@ -38,6 +38,7 @@
 #include <vector>
 
 // system includes
+#include <Eigen/Geometry>
 #include <moveit_msgs/CollisionObject.h>
 #include <octomap_msgs/OctomapWithPose.h>
 #include <smpl/occupancy_grid.h>
@@ -77,6 +78,44 @@ public:
 
     bool removeObject(const std::string& object_name);
 
+    /// \brief Return whether no objects, including octomaps, are in the world.
+    bool empty() const;
+
+    /// \name Batched Updates
+    ///@{
+
+    /// \brief Insert, move, and remove several objects with a single update of
+    ///     the occupancy grid.
+    ///
+    /// The batch is rejected as a whole if any of its operations would be
+    /// rejected individually or if an object appears in more than one
+    /// operation.
+    bool updateObjects(
+        const std::vector<ObjectConstPtr>& insert_objects,
+        const std::vector<ObjectConstPtr>& move_objects,
+        const std::vector<std::string>& remove_names);
+
+    /// \brief Process a sequence of collision objects, such as the world diff
+    ///     of a planning scene, coalescing runs of additions, moves, and
+    ///     removals into batched updates.
+    bool processCollisionObjects(
+        const std::vector<moveit_msgs::CollisionObject>& objects);
+    ///@}
+
+    /// \name Distance Field Cache
+    ///@{
+
+    /// \brief Track changes to the world without applying them to the
+    ///     occupancy grid.
+    ///
+    /// While set, objects are voxelized and recorded as usual, so that they
+    /// may be moved or removed later, but their voxels are assumed to be in the
+    /// occupancy grid already, as when its distance field has been loaded from
+    /// a cache of the same objects.
+    void setVoxelsPreloaded(bool preloaded);
+    bool voxelsPreloaded() const;
+    ///@}
+
     /// \brief Reset the underlying occupancy grid.
     ///
     /// Resets the WorldCollisionModel by clearing the underlying occupancy grid and
@@ -89,6 +128,21 @@ public:
     void setPadding(double padding);
     double padding() const;
 
+    /// \name Change Tracking
+    ///@{
+
+    /// \brief Return bounding boxes, in the grid frame, of the voxels added to
+    ///     or removed from the occupancy grid since the last call to
+    ///     clearChangedRegions().
+    const std::vector<Eigen::AlignedBox3d>& changedRegions() const;
+
+    void clearChangedRegions();
+
+    /// \brief Record the entire occupancy grid as changed, as when its
+    ///     distance field has been replaced wholesale.
+    void recordGridChanged();
+    ///@}
+
 private:
 
     std::unique_ptr<WorldCollisionModelImpl> m_impl;
@@ -29,10 +29,14 @@
 
 /// \author Andrew Dornbush
 
-#include <ros/console.h>
-
 #include "collision_operations.h"
 
+// system includes
+#include <ros/console.h>
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 namespace sbpl {
 namespace collision {
 
@@ -70,5 +74,94 @@ std::vector<SphereIndex> GatherSphereIndices(
     return sphere_indices;
 }
 
+void SpherePairBatch::clear()
+{
+    x1.clear();
+    y1.clear();
+    z1.clear();
+    x2.clear();
+    y2.clear();
+    z2.clear();
+    r.clear();
+    cd2.clear();
+    overlap.clear();
+}
+
+/// \brief Test every sphere pair in a batch for overlap
+///
+/// A pair overlaps when the squared distance between the sphere centers does
+/// not exceed the squared sum of their radii. Uses AVX or SSE2 when the
+/// translation unit is compiled with support for them, falling back to scalar
+/// arithmetic for the remainder of the batch.
+///
+/// \return The number of overlapping pairs
+int ComputeSpherePairOverlaps(SpherePairBatch& batch)
+{
+    const size_t n = batch.size();
+    batch.cd2.resize(n);
+    batch.overlap.resize(n);
+
+    const double* x1 = batch.x1.data();
+    const double* y1 = batch.y1.data();
+    const double* z1 = batch.z1.data();
+    const double* x2 = batch.x2.data();
+    const double* y2 = batch.y2.data();
+    const double* z2 = batch.z2.data();
+    const double* r = batch.r.data();
+    double* cd2 = batch.cd2.data();
+    uint8_t* overlap = batch.overlap.data();
+
+    int count = 0;
+    size_t i = 0;
+
+#if defined(__AVX__)
+    for (; i + 4 <= n; i += 4) {
+        const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x2 + i), _mm256_loadu_pd(x1 + i));
+        const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y2 + i), _mm256_loadu_pd(y1 + i));
+        const __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(z2 + i), _mm256_loadu_pd(z1 + i));
+        const __m256d d2 = _mm256_add_pd(
+                _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+                _mm256_mul_pd(dz, dz));
+        const __m256d rr = _mm256_loadu_pd(r + i);
+        _mm256_storeu_pd(cd2 + i, d2);
+        const int mask = _mm256_movemask_pd(
+                _mm256_cmp_pd(d2, _mm256_mul_pd(rr, rr), _CMP_LE_OQ));
+        overlap[i + 0] = (mask >> 0) & 1;
+        overlap[i + 1] = (mask >> 1) & 1;
+        overlap[i + 2] = (mask >> 2) & 1;
+        overlap[i + 3] = (mask >> 3) & 1;
+        count += __builtin_popcount(mask);
+    }
+#endif
+
+#if defined(__SSE2__)
+    for (; i + 2 <= n; i += 2) {
+        const __m128d dx = _mm_sub_pd(_mm_loadu_pd(x2 + i), _mm_loadu_pd(x1 + i));
+        const __m128d dy = _mm_sub_pd(_mm_loadu_pd(y2 + i), _mm_loadu_pd(y1 + i));
+        const __m128d dz = _mm_sub_pd(_mm_loadu_pd(z2 + i), _mm_loadu_pd(z1 + i));
+        const __m128d d2 = _mm_add_pd(
+                _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)),
+                _mm_mul_pd(dz, dz));
+        const __m128d rr = _mm_loadu_pd(r + i);
+        _mm_storeu_pd(cd2 + i, d2);
+        const int mask = _mm_movemask_pd(_mm_cmple_pd(d2, _mm_mul_pd(rr, rr)));
+        overlap[i + 0] = (mask >> 0) & 1;
+        overlap[i + 1] = (mask >> 1) & 1;
+        count += __builtin_popcount(mask);
+    }
+#endif
+
+    for (; i < n; ++i) {
+        const double dx = x2[i] - x1[i];
+        const double dy = y2[i] - y1[i];
+        const double dz = z2[i] - z1[i];
+        cd2[i] = dx * dx + dy * dy + dz * dz;
+        overlap[i] = cd2[i] <= r[i] * r[i];
+        count += overlap[i];
+    }
+
+    return count;
+}
+
 } // namespace collision
 } // namespace sbpl
@@ -32,6 +32,10 @@
 #ifndef sbpl_collision_collision_operations_h
 #define sbpl_collision_collision_operations_h
 
+// standard includes
+#include <stdint.h>
+#include <vector>
+
 // system includes
 #include <ros/console.h>
 #include <smpl/occupancy_grid.h>
@@ -48,6 +52,13 @@ bool CheckSphereCollision(
     double padding,
     double& dist);
 
+template <typename DistanceQuery>
+bool CheckSphereCollision(
+    const DistanceQuery& query,
+    const CollisionSphereState& s,
+    double padding,
+    double& dist);
+
 double SphereCollisionDistance(
     const OccupancyGrid& grid,
     const CollisionSphereState& s,
@@ -61,6 +72,14 @@ bool CheckVoxelsCollisions(
     double padding,
     double& dist);
 
+template <typename StateType, typename DistanceQuery>
+bool CheckVoxelsCollisions(
+    StateType& state,
+    std::vector<const CollisionSphereState*>& q,
+    const DistanceQuery& query,
+    double padding,
+    double& dist);
+
 static const char* COP_LOGGER = "collision_operations";
 
 /// Check a single sphere against an occupancy grid
@@ -76,6 +95,20 @@ bool CheckSphereCollision(
     return dist >= effective_radius * effective_radius;
 }
 
+/// Check a single sphere against a distance map query handle, either a
+/// DenseDistanceQuery or a DistanceMapInterface
+template <typename DistanceQuery>
+bool CheckSphereCollision(
+    const DistanceQuery& query,
+    const CollisionSphereState& s,
+    double padding,
+    double& dist)
+{
+    const double effective_radius = s.model->radius + padding;
+    dist = query.getMetricSquaredDistance(s.pos.x(), s.pos.y(), s.pos.z());
+    return dist >= effective_radius * effective_radius;
+}
+
 /// Compute the closest distance between a sphere and an occupied voxel
 inline
 double SphereCollisionDistance(
@@ -91,6 +124,38 @@ double SphereCollisionDistance(
 std::vector<SphereIndex> GatherSphereIndices(
     const RobotCollisionState& state, int gidx);
 
+/// \brief Structure-of-arrays storage for a batch of sphere pair overlap tests
+///
+/// Sphere positions are gathered into contiguous per-coordinate arrays so that
+/// ComputeSpherePairOverlaps can test several pairs per instruction. The
+/// arrays retain their capacity across clear() calls.
+struct SpherePairBatch
+{
+    std::vector<double> x1, y1, z1;
+    std::vector<double> x2, y2, z2;
+    std::vector<double> r; ///< combined radius of each pair
+
+    std::vector<double> cd2; ///< output squared center distance of each pair
+    std::vector<uint8_t> overlap; ///< output; nonzero if the pair overlaps
+
+    size_t size() const { return r.size(); }
+
+    void clear();
+
+    void push(const CollisionSphereState& s1, const CollisionSphereState& s2)
+    {
+        x1.push_back(s1.pos.x());
+        y1.push_back(s1.pos.y());
+        z1.push_back(s1.pos.z());
+        x2.push_back(s2.pos.x());
+        y2.push_back(s2.pos.y());
+        z2.push_back(s2.pos.z());
+        r.push_back(s1.model->radius + s2.model->radius);
+    }
+};
+
+int ComputeSpherePairOverlaps(SpherePairBatch& batch);
+
 /// Check sphere hierarchies for collisions against an occupancy grid
 ///
 /// \param state The aggregate state of the collision trees. Must have a method
@@ -108,6 +173,26 @@ bool CheckVoxelsCollisions(
     const OccupancyGrid& grid,
     double padding,
     double& dist)
+{
+    // select the distance lookup once for the whole traversal so that the
+    // sphere checks may be inlined
+    if (const DenseDistanceQuery* query = grid.getDenseDistanceQuery()) {
+        return CheckVoxelsCollisions(state, q, *query, padding, dist);
+    } else {
+        return CheckVoxelsCollisions(
+                state, q, *grid.getDistanceField(), padding, dist);
+    }
+}
+
+/// Check sphere hierarchies for collisions against a distance map query
+/// handle, either a DenseDistanceQuery or a DistanceMapInterface
+template <typename StateType, typename DistanceQuery>
+bool CheckVoxelsCollisions(
+    StateType& state,
+    std::vector<const CollisionSphereState*>& q,
+    const DistanceQuery& query,
+    double padding,
+    double& dist)
 {
     while (!q.empty()) {
         const CollisionSphereState* s = q.back();
@@ -120,7 +205,7 @@ bool CheckVoxelsCollisions(
         ROS_DEBUG_NAMED(COP_LOGGER, "Checking sphere '%s' with radius %0.3f at (%0.3f, %0.3f, %0.3f)", s->model->name.c_str(), s->model->radius, s->pos.x(), s->pos.y(), s->pos.z());
 
         double obs_dist;
-        if (CheckSphereCollision(grid, *s, padding, obs_dist)) {
+        if (CheckSphereCollision(query, *s, padding, obs_dist)) {
             ROS_DEBUG_NAMED(COP_LOGGER, " dist^2: %0.3f -> ok!", obs_dist);
             continue; // no collision -> ok!
         }
@@ -34,6 +34,8 @@
 
 // standard includes
 #include <assert.h>
+#include <algorithm>
+#include <cmath>
 #include <limits>
 #include <utility>
 #include <queue>
@@ -128,11 +130,18 @@ bool CollisionSpace::setPlanningScene(const moveit_msgs::PlanningScene& scene)
     // allowed collision matrix //
     //////////////////////////////
 
-    AllowedCollisionMatrix acm(scene.allowed_collision_matrix);
-    if (scene.is_diff) {
-        m_scm->updateAllowedCollisionMatrix(acm);
-    } else {
-        m_scm->setAllowedCollisionMatrix(acm);
+    const moveit_msgs::AllowedCollisionMatrix& acm_msg =
+            scene.allowed_collision_matrix;
+    if (!scene.is_diff ||
+        !acm_msg.entry_names.empty() ||
+        !acm_msg.default_entry_names.empty())
+    {
+        AllowedCollisionMatrix acm(acm_msg);
+        if (scene.is_diff) {
+            updateAllowedCollisionMatrix(acm);
+        } else {
+            setAllowedCollisionMatrix(acm);
+        }
     }
 
     //////////////////////////
@@ -143,11 +152,9 @@ bool CollisionSpace::setPlanningScene(const moveit_msgs::PlanningScene& scene)
 
     const auto& collision_objects = planning_scene_world.collision_objects;
     ROS_INFO_NAMED(CC_LOGGER, "Processing %zd collision objects", scene.world.collision_objects.size());
-    for (const moveit_msgs::CollisionObject& collision_object : scene.world.collision_objects) {
-        if (!processCollisionObject(collision_object)) {
-            ROS_ERROR_NAMED(CC_LOGGER, "Failed to process collision object '%s'", collision_object.id.c_str());
-            return false;
-        }
+    if (!processCollisionObjects(collision_objects)) {
+        ROS_ERROR_NAMED(CC_LOGGER, "Failed to process collision objects");
+        return false;
     }
 
     const auto& octomap = planning_scene_world.octomap;
@@ -169,7 +176,10 @@ bool CollisionSpace::setJointPosition(
 {
     if (m_rcm->hasJointVar(name)) {
         int jidx = m_rcm->jointVarIndex(name);
-        m_joint_vars[jidx] = position;
+        if (m_joint_vars[jidx] != position) {
+            m_joint_vars[jidx] = position;
+            m_robot_changed = true;
+        }
         return true;
     } else {
         return false;
@@ -189,6 +199,7 @@ void CollisionSpace::setWorldToModelTransform(
             m_rcs->getJointVarPositions() + vlidx,
             m_joint_vars.data() + vfidx);
     m_scm->setWorldToModelTransform(transform);
+    m_robot_changed = true;
 }
 
 /// \brief Set the padding applied to the collision model
@@ -196,6 +207,7 @@ void CollisionSpace::setPadding(double padding)
 {
     m_wcm->setPadding(padding);
     m_scm->setPadding(padding);
+    m_robot_changed = true;
 }
 
 /// \brief Return the allowed collision matrix
@@ -210,7 +222,8 @@ const AllowedCollisionMatrix& CollisionSpace::allowedCollisionMatrix() const
 void CollisionSpace::updateAllowedCollisionMatrix(
     const AllowedCollisionMatrix& acm)
 {
-    return m_scm->updateAllowedCollisionMatrix(acm);
+    m_scm->updateAllowedCollisionMatrix(acm);
+    m_robot_changed = true;
 }
 
 /// \brief Set the allowed collision matrix
@@ -219,6 +232,7 @@ void CollisionSpace::setAllowedCollisionMatrix(
     const AllowedCollisionMatrix& acm)
 {
     m_scm->setAllowedCollisionMatrix(acm);
+    m_robot_changed = true;
 }
 
 /// \brief Insert an object into the world
@@ -278,6 +292,19 @@ bool CollisionSpace::processCollisionObject(
     return m_wcm->processCollisionObject(object);
 }
 
+/// \brief Process a sequence of collision objects
+///
+/// Consecutive additions and removals are applied to the occupancy grid with a
+/// single distance field update.
+///
+/// \param objects The collision objects to be processed, in order
+/// \return true if all objects were processed successfully; false otherwise
+bool CollisionSpace::processCollisionObjects(
+    const std::vector<moveit_msgs::CollisionObject>& objects)
+{
+    return m_wcm->processCollisionObjects(objects);
+}
+
 /// \brief Process an octomap
 /// \param octomap The octomap
 /// \return true if the octomap was processed successfully; false otherwise
@@ -299,7 +326,11 @@ bool CollisionSpace::attachObject(
     const Affine3dVector& transforms,
     const std::string& link_name)
 {
-    return m_abcm->attachBody(id, shapes, transforms, link_name);
+    if (!m_abcm->attachBody(id, shapes, transforms, link_name)) {
+        return false;
+    }
+    m_robot_changed = true;
+    return true;
 }
 
 /// \brief Detach a collision object from the robot
@@ -307,7 +338,11 @@ bool CollisionSpace::attachObject(
 /// \return true if the object was detached; false otherwise
 bool CollisionSpace::detachObject(const std::string& id)
 {
-    return m_abcm->detachBody(id);
+    if (!m_abcm->detachBody(id)) {
+        return false;
+    }
+    m_robot_changed = true;
+    return true;
 }
 
 /// \brief Process an attached collision object
@@ -490,6 +525,27 @@ bool CollisionSpace::isStateValid(
     return checkCollision(state, dist);
 }
 
+/// \brief Check a linearly-interpolated motion between two states
+///
+/// The endpoints of the motion are checked first, followed by the waypoints
+/// between them in bisection (van der Corput) order, so that collisions far
+/// from either endpoint are found after only a few checks.
+///
+/// Long sub-segments are first tested for certification: if the sum of the
+/// clearances of the robot at the two endpoints of a sub-segment exceeds twice
+/// the largest distance any sphere may travel along it, as reported by
+/// RobotMotionCollisionModel::getMaxSphereMotion, no waypoint in between can be
+/// in collision and the whole sub-segment is skipped. A waypoint that has
+/// moved m from one endpoint has moved at most max_motion - m from the other,
+/// so its clearance is bounded below by that of the nearer endpoint in motion;
+/// the factor of two covers pairs of spheres that both move. Certification is
+/// disabled while bodies are attached, since their clearance is not yet
+/// accounted for by collisionDistance.
+///
+/// \param path_length The number of waypoints along the interpolated motion
+/// \param num_checks Incremented by the number of collision queries made,
+///     counting both waypoint checks and the clearance queries used for
+///     certification
 bool CollisionSpace::isStateToStateValid(
     const motion::RobotState& start,
     const motion::RobotState& finish,
@@ -499,59 +555,111 @@ bool CollisionSpace::isStateToStateValid(
 {
     const double res = 0.05;
 
+    // sub-segments with fewer interior waypoints than this are checked
+    // directly rather than paying for the two clearance queries
+    const int min_certify_waypoints = 4;
+
+    const auto& variables = m_planning_joint_to_collision_model_indices;
+
     MotionInterpolation interp(m_rcm.get());
 
-    m_rmcm->fillMotionInterpolation(
-            start, finish,
-            m_planning_joint_to_collision_model_indices, res,
-            interp);
+    m_rmcm->fillMotionInterpolation(start, finish, variables, res, interp);
 
     const bool verbose = false;
 
-    const int inc_cc = 5;
     double dist_temp = std::numeric_limits<double>::infinity();
 
     // for debugging & statistical purposes
     path_length = interp.waypointCount();
 
+    const int n = interp.waypointCount();
+    if (n == 0) {
+        return true;
+    }
+
     motion::RobotState interm;
 
-    // TODO: Looks like the idea here is to collision check the path starting at
-    // the most coarse resolution (just the endpoints) and increasing the
-    // granularity until all points are checked. This could probably be made
-    // irrespective of the number of waypoints by bisecting the path and
-    // checking the endpoints recursively.
-    if (interp.waypointCount() > inc_cc) {
-        // try to find collisions that might come later in the path earlier
-        for (int i = 0; i < inc_cc; i++) {
-            for (size_t j = i; j < interp.waypointCount(); j = j + inc_cc) {
-                num_checks++;
-                interp.interpolate(j, interm, m_planning_joint_to_collision_model_indices);
-                if (!isStateValid(interm, verbose, false, dist_temp)) {
-                    dist = dist_temp;
-                    return false;
-                }
-
-                if (dist_temp < dist) {
-                    dist = dist_temp;
-                }
-            }
+    auto check_waypoint = [&](int i) -> bool
+    {
+        num_checks++;
+        interp.interpolate(i, interm, variables);
+        if (!isStateValid(interm, verbose, false, dist_temp)) {
+            dist = dist_temp;
+            return false;
         }
-    } else {
-        for (size_t i = 0; i < interp.waypointCount(); i++) {
+
+        if (dist_temp < dist) {
+            dist = dist_temp;
+        }
+        return true;
+    };
+
+    if (!check_waypoint(0) || (n > 1 && !check_waypoint(n - 1))) {
+        return false;
+    }
+
+    const bool certify = m_abcm->attachedBodyCount() == 0;
+
+    // clearance at each waypoint, computed lazily; negative if unknown
+    std::vector<double> clearance;
+    int clearance_queries = 0;
+    auto waypoint_clearance = [&](int i) -> double
+    {
+        if (clearance[i] < 0.0) {
             num_checks++;
-            interp.interpolate(i, interm, m_planning_joint_to_collision_model_indices);
-            if (!isStateValid(interm, verbose, false, dist_temp)) {
-                dist = dist_temp;
-                return false;
-            }
+            ++clearance_queries;
+            interp.interpolate(i, interm, variables);
+            clearance[i] = std::max(0.0, collisionDistance(interm));
+        }
+        return clearance[i];
+    };
+
+    if (certify) {
+        clearance.assign(n, -1.0);
+    }
+
+    motion::RobotState seg_start;
+    motion::RobotState seg_finish;
+
+    int skipped = 0;
+
+    // visit sub-segments breadth-first, which checks midpoints in
+    // van der Corput order
+    std::queue<std::pair<int, int>> segments;
+    segments.push(std::make_pair(0, n - 1));
+    while (!segments.empty()) {
+        const int lo = segments.front().first;
+        const int hi = segments.front().second;
+        segments.pop();
+
+        const int interior = hi - lo - 1;
+        if (interior <= 0) {
+            continue;
+        }
+
+        if (certify && interior >= min_certify_waypoints) {
+            interp.interpolate(lo, seg_start, variables);
+            interp.interpolate(hi, seg_finish, variables);
+            const double max_motion =
+                    m_rmcm->getMaxSphereMotion(seg_start, seg_finish, variables);
 
-            if (dist_temp < dist) {
-                dist = dist_temp;
+            // spheres may approach obstacles and each other from both ends
+            if (waypoint_clearance(lo) + waypoint_clearance(hi) > 2.0 * max_motion) {
+                skipped += interior;
+                continue;
             }
         }
+
+        const int mid = lo + (hi - lo) / 2;
+        if (!check_waypoint(mid)) {
+            return false;
+        }
+
+        segments.push(std::make_pair(lo, mid));
+        segments.push(std::make_pair(mid, hi));
     }
 
+    ROS_DEBUG_NAMED(CC_LOGGER, "Certified %d of %d waypoints collision-free without checking, using %d clearance queries (%d checks saved)", skipped, n, clearance_queries, skipped - clearance_queries);
     return true;
 }
 
@@ -564,8 +672,8 @@ bool CollisionSpace::interpolatePath(
             finish.size() == m_planning_joint_to_collision_model_indices.size());
 
     // check joint limits on the start and finish points
-    if (withinJointPositionLimits(start) ||
-        withinJointPositionLimits(finish))
+    if (!withinJointPositionLimits(start) ||
+        !withinJointPositionLimits(finish))
     {
         ROS_ERROR_NAMED(CC_LOGGER, "Joint limits violated");
         return false;
@@ -586,6 +694,168 @@ bool CollisionSpace::interpolatePath(
     return true;
 }
 
+/// \brief Append the valid interpolated path between two states to a path
+///
+/// Waypoints are generated in order, at the resolution used by interpolatePath,
+/// and checked as they are appended, stopping at the first invalid waypoint.
+/// The start state is checked but not appended.
+///
+/// Since waypoints are evenly spaced along a linear motion, the largest
+/// distance any sphere may travel between two waypoints grows linearly with
+/// the number of waypoints between them. After a waypoint has been checked, its
+/// clearance certifies every following waypoint that no sphere can reach by
+/// moving less than half the clearance, and those waypoints are appended
+/// without being checked. As in isStateToStateValid, certification is disabled
+/// while bodies are attached.
+bool CollisionSpace::appendInterpolatedPath(
+    const motion::RobotState& start,
+    const motion::RobotState& finish,
+    motion::FlatPath& path,
+    bool& valid)
+{
+    assert(start.size() == m_planning_joint_to_collision_model_indices.size() &&
+            finish.size() == m_planning_joint_to_collision_model_indices.size());
+    assert(path.varCount() == start.size());
+
+    if (!withinJointPositionLimits(start) ||
+        !withinJointPositionLimits(finish))
+    {
+        ROS_ERROR_NAMED(CC_LOGGER, "Joint limits violated");
+        return false;
+    }
+
+    const double res = 0.05;
+
+    // waypoints certified by fewer than this many waypoints of clearance are
+    // not worth the clearance query; checking resumes for this many waypoints
+    // before clearance is queried again
+    const int min_certify_waypoints = 4;
+
+    const auto& variables = m_planning_joint_to_collision_model_indices;
+
+    MotionInterpolation interp(m_rcm.get());
+    m_rmcm->fillMotionInterpolation(start, finish, variables, res, interp);
+
+    valid = true;
+
+    const int n = interp.waypointCount();
+    if (n < 1) {
+        return true;
+    }
+
+    const double step_motion = n < 2 ? 0.0 :
+            m_rmcm->getMaxSphereMotion(start, finish, variables) / (n - 1);
+    const bool certify = m_abcm->attachedBodyCount() == 0 && step_motion > 0.0;
+
+    const size_t mark = path.size();
+    path.reserve(mark + n - 1);
+
+    motion::RobotState interm;
+
+    // the start state is checked along with the interpolated waypoints, but
+    // is expected to already be in the path
+    int certified_until = -1; // last waypoint certified collision-free
+    int backoff = 0; // waypoints to check before querying clearance again
+    int skipped = 0;
+    for (int i = 0; i < n; ++i) {
+        interp.interpolate(i, interm, variables);
+        if (i > 0) {
+            path.push_back(interm);
+        }
+
+        if (i <= certified_until) {
+            ++skipped;
+            continue;
+        }
+
+        double dist;
+        if (!isStateValid(interm, false, false, dist)) {
+            path.truncate(mark);
+            valid = false;
+            return true;
+        }
+
+        if (!certify) {
+            continue;
+        }
+
+        if (backoff > 0) {
+            --backoff;
+            continue;
+        }
+
+        const double clearance = std::max(0.0, collisionDistance(interm));
+        const int reach = (int)std::ceil(clearance / (2.0 * step_motion)) - 1;
+        if (reach >= min_certify_waypoints) {
+            certified_until = i + reach;
+        } else {
+            backoff = min_certify_waypoints;
+        }
+    }
+
+    ROS_DEBUG_NAMED(CC_LOGGER, "Certified %d of %d interpolated waypoints collision-free without checking", skipped, n - 1);
+    return true;
+}
+
+/// \brief Test whether a motion may be affected by changes to the world
+///
+/// A sphere check depends only on the distance field near the sphere, so the
+/// outcome of checking any waypoint can only have changed if a changed voxel
+/// lies within the padded radius of a sphere, plus the voxel discretization. The
+/// spheres at the start state are tested against the changed regions of the
+/// world collision model, further inflated by the largest distance any sphere
+/// may travel along the motion. Only the root sphere of each link is tested.
+/// Motions are always reported as affected while bodies are attached, since
+/// the motion of their spheres is not bounded by the motion model, and after
+/// any change to the robot state, attached bodies, padding, or allowed
+/// collision matrix, which may change the outcome of any check.
+bool CollisionSpace::isStateToStateAffected(
+    const motion::RobotState& start,
+    const motion::RobotState& finish)
+{
+    // changes to the robot may affect any motion
+    if (m_robot_changed) {
+        return true;
+    }
+
+    const std::vector<Eigen::AlignedBox3d>& regions = m_wcm->changedRegions();
+    if (regions.empty()) {
+        return false;
+    }
+
+    if (m_abcm->attachedBodyCount() > 0) {
+        return true;
+    }
+
+    const auto& variables = m_planning_joint_to_collision_model_indices;
+    const double max_motion =
+            m_rmcm->getMaxSphereMotion(start, finish, variables);
+    const double inflation = max_motion + m_wcm->padding() +
+            std::sqrt(3.0) * m_grid->resolution();
+
+    updateState(start);
+    for (const int ssidx : m_rcs->groupSpheresStateIndices(m_gidx)) {
+        const CollisionSphereState* s = m_rcs->spheresState(ssidx).spheres.root();
+        m_rcs->updateSphereState(SphereIndex(ssidx, s->index()));
+
+        const double margin = s->model->radius + inflation;
+        for (const Eigen::AlignedBox3d& region : regions) {
+            if (region.exteriorDistance(s->pos) < margin) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/// \brief Forget the changed regions of the world collision model
+void CollisionSpace::clearEnvironmentChanges()
+{
+    m_wcm->clearChangedRegions();
+    m_robot_changed = false;
+}
+
 visualization_msgs::MarkerArray
 CollisionSpace::getCollisionModelVisualization(const motion::RobotState& vals)
 {
@@ -642,6 +912,7 @@ CollisionSpace::CollisionSpace() :
     m_abcs(),
     m_wcm(),
     m_scm(),
+    m_robot_changed(false),
     m_group_name(),
     m_gidx(-1),
     m_planning_joint_to_collision_model_indices()
@@ -843,5 +1114,39 @@ CollisionSpacePtr CollisionSpaceBuilder::build(
     }
 }
 
+bool CollisionSpaceBuilder::setPlanningScene(
+    CollisionSpace& cspace,
+    const moveit_msgs::PlanningScene& scene,
+    const std::string& cache_path)
+{
+    // the cache key covers only the scene's world, so it describes the grid
+    // only if the scene is applied to an empty world
+    if (cache_path.empty() || !cspace.m_wcm->empty()) {
+        return cspace.setPlanningScene(scene);
+    }
+
+    const std::uint64_t scene_hash = HashPlanningSceneWorld(scene.world);
+
+    if (cspace.m_grid->loadCache(cache_path, scene_hash)) {
+        ROS_INFO_NAMED(CC_LOGGER, "Loaded distance field from cache '%s'", cache_path.c_str());
+        cspace.m_wcm->recordGridChanged();
+        cspace.m_wcm->setVoxelsPreloaded(true);
+        const bool res = cspace.setPlanningScene(scene);
+        cspace.m_wcm->setVoxelsPreloaded(false);
+        return res;
+    }
+
+    if (!cspace.setPlanningScene(scene)) {
+        return false;
+    }
+
+    if (cspace.m_grid->saveCache(cache_path, scene_hash)) {
+        ROS_INFO_NAMED(CC_LOGGER, "Saved distance field to cache '%s'", cache_path.c_str());
+    } else {
+        ROS_WARN_NAMED(CC_LOGGER, "Failed to save distance field to cache '%s'", cache_path.c_str());
+    }
+    return true;
+}
+
 } // namespace collision
 } // namespace sbpl
@@ -282,7 +282,7 @@ double RobotMotionCollisionModel::getMaxSphereMotion(
     assert(finish.size() == m_rcm->jointVarCount());
 
     double motion = 0.0;
-    for (size_t jidx; jidx < m_rcm->jointCount(); ++jidx) {
+    for (size_t jidx = 0; jidx < m_rcm->jointCount(); ++jidx) {
         size_t fvidx = m_rcm->jointVarIndexFirst(jidx);
 
         double dist = 0.0;
@@ -315,7 +315,11 @@ double RobotMotionCollisionModel::getMaxSphereMotion(
             const double dy = finish[fvidx + 1] - start[fvidx + 1];
             const double dz = finish[fvidx + 2] - start[fvidx + 2];
             dist = std::sqrt(dx * dx + dy * dy + dz * dz);
-            motion += dist;
+            double dq = 0.0;
+            for (int i = 3; i < 7; ++i) {
+                dq += std::fabs(finish[fvidx + i] - start[fvidx + i]);
+            }
+            motion += dist + M_PI * dq * (m_mr_centers[jidx].norm() + m_mr_radii[jidx]);
         }   break;
         }
     }
@@ -329,7 +333,7 @@ double RobotMotionCollisionModel::getMaxSphereMotion(
     assert(diff.size() == m_rcm->jointVarCount());
 
     double motion = 0.0;
-    for (size_t jidx = 0; jidx < m_rcm->jointVarCount(); ++jidx) {
+    for (size_t jidx = 0; jidx < m_rcm->jointCount(); ++jidx) {
         const int fvidx = m_rcm->jointVarIndexFirst(jidx);
 
         double dist = 0.0;
@@ -348,7 +352,7 @@ double RobotMotionCollisionModel::getMaxSphereMotion(
         case JointType::PLANAR: {
             const double dx = diff[fvidx + 0];
             const double dy = diff[fvidx + 1];
-            const double dth = diff[fvidx + 2];
+            const double dth = std::fabs(diff[fvidx + 2]);
             dist = std::sqrt(dx * dx + dy * dy);
             // TODO: see above
             motion += dist + dth * (m_mr_centers[jidx].norm() + m_mr_radii[jidx]);
@@ -358,7 +362,11 @@ double RobotMotionCollisionModel::getMaxSphereMotion(
             const double dy = diff[fvidx + 1];
             const double dz = diff[fvidx + 2];
             dist = std::sqrt(dx * dx + dy * dy + dz * dz);
-            motion += dist;
+            double dq = 0.0;
+            for (int i = 3; i < 7; ++i) {
+                dq += std::fabs(diff[fvidx + i]);
+            }
+            motion += dist + M_PI * dq * (m_mr_centers[jidx].norm() + m_mr_radii[jidx]);
         }   break;
         }
     }
@@ -368,6 +376,13 @@ double RobotMotionCollisionModel::getMaxSphereMotion(
 
 /// Return an upper bound on the distance any sphere might travel given the
 /// motion of a subset of joints.
+///
+/// The variables of multi-dof joints are bounded one at a time: a planar or
+/// floating translation variable moves any sphere by at most its own change,
+/// a planar rotation variable by its change times the motion radius, and a
+/// floating rotation variable by pi times its change times the motion radius,
+/// since a quaternion displacement d rotates the joint by at most pi * d along
+/// the interpolated path.
 double RobotMotionCollisionModel::getMaxSphereMotion(
     const motion::RobotState& start,
     const motion::RobotState& finish,
@@ -398,7 +413,21 @@ double RobotMotionCollisionModel::getMaxSphereMotion(
             motion += dist;
             break;
         case JointType::PLANAR:
+            if (vidx - m_rcm->jointVarIndexFirst(jidx) < 2) {
+                dist = std::fabs(finish[i] - start[i]);
+                motion += dist;
+            } else {
+                dist = angles::shortest_angle_dist(finish[i], start[i]);
+                motion += (m_mr_centers[jidx].norm() + m_mr_radii[jidx]) * dist;
+            }
+            break;
         case JointType::FLOATING:
+            dist = std::fabs(finish[i] - start[i]);
+            if (vidx - m_rcm->jointVarIndexFirst(jidx) < 3) {
+                motion += dist;
+            } else {
+                motion += M_PI * (m_mr_centers[jidx].norm() + m_mr_radii[jidx]) * dist;
+            }
             break;
         }
     }
@@ -431,7 +460,20 @@ double RobotMotionCollisionModel::getMaxSphereMotion(
             motion += dist;
             break;
         case JointType::PLANAR:
+            dist = std::fabs(diff[i]);
+            if (vidx - m_rcm->jointVarIndexFirst(jidx) < 2) {
+                motion += dist;
+            } else {
+                motion += (m_mr_centers[jidx].norm() + m_mr_radii[jidx]) * dist;
+            }
+            break;
         case JointType::FLOATING:
+            dist = std::fabs(diff[i]);
+            if (vidx - m_rcm->jointVarIndexFirst(jidx) < 3) {
+                motion += dist;
+            } else {
+                motion += M_PI * (m_mr_centers[jidx].norm() + m_mr_radii[jidx]) * dist;
+            }
             break;
         }
     }
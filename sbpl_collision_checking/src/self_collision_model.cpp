@@ -31,6 +31,9 @@
 
 #include <sbpl_collision_checking/self_collision_model.h>
 
+// standard includes
+#include <stdint.h>
+
 // system includes
 #include <leatherman/print.h>
 
@@ -61,6 +64,9 @@ public:
 
     void setPadding(double padding);
 
+    void setBatchedSphereChecks(bool enabled);
+    bool batchedSphereChecks() const;
+
     void setWorldToModelTransform(const Eigen::Affine3d& transform);
 
     bool checkCollision(
@@ -143,9 +149,23 @@ private:
     AllowedCollisionMatrix                  m_acm;
     double                                  m_padding;
 
+    // allowed collisions between leaf spheres, flattened out of m_acm so that
+    // leaf pairs can be tested without string lookups. every name in m_acm is
+    // assigned a row in a square bit matrix; every sphere model is mapped to
+    // the row of its name, or -1 if the name does not appear in m_acm
+    hash_map<std::string, int>                  m_acm_name_indices;
+    std::vector<uint64_t>                       m_acm_bits;
+    int                                         m_acm_row_words;
+    hash_map<const CollisionSpheresModel*, std::vector<int>> m_sphere_acm_indices;
+    int                                         m_sphere_acm_version;
+
+    bool                                        m_batched_sphere_checks;
+
     // queue storage for sphere hierarchy traversal
     typedef std::pair<const CollisionSphereState*, const CollisionSphereState*> SpherePair;
     std::vector<SpherePair> m_q;
+    std::vector<SpherePair> m_q_next;
+    SpherePairBatch         m_batch;
     std::vector<const CollisionSphereState*>    m_vq;
 
     std::vector<Eigen::Vector3d> m_v_rem;
@@ -162,6 +182,9 @@ private:
 #endif
 
     void initAllowedCollisionMatrix();
+    void updateAllowedCollisionBits();
+    const std::vector<int>& sphereAcmIndices(const CollisionSpheresModel* model);
+    bool leafCollisionAllowed(int acm_index1, int acm_index2) const;
 
     bool checkCommonInputs(
         const RobotCollisionState& state,
@@ -201,6 +224,24 @@ private:
         const CollisionSpheresState& ss2,
         double& dist);
 
+    template <typename StateTypeA, typename StateTypeB>
+    bool checkSpheresStateCollisionDepthFirst(
+        StateTypeA& stateA,
+        StateTypeB& stateB,
+        const int ss1i, const int ss2i,
+        const CollisionSpheresState& ss1,
+        const CollisionSpheresState& ss2,
+        double& dist);
+
+    template <typename StateTypeA, typename StateTypeB>
+    bool checkSpheresStateCollisionBatched(
+        StateTypeA& stateA,
+        StateTypeB& stateB,
+        const int ss1i, const int ss2i,
+        const CollisionSpheresState& ss1,
+        const CollisionSpheresState& ss2,
+        double& dist);
+
     void updateCheckedSpheresIndices();
     void updateRobotCheckedSphereIndices();
     void updateRobotAttachedBodyCheckedSphereIndices();
@@ -263,6 +304,12 @@ SelfCollisionModelImpl::SelfCollisionModelImpl(
     m_checked_attached_body_robot_spheres_states(),
     m_acm(),
     m_padding(0.0),
+    m_acm_name_indices(),
+    m_acm_bits(),
+    m_acm_row_words(0),
+    m_sphere_acm_indices(),
+    m_sphere_acm_version(-1),
+    m_batched_sphere_checks(true),
 #if USE_META_TREE
     m_model_state_map(),
     m_root_models(),
@@ -271,9 +318,12 @@ SelfCollisionModelImpl::SelfCollisionModelImpl(
     m_meta_state(),
 #endif
     m_q(),
+    m_q_next(),
+    m_batch(),
     m_vq()
 {
     initAllowedCollisionMatrix();
+    updateAllowedCollisionBits();
 }
 
 /// Seed the allowed collision matrix with pairs of adjacent links.
@@ -311,6 +361,82 @@ void SelfCollisionModelImpl::initAllowedCollisionMatrix()
     // when the first request with a valid group index is received
 }
 
+/// Rebuild the bit matrix of allowed collisions from the allowed collision
+/// matrix. Must be called whenever m_acm changes.
+void SelfCollisionModelImpl::updateAllowedCollisionBits()
+{
+    std::vector<std::string> names;
+    m_acm.getAllEntryNames(names);
+
+    m_acm_name_indices.clear();
+    for (size_t i = 0; i < names.size(); ++i) {
+        m_acm_name_indices[names[i]] = (int)i;
+    }
+
+    m_acm_row_words = ((int)names.size() + 63) >> 6;
+    m_acm_bits.assign(names.size() * m_acm_row_words, 0);
+
+    collision_detection::AllowedCollision::Type type;
+    for (size_t i = 0; i < names.size(); ++i) {
+        for (size_t j = i; j < names.size(); ++j) {
+            if (m_acm.getEntry(names[i], names[j], type) &&
+                type == collision_detection::AllowedCollision::ALWAYS)
+            {
+                m_acm_bits[i * m_acm_row_words + (j >> 6)] |= uint64_t(1) << (j & 63);
+                m_acm_bits[j * m_acm_row_words + (i >> 6)] |= uint64_t(1) << (i & 63);
+            }
+        }
+    }
+
+    // sphere models are remapped lazily
+    m_sphere_acm_indices.clear();
+
+    ROS_DEBUG_NAMED(SCM_LOGGER, "Flattened %zu allowed collision matrix entries", names.size());
+}
+
+/// Return the rows of the allowed collision bit matrix for each sphere in a
+/// spheres model, indexed by the index of the sphere in the model.
+const std::vector<int>& SelfCollisionModelImpl::sphereAcmIndices(
+    const CollisionSpheresModel* model)
+{
+    // attached body spheres models are destroyed and recreated as bodies are
+    // attached and detached; don't trust any cached models across versions
+    if (m_sphere_acm_version != m_abcm->version()) {
+        m_sphere_acm_indices.clear();
+        m_sphere_acm_version = m_abcm->version();
+    }
+
+    auto it = m_sphere_acm_indices.find(model);
+    if (it != m_sphere_acm_indices.end()) {
+        return it->second;
+    }
+
+    std::vector<int>& indices = m_sphere_acm_indices[model];
+    indices.resize(model->spheres.size(), -1);
+    for (size_t i = 0; i < model->spheres.size(); ++i) {
+        auto nit = m_acm_name_indices.find(model->spheres[i].name);
+        if (nit != m_acm_name_indices.end()) {
+            indices[i] = nit->second;
+        }
+    }
+    return indices;
+}
+
+/// Return whether collisions between two leaf spheres are allowed, given their
+/// rows in the allowed collision bit matrix.
+inline
+bool SelfCollisionModelImpl::leafCollisionAllowed(
+    int acm_index1,
+    int acm_index2) const
+{
+    if (acm_index1 < 0 || acm_index2 < 0) {
+        return false;
+    }
+    const uint64_t word =
+            m_acm_bits[acm_index1 * m_acm_row_words + (acm_index2 >> 6)];
+    return (word >> (acm_index2 & 63)) & 1;
+}
+
 /// Check that the input states are related to the collision models passed to
 /// the constructor.
 bool SelfCollisionModelImpl::checkCommonInputs(
@@ -380,6 +506,7 @@ void SelfCollisionModelImpl::updateAllowedCollisionMatrix(
             }
         }
     }
+    updateAllowedCollisionBits();
     updateCheckedSpheresIndices();
 }
 
@@ -388,6 +515,7 @@ void SelfCollisionModelImpl::setAllowedCollisionMatrix(
 {
     ROS_DEBUG_NAMED(SCM_LOGGER, "Overwrite allowed collision matrix");
     m_acm = acm;
+    updateAllowedCollisionBits();
     updateCheckedSpheresIndices();
 }
 
@@ -398,6 +526,19 @@ void SelfCollisionModelImpl::setPadding(double padding)
     m_padding = padding;
 }
 
+/// Select between the batched sphere hierarchy traversal and the original
+/// depth-first traversal for sphere-sphere checks. Both report the same
+/// collision results; the depth-first traversal is kept for comparison.
+void SelfCollisionModelImpl::setBatchedSphereChecks(bool enabled)
+{
+    m_batched_sphere_checks = enabled;
+}
+
+bool SelfCollisionModelImpl::batchedSphereChecks() const
+{
+    return m_batched_sphere_checks;
+}
+
 void SelfCollisionModelImpl::setWorldToModelTransform(
     const Eigen::Affine3d& transform)
 {
@@ -1099,6 +1240,131 @@ bool SelfCollisionModelImpl::checkSpheresStateCollision(
     const CollisionSpheresState& ss1,
     const CollisionSpheresState& ss2,
     double& dist)
+{
+    if (m_batched_sphere_checks) {
+        return checkSpheresStateCollisionBatched(
+                stateA, stateB, ss1i, ss2i, ss1, ss2, dist);
+    } else {
+        return checkSpheresStateCollisionDepthFirst(
+                stateA, stateB, ss1i, ss2i, ss1, ss2, dist);
+    }
+}
+
+/// Traverse the pair of sphere hierarchies level by level. All sphere pairs at
+/// the current level are gathered into a structure-of-arrays batch and tested
+/// for overlap together; overlapping pairs of leaves are resolved against the
+/// allowed collision bit matrix and all other overlapping pairs are split
+/// into the next level.
+///
+/// \sa checkSpheresStateCollision
+template <typename StateA, typename StateB>
+bool SelfCollisionModelImpl::checkSpheresStateCollisionBatched(
+    StateA& stateA,
+    StateB& stateB,
+    int ss1i,
+    int ss2i,
+    const CollisionSpheresState& ss1,
+    const CollisionSpheresState& ss2,
+    double& dist)
+{
+    ROS_DEBUG_NAMED(SCM_LOGGER, "Check spheres state collision (batched)");
+
+    const std::vector<int>& acm_indices1 = sphereAcmIndices(ss1.model);
+    const std::vector<int>& acm_indices2 = sphereAcmIndices(ss2.model);
+
+    // assertion: all spheres in the current level have been updated
+    stateA.updateSphereState(SphereIndex(ss1i, ss1.spheres.root()->index()));
+    stateB.updateSphereState(SphereIndex(ss2i, ss2.spheres.root()->index()));
+
+    auto& q = m_q;
+    auto& q_next = m_q_next;
+    auto& batch = m_batch;
+
+    q.clear();
+    q.push_back(std::make_pair(ss1.spheres.root(), ss2.spheres.root()));
+    while (!q.empty()) {
+        batch.clear();
+        for (const SpherePair& p : q) {
+            batch.push(*p.first, *p.second);
+        }
+
+        if (ComputeSpherePairOverlaps(batch) == 0) {
+            // no collision between any spheres in this level -> back out
+            break;
+        }
+
+        q_next.clear();
+        for (size_t i = 0; i < q.size(); ++i) {
+            if (!batch.overlap[i]) {
+                continue;
+            }
+
+            const CollisionSphereState* s1s = q[i].first;
+            const CollisionSphereState* s2s = q[i].second;
+
+            if (s1s->isLeaf() && s2s->isLeaf()) {
+                // collision found! check acm
+                if (!leafCollisionAllowed(
+                        acm_indices1[s1s->model->index()],
+                        acm_indices2[s2s->model->index()]))
+                {
+                    ROS_DEBUG_NAMED(SCM_LOGGER, "  *collision* '%s' x '%s'", s1s->model->name.c_str(), s2s->model->name.c_str());
+                    dist = batch.cd2[i];
+                    return false;
+                }
+                // collision between leaves is ok
+                continue;
+            }
+
+            // split the larger sphere, as in the depth-first traversal
+            bool split1;
+            if (s1s->isLeaf()) {
+                split1 = false;
+            } else if (s2s->isLeaf()) {
+                split1 = true;
+            } else {
+                split1 = s1s->model->radius > s2s->model->radius;
+            }
+
+            if (split1) {
+                const CollisionSphereState* sl = s1s->left;
+                const CollisionSphereState* sr = s1s->right;
+                stateA.updateSphereState(SphereIndex(ss1i, sl->index()));
+                stateA.updateSphereState(SphereIndex(ss1i, sr->index()));
+                q_next.push_back(std::make_pair(sl, s2s));
+                q_next.push_back(std::make_pair(sr, s2s));
+            } else {
+                const CollisionSphereState* sl = s2s->left;
+                const CollisionSphereState* sr = s2s->right;
+                stateB.updateSphereState(SphereIndex(ss2i, sl->index()));
+                stateB.updateSphereState(SphereIndex(ss2i, sr->index()));
+                q_next.push_back(std::make_pair(s1s, sl));
+                q_next.push_back(std::make_pair(s1s, sr));
+            }
+        }
+
+        q.swap(q_next);
+    }
+    ROS_DEBUG_NAMED(SCM_LOGGER, "queue exhaused");
+
+    // queue exhaused = no collision found
+    return true;
+}
+
+/// Traverse the pair of sphere hierarchies depth-first, one sphere pair at a
+/// time, resolving overlapping leaves against the allowed collision matrix by
+/// name.
+///
+/// \sa checkSpheresStateCollision
+template <typename StateA, typename StateB>
+bool SelfCollisionModelImpl::checkSpheresStateCollisionDepthFirst(
+    StateA& stateA,
+    StateB& stateB,
+    int ss1i,
+    int ss2i,
+    const CollisionSpheresState& ss1,
+    const CollisionSpheresState& ss2,
+    double& dist)
 {
     ROS_DEBUG_NAMED(SCM_LOGGER, "Check spheres state collision");
     auto sqrd = [](double d) { return d * d; };
@@ -1801,6 +2067,16 @@ void SelfCollisionModel::setPadding(double padding)
     return m_impl->setPadding(padding);
 }
 
+void SelfCollisionModel::setBatchedSphereChecks(bool enabled)
+{
+    return m_impl->setBatchedSphereChecks(enabled);
+}
+
+bool SelfCollisionModel::batchedSphereChecks() const
+{
+    return m_impl->batchedSphereChecks();
+}
+
 void SelfCollisionModel::setWorldToModelTransform(const Eigen::Affine3d& transform)
 {
     return m_impl->setWorldToModelTransform(transform);
@@ -35,6 +35,7 @@
 #include <eigen_conversions/eigen_msg.h>
 #include <geometric_shapes/shape_operations.h>
 #include <ros/console.h>
+#include <ros/serialization.h>
 
 namespace sbpl {
 namespace collision {
@@ -98,5 +99,49 @@ ObjectConstPtr ConvertCollisionObjectToObject(
     return ObjectConstPtr(o);
 }
 
+// Fold the serialized contents of a message into a 64-bit FNV-1a hash
+template <typename Message>
+static
+void HashMessage(
+    const Message& msg,
+    std::vector<std::uint8_t>& buffer,
+    std::uint64_t& hash)
+{
+    const std::uint32_t size = ros::serialization::serializationLength(msg);
+    buffer.resize(size);
+    ros::serialization::OStream stream(buffer.data(), size);
+    ros::serialization::serialize(stream, msg);
+
+    for (std::uint8_t b : buffer) {
+        hash ^= b;
+        hash *= 1099511628211ull;
+    }
+}
+
+/// Return a hash of the serialized contents of the collision objects and the
+/// octomap of a planning scene world, suitable for identifying a scene across
+/// runs. The sequence numbers and time stamps of the message headers are
+/// ignored.
+std::uint64_t HashPlanningSceneWorld(
+    const moveit_msgs::PlanningSceneWorld& world)
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    std::vector<std::uint8_t> buffer;
+    for (const moveit_msgs::CollisionObject& object : world.collision_objects) {
+        moveit_msgs::CollisionObject o(object);
+        o.header.seq = 0;
+        o.header.stamp = ros::Time(0);
+        HashMessage(o, buffer, hash);
+    }
+
+    octomap_msgs::OctomapWithPose octomap(world.octomap);
+    octomap.header.seq = 0;
+    octomap.header.stamp = ros::Time(0);
+    octomap.octomap.header.seq = 0;
+    octomap.octomap.header.stamp = ros::Time(0);
+    HashMessage(octomap, buffer, hash);
+    return hash;
+}
+
 } // namespace collision
 } // namespace sbpl
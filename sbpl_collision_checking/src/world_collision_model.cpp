@@ -33,6 +33,7 @@
 
 // standard includes
 #include <map>
+#include <set>
 
 // system includes
 #include <Eigen/Dense>
@@ -80,6 +81,14 @@ public:
 
     bool removeObject(const std::string& object_name);
 
+    bool updateObjects(
+        const std::vector<ObjectConstPtr>& insert_objects,
+        const std::vector<ObjectConstPtr>& move_objects,
+        const std::vector<std::string>& remove_names);
+
+    bool processCollisionObjects(
+        const std::vector<moveit_msgs::CollisionObject>& objects);
+
     void reset();
 
     visualization_msgs::MarkerArray getWorldVisualization() const;
@@ -88,8 +97,20 @@ public:
     void setPadding(double padding);
     double padding() const;
 
+    const std::vector<Eigen::AlignedBox3d>& changedRegions() const;
+    void clearChangedRegions();
+    void recordGridChanged();
+
+    void setVoxelsPreloaded(bool preloaded);
+    bool voxelsPreloaded() const;
+
+    bool empty() const;
+
 private:
 
+    // the number of changed regions beyond which all regions are merged
+    static const size_t MaxChangedRegions = 64;
+
     OccupancyGrid* m_grid;
 
     // set of collision objects
@@ -101,6 +122,19 @@ private:
 
     double m_padding;
 
+    // bounding boxes of voxels changed since the last clearChangedRegions()
+    std::vector<Eigen::AlignedBox3d> m_changed_regions;
+
+    // whether the voxels of inserted, moved, and removed objects are already
+    // reflected in the grid
+    bool m_voxels_preloaded;
+
+    void recordChangedVoxels(const VoxelList& voxels);
+
+    bool voxelizeObject(
+        const Object& object,
+        std::vector<VoxelList>& all_voxels) const;
+
     ////////////////////
     // Generic Shapes //
     ////////////////////
@@ -120,6 +154,8 @@ private:
 
     ObjectConstPtr convertOctomapToObject(
         const octomap_msgs::OctomapWithPose& octomap) const;
+    ObjectConstPtr convertMovedCollisionObject(
+        const moveit_msgs::CollisionObject& object) const;
 
     // return whether or not to accept an incoming collision object
     bool checkCollisionObjectAdd(
@@ -138,7 +174,7 @@ private:
     bool appendCollisionObject(const moveit_msgs::CollisionObject& object);
     bool moveCollisionObject(const moveit_msgs::CollisionObject& object);
 
-    void removeAllCollisionObjects();
+    bool removeAllCollisionObjects();
 
     ///////////////////
     // Visualization //
@@ -162,7 +198,9 @@ WorldCollisionModelImpl::WorldCollisionModelImpl(OccupancyGrid* grid) :
     m_grid(grid),
     m_object_map(),
     m_object_voxel_map(),
-    m_padding(0.0)
+    m_padding(0.0),
+    m_changed_regions(),
+    m_voxels_preloaded(false)
 {
 }
 
@@ -172,7 +210,9 @@ WorldCollisionModelImpl::WorldCollisionModelImpl(
 :
     m_grid(grid),
     m_object_voxel_map(o.m_object_voxel_map),
-    m_padding(o.m_padding)
+    m_padding(o.m_padding),
+    m_changed_regions(),
+    m_voxels_preloaded(false)
 {
     // TODO: check for different voxel origin/resolution/etc here...if they
     // differ, need to do a deep copy + revoxelization of the objects over just
@@ -199,21 +239,8 @@ bool WorldCollisionModelImpl::insertObject(const ObjectConstPtr& object)
 
     assert(m_object_voxel_map.find(object->id_) == m_object_voxel_map.end());
 
-    const double res = m_grid->resolution();
-    const Eigen::Vector3d origin(
-            m_grid->originX(), m_grid->originY(), m_grid->originZ());
-
-    const Eigen::Vector3d gmin(
-            m_grid->originX(), m_grid->originY(), m_grid->originZ());
-
-    const Eigen::Vector3d gmax(
-            m_grid->originX() + m_grid->sizeX(),
-            m_grid->originY() + m_grid->sizeY(),
-            m_grid->originZ() + m_grid->sizeZ());
-
-    std::vector<std::vector<Eigen::Vector3d>> all_voxels;
-    if (!VoxelizeObject(*object, res, origin, gmin, gmax, all_voxels)) {
-        ROS_ERROR_NAMED(WCM_LOGGER, "Failed to voxelize object '%s'", object->id_.c_str());
+    std::vector<VoxelList> all_voxels;
+    if (!voxelizeObject(*object, all_voxels)) {
         return false;
     }
 
@@ -224,10 +251,16 @@ bool WorldCollisionModelImpl::insertObject(const ObjectConstPtr& object)
 
     m_object_map.insert(std::make_pair(object->id_, object));
 
+    if (m_voxels_preloaded) {
+        ROS_DEBUG_NAMED(WCM_LOGGER, "Registering preloaded collision object '%s'", object->id_.c_str());
+        return true;
+    }
+
     for (const auto& voxel_list : vit.first->second) {
         ROS_DEBUG_NAMED(WCM_LOGGER, "Adding %zu voxels from collision object '%s' to the distance transform",
                 voxel_list.size(), object->id_.c_str());
         m_grid->addPointsToField(voxel_list);
+        recordChangedVoxels(voxel_list);
     }
 
     return true;
@@ -251,9 +284,12 @@ bool WorldCollisionModelImpl::removeObject(const std::string& object_name)
     auto vit = m_object_voxel_map.find(object_name);
     assert(vit != m_object_voxel_map.end());
 
-    for (const auto& voxel_list : vit->second) {
-        ROS_DEBUG_NAMED(WCM_LOGGER, "Removing %zu grid cells from the distance transform", voxel_list.size());
-        m_grid->removePointsFromField(voxel_list);
+    if (!m_voxels_preloaded) {
+        for (const auto& voxel_list : vit->second) {
+            ROS_DEBUG_NAMED(WCM_LOGGER, "Removing %zu grid cells from the distance transform", voxel_list.size());
+            m_grid->removePointsFromField(voxel_list);
+            recordChangedVoxels(voxel_list);
+        }
     }
 
     m_object_voxel_map.erase(vit);
@@ -263,20 +299,207 @@ bool WorldCollisionModelImpl::removeObject(const std::string& object_name)
 
 bool WorldCollisionModelImpl::moveShapes(const ObjectConstPtr& object)
 {
-    // TODO: optimized version
-    return removeObject(object) && insertObject(object);
+    return updateObjects(
+            std::vector<ObjectConstPtr>(),
+            std::vector<ObjectConstPtr>(1, object),
+            std::vector<std::string>());
 }
 
 bool WorldCollisionModelImpl::insertShapes(const ObjectConstPtr& object)
 {
-    // TODO: optimized version
-    return removeObject(object) && insertObject(object);
+    // TODO: only voxelize the inserted shapes
+    return moveShapes(object);
 }
 
 bool WorldCollisionModelImpl::removeShapes(const ObjectConstPtr& object)
 {
-    // TODO: optimized version
-    return removeObject(object) && insertObject(object);
+    // TODO: only remove the voxels of the removed shapes
+    return moveShapes(object);
+}
+
+bool WorldCollisionModelImpl::updateObjects(
+    const std::vector<ObjectConstPtr>& insert_objects,
+    const std::vector<ObjectConstPtr>& move_objects,
+    const std::vector<std::string>& remove_names)
+{
+    // validate the entire batch before modifying anything
+    std::set<std::string> names;
+    for (const std::string& name : remove_names) {
+        if (!names.insert(name).second) {
+            ROS_ERROR_NAMED(WCM_LOGGER, "Collision object '%s' appears multiple times in batched update", name.c_str());
+            return false;
+        }
+        if (!checkObjectRemove(name)) {
+            ROS_ERROR_NAMED(WCM_LOGGER, "Rejecting removal of collision object '%s'", name.c_str());
+            return false;
+        }
+    }
+    for (const ObjectConstPtr& object : move_objects) {
+        if (!names.insert(object->id_).second) {
+            ROS_ERROR_NAMED(WCM_LOGGER, "Collision object '%s' appears multiple times in batched update", object->id_.c_str());
+            return false;
+        }
+        if (!checkObjectMoveShape(*object) ||
+            object->shapes_.size() != object->shape_poses_.size())
+        {
+            ROS_ERROR_NAMED(WCM_LOGGER, "Rejecting move of collision object '%s'", object->id_.c_str());
+            return false;
+        }
+    }
+    for (const ObjectConstPtr& object : insert_objects) {
+        if (!names.insert(object->id_).second) {
+            ROS_ERROR_NAMED(WCM_LOGGER, "Collision object '%s' appears multiple times in batched update", object->id_.c_str());
+            return false;
+        }
+        if (!checkObjectInsert(*object)) {
+            ROS_ERROR_NAMED(WCM_LOGGER, "Rejecting addition of collision object '%s'", object->id_.c_str());
+            return false;
+        }
+    }
+
+    // voxelize the new and moved objects
+    std::vector<std::vector<VoxelList>> insert_voxels(insert_objects.size());
+    for (size_t i = 0; i < insert_objects.size(); ++i) {
+        if (!voxelizeObject(*insert_objects[i], insert_voxels[i])) {
+            return false;
+        }
+    }
+    std::vector<std::vector<VoxelList>> move_voxels(move_objects.size());
+    for (size_t i = 0; i < move_objects.size(); ++i) {
+        if (!voxelizeObject(*move_objects[i], move_voxels[i])) {
+            return false;
+        }
+    }
+
+    // coalesce the voxel changes into a single update of the grid
+    std::vector<const VoxelList*> removed;
+    std::vector<const VoxelList*> added;
+    for (const std::string& name : remove_names) {
+        for (const VoxelList& voxel_list : m_object_voxel_map[name]) {
+            removed.push_back(&voxel_list);
+        }
+    }
+    for (size_t i = 0; i < move_objects.size(); ++i) {
+        for (const VoxelList& voxel_list : m_object_voxel_map[move_objects[i]->id_]) {
+            removed.push_back(&voxel_list);
+        }
+        for (const VoxelList& voxel_list : move_voxels[i]) {
+            added.push_back(&voxel_list);
+        }
+    }
+    for (size_t i = 0; i < insert_objects.size(); ++i) {
+        for (const VoxelList& voxel_list : insert_voxels[i]) {
+            added.push_back(&voxel_list);
+        }
+    }
+
+    if (!m_voxels_preloaded) {
+        ROS_DEBUG_NAMED(WCM_LOGGER, "Updating the distance transform with %zu insertions, %zu moves, and %zu removals",
+                insert_objects.size(), move_objects.size(), remove_names.size());
+        m_grid->updatePointsInField(removed, added);
+        for (const VoxelList* voxel_list : removed) {
+            recordChangedVoxels(*voxel_list);
+        }
+        for (const VoxelList* voxel_list : added) {
+            recordChangedVoxels(*voxel_list);
+        }
+    }
+
+    for (const std::string& name : remove_names) {
+        m_object_voxel_map.erase(name);
+        m_object_map.erase(name);
+    }
+    for (size_t i = 0; i < move_objects.size(); ++i) {
+        const ObjectConstPtr& object = move_objects[i];
+        m_object_voxel_map[object->id_] = std::move(move_voxels[i]);
+        m_object_map[object->id_] = object;
+    }
+    for (size_t i = 0; i < insert_objects.size(); ++i) {
+        const ObjectConstPtr& object = insert_objects[i];
+        m_object_voxel_map[object->id_] = std::move(insert_voxels[i]);
+        m_object_map[object->id_] = object;
+    }
+
+    return true;
+}
+
+bool WorldCollisionModelImpl::processCollisionObjects(
+    const std::vector<moveit_msgs::CollisionObject>& objects)
+{
+    std::vector<ObjectConstPtr> insert_objects;
+    std::vector<ObjectConstPtr> move_objects;
+    std::vector<std::string> remove_names;
+    std::set<std::string> names;
+
+    auto flush = [&]() -> bool
+    {
+        if (insert_objects.empty() &&
+            move_objects.empty() &&
+            remove_names.empty())
+        {
+            return true;
+        }
+        const bool res = updateObjects(
+                insert_objects, move_objects, remove_names);
+        insert_objects.clear();
+        move_objects.clear();
+        remove_names.clear();
+        names.clear();
+        return res;
+    };
+
+    for (const moveit_msgs::CollisionObject& object : objects) {
+        const bool batched =
+                object.operation == moveit_msgs::CollisionObject::ADD ||
+                object.operation == moveit_msgs::CollisionObject::MOVE ||
+                object.operation == moveit_msgs::CollisionObject::REMOVE;
+
+        // apply the pending batch before any operation that depends on it
+        if (!batched || names.find(object.id) != names.end()) {
+            if (!flush()) {
+                return false;
+            }
+        }
+
+        if (!batched) {
+            if (!processCollisionObject(object)) {
+                return false;
+            }
+            continue;
+        }
+
+        if (object.operation == moveit_msgs::CollisionObject::ADD) {
+            if (!checkCollisionObjectAdd(object)) {
+                ROS_ERROR_NAMED(WCM_LOGGER, "Rejecting addition of collision object '%s'", object.id.c_str());
+                return false;
+            }
+
+            ObjectConstPtr op = ConvertCollisionObjectToObject(object);
+            if (!op) {
+                ROS_ERROR_NAMED(WCM_LOGGER, "Failed to convert collision object to internal representation");
+                return false;
+            }
+            insert_objects.push_back(op);
+        }
+        else if (object.operation == moveit_msgs::CollisionObject::MOVE) {
+            if (!checkCollisionObjectMove(object)) {
+                ROS_ERROR_NAMED(WCM_LOGGER, "Rejecting move of collision object '%s'", object.id.c_str());
+                return false;
+            }
+
+            ObjectConstPtr op = convertMovedCollisionObject(object);
+            if (!op) {
+                return false;
+            }
+            move_objects.push_back(op);
+        }
+        else {
+            remove_names.push_back(object.id);
+        }
+        names.insert(object.id);
+    }
+
+    return flush();
 }
 
 bool WorldCollisionModelImpl::processCollisionObject(
@@ -320,11 +543,13 @@ bool WorldCollisionModelImpl::insertOctomap(
 void WorldCollisionModelImpl::reset()
 {
     m_grid->reset();
+    std::vector<const VoxelList*> added;
     for (const auto& entry : m_object_voxel_map) {
         for (const auto& voxel_list : entry.second) {
-            m_grid->addPointsToField(voxel_list);
+            added.push_back(&voxel_list);
         }
     }
+    m_grid->updatePointsInField(std::vector<const VoxelList*>(), added);
 }
 
 visualization_msgs::MarkerArray
@@ -386,6 +611,92 @@ double WorldCollisionModelImpl::padding() const
     return m_padding;
 }
 
+const std::vector<Eigen::AlignedBox3d>&
+WorldCollisionModelImpl::changedRegions() const
+{
+    return m_changed_regions;
+}
+
+void WorldCollisionModelImpl::clearChangedRegions()
+{
+    m_changed_regions.clear();
+}
+
+void WorldCollisionModelImpl::recordGridChanged()
+{
+    Eigen::AlignedBox3d region(
+            Eigen::Vector3d(
+                    m_grid->originX(), m_grid->originY(), m_grid->originZ()),
+            Eigen::Vector3d(
+                    m_grid->originX() + m_grid->sizeX(),
+                    m_grid->originY() + m_grid->sizeY(),
+                    m_grid->originZ() + m_grid->sizeZ()));
+    m_changed_regions.assign(1, region);
+}
+
+void WorldCollisionModelImpl::setVoxelsPreloaded(bool preloaded)
+{
+    m_voxels_preloaded = preloaded;
+}
+
+bool WorldCollisionModelImpl::voxelsPreloaded() const
+{
+    return m_voxels_preloaded;
+}
+
+bool WorldCollisionModelImpl::empty() const
+{
+    return m_object_map.empty();
+}
+
+// Extend the set of changed regions by the bounding box of a list of voxels.
+// Once too many regions have accumulated, they are merged into a single box to
+// keep tests against the regions cheap.
+void WorldCollisionModelImpl::recordChangedVoxels(const VoxelList& voxels)
+{
+    if (voxels.empty()) {
+        return;
+    }
+
+    Eigen::AlignedBox3d region;
+    for (const Eigen::Vector3d& v : voxels) {
+        region.extend(v);
+    }
+
+    if (m_changed_regions.size() >= MaxChangedRegions) {
+        for (const Eigen::AlignedBox3d& r : m_changed_regions) {
+            region.extend(r);
+        }
+        m_changed_regions.clear();
+    }
+
+    m_changed_regions.push_back(region);
+}
+
+bool WorldCollisionModelImpl::voxelizeObject(
+    const Object& object,
+    std::vector<VoxelList>& all_voxels) const
+{
+    const double res = m_grid->resolution();
+    const Eigen::Vector3d origin(
+            m_grid->originX(), m_grid->originY(), m_grid->originZ());
+
+    const Eigen::Vector3d gmin(
+            m_grid->originX(), m_grid->originY(), m_grid->originZ());
+
+    const Eigen::Vector3d gmax(
+            m_grid->originX() + m_grid->sizeX(),
+            m_grid->originY() + m_grid->sizeY(),
+            m_grid->originZ() + m_grid->sizeZ());
+
+    if (!VoxelizeObject(object, res, origin, gmin, gmax, all_voxels)) {
+        ROS_ERROR_NAMED(WCM_LOGGER, "Failed to voxelize object '%s'", object.id_.c_str());
+        return false;
+    }
+
+    return true;
+}
+
 bool WorldCollisionModelImpl::haveObject(const std::string& name) const
 {
     return m_object_map.find(name) != m_object_map.end();
@@ -431,6 +742,42 @@ bool WorldCollisionModelImpl::checkObjectRemoveShape(const Object& object) const
     return haveObject(object.id_);
 }
 
+// Construct a copy of an existing collision object with the poses of its
+// shapes replaced by those of a MOVE operation. As in MoveIt, the poses are
+// given in the order of the object's primitives, meshes, and planes, and any
+// geometry in the message is ignored.
+ObjectConstPtr WorldCollisionModelImpl::convertMovedCollisionObject(
+    const moveit_msgs::CollisionObject& object) const
+{
+    auto oit = m_object_map.find(object.id);
+    if (oit == m_object_map.end()) {
+        return ObjectConstPtr();
+    }
+    const Object& curr = *oit->second;
+
+    std::vector<const geometry_msgs::Pose*> poses;
+    for (const geometry_msgs::Pose& pose : object.primitive_poses) {
+        poses.push_back(&pose);
+    }
+    for (const geometry_msgs::Pose& pose : object.mesh_poses) {
+        poses.push_back(&pose);
+    }
+    for (const geometry_msgs::Pose& pose : object.plane_poses) {
+        poses.push_back(&pose);
+    }
+
+    if (poses.size() != curr.shapes_.size()) {
+        ROS_ERROR_NAMED(WCM_LOGGER, "Number of poses (%zu) for moving collision object '%s' does not match its number of shapes (%zu)", poses.size(), object.id.c_str(), curr.shapes_.size());
+        return ObjectConstPtr();
+    }
+
+    ObjectPtr o(new Object(curr));
+    for (size_t i = 0; i < poses.size(); ++i) {
+        tf::poseMsgToEigen(*poses[i], o->shape_poses_[i]);
+    }
+    return ObjectConstPtr(o);
+}
+
 ObjectConstPtr WorldCollisionModelImpl::convertOctomapToObject(
     const octomap_msgs::OctomapWithPose& octomap) const
 {
@@ -610,16 +957,25 @@ bool WorldCollisionModelImpl::moveCollisionObject(const moveit_msgs::CollisionOb
         return false;
     }
 
-    // TODO: implement
-    ROS_ERROR_NAMED(WCM_LOGGER, "moveCollisionObject unimplemented");
-    return false;
+    ObjectConstPtr op = convertMovedCollisionObject(object);
+    if (!op) {
+        return false;
+    }
+
+    return moveShapes(op);
 }
 
-void WorldCollisionModelImpl::removeAllCollisionObjects()
+bool WorldCollisionModelImpl::removeAllCollisionObjects()
 {
+    std::vector<std::string> names;
+    names.reserve(m_object_map.size());
     for (const auto& entry : m_object_map) {
-        removeObject(entry.first);
+        names.push_back(entry.first);
     }
+    return updateObjects(
+            std::vector<ObjectConstPtr>(),
+            std::vector<ObjectConstPtr>(),
+            names);
 }
 
 void WorldCollisionModelImpl::getAllCollisionObjectVoxels(
@@ -772,6 +1128,20 @@ bool WorldCollisionModel::removeObject(const std::string& object_name)
     return m_impl->removeObject(object_name);
 }
 
+bool WorldCollisionModel::updateObjects(
+    const std::vector<ObjectConstPtr>& insert_objects,
+    const std::vector<ObjectConstPtr>& move_objects,
+    const std::vector<std::string>& remove_names)
+{
+    return m_impl->updateObjects(insert_objects, move_objects, remove_names);
+}
+
+bool WorldCollisionModel::processCollisionObjects(
+    const std::vector<moveit_msgs::CollisionObject>& objects)
+{
+    return m_impl->processCollisionObjects(objects);
+}
+
 void WorldCollisionModel::reset()
 {
     return m_impl->reset();
@@ -799,5 +1169,36 @@ double WorldCollisionModel::padding() const
     return m_impl->padding();
 }
 
+const std::vector<Eigen::AlignedBox3d>&
+WorldCollisionModel::changedRegions() const
+{
+    return m_impl->changedRegions();
+}
+
+void WorldCollisionModel::clearChangedRegions()
+{
+    return m_impl->clearChangedRegions();
+}
+
+void WorldCollisionModel::recordGridChanged()
+{
+    return m_impl->recordGridChanged();
+}
+
+void WorldCollisionModel::setVoxelsPreloaded(bool preloaded)
+{
+    return m_impl->setVoxelsPreloaded(preloaded);
+}
+
+bool WorldCollisionModel::voxelsPreloaded() const
+{
+    return m_impl->voxelsPreloaded();
+}
+
+bool WorldCollisionModel::empty() const
+{
+    return m_impl->empty();
+}
+
 } // namespace collision
 } // namespace sbpl
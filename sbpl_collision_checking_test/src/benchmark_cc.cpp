@@ -42,8 +42,13 @@
 #include <smpl/distance_map/distance_map.h>
 #include <smpl/distance_map/sparse_distance_map.h>
 #include <smpl/distance_map/euclid_distance_map.h>
+#include <smpl/distance_map/hashed_distance_map.h>
 #include <smpl/occupancy_grid.h>
+#include <sbpl_collision_checking/attached_bodies_collision_model.h>
+#include <sbpl_collision_checking/attached_bodies_collision_state.h>
 #include <sbpl_collision_checking/collision_space.h>
+#include <sbpl_collision_checking/robot_collision_state.h>
+#include <sbpl_collision_checking/self_collision_model.h>
 #include <urdf/model.h>
 
 sbpl::OccupancyGridPtr CreateGrid(const ros::NodeHandle& nh, double max_dist)
@@ -103,10 +108,16 @@ sbpl::OccupancyGridPtr CreateGrid(const ros::NodeHandle& nh, double max_dist)
     ROS_INFO("  res: %0.3f", res_m);
     ROS_INFO("  max_distance: %0.3f", max_distance_m);
 
-    const int dflib = 2; // 0 -> my dense, 1 -> my sparse, 2 -> df
+    // optional distance map type: "euclid", "sparse", "hashed", or
+    // "propagation" (default)
+    std::string distance_map_type = "propagation";
+    if (wcm_config.hasMember("distance_map")) {
+        distance_map_type = static_cast<std::string>(wcm_config["distance_map"]);
+    }
+    ROS_INFO("  distance map: %s", distance_map_type.c_str());
 
     sbpl::OccupancyGridPtr grid;
-    if (dflib == 0) {
+    if (distance_map_type == "euclid") {
         auto df = std::make_shared<sbpl::EuclidDistanceMap>(
                 origin_x, origin_y, origin_z,
                 size_x, size_y, size_z,
@@ -115,20 +126,30 @@ sbpl::OccupancyGridPtr CreateGrid(const ros::NodeHandle& nh, double max_dist)
 
         grid = std::make_shared<sbpl::OccupancyGrid>(df, ref_counted);
 
-    } else if (dflib == 1) {
+    } else if (distance_map_type == "sparse") {
         auto df = std::make_shared<sbpl::SparseDistanceMap>(
                 origin_x, origin_y, origin_z,
                 size_x, size_y, size_z,
                 res_m,
                 max_distance_m);
         grid = std::make_shared<sbpl::OccupancyGrid>(df, ref_counted);
-    } else {
+    } else if (distance_map_type == "hashed") {
+        auto df = std::make_shared<sbpl::HashedDistanceMap>(
+                origin_x, origin_y, origin_z,
+                size_x, size_y, size_z,
+                res_m,
+                max_distance_m);
+        grid = std::make_shared<sbpl::OccupancyGrid>(df, ref_counted);
+    } else if (distance_map_type == "propagation") {
         grid = std::make_shared<sbpl::OccupancyGrid>(
                 size_x, size_y, size_z,
                 res_m,
                 origin_x, origin_y, origin_z,
                 max_distance_m,
                 ref_counted);
+    } else {
+        ROS_ERROR("Unrecognized distance map type '%s'", distance_map_type.c_str());
+        return sbpl::OccupancyGridPtr();
     }
 
     grid->setReferenceFrame(world_frame);
@@ -148,6 +169,17 @@ public:
 
     ProfileResults profileCollisionChecks(double time_limit);
     ProfileResults profileDistanceChecks(double time_limit);
+
+    struct SelfCollisionResults
+    {
+        int check_count;
+        int collision_count;
+        int mismatch_count;
+        double depth_first_time;
+        double batched_time;
+    };
+
+    SelfCollisionResults profileSelfCollisionChecks(int count);
     int exportCheckedStates(const char* filename, int count);
     int verifyCheckedStates(const char* filename);
 
@@ -276,6 +308,75 @@ CollisionSpaceProfiler::profileDistanceChecks(double time_limit)
     return res;
 }
 
+/// Compare the depth-first and batched sphere hierarchy traversals of the self
+/// collision model over the same set of random states
+CollisionSpaceProfiler::SelfCollisionResults
+CollisionSpaceProfiler::profileSelfCollisionChecks(int count)
+{
+    ROS_INFO("Evaluating %d self collision checks per traversal", count);
+
+    sbpl::collision::AttachedBodiesCollisionModel abcm(m_rcm.get());
+    sbpl::collision::RobotCollisionState rcs(m_rcm.get());
+    sbpl::collision::AttachedBodiesCollisionState abcs(&abcm, &rcs);
+
+    // separate grid so that the voxels models of the self collision model
+    // under test don't interfere with the collision space
+    sbpl::OccupancyGridPtr grid = CreateGrid(m_nh, m_rcm->maxSphereRadius());
+    sbpl::collision::SelfCollisionModel scm(grid.get(), m_rcm.get(), &abcm);
+
+    sbpl::collision::AllowedCollisionMatrix acm;
+    initACM(acm);
+    scm.setAllowedCollisionMatrix(acm);
+
+    const int gidx = m_rcm->groupIndex("right_arm");
+
+    std::vector<std::vector<double>> states(count);
+    for (auto& state : states) {
+        state = createRandomState();
+    }
+
+    auto run_checks = [&](std::vector<bool>& valid) -> double
+    {
+        valid.resize(states.size());
+        double elapsed = 0.0;
+        for (size_t i = 0; i < states.size(); ++i) {
+            for (size_t j = 0; j < m_planning_joints.size(); ++j) {
+                rcs.setJointVarPosition(m_planning_joints[j], states[i][j]);
+            }
+            auto start = std::chrono::high_resolution_clock::now();
+            double dist;
+            valid[i] = scm.checkCollision(rcs, abcs, gidx, dist);
+            auto finish = std::chrono::high_resolution_clock::now();
+            elapsed += std::chrono::duration<double>(finish - start).count();
+        }
+        return elapsed;
+    };
+
+    SelfCollisionResults res;
+    res.check_count = count;
+
+    std::vector<bool> depth_first_valid;
+    scm.setBatchedSphereChecks(false);
+    res.depth_first_time = run_checks(depth_first_valid);
+
+    std::vector<bool> batched_valid;
+    scm.setBatchedSphereChecks(true);
+    res.batched_time = run_checks(batched_valid);
+
+    res.collision_count = 0;
+    res.mismatch_count = 0;
+    for (size_t i = 0; i < states.size(); ++i) {
+        if (!depth_first_valid[i]) {
+            ++res.collision_count;
+        }
+        if (depth_first_valid[i] != batched_valid[i]) {
+            ++res.mismatch_count;
+        }
+    }
+
+    return res;
+}
+
 std::vector<double> CollisionSpaceProfiler::createRandomState()
 {
     std::vector<double> out;
@@ -1443,6 +1544,107 @@ int CollisionSpaceProfiler::verifyCheckedStates(const char* filename)
     return diff;
 }
 
+struct TestSphere
+{
+    double x, y, z;
+    double sqrd_radius;
+};
+
+template <typename DistanceQuery>
+double RunSphereChecks(
+    const DistanceQuery& query,
+    const std::vector<TestSphere>& spheres,
+    std::vector<bool>& valid)
+{
+    valid.resize(spheres.size());
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        const TestSphere& s = spheres[i];
+        const double d2 = query.getMetricSquaredDistance(s.x, s.y, s.z);
+        valid[i] = d2 >= s.sqrd_radius;
+    }
+    auto finish = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+struct SphereCheckResults
+{
+    int check_count;
+    int collision_count;
+    int mismatch_count;
+    double virtual_time;
+    double dense_time;
+};
+
+/// Compare the throughput of sphere-vs-world checks made through the virtual
+/// DistanceMapInterface lookups against those made through the non-virtual
+/// DenseDistanceQuery handle, over the same set of random spheres in a world
+/// of random boxes
+SphereCheckResults ProfileSphereChecks(int count)
+{
+    ROS_INFO("Evaluating %d sphere checks per lookup method", count);
+
+    const double size = 2.0;
+    const double res_m = 0.02;
+    auto df = std::make_shared<sbpl::EuclidDistanceMap>(
+            0.0, 0.0, 0.0, size, size, size, res_m, 0.2);
+    sbpl::OccupancyGrid grid(df);
+
+    std::default_random_engine rng;
+    std::uniform_real_distribution<double> coord(0.0, size);
+    std::uniform_real_distribution<double> extent(0.05, 0.3);
+
+    std::vector<Eigen::Vector3d> points;
+    for (int i = 0; i < 40; ++i) {
+        const Eigen::Vector3d min(coord(rng), coord(rng), coord(rng));
+        const Eigen::Vector3d max =
+                min + Eigen::Vector3d(extent(rng), extent(rng), extent(rng));
+        for (double x = min.x(); x < max.x(); x += res_m) {
+        for (double y = min.y(); y < max.y(); y += res_m) {
+        for (double z = min.z(); z < max.z(); z += res_m) {
+            points.emplace_back(x, y, z);
+        }
+        }
+        }
+    }
+    grid.addPointsToField(points);
+
+    std::uniform_real_distribution<double> center(-0.1, size + 0.1);
+    std::uniform_real_distribution<double> radius(0.02, 0.1);
+    std::vector<TestSphere> spheres(count);
+    for (TestSphere& s : spheres) {
+        const double r = radius(rng);
+        s.x = center(rng);
+        s.y = center(rng);
+        s.z = center(rng);
+        s.sqrd_radius = r * r;
+    }
+
+    SphereCheckResults res;
+    res.check_count = count;
+
+    const sbpl::DistanceMapInterface& dmi = *grid.getDistanceField();
+    std::vector<bool> virtual_valid;
+    res.virtual_time = RunSphereChecks(dmi, spheres, virtual_valid);
+
+    const sbpl::DenseDistanceQuery& query = *grid.getDenseDistanceQuery();
+    std::vector<bool> dense_valid;
+    res.dense_time = RunSphereChecks(query, spheres, dense_valid);
+
+    res.collision_count = 0;
+    res.mismatch_count = 0;
+    for (size_t i = 0; i < spheres.size(); ++i) {
+        if (!virtual_valid[i]) {
+            ++res.collision_count;
+        }
+        if (virtual_valid[i] != dense_valid[i]) {
+            ++res.mismatch_count;
+        }
+    }
+
+    return res;
+}
+
 int main(int argc, char *argv[])
 {
     ros::init(argc, argv, "benchmark");
@@ -1455,6 +1657,21 @@ int main(int argc, char *argv[])
 
     const char* cmd = argv[1];
 
+    // sphere checks against a synthetic world don't require the robot model
+    if (0 == strcmp(cmd, "spheres")) {
+        const int count = argc > 2 ? atoi(argv[2]) : 10000000;
+        auto res = ProfileSphereChecks(count);
+        ROS_INFO("check count: %d (%d in collision)", res.check_count, res.collision_count);
+        ROS_INFO("virtual: %g checks / second", res.check_count / res.virtual_time);
+        ROS_INFO("dense query: %g checks / second", res.check_count / res.dense_time);
+        ROS_INFO("speedup: %g", res.virtual_time / res.dense_time);
+        if (res.mismatch_count != 0) {
+            ROS_ERROR("%d checks disagree between lookup methods", res.mismatch_count);
+            return 1;
+        }
+        return 0;
+    }
+
     CollisionSpaceProfiler prof;
     if (!prof.init()) {
         ROS_ERROR("Failed to initialize profiler");
@@ -1492,6 +1709,17 @@ int main(int argc, char *argv[])
             ROS_INFO("checks / second: %g", res.check_count / time_limit);
             ROS_INFO("seconds / check: %g", time_limit / res.check_count);
         }
+    } else if (0 == strcmp(cmd, "self")) {
+        const int count = argc > 2 ? atoi(argv[2]) : 100000;
+        auto res = prof.profileSelfCollisionChecks(count);
+        ROS_INFO("check count: %d (%d in collision)", res.check_count, res.collision_count);
+        ROS_INFO("depth-first: %g seconds / check", res.depth_first_time / res.check_count);
+        ROS_INFO("batched: %g seconds / check", res.batched_time / res.check_count);
+        ROS_INFO("speedup: %g", res.depth_first_time / res.batched_time);
+        if (res.mismatch_count != 0) {
+            ROS_ERROR("%d checks disagree between traversals", res.mismatch_count);
+            return 1;
+        }
     } else if (0 == strcmp(cmd, "load")) {
         return 0;
     }
@@ -143,6 +143,13 @@ public:
         std::vector<double>& pose);
     ///@}
 
+    /// \name Reimplemented Public Functions from ForwardKinematicsInterface
+    ///@{
+    bool computeBatchPlanningLinkFK(
+        const std::vector<std::vector<double>>& states,
+        std::vector<std::vector<double>>& poses) override;
+    ///@}
+
     /// \name Required Public Functions from Extension
     ///@{
     Extension* getExtension(size_t class_code) override;
@@ -175,6 +182,16 @@ protected:
     std::unique_ptr<KDL::ChainIkSolverVel_pinv>         ik_vel_solver_;
     std::unique_ptr<KDL::ChainFkSolverPos_recursive>    fk_solver_;
 
+    // cached forward kinematics of the chain. fk_frames_[i] is the pose of
+    // the root of segment i at the joint positions fk_jnt_pos_, valid for
+    // i <= fk_valid_count_
+    std::vector<KDL::Frame> fk_frames_;
+    KDL::JntArray fk_jnt_pos_;
+    int fk_valid_count_;
+    std::vector<int> segment_joints_; // joint index of each segment, or -1
+    std::vector<int> joint_segments_; // segment index of each joint
+    std::vector<int> fk_batch_order_;
+
     std::vector<bool> continuous_;
     std::vector<double> min_limits_;
     std::vector<double> max_limits_;
@@ -183,6 +200,15 @@ protected:
     std::map<std::string, int> joint_map_;
     std::map<std::string, int> link_map_;
 
+    bool computeChainFK(
+        const std::vector<double>& angles,
+        int segment,
+        KDL::Frame& f);
+
+    void planningPoseToKinematicsFrame(
+        const std::vector<double>& pose,
+        KDL::Frame& f) const;
+
     double normalizeAngle(double a, double a_min, double a_max) const;
     void normalizeAngles(KDL::JntArray& angles) const;
     void normalizeAngles(std::vector<double>& angles) const;
@@ -32,6 +32,9 @@
 
 #include <sbpl_kdl_robot_model/kdl_robot_model.h>
 
+// standard includes
+#include <algorithm>
+
 // system includes
 #include <kdl/tree.hpp>
 #include <leatherman/print.h>
@@ -48,7 +51,13 @@ KDLRobotModel::KDLRobotModel() :
     initialized_(false),
     ik_solver_(),
     ik_vel_solver_(),
-    fk_solver_()
+    fk_solver_(),
+    fk_frames_(),
+    fk_jnt_pos_(),
+    fk_valid_count_(0),
+    segment_joints_(),
+    joint_segments_(),
+    fk_batch_order_()
 {
 }
 
@@ -129,6 +138,19 @@ bool KDLRobotModel::init(
     jnt_pos_in_.resize(kchain_.getNrOfJoints());
     jnt_pos_out_.resize(kchain_.getNrOfJoints());
 
+    // FK cache
+    fk_frames_.assign(kchain_.getNrOfSegments() + 1, KDL::Frame::Identity());
+    fk_jnt_pos_.resize(kchain_.getNrOfJoints());
+    fk_valid_count_ = 0;
+    segment_joints_.assign(kchain_.getNrOfSegments(), -1);
+    joint_segments_.clear();
+    for (size_t i = 0; i < kchain_.getNrOfSegments(); ++i) {
+        if (kchain_.getSegment(i).getJoint().getType() != KDL::Joint::None) {
+            segment_joints_[i] = (int)joint_segments_.size();
+            joint_segments_.push_back((int)i);
+        }
+    }
+
     // IK solver
     KDL::JntArray q_min(planning_joints_.size());
     KDL::JntArray q_max(planning_joints_.size());
@@ -347,20 +369,79 @@ const std::string& KDLRobotModel::getPlanningLink() const
     return planning_link_;
 }
 
-bool KDLRobotModel::computeFK(
+/// Compute the pose of the root of a segment of the chain, in the kinematics
+/// frame, equivalent to KDL::ChainFkSolverPos_recursive::JntToCart.
+///
+/// The poses of the segment roots computed by the previous call are cached,
+/// and only the poses of segments following the first joint whose position
+/// differs from the previous call are recomputed.
+bool KDLRobotModel::computeChainFK(
     const std::vector<double>& angles,
-    const std::string& name,
+    int segment,
     KDL::Frame& f)
 {
+    if (segment < 0 || segment >= (int)fk_frames_.size()) {
+        return false;
+    }
+
     for (size_t i = 0; i < angles.size(); ++i) {
         jnt_pos_in_(i) = angles[i];
     }
 
     normalizeAngles(jnt_pos_in_);
 
+    // invalidate the poses following the first changed joint
+    for (size_t j = 0; j < joint_segments_.size(); ++j) {
+        if (jnt_pos_in_(j) != fk_jnt_pos_(j)) {
+            fk_valid_count_ = std::min(fk_valid_count_, joint_segments_[j]);
+            for (size_t jj = j; jj < joint_segments_.size(); ++jj) {
+                fk_jnt_pos_(jj) = jnt_pos_in_(jj);
+            }
+            break;
+        }
+    }
+
+    for (int i = fk_valid_count_; i < segment; ++i) {
+        const KDL::Segment& seg = kchain_.getSegment(i);
+        const int j = segment_joints_[i];
+        fk_frames_[i + 1] = fk_frames_[i] * seg.pose(j >= 0 ? fk_jnt_pos_(j) : 0.0);
+    }
+    fk_valid_count_ = std::max(fk_valid_count_, segment);
+
+    f = fk_frames_[segment];
+    return true;
+}
+
+/// Convert a pose of the planning link in the planning frame, given as
+/// { x, y, z, R, P, Y } or { x, y, z, qx, qy, qz, qw }, into a frame in the
+/// kinematics frame.
+void KDLRobotModel::planningPoseToKinematicsFrame(
+    const std::vector<double>& pose,
+    KDL::Frame& f) const
+{
+    f.p.x(pose[0]);
+    f.p.y(pose[1]);
+    f.p.z(pose[2]);
+
+    if (pose.size() == 6) {
+        // RPY
+        f.M = KDL::Rotation::RPY(pose[3], pose[4], pose[5]);
+    } else {
+        // quaternion
+        f.M = KDL::Rotation::Quaternion(pose[3], pose[4], pose[5], pose[6]);
+    }
+
+    f = T_planning_to_kinematics_ * f;
+}
+
+bool KDLRobotModel::computeFK(
+    const std::vector<double>& angles,
+    const std::string& name,
+    KDL::Frame& f)
+{
     KDL::Frame f1;
-    if (fk_solver_->JntToCart(jnt_pos_in_, f1, link_map_[name]) < 0) {
-        ROS_ERROR("JntToCart returned < 0.");
+    if (!computeChainFK(angles, link_map_[name], f1)) {
+        ROS_ERROR("Failed to compute FK of link '%s': segment %d is not in the kinematic chain", name.c_str(), link_map_[name]);
         return false;
     }
     f = T_kinematics_to_planning_ * f1;
@@ -403,13 +484,8 @@ bool KDLRobotModel::computePlanningLinkFK(
 {
     KDL::Frame f, f1;
     pose.resize(6, 0);
-    for (size_t i = 0; i < angles.size(); ++i) {
-        jnt_pos_in_(i) = angles[i];
-    }
-    normalizeAngles(jnt_pos_in_);
-
-    if (fk_solver_->JntToCart(jnt_pos_in_, f1, link_map_[planning_link_]) < 0) {
-        ROS_ERROR("JntToCart returned < 0.");
+    if (!computeChainFK(angles, link_map_[planning_link_], f1)) {
+        ROS_ERROR("Failed to compute FK of planning link '%s': segment %d is not in the kinematic chain", planning_link_.c_str(), link_map_[planning_link_]);
         return false;
     }
 
@@ -422,6 +498,32 @@ bool KDLRobotModel::computePlanningLinkFK(
     return true;
 }
 
+/// Compute forward kinematics of the planning link for several states. The
+/// states are visited in lexicographic order of their joint positions so that
+/// consecutive states share as many leading joint positions, and thus cached
+/// segment poses, as possible.
+bool KDLRobotModel::computeBatchPlanningLinkFK(
+    const std::vector<std::vector<double>>& states,
+    std::vector<std::vector<double>>& poses)
+{
+    poses.resize(states.size());
+
+    fk_batch_order_.resize(states.size());
+    for (size_t i = 0; i < states.size(); ++i) {
+        fk_batch_order_[i] = (int)i;
+    }
+    std::sort(fk_batch_order_.begin(), fk_batch_order_.end(),
+            [&](int a, int b) { return states[a] < states[b]; });
+
+    bool res = true;
+    for (int i : fk_batch_order_) {
+        if (!computePlanningLinkFK(states[i], poses[i])) {
+            res = false;
+        }
+    }
+    return res;
+}
+
 bool KDLRobotModel::computeIK(
     const std::vector<double>& pose,
     const std::vector<double>& start,
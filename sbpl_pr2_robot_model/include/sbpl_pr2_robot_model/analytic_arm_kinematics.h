@@ -0,0 +1,184 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#ifndef sbpl_manip_analytic_arm_kinematics_h
+#define sbpl_manip_analytic_arm_kinematics_h
+
+// standard includes
+#include <vector>
+
+// system includes
+#include <Eigen/Dense>
+#include <kdl/chain.hpp>
+#include <kdl/frames.hpp>
+
+namespace sbpl {
+namespace motion {
+
+/// \brief Closed-form kinematics for 7-dof arms with the joint layout of the
+///     PR2 and UBR1 arms
+///
+/// The arm must consist of, in order, a shoulder pan (z), shoulder lift (y),
+/// upper arm roll (x), elbow flex (y), forearm roll (x), wrist flex (y), and
+/// wrist roll (x) joint. The origins of all joints following the shoulder lift
+/// must lie along the x axis of the preceding joint, without rotation, so that
+/// the shoulder lift and upper arm roll axes intersect and the three wrist
+/// axes intersect at the wrist flex joint. The shoulder lift may be offset
+/// from the shoulder pan axis in x and z.
+///
+/// Inverse kinematics are parameterized by the upper arm roll angle. All
+/// computation is done with fixed-size types and does not allocate.
+class AnalyticArmKinematics
+{
+public:
+
+    static const int DOF = 7;
+    static const int FREE_ANGLE_INDEX = 2;
+
+    typedef Eigen::Matrix<double, DOF, 1> JointVector;
+
+    AnalyticArmKinematics();
+
+    /// \brief Extract the arm geometry from a kinematic chain
+    ///
+    /// Fixed segments before the shoulder pan joint and after the wrist roll
+    /// joint are allowed. Joint limits are given in the order of the chain's
+    /// joints.
+    ///
+    /// \return false if the chain does not have the expected structure
+    bool init(
+        const KDL::Chain& chain,
+        const std::vector<double>& min_limits,
+        const std::vector<double>& max_limits,
+        const std::vector<bool>& continuous);
+
+    bool initialized() const { return m_initialized; }
+
+    /// \brief Return the solution branch of a configuration, identified by the
+    ///     signs of its elbow flex and wrist flex angles, or -1 if the
+    ///     configuration does not have DOF variables
+    static int SolutionBranch(const std::vector<double>& q);
+
+    /// \brief Compute the pose of the chain tip in the chain root frame
+    void computeFK(const JointVector& q, Eigen::Affine3d& pose) const;
+
+    /// \brief Compute the solution within joint limits, nearest to the seed,
+    ///     with the upper arm roll fixed to \p free_angle
+    bool computeIK(
+        const Eigen::Affine3d& pose,
+        double free_angle,
+        const JointVector& seed,
+        JointVector& solution) const;
+
+    /// \brief Compute solutions for several poses, with the upper arm roll of
+    ///     each solution fixed to that of the seed
+    ///
+    /// Solutions are computed in order until the first pose with no solution.
+    /// The first pose is seeded with \p seed and each subsequent pose with the
+    /// solution to the pose preceding it.
+    ///
+    /// \return The number of poses for which a solution was found
+    int computeIK(
+        const Eigen::Affine3d* poses,
+        int count,
+        const JointVector& seed,
+        JointVector* solutions) const;
+
+    /// \brief Compute a solution with the upper arm roll nearest to that of
+    ///     the seed, by searching over the upper arm roll in increments of
+    ///     \p increment
+    bool computeIKSearch(
+        const Eigen::Affine3d& pose,
+        const JointVector& seed,
+        double increment,
+        JointVector& solution) const;
+
+private:
+
+    bool m_initialized;
+
+    // pose of the shoulder pan joint in the chain root frame
+    Eigen::Matrix3d m_base_rot;
+    Eigen::Vector3d m_base_pos;
+
+    // offset of the shoulder lift joint from the shoulder pan joint
+    double m_shoulder_x;
+    double m_shoulder_z;
+
+    // offsets of the upper arm roll, elbow flex, forearm roll, wrist flex, and
+    // wrist roll joints along the x axis of the preceding joint
+    double m_link_offsets[5];
+
+    // distances from the shoulder lift joint to the elbow and from the elbow
+    // to the wrist flex joint
+    double m_upper_arm_length;
+    double m_forearm_length;
+
+    // pose of the chain tip in the wrist roll frame
+    Eigen::Matrix3d m_tip_rot;
+    Eigen::Vector3d m_tip_pos;
+
+    // offset of the chain tip from the wrist flex joint in the wrist roll frame
+    Eigen::Vector3d m_wrist_to_tip;
+
+    double m_min_limits[DOF];
+    double m_max_limits[DOF];
+    bool m_continuous[DOF];
+
+    struct FreeAngleTerms;
+
+    void computeFreeAngleTerms(double free_angle, FreeAngleTerms& terms) const;
+
+    bool solve(
+        const Eigen::Affine3d& pose,
+        const FreeAngleTerms& terms,
+        const JointVector& seed,
+        JointVector& solution) const;
+
+    bool solveWrist(
+        const Eigen::Matrix3d& R,
+        const JointVector& seed,
+        int branch,
+        JointVector& q) const;
+
+    bool normalizeIntoLimits(int jidx, double& angle) const;
+};
+
+/// \brief Convert a KDL frame into an Eigen transform
+void KDLFrameToTransform(const KDL::Frame& f, Eigen::Affine3d& T);
+
+/// \brief Convert an Eigen transform into a KDL frame
+void TransformToKDLFrame(const Eigen::Affine3d& T, KDL::Frame& f);
+
+} // namespace motion
+} // namespace sbpl
+
+#endif
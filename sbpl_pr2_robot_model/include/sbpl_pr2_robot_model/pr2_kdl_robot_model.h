@@ -38,6 +38,7 @@
 #include <vector>
 
 // system includes
+#include <Eigen/Dense>
 #include <kdl/chain.hpp>
 #include <kdl/chainfksolverpos_recursive.hpp>
 #include <kdl/chainiksolverpos_nr_jl.hpp>
@@ -51,12 +52,15 @@
 #include <urdf/model.h>
 
 // project includes
+#include <sbpl_pr2_robot_model/analytic_arm_kinematics.h>
 #include <sbpl_pr2_robot_model/orientation_solver.h>
 
 namespace sbpl {
 namespace motion {
 
-class PR2KDLRobotModel : public KDLRobotModel
+class PR2KDLRobotModel :
+    public KDLRobotModel,
+    public virtual RedundantManipulatorInterface
 {
 public:
 
@@ -64,6 +68,11 @@ public:
 
     ~PR2KDLRobotModel();
 
+    /// \brief Use closed-form kinematics in place of pr2_arm_kinematics, when the
+    ///     kinematic chain supports them. Disabled by default.
+    void setUseAnalyticKinematics(bool use);
+    bool useAnalyticKinematics() const;
+
     /// \name Reimplemented Functions from KDLRobotModel
     ///@{
     bool init(
@@ -79,10 +88,38 @@ public:
         std::vector<double>& solution,
         ik_option::IkOption option = ik_option::UNRESTRICTED) override;
 
+    bool computeIK(
+        const std::vector<double>& pose,
+        const std::vector<double>& start,
+        std::vector<std::vector<double>>& solutions,
+        ik_option::IkOption option = ik_option::UNRESTRICTED) override;
+
     bool computeFastIK(
         const std::vector<double>& pose,
         const std::vector<double>& start,
         std::vector<double>& solution) override;
+
+    bool computePlanningLinkFK(
+        const std::vector<double>& angles,
+        std::vector<double>& pose) override;
+
+    Extension* getExtension(size_t class_code) override;
+    ///@}
+
+    /// \name Required Public Functions from RedundantManipulatorInterface
+    ///@{
+    const int redundantVariableCount() const override;
+    const int redundantVariableIndex(int rvidx) const override;
+    ///@}
+
+    /// \name Reimplemented Public Functions from RedundantManipulatorInterface
+    ///@{
+    bool computeBatchFastIK(
+        const std::vector<std::vector<double>>& poses,
+        const std::vector<double>& start,
+        std::vector<std::vector<double>>& solutions) override;
+
+    int ikSolutionBranch(const std::vector<double>& state) const override;
     ///@}
 
 private:
@@ -91,9 +128,22 @@ private:
 
     std::unique_ptr<RPYSolver> rpy_solver_;
 
+    // closed-form kinematics of the chain, used in place of pr2_ik_solver_
+    // when enabled and the chain matches its expected structure
+    AnalyticArmKinematics analytic_kinematics_;
+    bool use_analytic_kinematics_;
+    std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d>> batch_poses_;
+    std::vector<AnalyticArmKinematics::JointVector> batch_solutions_;
+
     std::string forearm_roll_link_name_;
     std::string wrist_pitch_joint_name_;
     std::string end_effector_link_name_;
+
+    bool computeAnalyticIK(
+        const std::vector<double>& pose,
+        const std::vector<double>& start,
+        std::vector<double>& solution,
+        bool search);
 };
 
 } // namespace motion
@@ -37,6 +37,7 @@
 #include <vector>
 
 // system includes
+#include <Eigen/Dense>
 #include <kdl/chain.hpp>
 #include <kdl/chainfksolverpos_recursive.hpp>
 #include <kdl/chainiksolverpos_nr_jl.hpp>
@@ -49,12 +50,15 @@
 
 // project includes
 #include <sbpl_kdl_robot_model/kdl_robot_model.h>
+#include <sbpl_pr2_robot_model/analytic_arm_kinematics.h>
 #include <sbpl_pr2_robot_model/orientation_solver.h>
 
 namespace sbpl {
 namespace motion {
 
-class UBR1KDLRobotModel : public KDLRobotModel
+class UBR1KDLRobotModel :
+    public KDLRobotModel,
+    public virtual RedundantManipulatorInterface
 {
 public:
 
@@ -62,20 +66,81 @@ public:
 
     virtual ~UBR1KDLRobotModel();
 
+    /// \brief Use closed-form kinematics in place of KDL, when the
+    ///     kinematic chain supports them. Disabled by default.
+    void setUseAnalyticKinematics(bool use);
+    bool useAnalyticKinematics() const;
+
+    /// \name Reimplemented Functions from KDLRobotModel
+    ///@{
+    bool init(
+        const std::string& robot_description,
+        const std::vector<std::string>& planning_joints,
+        const std::string& chain_root_link,
+        const std::string& chain_tip_link,
+        int free_angle = DEFAULT_FREE_ANGLE_INDEX) override;
+
     /* Inverse Kinematics */
-    virtual bool computeIK(
+    bool computeIK(
         const std::vector<double>& pose,
         const std::vector<double>& start,
         std::vector<double>& solution,
-        int option = ik_option::UNRESTRICTED);
+        ik_option::IkOption option = ik_option::UNRESTRICTED) override;
+
+    bool computeIK(
+        const std::vector<double>& pose,
+        const std::vector<double>& start,
+        std::vector<std::vector<double>>& solutions,
+        ik_option::IkOption option = ik_option::UNRESTRICTED) override;
+
+    bool computeFastIK(
+        const std::vector<double>& pose,
+        const std::vector<double>& start,
+        std::vector<double>& solution) override;
+
+    bool computePlanningLinkFK(
+        const std::vector<double>& angles,
+        std::vector<double>& pose) override;
+
+    Extension* getExtension(size_t class_code) override;
+    ///@}
+
+    /// \name Required Public Functions from RedundantManipulatorInterface
+    ///@{
+    const int redundantVariableCount() const override;
+    const int redundantVariableIndex(int rvidx) const override;
+    ///@}
+
+    /// \name Reimplemented Public Functions from RedundantManipulatorInterface
+    ///@{
+    bool computeBatchFastIK(
+        const std::vector<std::vector<double>>& poses,
+        const std::vector<double>& start,
+        std::vector<std::vector<double>>& solutions) override;
+
+    int ikSolutionBranch(const std::vector<double>& state) const override;
+    ///@}
 
   private:
 
     RPYSolver* rpy_solver_;
 
+    // closed-form kinematics of the chain, used in place of the KDL solvers
+    // when enabled and the chain matches its expected structure
+    AnalyticArmKinematics analytic_kinematics_;
+    bool use_analytic_kinematics_;
+    std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d>> batch_poses_;
+    std::vector<AnalyticArmKinematics::JointVector> batch_solutions_;
+
     std::string forearm_roll_link_name_;
     std::string wrist_pitch_joint_name_;
     std::string end_effector_link_name_;
+
+    bool computeAnalyticIK(
+        const std::vector<double>& pose,
+        const std::vector<double>& start,
+        std::vector<double>& solution,
+        bool search);
 };
 
 } // namespace motion
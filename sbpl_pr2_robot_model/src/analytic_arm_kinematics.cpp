@@ -0,0 +1,623 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#include <sbpl_pr2_robot_model/analytic_arm_kinematics.h>
+
+// standard includes
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// system includes
+#include <smpl/angles.h>
+
+namespace sbpl {
+namespace motion {
+
+static const double GeometryTolerance = 1e-6;
+static const double SingularityTolerance = 1e-9;
+
+static
+Eigen::Matrix3d RotX(double a)
+{
+    const double c = std::cos(a);
+    const double s = std::sin(a);
+    Eigen::Matrix3d R;
+    R << 1.0, 0.0, 0.0,
+         0.0,   c,  -s,
+         0.0,   s,   c;
+    return R;
+}
+
+static
+Eigen::Matrix3d RotY(double a)
+{
+    const double c = std::cos(a);
+    const double s = std::sin(a);
+    Eigen::Matrix3d R;
+    R <<   c, 0.0,   s,
+         0.0, 1.0, 0.0,
+          -s, 0.0,   c;
+    return R;
+}
+
+static
+Eigen::Matrix3d RotZ(double a)
+{
+    const double c = std::cos(a);
+    const double s = std::sin(a);
+    Eigen::Matrix3d R;
+    R <<   c,  -s, 0.0,
+           s,   c, 0.0,
+         0.0, 0.0, 1.0;
+    return R;
+}
+
+static
+Eigen::Matrix3d RotAxis(int axis, double a)
+{
+    switch (axis) {
+    case 0:
+        return RotX(a);
+    case 1:
+        return RotY(a);
+    default:
+        return RotZ(a);
+    }
+}
+
+// Terms of the shoulder and elbow solution that depend only on the upper arm
+// roll angle, shared by all poses solved for the same angle
+struct AnalyticArmKinematics::FreeAngleTerms
+{
+    double angle;
+    double s;
+    double c;
+
+    // pose-independent parts of the leading and constant coefficients of the
+    // quadratic in the cosine of the elbow flex angle
+    double qa;
+    double qc;
+};
+
+AnalyticArmKinematics::AnalyticArmKinematics() :
+    m_initialized(false),
+    m_base_rot(Eigen::Matrix3d::Identity()),
+    m_base_pos(Eigen::Vector3d::Zero()),
+    m_shoulder_x(0.0),
+    m_shoulder_z(0.0),
+    m_upper_arm_length(0.0),
+    m_forearm_length(0.0),
+    m_tip_rot(Eigen::Matrix3d::Identity()),
+    m_tip_pos(Eigen::Vector3d::Zero()),
+    m_wrist_to_tip(Eigen::Vector3d::Zero())
+{
+    for (int i = 0; i < 5; ++i) {
+        m_link_offsets[i] = 0.0;
+    }
+    for (int i = 0; i < DOF; ++i) {
+        m_min_limits[i] = -M_PI;
+        m_max_limits[i] = M_PI;
+        m_continuous[i] = true;
+    }
+}
+
+bool AnalyticArmKinematics::init(
+    const KDL::Chain& chain,
+    const std::vector<double>& min_limits,
+    const std::vector<double>& max_limits,
+    const std::vector<bool>& continuous)
+{
+    m_initialized = false;
+
+    if (min_limits.size() != DOF ||
+        max_limits.size() != DOF ||
+        continuous.size() != DOF)
+    {
+        return false;
+    }
+
+    // expected axis of each joint in its origin frame
+    const int axes[DOF] = { 2, 1, 0, 1, 0, 1, 0 };
+
+    // accumulated transform of the fixed segments since the last joint
+    KDL::Frame fixed = KDL::Frame::Identity();
+
+    int jidx = 0;
+    for (unsigned int sidx = 0; sidx < chain.getNrOfSegments(); ++sidx) {
+        const KDL::Segment& segment = chain.getSegment(sidx);
+        const KDL::Joint& joint = segment.getJoint();
+        if (joint.getType() == KDL::Joint::None) {
+            fixed = fixed * segment.getFrameToTip();
+            continue;
+        }
+
+        if (jidx >= DOF ||
+            joint.getType() == KDL::Joint::TransAxis ||
+            joint.getType() == KDL::Joint::TransX ||
+            joint.getType() == KDL::Joint::TransY ||
+            joint.getType() == KDL::Joint::TransZ)
+        {
+            return false;
+        }
+
+        // require the joint to rotate about an axis of its origin frame,
+        // applied after the origin transform
+        Eigen::Affine3d origin;
+        KDLFrameToTransform(fixed * segment.getFrameToTip(), origin);
+
+        const double test_angle = 0.5;
+        Eigen::Affine3d moved;
+        KDLFrameToTransform(fixed * segment.pose(test_angle), moved);
+
+        const Eigen::Matrix3d expected =
+                origin.linear() * RotAxis(axes[jidx], test_angle);
+        if (!moved.linear().isApprox(expected, GeometryTolerance) ||
+            !moved.translation().isApprox(
+                    origin.translation(), GeometryTolerance))
+        {
+            return false;
+        }
+
+        const Eigen::Vector3d& p = origin.translation();
+        if (jidx == 0) {
+            m_base_rot = origin.linear();
+            m_base_pos = p;
+        } else {
+            if (!origin.linear().isIdentity(GeometryTolerance)) {
+                return false;
+            }
+            if (jidx == 1) {
+                if (std::fabs(p.y()) > GeometryTolerance) {
+                    return false;
+                }
+                m_shoulder_x = p.x();
+                m_shoulder_z = p.z();
+            } else {
+                if (std::fabs(p.y()) > GeometryTolerance ||
+                    std::fabs(p.z()) > GeometryTolerance)
+                {
+                    return false;
+                }
+                m_link_offsets[jidx - 2] = p.x();
+            }
+        }
+
+        fixed = KDL::Frame::Identity();
+        ++jidx;
+    }
+
+    if (jidx != DOF) {
+        return false;
+    }
+
+    Eigen::Affine3d tip;
+    KDLFrameToTransform(fixed, tip);
+    m_tip_rot = tip.linear();
+    m_tip_pos = tip.translation();
+
+    m_upper_arm_length = m_link_offsets[0] + m_link_offsets[1];
+    m_forearm_length = m_link_offsets[2] + m_link_offsets[3];
+    if (m_upper_arm_length < GeometryTolerance ||
+        m_forearm_length < GeometryTolerance)
+    {
+        return false;
+    }
+
+    m_wrist_to_tip = m_link_offsets[4] * Eigen::Vector3d::UnitX() + m_tip_pos;
+
+    for (int i = 0; i < DOF; ++i) {
+        m_min_limits[i] = min_limits[i];
+        m_max_limits[i] = max_limits[i];
+        m_continuous[i] = continuous[i];
+    }
+
+    m_initialized = true;
+    return true;
+}
+
+void AnalyticArmKinematics::computeFK(
+    const JointVector& q,
+    Eigen::Affine3d& pose) const
+{
+    // the offset of each joint following a roll joint lies along the roll
+    // axis, so the roll rotation may be applied after the offset
+    Eigen::Matrix3d R = m_base_rot * RotZ(q[0]);
+    Eigen::Vector3d p = m_base_pos + R * Eigen::Vector3d(m_shoulder_x, 0.0, m_shoulder_z);
+
+    R = R * RotY(q[1]);
+    p += (m_link_offsets[0] + m_link_offsets[1]) * R.col(0);
+
+    R = R * RotX(q[2]) * RotY(q[3]);
+    p += (m_link_offsets[2] + m_link_offsets[3]) * R.col(0);
+
+    R = R * RotX(q[4]) * RotY(q[5]);
+    p += m_link_offsets[4] * R.col(0);
+
+    R = R * RotX(q[6]);
+
+    pose.linear() = R * m_tip_rot;
+    pose.translation() = p + R * m_tip_pos;
+    pose.makeAffine();
+}
+
+bool AnalyticArmKinematics::computeIK(
+    const Eigen::Affine3d& pose,
+    double free_angle,
+    const JointVector& seed,
+    JointVector& solution) const
+{
+    FreeAngleTerms terms;
+    computeFreeAngleTerms(free_angle, terms);
+    return solve(pose, terms, seed, solution);
+}
+
+int AnalyticArmKinematics::computeIK(
+    const Eigen::Affine3d* poses,
+    int count,
+    const JointVector& seed,
+    JointVector* solutions) const
+{
+    FreeAngleTerms terms;
+    computeFreeAngleTerms(seed[FREE_ANGLE_INDEX], terms);
+    for (int i = 0; i < count; ++i) {
+        // seed each pose with the solution to the preceding pose so that
+        // consecutive waypoints remain on the same solution branch
+        const JointVector& prev = i == 0 ? seed : solutions[i - 1];
+        if (!solve(poses[i], terms, prev, solutions[i])) {
+            return i;
+        }
+    }
+    return count;
+}
+
+bool AnalyticArmKinematics::computeIKSearch(
+    const Eigen::Affine3d& pose,
+    const JointVector& seed,
+    double increment,
+    JointVector& solution) const
+{
+    const double initial_guess = seed[FREE_ANGLE_INDEX];
+    if (computeIK(pose, initial_guess, seed, solution)) {
+        return true;
+    }
+
+    if (increment <= 0.0) {
+        return false;
+    }
+
+    double lo, hi;
+    if (m_continuous[FREE_ANGLE_INDEX]) {
+        lo = initial_guess - M_PI;
+        hi = initial_guess + M_PI;
+    } else {
+        lo = m_min_limits[FREE_ANGLE_INDEX];
+        hi = m_max_limits[FREE_ANGLE_INDEX];
+    }
+
+    // alternate between increasing and decreasing the free angle
+    for (int i = 1; ; ++i) {
+        const double up = initial_guess + i * increment;
+        const double down = initial_guess - i * increment;
+        if (up > hi && down < lo) {
+            return false;
+        }
+        if (up <= hi && computeIK(pose, up, seed, solution)) {
+            return true;
+        }
+        if (down >= lo && computeIK(pose, down, seed, solution)) {
+            return true;
+        }
+    }
+}
+
+void AnalyticArmKinematics::computeFreeAngleTerms(
+    double free_angle,
+    FreeAngleTerms& terms) const
+{
+    const double L1 = m_upper_arm_length;
+    const double L2 = m_forearm_length;
+    const double a = m_shoulder_x;
+    terms.angle = free_angle;
+    terms.s = std::sin(free_angle);
+    terms.c = std::cos(free_angle);
+    terms.qa = L1 * L1 * L2 * L2 - a * a * L2 * L2 * terms.s * terms.s;
+    terms.qc = a * a * L2 * L2 * terms.s * terms.s;
+}
+
+// Solve for the shoulder pan (t1), shoulder lift (t2), and elbow flex (t4)
+// angles that place the wrist flex joint, w, given the upper arm roll angle
+// (t3). In the shoulder pan frame, with the shoulder lift joint at
+// s = (a, 0, b):
+//
+//     Rz(-t1) * w - s = Ry(t2) * u
+//     u = (L1 + L2 * c4, L2 * s3 * s4, -L2 * c3 * s4)
+//
+// Comparing the y components and squared norms of each side gives
+//
+//     -r * sin(t1 - phi) = L2 * s3 * s4
+//     K - 2 * a * r * cos(t1 - phi) = 2 * L1 * L2 * c4
+//
+// where (r, phi) is the polar position of w and
+// K = |w|^2 + |s|^2 - 2 * b * w_z - L1^2 - L2^2, which, eliminating t1, is a
+// quadratic in c4. The shoulder lift angle is the rotation between u and the
+// shoulder-relative wrist position in the xz-plane. The wrist angles then
+// follow from the remaining rotation, Rx(t5) * Ry(t6) * Rx(t7).
+bool AnalyticArmKinematics::solve(
+    const Eigen::Affine3d& pose,
+    const FreeAngleTerms& terms,
+    const JointVector& seed,
+    JointVector& solution) const
+{
+    if (!m_initialized) {
+        return false;
+    }
+
+    JointVector q;
+    q[2] = terms.angle;
+    if (!normalizeIntoLimits(2, q[2])) {
+        return false;
+    }
+
+    const Eigen::Matrix3d R = m_base_rot.transpose() * pose.linear();
+    const Eigen::Vector3d p = m_base_rot.transpose() * (pose.translation() - m_base_pos);
+
+    // orientation of the wrist roll link and position of the wrist center
+    const Eigen::Matrix3d Rw = R * m_tip_rot.transpose();
+    const Eigen::Vector3d w = p - Rw * m_wrist_to_tip;
+
+    const double L1 = m_upper_arm_length;
+    const double L2 = m_forearm_length;
+    const double a = m_shoulder_x;
+    const double b = m_shoulder_z;
+    const double s3 = terms.s;
+    const double c3 = terms.c;
+
+    const double r2 = w.x() * w.x() + w.y() * w.y();
+    const double r = std::sqrt(r2);
+    const double phi = std::atan2(w.y(), w.x());
+    const double K = w.squaredNorm() + a * a + b * b - 2.0 * b * w.z() - L1 * L1 - L2 * L2;
+
+    const bool offset = std::fabs(a) > GeometryTolerance;
+
+    double c4s[2];
+    int c4_count = 0;
+    if (offset) {
+        if (r < SingularityTolerance) {
+            return false;
+        }
+        const double qa = terms.qa;
+        const double qb = -K * L1 * L2;
+        const double qc = 0.25 * K * K + terms.qc - a * a * r2;
+        if (std::fabs(qa) < SingularityTolerance) {
+            if (std::fabs(qb) < SingularityTolerance) {
+                return false;
+            }
+            c4s[c4_count++] = -qc / qb;
+        } else {
+            double disc = qb * qb - 4.0 * qa * qc;
+            if (disc < 0.0) {
+                if (disc < -SingularityTolerance) {
+                    return false;
+                }
+                disc = 0.0;
+            }
+            const double sq = std::sqrt(disc);
+            c4s[c4_count++] = (-qb + sq) / (2.0 * qa);
+            if (sq > 0.0) {
+                c4s[c4_count++] = (-qb - sq) / (2.0 * qa);
+            }
+        }
+    } else {
+        c4s[c4_count++] = K / (2.0 * L1 * L2);
+    }
+
+    double best_dist = std::numeric_limits<double>::infinity();
+
+    for (int ci = 0; ci < c4_count; ++ci) {
+        double c4 = c4s[ci];
+        if (c4 < -1.0 || c4 > 1.0) {
+            if (std::fabs(c4) > 1.0 + SingularityTolerance) {
+                continue;
+            }
+            c4 = c4 < 0.0 ? -1.0 : 1.0;
+        }
+
+        for (int s4_sign = 1; s4_sign >= -1; s4_sign -= 2) {
+            const double s4 = s4_sign * std::sqrt(1.0 - c4 * c4);
+            if (s4_sign < 0 && s4 == 0.0) {
+                break;
+            }
+
+            q[3] = std::atan2(s4, c4);
+            if (!normalizeIntoLimits(3, q[3])) {
+                continue;
+            }
+
+            // candidate shoulder pan angles, relative to phi
+            double alphas[2];
+            int alpha_count = 0;
+            const double sin_alpha_r = -L2 * s3 * s4;
+            if (offset) {
+                const double cos_alpha_r = (K - 2.0 * L1 * L2 * c4) / (2.0 * a);
+                alphas[alpha_count++] = std::atan2(sin_alpha_r, cos_alpha_r);
+            } else if (r < SingularityTolerance) {
+                // the wrist lies on the shoulder pan axis
+                if (std::fabs(sin_alpha_r) > GeometryTolerance) {
+                    continue;
+                }
+                alphas[alpha_count++] = seed[0] - phi;
+            } else {
+                const double sin_alpha = sin_alpha_r / r;
+                if (std::fabs(sin_alpha) > 1.0) {
+                    continue;
+                }
+                const double cos_alpha = std::sqrt(1.0 - sin_alpha * sin_alpha);
+                alphas[alpha_count++] = std::atan2(sin_alpha, cos_alpha);
+                alphas[alpha_count++] = std::atan2(sin_alpha, -cos_alpha);
+            }
+
+            const Eigen::Vector3d u(L1 + L2 * c4, L2 * s3 * s4, -L2 * c3 * s4);
+
+            for (int ai = 0; ai < alpha_count; ++ai) {
+                q[0] = phi + alphas[ai];
+                if (!normalizeIntoLimits(0, q[0])) {
+                    continue;
+                }
+
+                const double c1 = std::cos(q[0]);
+                const double s1 = std::sin(q[0]);
+
+                const double vx = c1 * w.x() + s1 * w.y() - a;
+                const double vz = w.z() - b;
+                q[1] = std::atan2(u.z(), u.x()) - std::atan2(vz, vx);
+                if (!normalizeIntoLimits(1, q[1])) {
+                    continue;
+                }
+
+                const Eigen::Matrix3d R04 =
+                        RotZ(q[0]) * RotY(q[1]) * RotX(q[2]) * RotY(q[3]);
+                const Eigen::Matrix3d M = R04.transpose() * Rw;
+
+                for (int branch = 0; branch < 2; ++branch) {
+                    if (!solveWrist(M, seed, branch, q)) {
+                        continue;
+                    }
+
+                    double dist = 0.0;
+                    for (int j = 0; j < DOF; ++j) {
+                        const double d = m_continuous[j] ?
+                                angles::shortest_angle_diff(q[j], seed[j]) :
+                                q[j] - seed[j];
+                        dist += d * d;
+                    }
+                    if (dist < best_dist) {
+                        best_dist = dist;
+                        solution = q;
+                    }
+                }
+            }
+        }
+    }
+
+    return best_dist != std::numeric_limits<double>::infinity();
+}
+
+// Decompose the wrist rotation, M = Rx(t5) * Ry(t6) * Rx(t7), choosing the
+// solution with positive (branch 0) or negative (branch 1) wrist flex. At the
+// singularity, where the forearm and wrist roll axes align, the forearm roll
+// is taken from the seed.
+bool AnalyticArmKinematics::solveWrist(
+    const Eigen::Matrix3d& M,
+    const JointVector& seed,
+    int branch,
+    JointVector& q) const
+{
+    // recover the sine of the wrist flex from the off-diagonal terms, which,
+    // unlike 1 - c6^2, retain their precision near the singularity
+    const double c6 = M(0, 0);
+    const double s6_abs = std::sqrt(M(1, 0) * M(1, 0) + M(2, 0) * M(2, 0));
+    if (s6_abs > SingularityTolerance) {
+        const double sign = branch == 0 ? 1.0 : -1.0;
+        q[4] = std::atan2(sign * M(1, 0), -sign * M(2, 0));
+        q[5] = std::atan2(sign * s6_abs, c6);
+        q[6] = std::atan2(sign * M(0, 1), sign * M(0, 2));
+    } else {
+        if (branch != 0) {
+            return false;
+        }
+        const double roll = std::atan2(M(2, 1), M(1, 1));
+        q[4] = seed[4];
+        if (c6 > 0.0) {
+            q[5] = 0.0;
+            q[6] = roll - q[4];
+        } else {
+            q[5] = M_PI;
+            q[6] = q[4] - roll;
+        }
+    }
+
+    return normalizeIntoLimits(4, q[4]) &&
+            normalizeIntoLimits(5, q[5]) &&
+            normalizeIntoLimits(6, q[6]);
+}
+
+int AnalyticArmKinematics::SolutionBranch(const std::vector<double>& q)
+{
+    if (q.size() != DOF) {
+        return -1;
+    }
+    const int elbow = std::sin(q[3]) < 0.0 ? 1 : 0;
+    const int wrist = std::sin(q[5]) < 0.0 ? 1 : 0;
+    return (elbow << 1) | wrist;
+}
+
+// Normalize a joint angle into its limits, or into [-pi, pi] for continuous
+// joints, as KDLRobotModel does for its solutions
+bool AnalyticArmKinematics::normalizeIntoLimits(
+    int jidx,
+    double& angle) const
+{
+    angle = angles::normalize_angle(angle);
+    if (m_continuous[jidx]) {
+        return true;
+    }
+
+    if (angle < m_min_limits[jidx]) {
+        angle += 2.0 * M_PI;
+    } else if (angle > m_max_limits[jidx]) {
+        angle -= 2.0 * M_PI;
+    }
+    return angle >= m_min_limits[jidx] && angle <= m_max_limits[jidx];
+}
+
+void KDLFrameToTransform(const KDL::Frame& f, Eigen::Affine3d& T)
+{
+    T.linear() <<
+            f.M(0, 0), f.M(0, 1), f.M(0, 2),
+            f.M(1, 0), f.M(1, 1), f.M(1, 2),
+            f.M(2, 0), f.M(2, 1), f.M(2, 2);
+    T.translation() = Eigen::Vector3d(f.p.x(), f.p.y(), f.p.z());
+    T.makeAffine();
+}
+
+void TransformToKDLFrame(const Eigen::Affine3d& T, KDL::Frame& f)
+{
+    const Eigen::Matrix3d R = T.linear();
+    f.M = KDL::Rotation(
+            R(0, 0), R(0, 1), R(0, 2),
+            R(1, 0), R(1, 1), R(1, 2),
+            R(2, 0), R(2, 1), R(2, 2));
+    f.p = KDL::Vector(T.translation().x(), T.translation().y(), T.translation().z());
+}
+
+} // namespace motion
+} // namespace sbpl
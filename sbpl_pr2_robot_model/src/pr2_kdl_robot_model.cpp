@@ -46,7 +46,11 @@ namespace motion {
 PR2KDLRobotModel::PR2KDLRobotModel() :
     KDLRobotModel(),
     pr2_ik_solver_(),
-    rpy_solver_()
+    rpy_solver_(),
+    analytic_kinematics_(),
+    use_analytic_kinematics_(false),
+    batch_poses_(),
+    batch_solutions_()
 {
     forearm_roll_link_name_ = "r_forearm_roll_link";
     wrist_pitch_joint_name_ = "r_wrist_flex_joint";
@@ -110,10 +114,29 @@ bool PR2KDLRobotModel::init(
 
     rpy_solver_.reset(new RPYSolver(wrist_min_limit, wrist_max_limit));
 
+    if (planning_joints_.size() == AnalyticArmKinematics::DOF &&
+        free_angle_ == AnalyticArmKinematics::FREE_ANGLE_INDEX &&
+        analytic_kinematics_.init(kchain_, min_limits_, max_limits_, continuous_))
+    {
+        ROS_INFO("Closed-form kinematics are available for the PR2 arm");
+    } else {
+        ROS_INFO("Kinematic chain does not support closed-form kinematics");
+    }
+
     initialized_ = true;
     return true;
 }
 
+void PR2KDLRobotModel::setUseAnalyticKinematics(bool use)
+{
+    use_analytic_kinematics_ = use;
+}
+
+bool PR2KDLRobotModel::useAnalyticKinematics() const
+{
+    return use_analytic_kinematics_ && analytic_kinematics_.initialized();
+}
+
 bool PR2KDLRobotModel::computeIK(
     const std::vector<double>& pose,
     const std::vector<double>& start,
@@ -166,6 +189,8 @@ bool PR2KDLRobotModel::computeIK(
         }
 
         return rpy_solver_->computeRPYOnly(rpy2, start, fpose, epose, 1, solution);
+    } else if (useAnalyticKinematics()) {
+        return computeAnalyticIK(pose, start, solution, true);
     } else {
         const double timeout = 0.2;
         const double consistency_limit = 2.0 * M_PI;
@@ -187,11 +212,32 @@ bool PR2KDLRobotModel::computeIK(
     return true;
 }
 
+bool PR2KDLRobotModel::computeIK(
+    const std::vector<double>& pose,
+    const std::vector<double>& start,
+    std::vector<std::vector<double>>& solutions,
+    ik_option::IkOption option)
+{
+    if (option == ik_option::RESTRICT_XYZ || !useAnalyticKinematics()) {
+        return KDLRobotModel::computeIK(pose, start, solutions, option);
+    }
+
+    std::vector<double> solution;
+    if (computeAnalyticIK(pose, start, solution, true)) {
+        solutions.push_back(solution);
+    }
+    return solutions.size() > 0;
+}
+
 bool PR2KDLRobotModel::computeFastIK(
     const std::vector<double>& pose,
     const std::vector<double>& start,
     std::vector<double>& solution)
 {
+    if (useAnalyticKinematics()) {
+        return computeAnalyticIK(pose, start, solution, false);
+    }
+
     //pose: {x,y,z,r,p,y} or {x,y,z,qx,qy,qz,qw}
     KDL::Frame frame_des;
     frame_des.p.x(pose[0]);
@@ -227,5 +273,137 @@ bool PR2KDLRobotModel::computeFastIK(
     return true;
 }
 
+bool PR2KDLRobotModel::computePlanningLinkFK(
+    const std::vector<double>& angles,
+    std::vector<double>& pose)
+{
+    if (!useAnalyticKinematics() || planning_link_ != chain_tip_name_) {
+        return KDLRobotModel::computePlanningLinkFK(angles, pose);
+    }
+
+    AnalyticArmKinematics::JointVector q;
+    for (int i = 0; i < AnalyticArmKinematics::DOF; ++i) {
+        q[i] = angles[i];
+    }
+
+    Eigen::Affine3d T;
+    analytic_kinematics_.computeFK(q, T);
+
+    KDL::Frame f;
+    TransformToKDLFrame(T, f);
+    f = T_kinematics_to_planning_ * f;
+
+    pose.resize(6);
+    pose[0] = f.p[0];
+    pose[1] = f.p[1];
+    pose[2] = f.p[2];
+    f.M.GetRPY(pose[3], pose[4], pose[5]);
+    return true;
+}
+
+Extension* PR2KDLRobotModel::getExtension(size_t class_code)
+{
+    if (class_code == GetClassCode<RedundantManipulatorInterface>()) {
+        return this;
+    }
+    return KDLRobotModel::getExtension(class_code);
+}
+
+const int PR2KDLRobotModel::redundantVariableCount() const
+{
+    return 1;
+}
+
+const int PR2KDLRobotModel::redundantVariableIndex(int rvidx) const
+{
+    return free_angle_;
+}
+
+/// Solve for all poses at once with the closed-form kinematics, sharing the
+/// terms that depend only on the free angle of the seed.
+bool PR2KDLRobotModel::computeBatchFastIK(
+    const std::vector<std::vector<double>>& poses,
+    const std::vector<double>& start,
+    std::vector<std::vector<double>>& solutions)
+{
+    if (!useAnalyticKinematics()) {
+        return RedundantManipulatorInterface::computeBatchFastIK(
+                poses, start, solutions);
+    }
+
+    batch_poses_.resize(poses.size());
+    for (size_t i = 0; i < poses.size(); ++i) {
+        KDL::Frame frame_des;
+        planningPoseToKinematicsFrame(poses[i], frame_des);
+        KDLFrameToTransform(frame_des, batch_poses_[i]);
+    }
+
+    AnalyticArmKinematics::JointVector seed;
+    for (int i = 0; i < AnalyticArmKinematics::DOF; ++i) {
+        seed[i] = start[i];
+    }
+
+    batch_solutions_.resize(poses.size());
+    const int count = analytic_kinematics_.computeIK(
+            batch_poses_.data(), (int)poses.size(), seed, batch_solutions_.data());
+
+    solutions.resize(count);
+    for (int i = 0; i < count; ++i) {
+        const AnalyticArmKinematics::JointVector& q = batch_solutions_[i];
+        solutions[i].assign(q.data(), q.data() + AnalyticArmKinematics::DOF);
+    }
+
+    return count == (int)poses.size();
+}
+
+/// Both pr2_arm_kinematics and the closed-form kinematics select the solution
+/// nearest to the seed, which, for nearby poses, lies on the seed's branch.
+int PR2KDLRobotModel::ikSolutionBranch(const std::vector<double>& state) const
+{
+    if (free_angle_ != AnalyticArmKinematics::FREE_ANGLE_INDEX) {
+        return -1;
+    }
+    return AnalyticArmKinematics::SolutionBranch(state);
+}
+
+/// Compute an ik solution with the closed-form kinematics, either with the
+/// free angle restricted to that of the seed or by searching over the free
+/// angle with the same discretization as pr2_ik_solver_.
+bool PR2KDLRobotModel::computeAnalyticIK(
+    const std::vector<double>& pose,
+    const std::vector<double>& start,
+    std::vector<double>& solution,
+    bool search)
+{
+    KDL::Frame frame_des;
+    planningPoseToKinematicsFrame(pose, frame_des);
+
+    Eigen::Affine3d T;
+    KDLFrameToTransform(frame_des, T);
+
+    AnalyticArmKinematics::JointVector seed;
+    for (int i = 0; i < AnalyticArmKinematics::DOF; ++i) {
+        seed[i] = start[i];
+    }
+
+    AnalyticArmKinematics::JointVector q;
+    if (search) {
+        const double search_discretization_angle = 0.02;
+        if (!analytic_kinematics_.computeIKSearch(
+                T, seed, search_discretization_angle, q))
+        {
+            return false;
+        }
+    } else {
+        const double free_angle = seed[AnalyticArmKinematics::FREE_ANGLE_INDEX];
+        if (!analytic_kinematics_.computeIK(T, free_angle, seed, q)) {
+            return false;
+        }
+    }
+
+    solution.assign(q.data(), q.data() + AnalyticArmKinematics::DOF);
+    return true;
+}
+
 } // namespace motion
 } // namespace sbpl
@@ -42,7 +42,11 @@ namespace sbpl {
 namespace motion {
 
 UBR1KDLRobotModel::UBR1KDLRobotModel() :
-    rpy_solver_(NULL)
+    rpy_solver_(NULL),
+    analytic_kinematics_(),
+    use_analytic_kinematics_(false),
+    batch_poses_(),
+    batch_solutions_()
 {
     chain_root_name_ = "torso_lift_link";
     chain_tip_name_ = "gripper_link";
@@ -69,11 +73,50 @@ UBR1KDLRobotModel::~UBR1KDLRobotModel()
     }
 }
 
+void UBR1KDLRobotModel::setUseAnalyticKinematics(bool use)
+{
+    use_analytic_kinematics_ = use;
+}
+
+bool UBR1KDLRobotModel::useAnalyticKinematics() const
+{
+    return use_analytic_kinematics_ && analytic_kinematics_.initialized();
+}
+
+bool UBR1KDLRobotModel::init(
+    const std::string& robot_description,
+    const std::vector<std::string>& planning_joints,
+    const std::string& chain_root_link,
+    const std::string& chain_tip_link,
+    int free_angle)
+{
+    if (!KDLRobotModel::init(
+            robot_description,
+            planning_joints,
+            chain_root_link,
+            chain_tip_link,
+            free_angle))
+    {
+        return false;
+    }
+
+    if (planning_joints_.size() == AnalyticArmKinematics::DOF &&
+        free_angle_ == AnalyticArmKinematics::FREE_ANGLE_INDEX &&
+        analytic_kinematics_.init(kchain_, min_limits_, max_limits_, continuous_))
+    {
+        ROS_INFO("Closed-form kinematics are available for the UBR1 arm");
+    } else {
+        ROS_INFO("Kinematic chain does not support closed-form kinematics");
+    }
+
+    return true;
+}
+
 bool UBR1KDLRobotModel::computeIK(
     const std::vector<double>& pose,
     const std::vector<double>& start,
     std::vector<double>& solution,
-    int option)
+    ik_option::IkOption option)
 {
     // pose: { x, y, z, r, p, y } or { x, y, z, qx, qy, qz, qw}
     KDL::Frame frame_des;
@@ -123,6 +166,9 @@ bool UBR1KDLRobotModel::computeIK(
 
         return rpy_solver_->computeRPYOnly(rpy2, start, fpose, epose, 1, solution);
     }
+    else if (useAnalyticKinematics()) {
+        return computeAnalyticIK(pose, start, solution, true);
+    }
     else {
         if (computeIKSearch(pose, start, solution, 0.01) < 0) {
             return false;
@@ -136,5 +182,161 @@ bool UBR1KDLRobotModel::computeIK(
     return true;
 }
 
+bool UBR1KDLRobotModel::computeIK(
+    const std::vector<double>& pose,
+    const std::vector<double>& start,
+    std::vector<std::vector<double>>& solutions,
+    ik_option::IkOption option)
+{
+    if (option == ik_option::RESTRICT_XYZ || !useAnalyticKinematics()) {
+        return KDLRobotModel::computeIK(pose, start, solutions, option);
+    }
+
+    std::vector<double> solution;
+    if (computeAnalyticIK(pose, start, solution, true)) {
+        solutions.push_back(solution);
+    }
+    return solutions.size() > 0;
+}
+
+bool UBR1KDLRobotModel::computeFastIK(
+    const std::vector<double>& pose,
+    const std::vector<double>& start,
+    std::vector<double>& solution)
+{
+    if (useAnalyticKinematics()) {
+        return computeAnalyticIK(pose, start, solution, false);
+    }
+    return KDLRobotModel::computeFastIK(pose, start, solution);
+}
+
+bool UBR1KDLRobotModel::computePlanningLinkFK(
+    const std::vector<double>& angles,
+    std::vector<double>& pose)
+{
+    if (!useAnalyticKinematics() || planning_link_ != chain_tip_name_) {
+        return KDLRobotModel::computePlanningLinkFK(angles, pose);
+    }
+
+    AnalyticArmKinematics::JointVector q;
+    for (int i = 0; i < AnalyticArmKinematics::DOF; ++i) {
+        q[i] = angles[i];
+    }
+
+    Eigen::Affine3d T;
+    analytic_kinematics_.computeFK(q, T);
+
+    KDL::Frame f;
+    TransformToKDLFrame(T, f);
+    f = T_kinematics_to_planning_ * f;
+
+    pose.resize(6);
+    pose[0] = f.p[0];
+    pose[1] = f.p[1];
+    pose[2] = f.p[2];
+    f.M.GetRPY(pose[3], pose[4], pose[5]);
+    return true;
+}
+
+Extension* UBR1KDLRobotModel::getExtension(size_t class_code)
+{
+    if (class_code == GetClassCode<RedundantManipulatorInterface>()) {
+        return this;
+    }
+    return KDLRobotModel::getExtension(class_code);
+}
+
+const int UBR1KDLRobotModel::redundantVariableCount() const
+{
+    return 1;
+}
+
+const int UBR1KDLRobotModel::redundantVariableIndex(int rvidx) const
+{
+    return free_angle_;
+}
+
+bool UBR1KDLRobotModel::computeBatchFastIK(
+    const std::vector<std::vector<double>>& poses,
+    const std::vector<double>& start,
+    std::vector<std::vector<double>>& solutions)
+{
+    if (!useAnalyticKinematics()) {
+        return RedundantManipulatorInterface::computeBatchFastIK(
+                poses, start, solutions);
+    }
+
+    batch_poses_.resize(poses.size());
+    for (size_t i = 0; i < poses.size(); ++i) {
+        KDL::Frame frame_des;
+        planningPoseToKinematicsFrame(poses[i], frame_des);
+        KDLFrameToTransform(frame_des, batch_poses_[i]);
+    }
+
+    AnalyticArmKinematics::JointVector seed;
+    for (int i = 0; i < AnalyticArmKinematics::DOF; ++i) {
+        seed[i] = start[i];
+    }
+
+    batch_solutions_.resize(poses.size());
+    const int count = analytic_kinematics_.computeIK(
+            batch_poses_.data(), (int)poses.size(), seed, batch_solutions_.data());
+
+    solutions.resize(count);
+    for (int i = 0; i < count; ++i) {
+        const AnalyticArmKinematics::JointVector& q = batch_solutions_[i];
+        solutions[i].assign(q.data(), q.data() + AnalyticArmKinematics::DOF);
+    }
+
+    return count == (int)poses.size();
+}
+
+/// Branches are only identified for the closed-form kinematics, which select
+/// the solution nearest to the seed. The KDL solvers converge to a solution
+/// that depends on the whole seed.
+int UBR1KDLRobotModel::ikSolutionBranch(const std::vector<double>& state) const
+{
+    if (!useAnalyticKinematics()) {
+        return -1;
+    }
+    return AnalyticArmKinematics::SolutionBranch(state);
+}
+
+bool UBR1KDLRobotModel::computeAnalyticIK(
+    const std::vector<double>& pose,
+    const std::vector<double>& start,
+    std::vector<double>& solution,
+    bool search)
+{
+    KDL::Frame frame_des;
+    planningPoseToKinematicsFrame(pose, frame_des);
+
+    Eigen::Affine3d T;
+    KDLFrameToTransform(frame_des, T);
+
+    AnalyticArmKinematics::JointVector seed;
+    for (int i = 0; i < AnalyticArmKinematics::DOF; ++i) {
+        seed[i] = start[i];
+    }
+
+    AnalyticArmKinematics::JointVector q;
+    if (search) {
+        const double search_discretization_angle = 0.02;
+        if (!analytic_kinematics_.computeIKSearch(
+                T, seed, search_discretization_angle, q))
+        {
+            return false;
+        }
+    } else {
+        const double free_angle = seed[AnalyticArmKinematics::FREE_ANGLE_INDEX];
+        if (!analytic_kinematics_.computeIK(T, free_angle, seed, q)) {
+            return false;
+        }
+    }
+
+    solution.assign(q.data(), q.data() + AnalyticArmKinematics::DOF);
+    return true;
+}
+
 } // namespace motion
 } // namespace sbpl
@@ -34,14 +34,19 @@
 #define SMPL_BFS3D_H
 
 #include <stdio.h>
+#include <memory>
 #include <queue>
 #include <tuple>
 #include <iostream>
+#include <vector>
 #include <ros/ros.h>
 
 #include <boost/thread.hpp>
 
 namespace sbpl {
+
+class ThreadPool;
+
 namespace motion {
 
 class BFS_3D
@@ -57,6 +62,7 @@ public:
     void getDimensions(int* length, int* width, int* height);
 
     void setWall(int x, int y, int z);
+    void unsetWall(int x, int y, int z);
 
     // \brief Clear cells around a given cell until freespace is encountered.
     //
@@ -75,6 +81,28 @@ public:
 
     void run_components(int gx, int gy, int gz);
 
+    /// \brief Update the distances from the previous search's start cells to
+    ///     reflect walls set or cleared since the search was run.
+    ///
+    /// Only the distances of cells whose shortest paths are affected by the
+    /// changed walls are recomputed. The repair runs to completion before this
+    /// function returns.
+    ///
+    /// \return false if there is no previous search to repair, if a start cell
+    ///     has become a wall, or if so many cells have changed that a new
+    ///     search would be cheaper; true otherwise
+    bool repair();
+
+    /// \brief Set the number of threads used to compute the distances.
+    ///
+    /// With more than one thread, each BFS level is split into blocks of
+    /// cells that are expanded concurrently, and the cells of the next level
+    /// are claimed by atomic compare-and-swap. The computed distances are
+    /// identical to those of the single-threaded search. The number of threads
+    /// may not be changed while the search is running.
+    void setNumThreads(int num_threads);
+    int numThreads() const { return m_num_threads; }
+
     bool inBounds(int x, int y, int z) const;
 
     /// \brief Return the distance, in cells, to the nearest occupied cell.
@@ -117,6 +145,23 @@ private:
     std::vector<bool> m_closed;
     std::vector<int> m_distances;
 
+    int m_num_threads;
+    std::unique_ptr<ThreadPool> m_pool;
+
+    // per-worker storage for the cells discovered in the current level
+    std::vector<std::vector<int>> m_next_levels;
+
+    // start cells of the previous search and cells whose wall state has
+    // changed since
+    bool m_has_distances;
+    std::vector<int> m_sources;
+    std::vector<int> m_changed_cells;
+
+    // scratch storage for repair()
+    std::vector<int> m_repair_check;
+    std::vector<int> m_repair_invalid;
+    std::vector<std::vector<int>> m_repair_buckets;
+
     int getNode(int x, int y, int z) const;
     bool getCoord(int node, int& x, int& y, int& z) const;
     void setWall(int node);
@@ -125,6 +170,8 @@ private:
     int isUndiscovered(int node) const;
     int neighbor(int node, int neighbor) const;
 
+    void startSearch();
+
     void search(
         int width,
         int planeSize,
@@ -133,6 +180,12 @@ private:
         int& queue_head,
         int& queue_tail);
 
+    void parallelSearch(
+        int volatile* distance_grid,
+        int* queue,
+        int& queue_head,
+        int& queue_tail);
+
     void search(
         int width,
         int planeSize,
@@ -188,17 +241,7 @@ void BFS_3D::run(InputIt cells_begin, InputIt cells_end)
 
     m_queue_tail = start_count;
 
-    // fire off background thread to compute bfs
-    m_search_thread = boost::thread(
-            static_cast<void (BFS_3D::*)(int, int, int volatile*, int*, int&, int&)>(&BFS_3D::search),
-            this,
-            m_dim_x,
-            m_dim_xy,
-            m_distance_grid,
-            m_queue,
-            m_queue_head,
-            m_queue_tail);
-    m_running = true;
+    startSearch();
 }
 
 inline int BFS_3D::getNode(int x, int y, int z) const
@@ -227,12 +270,22 @@ inline bool BFS_3D::getCoord(int node, int& x, int& y, int& z) const
 
 inline void BFS_3D::setWall(int node)
 {
-    m_distance_grid[node] = WALL;
+    if (m_distance_grid[node] != WALL) {
+        if (m_has_distances) {
+            m_changed_cells.push_back(node);
+        }
+        m_distance_grid[node] = WALL;
+    }
 }
 
 inline void BFS_3D::unsetWall(int node)
 {
-    m_distance_grid[node] = UNDISCOVERED;
+    if (m_distance_grid[node] == WALL) {
+        if (m_has_distances) {
+            m_changed_cells.push_back(node);
+        }
+        m_distance_grid[node] = UNDISCOVERED;
+    }
 }
 
 inline bool BFS_3D::isWall(int node) const
@@ -41,6 +41,7 @@
 #include <visualization_msgs/MarkerArray.h>
 
 // project includes
+#include <smpl/flat_path.h>
 #include <smpl/types.h>
 
 namespace sbpl {
@@ -98,6 +99,46 @@ public:
         const RobotState& finish,
         std::vector<RobotState>& path) = 0;
 
+    /// \brief Append the valid prefix of the interpolated path between two
+    ///     joint states to a path.
+    ///
+    /// The waypoints following the start state, up to and including the finish
+    /// state, are interpolated as by interpolatePath and appended to the path,
+    /// checking each waypoint as it is produced. The start state is checked
+    /// but not appended. Interpolation stops at the first invalid waypoint,
+    /// in which case none of the waypoints are left in the path and valid is
+    /// set to false. The default implementation checks
+    /// the result of interpolatePath with isStateValid.
+    ///
+    /// \param[in] start The start configuration of the joint group
+    /// \param[in] finish The end configuration of the joint group
+    /// \param[in,out] path The path to append interpolated waypoints to
+    /// \param[out] valid Whether all interpolated waypoints are valid
+    /// \return Whether a linearly interpolated path could be constructed
+    virtual bool appendInterpolatedPath(
+        const RobotState& start,
+        const RobotState& finish,
+        FlatPath& path,
+        bool& valid);
+
+    /// \name Environment Changes
+    ///@{
+
+    /// \brief Return whether the validity of the interpolated path between two
+    ///     states may have been changed by modifications to the environment
+    ///     since the last call to clearEnvironmentChanges().
+    ///
+    /// The test may be conservative, but must never return false for a motion
+    /// whose validity has changed. The default implementation reports every
+    /// motion as affected.
+    virtual bool isStateToStateAffected(
+        const RobotState& start,
+        const RobotState& finish);
+
+    /// \brief Forget all modifications made to the environment so far.
+    virtual void clearEnvironmentChanges();
+    ///@}
+
     /// \name Visualization
     ///@{
     virtual visualization_msgs::MarkerArray getCollisionModelVisualization(
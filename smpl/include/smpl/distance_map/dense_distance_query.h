@@ -0,0 +1,171 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#ifndef SMPL_DENSE_DISTANCE_QUERY_H
+#define SMPL_DENSE_DISTANCE_QUERY_H
+
+// standard includes
+#include <cstdint>
+
+namespace sbpl {
+
+template <typename Derived>
+class DistanceMap;
+
+/// A lightweight, non-virtual handle for querying the distances stored by a
+/// DistanceMap. All queries are inline reads from the map's distance storage,
+/// so a handle obtained once may be used in place of the virtual lookups of
+/// DistanceMapInterface in performance-critical loops. Query results are
+/// identical to those of the map.
+///
+/// A handle remains valid for the lifetime of the map it was obtained from,
+/// and reflects subsequent modifications to the map.
+class DenseDistanceQuery
+{
+public:
+
+    /// The distances of a DistanceMap are stored in bricks of
+    /// (1 << BRICK_SHIFT)^3 cells.
+    static const int BRICK_SHIFT = 3;
+    static const int BRICK_MASK = (1 << BRICK_SHIFT) - 1;
+
+    /// Return the index into bricked distance storage, with the given number
+    /// of bricks along y and z, of the cell at (x, y, z).
+    static int BrickIndex(
+        int x, int y, int z,
+        int brick_count_y, int brick_count_z)
+    {
+        const int brick =
+                ((x >> BRICK_SHIFT) * brick_count_y + (y >> BRICK_SHIFT)) *
+                        brick_count_z +
+                (z >> BRICK_SHIFT);
+        return (brick << (3 * BRICK_SHIFT)) |
+                ((x & BRICK_MASK) << (2 * BRICK_SHIFT)) |
+                ((y & BRICK_MASK) << BRICK_SHIFT) |
+                (z & BRICK_MASK);
+    }
+
+    DenseDistanceQuery() :
+        m_dist(nullptr),
+        m_sqrt_table(nullptr),
+        m_num_cells_x(0),
+        m_num_cells_y(0),
+        m_num_cells_z(0),
+        m_brick_count_y(0),
+        m_brick_count_z(0),
+        m_origin_x(0.0),
+        m_origin_y(0.0),
+        m_origin_z(0.0),
+        m_inv_res(0.0),
+        m_sqrd_res(0.0)
+    { }
+
+    bool isCellValid(int x, int y, int z) const
+    {
+        // the unsigned comparisons also reject negative coordinates
+        return ((unsigned)x < (unsigned)m_num_cells_x) &
+                ((unsigned)y < (unsigned)m_num_cells_y) &
+                ((unsigned)z < (unsigned)m_num_cells_z);
+    }
+
+    void worldToGrid(
+        double world_x, double world_y, double world_z,
+        int& x, int& y, int& z) const
+    {
+        x = (int)(m_inv_res * (world_x - m_origin_x) + 0.5) - 1;
+        y = (int)(m_inv_res * (world_y - m_origin_y) + 0.5) - 1;
+        z = (int)(m_inv_res * (world_z - m_origin_z) + 0.5) - 1;
+    }
+
+    double getCellDistance(int x, int y, int z) const
+    {
+        if (!isCellValid(x, y, z)) {
+            return 0.0;
+        }
+        return m_sqrt_table[m_dist[index(x, y, z)]];
+    }
+
+    double getCellSquaredDistance(int x, int y, int z) const
+    {
+        if (!isCellValid(x, y, z)) {
+            return 0.0;
+        }
+        return m_sqrd_res * m_dist[index(x, y, z)];
+    }
+
+    double getMetricDistance(double x, double y, double z) const
+    {
+        int gx, gy, gz;
+        worldToGrid(x, y, z, gx, gy, gz);
+        return getCellDistance(gx, gy, gz);
+    }
+
+    double getMetricSquaredDistance(double x, double y, double z) const
+    {
+        int gx, gy, gz;
+        worldToGrid(x, y, z, gx, gy, gz);
+        return getCellSquaredDistance(gx, gy, gz);
+    }
+
+private:
+
+    template <typename Derived>
+    friend class DistanceMap;
+
+    // squared cell distances, in bricked order, including the border cells
+    const std::uint16_t* m_dist;
+
+    // metric distances indexed by squared cell distance
+    const double* m_sqrt_table;
+
+    int m_num_cells_x;
+    int m_num_cells_y;
+    int m_num_cells_z;
+    int m_brick_count_y;
+    int m_brick_count_z;
+
+    // origin of the border cells, from which grid coordinates are offset
+    double m_origin_x;
+    double m_origin_y;
+    double m_origin_z;
+    double m_inv_res;
+    double m_sqrd_res;
+
+    int index(int x, int y, int z) const
+    {
+        return BrickIndex(
+                x + 1, y + 1, z + 1, m_brick_count_y, m_brick_count_z);
+    }
+};
+
+} // namespace sbpl
+
+#endif
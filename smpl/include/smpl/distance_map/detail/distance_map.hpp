@@ -35,41 +35,21 @@
 #include "../distance_map.h"
 
 // standard includes
+#include <assert.h>
 #include <cmath>
+#include <cstring>
 #include <algorithm>
-#include <set>
+#include <functional>
+#include <memory>
+#include <stdexcept>
 
-namespace sbpl {
+// system includes
+#include <ros/console.h>
 
-#define VECTOR_BUCKET_LIST_INSERT(o, key) \
-{\
-    o->pos = m_open[key].size();\
-    m_open[key].push_back(o);\
-    o->bucket = key;\
-}
+// project includes
+#include <smpl/thread_pool.h>
 
-#define VECTOR_BUCKET_LIST_UPDATE(o, key) \
-{\
-    m_open[o->bucket][o->pos] = m_open[o->bucket].back();\
-\
-    m_open[o->bucket][o->pos]->pos = o->pos;\
-    m_open[o->bucket].pop_back();\
-\
-    o->pos = m_open[key].size();\
-    m_open[key].push_back(o);\
-    o->bucket = key;\
-}
-
-#define VECTOR_BUCKET_LIST_POP(s, b) \
-{\
-    s = m_open[b].back();\
-    m_open[b].pop_back();\
-    s->bucket = -1;\
-}
-
-#define BUCKET_INSERT(o, key) do { VECTOR_BUCKET_LIST_INSERT(o, key) } while (0)
-#define BUCKET_UPDATE(o, key) do { VECTOR_BUCKET_LIST_UPDATE(o, key) } while (0)
-#define BUCKET_POP(s, bucket) do { VECTOR_BUCKET_LIST_POP(s, bucket) } while (0)
+namespace sbpl {
 
 /// \class DistanceMap
 ///
@@ -92,6 +72,37 @@ namespace sbpl {
 /// usually worth the additional overhead to maintain the priority queue
 /// correctly in this domain.
 ///
+/// The distance values returned by queries are stored separately from the
+/// state required to propagate distance updates, as an array of 16-bit squared
+/// cell distances arranged in 8x8x8 bricks. The propagation state, 12 bytes per
+/// cell, is allocated on construction and kept between modifications, so that
+/// changes may be propagated incrementally. It may be released via
+/// discardPropagationState() once the map is no longer expected to change,
+/// leaving only the queryable distances, 2 bytes per cell, and an obstacle
+/// bitmap; it is rebuilt from the obstacle bitmap on the next modification.
+/// Maps loaded from a cache start without it. Maps that are modified rarely
+/// may instead release it after every modification, trading the cost of
+/// rebuilding it for memory, via setRetainPropagationState(false).
+///
+/// Since squared cell distances are stored in 16 bits, distances are
+/// propagated at most MAX_DIST_CELLS (255) cells from each obstacle; a larger
+/// maximum distance is clamped, with a warning, and maxDistance() reports the
+/// clamped value. The map may be at most 32765 cells along each axis, and
+/// construction of a larger map throws std::length_error.
+///
+/// If the derived class computes squared Euclidean distances to the nearest
+/// obstacle cell, and declares so by implementing
+///
+///     bool isEuclidean() const { return true; }
+///
+/// then large batches of changes, along with the initial computation, are
+/// handled by recomputing the distances of all cells with an exact separable
+/// distance transform (Felzenszwalb and Huttenlocher, "Distance Transforms of
+/// Sampled Functions", 2012) instead of propagating the changes cell by cell.
+/// The transform is computed over slabs of the grid in parallel when more than
+/// one thread is requested via setNumThreads(). Its results are identical to
+/// those of the propagation, so the choice only affects performance.
+///
 /// The base class DistanceMapBase completes implements functionality
 /// independent of the distance function that is used to update cells. It is
 /// not intended to be used directly. DistanceMap implements functionality that
@@ -101,12 +112,22 @@ namespace sbpl {
 /// function used to compute the distance updates from neighboring cells by
 /// implementing a member function with the following signature:
 ///
-///     int distance(const Cell& s, const Cell& n);
+///     int distance(const Cell& s, int dx, int dy, int dz);
 ///
-/// that returns the new distance for cell s, being updated from adjacent cell
-/// n. If the distance function is made private (and it likely should be, since
-/// the Cell struct is private to DistanceMapBase), the derived class must
-/// declare DistanceMap as a friend.
+/// that returns the new distance for the cell at offset (dx, dy, dz) from cell
+/// s, being updated from s. The nearest obstacle of s is located at offset
+/// (s.obs_x, s.obs_y, s.obs_z) from s. If the distance function is made
+/// private (and it likely should be, since the Cell struct is private to
+/// DistanceMap), the derived class must declare DistanceMap as a friend.
+
+template <typename Derived>
+const int DistanceMap<Derived>::MAX_DIST_CELLS;
+
+template <typename Derived>
+const std::int16_t DistanceMap<Derived>::NO_OBSTACLE;
+
+template <typename Derived>
+const std::uint32_t DistanceMap<Derived>::FILE_VERSION;
 
 template <typename Derived>
 DistanceMap<Derived>::DistanceMap(
@@ -119,10 +140,21 @@ DistanceMap<Derived>::DistanceMap(
         origin_x, origin_y, origin_z,
         size_x, size_y, size_z,
         resolution),
+    m_cell_count_x(0),
+    m_cell_count_y(0),
+    m_cell_count_z(0),
+    m_stride_x(0),
+    m_stride_y(0),
+    m_brick_count_y(0),
+    m_brick_count_z(0),
+    m_dist(),
+    m_mapped_file(),
+    m_mapped_dist(nullptr),
+    m_obstacles(),
     m_cells(),
-    m_max_dist(max_dist),
+    m_max_dist(std::min(max_dist, (double)MAX_DIST_CELLS * resolution)),
     m_inv_res(1.0 / resolution),
-    m_dmax_int((int)std::ceil(m_max_dist * m_inv_res)),
+    m_dmax_int(std::min((int)std::ceil(m_max_dist * m_inv_res), (int)MAX_DIST_CELLS)),
     m_dmax_sqrd_int(m_dmax_int * m_dmax_int),
     m_bucket(m_dmax_sqrd_int + 1),
     m_no_update_dir(dirnum(0, 0, 0)),
@@ -132,13 +164,36 @@ DistanceMap<Derived>::DistanceMap(
     m_neighbor_offsets(),
     m_neighbor_dirs(),
     m_open(),
-    m_rem_stack()
+    m_rem_stack(),
+    m_retain_propagation_state(true),
+    m_num_threads(1),
+    m_pool()
 {
-    int cell_count_x = (int)(size_x * m_inv_res + 0.5) + 2;
-    int cell_count_y = (int)(size_y * m_inv_res + 0.5) + 2;
-    int cell_count_z = (int)(size_z * m_inv_res + 0.5) + 2;
+    if (max_dist > m_max_dist) {
+        ROS_WARN("Clamping maximum distance of distance map from %0.3f to %0.3f (%d cells)", max_dist, m_max_dist, MAX_DIST_CELLS);
+    }
 
-    m_open.resize(m_dmax_sqrd_int + 1);
+    m_cell_count_x = (int)(size_x * m_inv_res + 0.5) + 2;
+    m_cell_count_y = (int)(size_y * m_inv_res + 0.5) + 2;
+    m_cell_count_z = (int)(size_z * m_inv_res + 0.5) + 2;
+
+    // obstacle offsets must be representable by the fields of Cell
+    if (m_cell_count_x > INT16_MAX ||
+        m_cell_count_y > INT16_MAX ||
+        m_cell_count_z > INT16_MAX)
+    {
+        ROS_ERROR("Distance map of %d x %d x %d cells exceeds the maximum of %d cells along each axis", m_cell_count_x - 2, m_cell_count_y - 2, m_cell_count_z - 2, INT16_MAX - 2);
+        throw std::length_error("DistanceMap size exceeds the maximum number of cells along an axis");
+    }
+
+    m_stride_y = m_cell_count_z;
+    m_stride_x = m_cell_count_y * m_cell_count_z;
+
+    m_brick_count_y = (m_cell_count_y + BRICK_MASK) >> BRICK_SHIFT;
+    m_brick_count_z = (m_cell_count_z + BRICK_MASK) >> BRICK_SHIFT;
+    m_dist.resize(brickedCellCount());
+
+    m_obstacles.assign((size_t)m_cell_count_x * m_stride_x, false);
 
     // precompute table of sqrts for relevant distance values
     m_sqrt_table.resize(m_dmax_sqrd_int + 1, 0.0);
@@ -152,8 +207,8 @@ DistanceMap<Derived>::DistanceMap(
     for (size_t i = 0; i < m_indices.size(); ++i) {
         const Eigen::Vector3i& neighbor = m_neighbors[m_indices[i]];
         m_neighbor_offsets[i] = 0;
-        m_neighbor_offsets[i] += neighbor.x() * cell_count_z * cell_count_y;
-        m_neighbor_offsets[i] += neighbor.y() * cell_count_z;
+        m_neighbor_offsets[i] += neighbor.x() * m_stride_x;
+        m_neighbor_offsets[i] += neighbor.y() * m_stride_y;
         m_neighbor_offsets[i] += neighbor.z() * 1;
 
         if (i < NON_BORDER_NEIGHBOR_LIST_SIZE) {
@@ -163,25 +218,11 @@ DistanceMap<Derived>::DistanceMap(
         }
     }
 
-    // initialize non-border free cells
-    m_cells.resize(cell_count_x, cell_count_y, cell_count_z);
-    for (int x = 1; x < m_cells.xsize() - 1; ++x) {
-    for (int y = 1; y < m_cells.ysize() - 1; ++y) {
-    for (int z = 1; z < m_cells.zsize() - 1; ++z) {
-        Cell& c = m_cells(x, y, z);
-        resetCell(c);
-        c.x = x;
-        c.y = y;
-        c.z = z;
-    }
-    }
-    }
-
-    initBorderCells();
-    propagateBorder();
+    initPropagationState();
 }
 
-/// Return the distance value for an invalid cell.
+/// Return the distance value for an invalid cell. This is the maximum distance
+/// given on construction, clamped to MAX_DIST_CELLS (255) cells.
 template <typename Derived>
 double DistanceMap<Derived>::maxDistance() const
 {
@@ -192,10 +233,11 @@ double DistanceMap<Derived>::maxDistance() const
 /// also consider the distance to the nearest border cell. A value of 0.0 is
 /// returned for obstacle cells and cells outside of the bounding volume.
 template <typename Derived>
+inline
 double DistanceMap<Derived>::getDistance(double x, double y, double z) const
 {
     int gx, gy, gz;
-    worldToGrid(x, y, z, gx, gy, gz);
+    DistanceMap::worldToGrid(x, y, z, gx, gy, gz);
     return getDistance(gx, gy, gz);
 }
 
@@ -203,14 +245,225 @@ double DistanceMap<Derived>::getDistance(double x, double y, double z) const
 /// will also consider the distance to the nearest border cell. A value of 0.0
 /// is returned for obstacle cells and cells outside of the bounding volume.
 template <typename Derived>
+inline
 double DistanceMap<Derived>::getDistance(int x, int y, int z) const
 {
-    if (!isCellValid(x, y, z)) {
+    if (!DistanceMap::isCellValid(x, y, z)) {
         return 0.0;
     }
+    return m_sqrt_table[distData()[brickIndex(x + 1, y + 1, z + 1)]];
+}
+
+/// Return a non-virtual handle for querying the distances stored in this map.
+/// The handle remains valid for the lifetime of this map, except that it is
+/// invalidated by load() and, after a successful load(), by the next
+/// modification of the map.
+template <typename Derived>
+DenseDistanceQuery DistanceMap<Derived>::denseQuery() const
+{
+    DenseDistanceQuery q;
+    q.m_dist = distData();
+    q.m_sqrt_table = m_sqrt_table.data();
+    q.m_num_cells_x = m_cell_count_x - 2;
+    q.m_num_cells_y = m_cell_count_y - 2;
+    q.m_num_cells_z = m_cell_count_z - 2;
+    q.m_brick_count_y = m_brick_count_y;
+    q.m_brick_count_z = m_brick_count_z;
+    q.m_origin_x = m_origin_x - m_res;
+    q.m_origin_y = m_origin_y - m_res;
+    q.m_origin_z = m_origin_z - m_res;
+    q.m_inv_res = m_inv_res;
+    q.m_sqrd_res = m_res * m_res;
+    return q;
+}
+
+/// Release the state used to propagate distance updates, leaving only the
+/// storage required to answer distance queries. The propagation state is
+/// rebuilt, from the current set of obstacle cells, by the next call to any of
+/// the modifiers.
+template <typename Derived>
+void DistanceMap<Derived>::discardPropagationState()
+{
+    m_cells.clear();
+    bucket_list().swap(m_open);
+    std::vector<Cell*>().swap(m_rem_stack);
+}
+
+/// Return whether the state used to propagate distance updates is currently
+/// allocated.
+template <typename Derived>
+bool DistanceMap<Derived>::hasPropagationState() const
+{
+    return m_cells.size() != 0;
+}
+
+/// Set whether the state used to propagate distance updates is kept between
+/// modifications, which is the default. If not, it is released now and after
+/// each modification, and rebuilt from the obstacle bitmap, by recomputing
+/// the distances of all cells, at the start of the next one.
+template <typename Derived>
+void DistanceMap<Derived>::setRetainPropagationState(bool retain)
+{
+    m_retain_propagation_state = retain;
+    if (!retain) {
+        discardPropagationState();
+    }
+}
 
-    int d2 = m_cells(x + 1, y + 1, z + 1).dist;
-    return m_sqrt_table[d2];
+/// Set the number of threads used to compute the exact distance transform for
+/// large batches of changes. Incremental updates are always computed by a
+/// single thread.
+template <typename Derived>
+void DistanceMap<Derived>::setNumThreads(int num_threads)
+{
+    m_num_threads = std::max(num_threads, 1);
+    if (m_num_threads > 1) {
+        m_pool.pool.reset(new ThreadPool(m_num_threads - 1));
+    } else {
+        m_pool.pool.reset();
+    }
+}
+
+template <typename Derived>
+DistanceMap<Derived>::TransformPool::TransformPool(const TransformPool& o) :
+    pool(o.pool ? new ThreadPool(o.pool->workerCount() - 1) : nullptr)
+{
+}
+
+template <typename Derived>
+typename DistanceMap<Derived>::TransformPool&
+DistanceMap<Derived>::TransformPool::operator=(const TransformPool& o)
+{
+    if (this != &o) {
+        pool.reset(o.pool ? new ThreadPool(o.pool->workerCount() - 1) : nullptr);
+    }
+    return *this;
+}
+
+/// Write the distances and obstacle cells of this map to a stream, as a
+/// section of a cache file that may later be mapped by load(). The section is
+/// padded to a multiple of 64 bytes, and should begin at a 64-byte aligned
+/// offset into the file.
+template <typename Derived>
+bool DistanceMap<Derived>::save(std::ostream& os) const
+{
+    auto align = [](std::uint64_t offset) { return (offset + 63) & ~(std::uint64_t)63; };
+
+    const size_t dist_count = brickedCellCount();
+    const size_t obstacle_bytes = (m_obstacles.size() + 7) / 8;
+
+    FileHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, "SMPLDMAP", sizeof(h.magic));
+    h.version = FILE_VERSION;
+    h.header_size = sizeof(FileHeader);
+    h.cell_count_x = m_cell_count_x;
+    h.cell_count_y = m_cell_count_y;
+    h.cell_count_z = m_cell_count_z;
+    h.dmax_int = m_dmax_int;
+    h.origin_x = m_origin_x;
+    h.origin_y = m_origin_y;
+    h.origin_z = m_origin_z;
+    h.resolution = m_res;
+    h.dist_offset = align(sizeof(FileHeader));
+    h.dist_count = dist_count;
+    h.obstacle_offset = align(h.dist_offset + dist_count * sizeof(std::uint16_t));
+    h.obstacle_count = m_obstacles.size();
+    h.size = align(h.obstacle_offset + obstacle_bytes);
+
+    std::vector<char> obstacle_bits(obstacle_bytes, 0);
+    for (size_t i = 0; i < m_obstacles.size(); ++i) {
+        if (m_obstacles[i]) {
+            obstacle_bits[i >> 3] |= (char)(1 << (i & 7));
+        }
+    }
+
+    std::uint64_t pos = 0;
+    auto pad_to = [&](std::uint64_t offset) {
+        static const char zeros[64] = { 0 };
+        os.write(zeros, offset - pos);
+        pos = offset;
+    };
+
+    os.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    pos += sizeof(h);
+    pad_to(h.dist_offset);
+    os.write(
+            reinterpret_cast<const char*>(distData()),
+            dist_count * sizeof(std::uint16_t));
+    pos += dist_count * sizeof(std::uint16_t);
+    pad_to(h.obstacle_offset);
+    os.write(obstacle_bits.data(), obstacle_bits.size());
+    pos += obstacle_bits.size();
+    pad_to(h.size);
+
+    return (bool)os;
+}
+
+/// Replace the contents of this map with a section, written by save(), of a
+/// mapped file. The section must have been saved from a map with the same
+/// dimensions, resolution, and maximum distance. The distances are read
+/// directly from the mapping until the map is next modified, at which point
+/// the propagation state is rebuilt from the obstacle cells. On success, \p
+/// size is set to the size of the section.
+template <typename Derived>
+bool DistanceMap<Derived>::load(
+    const std::shared_ptr<const MappedFile>& file,
+    size_t offset,
+    size_t& size)
+{
+    if (!file || offset + sizeof(FileHeader) > file->size()) {
+        return false;
+    }
+
+    const char* base = file->data() + offset;
+
+    FileHeader h;
+    std::memcpy(&h, base, sizeof(h));
+    if (std::memcmp(h.magic, "SMPLDMAP", sizeof(h.magic)) != 0 ||
+        h.version != FILE_VERSION ||
+        h.header_size != sizeof(FileHeader))
+    {
+        return false;
+    }
+
+    if (h.cell_count_x != m_cell_count_x ||
+        h.cell_count_y != m_cell_count_y ||
+        h.cell_count_z != m_cell_count_z ||
+        h.dmax_int != m_dmax_int ||
+        h.origin_x != m_origin_x ||
+        h.origin_y != m_origin_y ||
+        h.origin_z != m_origin_z ||
+        h.resolution != m_res)
+    {
+        return false;
+    }
+
+    const size_t dist_count = brickedCellCount();
+    const size_t obstacle_bytes = (m_obstacles.size() + 7) / 8;
+    if (h.dist_count != dist_count ||
+        h.obstacle_count != m_obstacles.size() ||
+        h.size > file->size() - offset ||
+        h.dist_offset + dist_count * sizeof(std::uint16_t) > h.size ||
+        h.obstacle_offset + obstacle_bytes > h.size ||
+        (std::uintptr_t)(base + h.dist_offset) % alignof(std::uint16_t) != 0)
+    {
+        return false;
+    }
+
+    const unsigned char* obstacle_bits =
+            reinterpret_cast<const unsigned char*>(base + h.obstacle_offset);
+    for (size_t i = 0; i < m_obstacles.size(); ++i) {
+        m_obstacles[i] = (obstacle_bits[i >> 3] >> (i & 7)) & 1;
+    }
+
+    discardPropagationState();
+    std::vector<std::uint16_t>().swap(m_dist);
+    m_mapped_file = file;
+    m_mapped_dist = reinterpret_cast<const std::uint16_t*>(base + h.dist_offset);
+
+    size = h.size;
+    return true;
 }
 
 /// Add a set of obstacle points to the distance map and update the distance
@@ -220,6 +473,10 @@ template <typename Derived>
 void DistanceMap<Derived>::addPointsToMap(
     const std::vector<Eigen::Vector3d>& points)
 {
+    ensurePropagationState();
+
+    const bool bulk = useBulkTransform(points.size());
+
     for (const Eigen::Vector3d& p : points) {
         int gx, gy, gz;
         worldToGrid(p.x(), p.y(), p.z(), gx, gy, gz);
@@ -233,12 +490,20 @@ void DistanceMap<Derived>::addPointsToMap(
         if (c.dist_new > 0) {
             c.dir = m_no_update_dir;
             c.dist_new = 0;
-            c.obs = &c;
-            updateVertex(&c);
+            setObstacle(c);
+            if (!bulk) {
+                updateVertex(&c);
+            }
         }
     }
 
-    propagate();
+    if (bulk) {
+        computeTransform();
+    } else {
+        propagate();
+    }
+
+    finishModification();
 }
 
 /// Remove a set of obstacle points from the distance map and update the
@@ -248,6 +513,24 @@ template <typename Derived>
 void DistanceMap<Derived>::removePointsFromMap(
     const std::vector<Eigen::Vector3d>& points)
 {
+    ensurePropagationState();
+
+    if (useBulkTransform(points.size())) {
+        for (const Eigen::Vector3d& p : points) {
+            int gx, gy, gz;
+            worldToGrid(p.x(), p.y(), p.z(), gx, gy, gz);
+            if (isCellValid(gx, gy, gz)) {
+                Cell& c = m_cells(gx + 1, gy + 1, gz + 1);
+                if (isObstacle(c)) {
+                    clearObstacle(c);
+                }
+            }
+        }
+        computeTransform();
+        finishModification();
+        return;
+    }
+
     for (const Eigen::Vector3d& p : points) {
         int gx, gy, gz;
         worldToGrid(p.x(), p.y(), p.z(), gx, gy, gz);
@@ -259,19 +542,20 @@ void DistanceMap<Derived>::removePointsFromMap(
 
         Cell& c = m_cells(gx, gy, gz);
 
-        if (c.obs != &c) {
+        if (!isObstacle(c)) {
             continue;
         }
 
         c.dist_new = m_dmax_sqrd_int;
-        c.obs = nullptr;
+        clearObstacle(c);
 
-        c.dist = m_dmax_sqrd_int;
+        setDist(&c, m_dmax_sqrd_int);
         c.dir = m_no_update_dir;
         m_rem_stack.push_back(&c);
     }
 
     propagateRemovals();
+    finishModification();
 }
 
 /// Add the set (new_points - old_points) of obstacle cells and remove the set
@@ -282,109 +566,124 @@ void DistanceMap<Derived>::updatePointsInMap(
     const std::vector<Eigen::Vector3d>& old_points,
     const std::vector<Eigen::Vector3d>& new_points)
 {
-    std::set<Eigen::Vector3i, Eigen_Vector3i_compare> old_point_set;
-    for (const Eigen::Vector3d& wp : old_points) {
-        Eigen::Vector3i gp;
-        worldToGrid(wp.x(), wp.y(), wp.z(), gp.x(), gp.y(), gp.z());
-        if (isCellValid(gp.x(), gp.y(), gp.z())) {
-            ++gp.x(); ++gp.y(); ++gp.z();
-            old_point_set.insert(gp);
+    ensurePropagationState();
+
+    // gather the indices of the cells containing the old and new points;
+    // cell indices are ordered lexicographically by cell coordinates
+    auto to_cell_indices = [&](
+        const std::vector<Eigen::Vector3d>& points,
+        std::vector<int>& indices)
+    {
+        indices.reserve(points.size());
+        for (const Eigen::Vector3d& wp : points) {
+            int gx, gy, gz;
+            worldToGrid(wp.x(), wp.y(), wp.z(), gx, gy, gz);
+            if (isCellValid(gx, gy, gz)) {
+                indices.push_back(
+                        (gx + 1) * m_stride_x + (gy + 1) * m_stride_y + gz + 1);
+            }
         }
-    }
+        std::sort(indices.begin(), indices.end());
+        indices.erase(
+                std::unique(indices.begin(), indices.end()), indices.end());
+    };
 
-    std::set<Eigen::Vector3i, Eigen_Vector3i_compare> new_point_set;
-    for (const Eigen::Vector3d& wp : new_points) {
-        Eigen::Vector3i gp;
-        worldToGrid(wp.x(), wp.y(), wp.z(), gp.x(), gp.y(), gp.z());
-        if (isCellValid(gp.x(), gp.y(), gp.z())) {
-            ++gp.x(); ++gp.y(); ++gp.z();
-            new_point_set.insert(gp);
-        }
-    }
+    std::vector<int> old_indices;
+    to_cell_indices(old_points, old_indices);
 
-    Eigen_Vector3i_compare comp;
+    std::vector<int> new_indices;
+    to_cell_indices(new_points, new_indices);
 
-    std::vector<Eigen::Vector3i> old_not_new;
+    std::vector<int> old_not_new;
     std::set_difference(
-            old_point_set.begin(), old_point_set.end(),
-            new_point_set.begin(), new_point_set.end(),
-            std::inserter(old_not_new, old_not_new.end()),
-            comp);
+            old_indices.begin(), old_indices.end(),
+            new_indices.begin(), new_indices.end(),
+            std::back_inserter(old_not_new));
 
-    std::vector<Eigen::Vector3i> new_not_old;
+    std::vector<int> new_not_old;
     std::set_difference(
-            new_point_set.begin(), new_point_set.end(),
-            old_point_set.begin(), old_point_set.end(),
-            std::inserter(new_not_old, new_not_old.end()),
-            comp);
+            new_indices.begin(), new_indices.end(),
+            old_indices.begin(), old_indices.end(),
+            std::back_inserter(new_not_old));
+
+    if (useBulkTransform(old_not_new.size() + new_not_old.size())) {
+        for (int i : old_not_new) {
+            Cell& c = m_cells[i];
+            if (isObstacle(c)) {
+                clearObstacle(c);
+            }
+        }
+        for (int i : new_not_old) {
+            Cell& c = m_cells[i];
+            if (c.dist_new != 0) {
+                c.dist_new = 0;
+                setObstacle(c);
+            }
+        }
+        computeTransform();
+        finishModification();
+        return;
+    }
 
     // remove obstacle cells that were in the old cloud but not the new cloud
-    for (const Eigen::Vector3i& p : old_not_new) {
-        Cell& c = m_cells(p.x(), p.y(), p.z());
-        if (c.obs != &c) {
+    for (int i : old_not_new) {
+        Cell& c = m_cells[i];
+        if (!isObstacle(c)) {
             continue; // skip already-free cells
         }
         c.dir = m_no_update_dir;
         c.dist_new = m_dmax_sqrd_int;
-        c.dist = m_dmax_sqrd_int;
-        c.obs = nullptr;
+        setDist(&c, m_dmax_sqrd_int);
+        clearObstacle(c);
         m_rem_stack.push_back(&c);
     }
 
     propagateRemovals();
 
     // add obstacle cells that are in the new cloud but not the old cloud
-    for (const Eigen::Vector3i& p : new_not_old) {
-        Cell& c = m_cells(p.x(), p.y(), p.z());
+    for (int i : new_not_old) {
+        Cell& c = m_cells[i];
         if (c.dist_new == 0) {
             continue; // skip already-obstacle cells
         }
         c.dir = m_no_update_dir;
         c.dist_new = 0;
-        c.obs = &c;
+        setObstacle(c);
         updateVertex(&c);
     }
 
     propagate();
+    finishModification();
 }
 
 /// Reset all points in the distance map to their uninitialized (free) values.
 template <typename Derived>
 void DistanceMap<Derived>::reset()
 {
-    for (size_t x = 1; x < m_cells.xsize() - 1; ++x) {
-    for (size_t y = 1; y < m_cells.ysize() - 1; ++y) {
-    for (size_t z = 1; z < m_cells.zsize() - 1; ++z) {
-        Cell& c = m_cells(x, y, z);
-        resetCell(c);
-    }
-    }
-    }
-
-    initBorderCells();
-
-    propagateBorder();
+    std::fill(m_obstacles.begin(), m_obstacles.end(), false);
+    initPropagationState();
+    finishModification();
 }
 
 /// Return the number of cells along the x axis.
 template <typename Derived>
 int DistanceMap<Derived>::numCellsX() const
 {
-    return m_cells.xsize() - 2;
+    return m_cell_count_x - 2;
 }
 
 /// Return the number of cells along the y axis.
 template <typename Derived>
 int DistanceMap<Derived>::numCellsY() const
 {
-    return m_cells.ysize() - 2;
+    return m_cell_count_y - 2;
 }
 
 /// Return the number of cells along the z axis.
 template <typename Derived>
 int DistanceMap<Derived>::numCellsZ() const
 {
-    return m_cells.zsize() - 2;
+    return m_cell_count_z - 2;
 }
 
 template <typename Derived>
@@ -405,6 +704,24 @@ double DistanceMap<Derived>::getCellDistance(int x, int y, int z) const
     return getDistance(x, y, z);
 }
 
+template <typename Derived>
+double DistanceMap<Derived>::getMetricSquaredDistance(
+    double x, double y, double z) const
+{
+    int gx, gy, gz;
+    DistanceMap::worldToGrid(x, y, z, gx, gy, gz);
+    return getCellSquaredDistance(gx, gy, gz);
+}
+
+template <typename Derived>
+double DistanceMap<Derived>::getCellSquaredDistance(int x, int y, int z) const
+{
+    if (!DistanceMap::isCellValid(x, y, z)) {
+        return 0.0;
+    }
+    return m_res * m_res * distData()[brickIndex(x + 1, y + 1, z + 1)];
+}
+
 /// Return the effective grid coordinates of the cell containing the given point
 /// specified in world coordinates.
 template <typename Derived>
@@ -420,6 +737,7 @@ void DistanceMap<Derived>::gridToWorld(
 /// Return the point in world coordinates marking the center of the cell at the
 /// given effective grid coordinates.
 template <typename Derived>
+inline
 void DistanceMap<Derived>::worldToGrid(
     double world_x, double world_y, double world_z,
     int& x, int& y, int& z) const
@@ -431,11 +749,150 @@ void DistanceMap<Derived>::worldToGrid(
 
 /// Test if a cell is outside the bounding volume.
 template <typename Derived>
+inline
 bool DistanceMap<Derived>::isCellValid(int x, int y, int z) const
 {
-    return x >= 0 && x < m_cells.xsize() - 2 &&
-        y >= 0 && y < m_cells.ysize() - 2 &&
-        z >= 0 && z < m_cells.zsize() - 2;
+    // the unsigned comparisons also reject negative coordinates
+    return ((unsigned)x < (unsigned)(m_cell_count_x - 2)) &
+            ((unsigned)y < (unsigned)(m_cell_count_y - 2)) &
+            ((unsigned)z < (unsigned)(m_cell_count_z - 2));
+}
+
+/// Return the index into the bricked distance array of the cell at the given
+/// grid coordinates, including the border cells.
+template <typename Derived>
+inline
+int DistanceMap<Derived>::brickIndex(int x, int y, int z) const
+{
+    return DenseDistanceQuery::BrickIndex(
+            x, y, z, m_brick_count_y, m_brick_count_z);
+}
+
+template <typename Derived>
+int DistanceMap<Derived>::brickIndex(const Cell* c) const
+{
+    const int i = (int)(c - m_cells.data());
+    const int x = i / m_stride_x;
+    const int y = (i - x * m_stride_x) / m_stride_y;
+    const int z = i - x * m_stride_x - y * m_stride_y;
+    return brickIndex(x, y, z);
+}
+
+/// Return the number of entries in the bricked distance array, including the
+/// padding of partial bricks.
+template <typename Derived>
+size_t DistanceMap<Derived>::brickedCellCount() const
+{
+    const size_t brick_count_x = (m_cell_count_x + BRICK_MASK) >> BRICK_SHIFT;
+    return brick_count_x * m_brick_count_y * m_brick_count_z <<
+            (3 * BRICK_SHIFT);
+}
+
+template <typename Derived>
+inline
+const std::uint16_t* DistanceMap<Derived>::distData() const
+{
+    return m_mapped_dist ? m_mapped_dist : m_dist.data();
+}
+
+/// Set the distance of a cell, mirroring it into the queryable distances.
+template <typename Derived>
+void DistanceMap<Derived>::setDist(Cell* c, int d)
+{
+    c->dist = d;
+    m_dist[brickIndex(c)] = d;
+}
+
+template <typename Derived>
+bool DistanceMap<Derived>::isObstacle(const Cell& c) const
+{
+    return (c.obs_x | c.obs_y | c.obs_z) == 0;
+}
+
+template <typename Derived>
+void DistanceMap<Derived>::setObstacle(Cell& c)
+{
+    c.obs_x = c.obs_y = c.obs_z = 0;
+    m_obstacles[&c - m_cells.data()] = true;
+}
+
+template <typename Derived>
+void DistanceMap<Derived>::clearObstacle(Cell& c)
+{
+    c.obs_x = c.obs_y = c.obs_z = NO_OBSTACLE;
+    m_obstacles[&c - m_cells.data()] = false;
+}
+
+/// Test whether a cell's nearest obstacle is still an obstacle cell.
+template <typename Derived>
+bool DistanceMap<Derived>::hasValidObstacle(const Cell* c) const
+{
+    if (c->obs_x == NO_OBSTACLE) {
+        return false;
+    }
+    const Cell* o = c +
+            c->obs_x * m_stride_x + c->obs_y * m_stride_y + c->obs_z;
+    return isObstacle(*o);
+}
+
+/// Allocate the propagation state, if necessary, and recompute the distances
+/// of all cells from the border cells and the obstacle cells.
+template <typename Derived>
+void DistanceMap<Derived>::initPropagationState()
+{
+    // all distances are recomputed below, so mapped distances are dropped
+    // rather than copied
+    if (m_mapped_dist) {
+        m_mapped_dist = nullptr;
+        m_mapped_file.reset();
+        m_dist.resize(brickedCellCount());
+    }
+
+    m_cells.resize(m_cell_count_x, m_cell_count_y, m_cell_count_z);
+    m_open.resize(m_dmax_sqrd_int + 1);
+
+    if (static_cast<const Derived*>(this)->isEuclidean()) {
+        computeTransform();
+        return;
+    }
+
+    std::fill(m_dist.begin(), m_dist.end(), m_dmax_sqrd_int);
+
+    // initialize non-border cells
+    for (int x = 1; x < m_cell_count_x - 1; ++x) {
+    for (int y = 1; y < m_cell_count_y - 1; ++y) {
+    for (int z = 1; z < m_cell_count_z - 1; ++z) {
+        Cell& c = m_cells(x, y, z);
+        resetCell(c);
+        if (m_obstacles[&c - m_cells.data()]) {
+            c.dist_new = 0;
+            c.obs_x = c.obs_y = c.obs_z = 0;
+            updateVertex(&c);
+        }
+    }
+    }
+    }
+
+    initBorderCells();
+    propagateBorder();
+}
+
+template <typename Derived>
+void DistanceMap<Derived>::ensurePropagationState()
+{
+    if (!hasPropagationState()) {
+        initPropagationState();
+    }
+}
+
+/// Release the propagation state at the end of a modification, unless it is
+/// retained between modifications.
+template <typename Derived>
+void DistanceMap<Derived>::finishModification()
+{
+    if (!m_retain_propagation_state) {
+        discardPropagationState();
+    }
 }
 
 template <typename Derived>
@@ -443,65 +900,264 @@ void DistanceMap<Derived>::initBorderCells()
 {
     auto init_obs_cell = [&](int x, int y, int z) {
         Cell& c = m_cells(x, y, z);
-        c.x = x;
-        c.y = y;
-        c.z = z;
         c.dist = m_dmax_sqrd_int;
         c.dist_new = 0;
 #if SMPL_DMAP_RETURN_CHANGED_CELLS
         c.dist_old = m_dmax_sqrd_int;
 #endif
-        c.obs = &c;
-        c.bucket = -1;
+        c.obs_x = c.obs_y = c.obs_z = 0;
+        c.open = 0;
 
-        int src_dir_x = (x == 0) ? 1 : ((x == m_cells.xsize() - 1) ? -1 : 0);
-        int src_dir_y = (y == 0) ? 1 : ((y == m_cells.ysize() - 1) ? -1 : 0);
-        int src_dir_z = (z == 0) ? 1 : ((z == m_cells.zsize() - 1) ? -1 : 0);
-        c.dir = dirnum(src_dir_x, src_dir_y, src_dir_z, 1);
+        c.dir = borderDir(x, y, z);
         updateVertex(&c);
     };
 
     // initialize border cells
-    for (int y = 0; y < m_cells.ysize(); ++y) {
-    for (int z = 0; z < m_cells.zsize(); ++z) {
+    for (int y = 0; y < m_cell_count_y; ++y) {
+    for (int z = 0; z < m_cell_count_z; ++z) {
         init_obs_cell(0, y, z);
-        init_obs_cell(m_cells.xsize() - 1, y, z);
+        init_obs_cell(m_cell_count_x - 1, y, z);
     }
     }
-    for (int x = 1; x < m_cells.xsize() - 1; ++x) {
-    for (int z = 0; z < m_cells.zsize(); ++z) {
+    for (int x = 1; x < m_cell_count_x - 1; ++x) {
+    for (int z = 0; z < m_cell_count_z; ++z) {
         init_obs_cell(x, 0, z);
-        init_obs_cell(x, m_cells.ysize() - 1, z);
+        init_obs_cell(x, m_cell_count_y - 1, z);
     }
     }
-    for (int x = 1; x < m_cells.xsize() - 1; ++x) {
-    for (int y = 1; y < m_cells.ysize() - 1; ++y) {
+    for (int x = 1; x < m_cell_count_x - 1; ++x) {
+    for (int y = 1; y < m_cell_count_y - 1; ++y) {
         init_obs_cell(x, y, 0);
-        init_obs_cell(x, y, m_cells.zsize() - 1);
+        init_obs_cell(x, y, m_cell_count_z - 1);
     }
     }
 }
 
+/// Return the update direction of a border cell, pointing into the grid.
+template <typename Derived>
+int DistanceMap<Derived>::borderDir(int x, int y, int z) const
+{
+    int src_dir_x = (x == 0) ? 1 : ((x == m_cell_count_x - 1) ? -1 : 0);
+    int src_dir_y = (y == 0) ? 1 : ((y == m_cell_count_y - 1) ? -1 : 0);
+    int src_dir_z = (z == 0) ? 1 : ((z == m_cell_count_z - 1) ? -1 : 0);
+    return dirnum(src_dir_x, src_dir_y, src_dir_z, 1);
+}
+
+/// Test whether a batch of changes is large enough that recomputing the
+/// distances of all cells is expected to be cheaper than propagating the
+/// changes, which is the case when the cells within range of the changed cells
+/// may cover the entire grid.
+template <typename Derived>
+bool DistanceMap<Derived>::useBulkTransform(size_t change_count) const
+{
+    if (!static_cast<const Derived*>(this)->isEuclidean()) {
+        return false;
+    }
+    const size_t range = 2 * m_dmax_int + 1;
+    return change_count * range * range * range >= m_obstacles.size();
+}
+
+/// Recompute the distances, nearest obstacles, and update directions of all
+/// cells, including the border cells, from the obstacle bitmap. The squared
+/// distance transform is separable, and is computed by finding the lower
+/// envelope of parabolas along each line of cells, first along z, then y,
+/// then x. Each pass stores the nearest site found so far in the obstacle
+/// offset fields of each cell, as absolute coordinates, and the squared
+/// distance to it in dist_new. Lines along z and y are processed in parallel
+/// over x-slabs and lines along x in parallel over y-slabs.
+template <typename Derived>
+void DistanceMap<Derived>::computeTransform()
+{
+    ThreadPool* pool = m_pool.pool.get();
+
+    const int worker_count = pool ? pool->workerCount() : 1;
+    const int max_count = std::max(
+            m_cell_count_x, std::max(m_cell_count_y, m_cell_count_z));
+    std::vector<EnvelopeScratch> scratch(worker_count);
+    for (EnvelopeScratch& s : scratch) {
+        s.f.resize(max_count);
+        s.d.resize(max_count);
+        s.arg.resize(max_count);
+        s.feature_y.resize(max_count);
+        s.feature_z.resize(max_count);
+        s.v.resize(max_count);
+        s.boundary.resize(max_count + 1);
+    }
+
+    auto parallel_for = [&](int count, const ThreadPool::LoopBody& body) {
+        if (pool) {
+            pool->parallelFor(count, body);
+        } else {
+            for (int i = 0; i < count; ++i) {
+                body(i, 0);
+            }
+        }
+    };
+
+    const int cx = m_cell_count_x;
+    const int cy = m_cell_count_y;
+    const int cz = m_cell_count_z;
+
+    // transform along z, then y, within each x-slab
+    parallel_for(cx, [&](int x, int worker) {
+        EnvelopeScratch& s = scratch[worker];
+        const bool border_x = x == 0 || x == cx - 1;
+        for (int y = 0; y < cy; ++y) {
+            const bool border_xy = border_x || y == 0 || y == cy - 1;
+            Cell* line = &m_cells(x, y, 0);
+            const size_t first = (size_t)x * m_stride_x + y * m_stride_y;
+            for (int z = 0; z < cz; ++z) {
+                const bool obstacle = border_xy || z == 0 || z == cz - 1 ||
+                        m_obstacles[first + z];
+                s.f[z] = obstacle ? 0 : m_dmax_sqrd_int;
+            }
+            transformLine(cz, s);
+            for (int z = 0; z < cz; ++z) {
+                line[z].dist_new = s.d[z];
+                line[z].obs_y = y;
+                line[z].obs_z = s.arg[z];
+            }
+        }
+
+        for (int z = 0; z < cz; ++z) {
+            Cell* line = &m_cells(x, 0, z);
+            for (int y = 0; y < cy; ++y) {
+                const Cell& c = line[y * m_stride_y];
+                s.f[y] = c.dist_new;
+                s.feature_z[y] = c.obs_z;
+            }
+            transformLine(cy, s);
+            for (int y = 0; y < cy; ++y) {
+                Cell& c = line[y * m_stride_y];
+                c.dist_new = s.d[y];
+                c.obs_y = s.arg[y];
+                c.obs_z = s.feature_z[s.arg[y]];
+            }
+        }
+    });
+
+    // transform along x within each y-slab, and finalize each cell
+    parallel_for(cy, [&](int y, int worker) {
+        EnvelopeScratch& s = scratch[worker];
+        for (int z = 0; z < cz; ++z) {
+            Cell* line = &m_cells(0, y, z);
+            for (int x = 0; x < cx; ++x) {
+                const Cell& c = line[x * m_stride_x];
+                s.f[x] = c.dist_new;
+                s.feature_y[x] = c.obs_y;
+                s.feature_z[x] = c.obs_z;
+            }
+            transformLine(cx, s);
+            for (int x = 0; x < cx; ++x) {
+                Cell& c = line[x * m_stride_x];
+                const int d = s.d[x];
+                c.dist = d;
+                c.dist_new = d;
+#if SMPL_DMAP_RETURN_CHANGED_CELLS
+                c.dist_old = d;
+#endif
+                c.open = 0;
+                const bool border =
+                        x == 0 || x == cx - 1 ||
+                        y == 0 || y == cy - 1 ||
+                        z == 0 || z == cz - 1;
+                if (d >= m_dmax_sqrd_int) {
+                    c.obs_x = c.obs_y = c.obs_z = NO_OBSTACLE;
+                    c.dir = m_no_update_dir;
+                } else {
+                    c.obs_x = s.arg[x] - x;
+                    c.obs_y = s.feature_y[s.arg[x]] - y;
+                    c.obs_z = s.feature_z[s.arg[x]] - z;
+                    if (border) {
+                        c.dir = borderDir(x, y, z);
+                    } else if (d == 0) {
+                        c.dir = m_no_update_dir;
+                    } else {
+                        // as if propagated away from the nearest obstacle
+                        c.dir = dirnum(
+                                (c.obs_x < 0) - (c.obs_x > 0),
+                                (c.obs_y < 0) - (c.obs_y > 0),
+                                (c.obs_z < 0) - (c.obs_z > 0));
+                    }
+                }
+                m_dist[brickIndex(x, y, z)] = d;
+            }
+        }
+    });
+
+    m_bucket = (int)m_open.size();
+}
+
+/// Compute the lower envelope of the parabolas rooted at each site i of a line
+/// of n cells, with height scratch.f[i], storing the minimum squared distance
+/// of each cell in scratch.d and the site attaining it in scratch.arg. Sites
+/// with height at least the maximum squared distance are ignored, and squared
+/// distances are clamped to it.
+template <typename Derived>
+void DistanceMap<Derived>::transformLine(int n, EnvelopeScratch& s) const
+{
+    const int inf = m_dmax_sqrd_int;
+
+    int k = -1;
+    for (int q = 0; q < n; ++q) {
+        if (s.f[q] >= inf) {
+            continue;
+        }
+        double b = -HUGE_VAL;
+        while (k >= 0) {
+            const int p = s.v[k];
+            b = (double)((s.f[q] + q * q) - (s.f[p] + p * p)) / (2 * (q - p));
+            if (b > s.boundary[k]) {
+                break;
+            }
+            --k;
+        }
+        if (k < 0) {
+            b = -HUGE_VAL;
+        }
+        ++k;
+        s.v[k] = q;
+        s.boundary[k] = b;
+    }
+
+    if (k < 0) {
+        for (int q = 0; q < n; ++q) {
+            s.d[q] = inf;
+            s.arg[q] = q;
+        }
+        return;
+    }
+
+    int j = 0;
+    for (int q = 0; q < n; ++q) {
+        while (j < k && s.boundary[j + 1] < q) {
+            ++j;
+        }
+        const int p = s.v[j];
+        s.d[q] = std::min((q - p) * (q - p) + s.f[p], inf);
+        s.arg[q] = p;
+    }
+}
+
+/// Insert a cell into the bucket for its current key. Entries are not removed
+/// from their previous bucket when a cell's key changes; stale entries are
+/// instead skipped when they are popped.
 template <typename Derived>
 void DistanceMap<Derived>::updateVertex(Cell* o)
 {
     const int key = std::min(o->dist, o->dist_new);
     assert(key < m_open.size());
-    if (o->bucket >= 0) { // in heap
-        assert(o->bucket < m_open.size());
-        BUCKET_UPDATE(o, key);
-    } else { // not in the heap yet
-        BUCKET_INSERT(o, key);
-    }
+    m_open[key].push_back(o);
+    o->open = 1;
     if (key < m_bucket) {
         m_bucket = key;
     }
 }
 
 template <typename Derived>
-int DistanceMap<Derived>::distance(const Cell& n, const Cell& s)
+int DistanceMap<Derived>::distance(const Cell& s, int dx, int dy, int dz)
 {
-    return static_cast<Derived*>(this)->distance(n, s);
+    return static_cast<Derived*>(this)->distance(s, dx, dy, dz);
 }
 
 template <typename Derived>
@@ -511,12 +1167,15 @@ void DistanceMap<Derived>::lower(Cell* s)
     std::tie(nfirst, nlast) = m_neighbor_ranges[s->dir];
     for (int i = nfirst; i != nlast; ++i) {
         Cell* n = s + m_neighbor_offsets[i];
+        const Eigen::Vector3i& d = m_neighbors[m_indices[i]];
 //        if (n->dist_new > s->dist_new)
         {
-            int dp = distance(*n, *s);
+            int dp = distance(*s, d.x(), d.y(), d.z());
             if (dp < n->dist_new) {
                 n->dist_new = dp;
-                n->obs = s->obs;
+                n->obs_x = s->obs_x - d.x();
+                n->obs_y = s->obs_y - d.y();
+                n->obs_z = s->obs_z - d.z();
                 n->dir = m_neighbor_dirs[i];
                 updateVertex(n);
             }
@@ -539,30 +1198,37 @@ void DistanceMap<Derived>::raise(Cell* s)
 template <typename Derived>
 void DistanceMap<Derived>::waveout(Cell* n)
 {
-    if (n == n->obs) {
+    if (isObstacle(*n)) {
         return;
     }
 
     n->dist_new = m_dmax_sqrd_int;
-    Cell* obs_old = n->obs;
-    n->obs = nullptr;
+    const std::int16_t obs_old_x = n->obs_x;
+    const std::int16_t obs_old_y = n->obs_y;
+    const std::int16_t obs_old_z = n->obs_z;
+    n->obs_x = n->obs_y = n->obs_z = NO_OBSTACLE;
 
     int nfirst, nlast;
     std::tie(nfirst, nlast) = m_neighbor_ranges[m_no_update_dir];
     for (int i = nfirst; i != nlast; ++i) {
         Cell* a = n + m_neighbor_offsets[i];
-        auto valid = [](Cell* c) { return c && c->obs == c; };
-        if (valid(a->obs)) {
-            int dp = distance(*n, *a);
+        if (hasValidObstacle(a)) {
+            const Eigen::Vector3i& d = m_neighbors[m_indices[i]];
+            int dp = distance(*a, -d.x(), -d.y(), -d.z());
             if (dp < n->dist_new) {
                 n->dist_new = dp;
-                n->obs = a->obs;
+                n->obs_x = a->obs_x + d.x();
+                n->obs_y = a->obs_y + d.y();
+                n->obs_z = a->obs_z + d.z();
                 n->dir = m_no_update_dir;
             }
         }
     }
 
-    if (n->obs != obs_old) {
+    if (n->obs_x != obs_old_x ||
+        n->obs_y != obs_old_y ||
+        n->obs_z != obs_old_z)
+    {
 //        n->dir = m_no_update_dir;
         updateVertex(n);
     }
@@ -574,13 +1240,19 @@ void DistanceMap<Derived>::propagate()
     int iter_count = 0;
     while (m_bucket < (int)m_open.size()) {
         while (!m_open[m_bucket].empty()) {
-            ++iter_count;
             assert(m_bucket >= 0 && m_bucket < m_open.size());
-            Cell* s;
-            BUCKET_POP(s, m_bucket);
+            Cell* s = m_open[m_bucket].back();
+            m_open[m_bucket].pop_back();
+
+            // skip stale entries
+            if (!s->open || std::min(s->dist, s->dist_new) != m_bucket) {
+                continue;
+            }
+            s->open = 0;
+            ++iter_count;
 
             if (s->dist_new < s->dist) {
-                s->dist = s->dist_new;
+                setDist(s, s->dist_new);
 
                 // foreach n in adj(min)
                 lower(s);
@@ -592,7 +1264,7 @@ void DistanceMap<Derived>::propagate()
                 }
 #endif
             } else {
-                s->dist = m_dmax_sqrd_int;
+                setDist(s, m_dmax_sqrd_int);
                 s->dir = m_no_update_dir;
                 raise(s);
                 if (s->dist != s->dist_new) {
@@ -612,10 +1284,13 @@ void DistanceMap<Derived>::lowerBounded(Cell* s)
     for (int i = nfirst; i != nlast; ++i) {
         Cell* n = s + m_neighbor_offsets[i];
         if (n->dist_new > s->dist_new) {
-            int dp = distance(*n, *s);
+            const Eigen::Vector3i& d = m_neighbors[m_indices[i]];
+            int dp = distance(*s, d.x(), d.y(), d.z());
             if (dp < n->dist_new) {
                 n->dist_new = dp;
-                n->obs = s->obs;
+                n->obs_x = s->obs_x - d.x();
+                n->obs_y = s->obs_y - d.y();
+                n->obs_z = s->obs_z - d.z();
                 n->dir = m_neighbor_dirs[i];
                 updateVertex(n);
             }
@@ -634,12 +1309,11 @@ void DistanceMap<Derived>::propagateRemovals()
         std::tie(nfirst, nlast) = m_neighbor_ranges[m_no_update_dir];
         for (int i = nfirst; i != nlast; ++i) {
             Cell* n = s + m_neighbor_offsets[i];
-            auto valid = [](Cell* c) { return c && c->obs == c; };
-            if (!valid(n->obs)) {
+            if (!hasValidObstacle(n)) {
                 if (n->dist_new != m_dmax_sqrd_int) {
                     n->dist_new = m_dmax_sqrd_int;
-                    n->dist = m_dmax_sqrd_int;
-                    n->obs = nullptr;
+                    setDist(n, m_dmax_sqrd_int);
+                    n->obs_x = n->obs_y = n->obs_z = NO_OBSTACLE;
                     n->dir = m_no_update_dir;
                     m_rem_stack.push_back(n);
                 }
@@ -658,13 +1332,19 @@ void DistanceMap<Derived>::propagateBorder()
     while (m_bucket < (int)m_open.size()) {
         while (!m_open[m_bucket].empty()) {
             assert(m_bucket >= 0 && m_bucket < m_open.size());
-            Cell* s;
-            BUCKET_POP(s, m_bucket);
+            Cell* s = m_open[m_bucket].back();
+            m_open[m_bucket].pop_back();
+
+            // skip stale entries
+            if (!s->open || std::min(s->dist, s->dist_new) != m_bucket) {
+                continue;
+            }
+            s->open = 0;
 
 //            if (s->dist_new < s->dist)
             {
                 assert(s->dist_new <= s->dist);
-                s->dist = s->dist_new;
+                setDist(s, s->dist_new);
 
                 // foreach n in adj(min)
                 lowerBounded(s);
@@ -689,8 +1369,8 @@ void DistanceMap<Derived>::resetCell(Cell& c) const
 #if SMPL_DMAP_RETURN_CHANGED_CELLS
     c.dist_old = m_dmax_sqrd_int;
 #endif
-    c.obs = nullptr;
-    c.bucket = -1;
+    c.obs_x = c.obs_y = c.obs_z = NO_OBSTACLE;
+    c.open = 0;
     c.dir = m_no_update_dir;
 }
 
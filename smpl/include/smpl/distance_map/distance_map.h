@@ -34,6 +34,9 @@
 
 // standard includes
 #include <array>
+#include <cstdint>
+#include <memory>
+#include <ostream>
 #include <utility>
 #include <vector>
 
@@ -44,12 +47,16 @@
 // project includes
 #include <smpl/grid.h>
 #include <smpl/forward.h>
+#include <smpl/mapped_file.h>
+#include <smpl/distance_map/dense_distance_query.h>
 #include <smpl/distance_map/distance_map_interface.h>
 
 #include "detail/distance_map_common.h"
 
 namespace sbpl {
 
+class ThreadPool;
+
 template <typename Derived>
 class DistanceMap : public DistanceMapInterface
 {
@@ -66,6 +73,23 @@ public:
     double getDistance(double x, double y, double z) const;
     double getDistance(int x, int y, int z) const;
 
+    DenseDistanceQuery denseQuery() const;
+
+    void discardPropagationState();
+    bool hasPropagationState() const;
+
+    void setRetainPropagationState(bool retain);
+    bool retainPropagationState() const { return m_retain_propagation_state; }
+
+    void setNumThreads(int num_threads);
+    int numThreads() const { return m_num_threads; }
+
+    bool save(std::ostream& os) const;
+    bool load(
+        const std::shared_ptr<const MappedFile>& file,
+        size_t offset,
+        size_t& size);
+
     /// \name Required Functions from DistanceMapInterface
     ///@{
     void addPointsToMap(const std::vector<Eigen::Vector3d>& points) override;
@@ -85,6 +109,9 @@ public:
     double getMetricDistance(double x, double y, double z) const override;
     double getCellDistance(int x, int y, int z) const override;
 
+    double getMetricSquaredDistance(double x, double y, double z) const override;
+    double getCellSquaredDistance(int x, int y, int z) const override;
+
     void gridToWorld(
         int x, int y, int z,
         double& world_x, double& world_y, double& world_z) const override;
@@ -100,24 +127,61 @@ public:
 
 private:
 
+    // Propagation state for a single cell. Distances are stored as squared
+    // cell distances, which are bounded by MAX_DIST_CELLS^2, and the nearest
+    // obstacle cell is stored as an offset from the cell, so that the struct
+    // stays small enough for several cells to share a cache line.
     struct Cell
     {
-        int x;
-        int y;
-        int z;
-
-        int dist;
-        int dist_new;
+        std::uint16_t dist;
+        std::uint16_t dist_new;
 #if SMPL_DMAP_RETURN_CHANGED_CELLS
-        int dist_old;
+        std::uint16_t dist_old;
 #endif
-        Cell* obs;
-        int bucket;
-        int dir;
-
-        int pos;
+        std::int16_t obs_x;
+        std::int16_t obs_y;
+        std::int16_t obs_z;
+        std::uint8_t dir;
+        std::uint8_t open;
     };
 
+    // Maximum distance, in cells, that may be propagated from an obstacle, so
+    // that squared cell distances fit in 16 bits
+    static const int MAX_DIST_CELLS = 255;
+
+    // Sentinel obstacle offset for cells with no nearest obstacle
+    static const std::int16_t NO_OBSTACLE = INT16_MIN;
+
+    // Queryable distances are stored in bricks of 8x8x8 cells
+    static const int BRICK_SHIFT = DenseDistanceQuery::BRICK_SHIFT;
+    static const int BRICK_MASK = DenseDistanceQuery::BRICK_MASK;
+
+    // Dimensions of the grid, including the border cells. These are kept
+    // separately from m_cells so that they remain valid after the propagation
+    // state has been discarded.
+    int m_cell_count_x;
+    int m_cell_count_y;
+    int m_cell_count_z;
+    int m_stride_x;
+    int m_stride_y;
+
+    int m_brick_count_y;
+    int m_brick_count_z;
+
+    // Squared cell distances, in bricked order, read by the distance queries.
+    std::vector<std::uint16_t> m_dist;
+
+    // Squared cell distances mapped from a file by load(), which are read in
+    // place of m_dist until the map is next modified
+    std::shared_ptr<const MappedFile> m_mapped_file;
+    const std::uint16_t* m_mapped_dist;
+
+    // Obstacle cells, in the same order as m_cells, from which the propagation
+    // state can be rebuilt after it has been discarded.
+    std::vector<bool> m_obstacles;
+
+    // Propagation state for all cells, including the border cells. Empty if
+    // the propagation state has been discarded.
     Grid3<Cell> m_cells;
 
     double m_max_dist;
@@ -164,11 +228,92 @@ private:
 
     std::vector<Cell*> m_rem_stack;
 
+    // Whether the propagation state is kept between modifications
+    bool m_retain_propagation_state;
+
+    // Number of threads used to compute the exact distance transform
+    int m_num_threads;
+
+    // Workers used to compute the exact distance transform, kept across
+    // transforms. A copy of the distance map starts its own workers, since a
+    // pool may run loops for only one caller at a time.
+    struct TransformPool
+    {
+        std::unique_ptr<ThreadPool> pool;
+
+        TransformPool() = default;
+        TransformPool(const TransformPool& o);
+        TransformPool& operator=(const TransformPool& o);
+    };
+
+    TransformPool m_pool;
+
+    // Scratch storage for computing the lower envelope of parabolas along a
+    // line of cells
+    struct EnvelopeScratch
+    {
+        std::vector<int> f;
+        std::vector<int> d;
+        std::vector<int> arg;
+        std::vector<int> feature_y;
+        std::vector<int> feature_z;
+        std::vector<int> v;
+        std::vector<double> boundary;
+    };
+
+    // Layout of the section of a file written by save()
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t header_size;
+        std::int32_t cell_count_x;
+        std::int32_t cell_count_y;
+        std::int32_t cell_count_z;
+        std::int32_t dmax_int;
+        double origin_x;
+        double origin_y;
+        double origin_z;
+        double resolution;
+
+        // offsets are relative to the start of the section
+        std::uint64_t dist_offset;
+        std::uint64_t dist_count;
+        std::uint64_t obstacle_offset;
+        std::uint64_t obstacle_count;
+        std::uint64_t size;
+    };
+
+    static const std::uint32_t FILE_VERSION = 1;
+
+    int brickIndex(int x, int y, int z) const;
+    int brickIndex(const Cell* c) const;
+
+    size_t brickedCellCount() const;
+    const std::uint16_t* distData() const;
+
+    void setDist(Cell* c, int d);
+
+    bool isObstacle(const Cell& c) const;
+    void setObstacle(Cell& c);
+    void clearObstacle(Cell& c);
+    bool hasValidObstacle(const Cell* c) const;
+
+    void initPropagationState();
+    void ensurePropagationState();
+    void finishModification();
+
+    bool isEuclidean() const { return false; }
+    bool useBulkTransform(size_t change_count) const;
+    void computeTransform();
+    void transformLine(int n, EnvelopeScratch& scratch) const;
+    int borderDir(int x, int y, int z) const;
+
     void initBorderCells();
 
     void updateVertex(Cell* c);
 
-    int distance(const Cell& n, const Cell& s);
+    int distance(const Cell& s, int dx, int dy, int dz);
 
     void lower(Cell* s);
     void raise(Cell* s);
@@ -50,7 +50,7 @@ public:
 
 private:
 
-    int distance(const Cell& n, const Cell& s);
+    int distance(const Cell& s, int dx, int dy, int dz);
 };
 
 } // namespace sbpl
@@ -50,7 +50,9 @@ public:
 
 private:
 
-    int distance(const Cell& n, const Cell& s);
+    int distance(const Cell& s, int dx, int dy, int dz);
+
+    bool isEuclidean() const { return true; }
 };
 
 } // namespace sbpl
@@ -0,0 +1,252 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#ifndef SMPL_HASHED_DISTANCE_MAP_H
+#define SMPL_HASHED_DISTANCE_MAP_H
+
+// standard includes
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// system includes
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+// project includes
+#include <smpl/distance_map/distance_map_interface.h>
+#include "detail/distance_map_common.h"
+
+namespace sbpl {
+
+/// A Euclidean distance map for large, mostly empty workspaces. Cells are
+/// stored in dense bricks of 8x8x8 cells, which are found through a hash table
+/// keyed by brick coordinates. Bricks are only allocated for cells within the
+/// maximum propagation distance of an obstacle and are released once all of
+/// their cells are out of range of every obstacle, so memory scales with the
+/// volume around the obstacles rather than with the volume of the workspace.
+///
+/// Unlike the dense DistanceMap types, the boundary of the map is not treated
+/// as an obstacle.
+class HashedDistanceMap : public DistanceMapInterface
+{
+public:
+
+    HashedDistanceMap(
+        double origin_x, double origin_y, double origin_z,
+        double size_x, double size_y, double size_z,
+        double resolution,
+        double max_dist);
+
+    HashedDistanceMap(const HashedDistanceMap& o);
+
+    double maxDistance() const;
+
+    double getDistance(double x, double y, double z) const;
+    double getDistance(int x, int y, int z) const;
+
+    size_t numAllocatedBricks() const { return m_bricks.size(); }
+    size_t numAllocatedCells() const { return m_bricks.size() * BRICK_SIZE; }
+
+    /// \name Required Functions from DistanceMapInterface
+    ///@{
+    DistanceMapInterface* clone() const override;
+
+    void addPointsToMap(const std::vector<Eigen::Vector3d>& points) override;
+    void removePointsFromMap(const std::vector<Eigen::Vector3d>& points) override;
+    void updatePointsInMap(
+        const std::vector<Eigen::Vector3d>& old_points,
+        const std::vector<Eigen::Vector3d>& new_points) override;
+
+    void reset() override;
+
+    int numCellsX() const override;
+    int numCellsY() const override;
+    int numCellsZ() const override;
+
+    double getUninitializedDistance() const override;
+
+    double getMetricDistance(double x, double y, double z) const override;
+    double getCellDistance(int x, int y, int z) const override;
+
+    double getMetricSquaredDistance(double x, double y, double z) const override;
+    double getCellSquaredDistance(int x, int y, int z) const override;
+
+    void gridToWorld(
+        int x, int y, int z,
+        double& world_x, double& world_y, double& world_z) const override;
+
+    void worldToGrid(
+        double world_x, double world_y, double world_z,
+        int& x, int& y, int& z) const override;
+
+    bool isCellValid(int x, int y, int z) const override;
+    ///@}
+
+private:
+
+    // Propagation state for a single cell, as in DistanceMap. The nearest
+    // obstacle cell is stored as an offset from the cell.
+    struct Cell
+    {
+        std::uint16_t dist;
+        std::uint16_t dist_new;
+        std::int16_t obs_x;
+        std::int16_t obs_y;
+        std::int16_t obs_z;
+        std::uint8_t dir;
+        std::uint8_t open;
+    };
+
+    static const int BRICK_SHIFT = 3;
+    static const int BRICK_MASK = (1 << BRICK_SHIFT) - 1;
+    static const int BRICK_SIZE = 1 << (3 * BRICK_SHIFT);
+
+    // Maximum distance, in cells, that may be propagated from an obstacle
+    static const int MAX_DIST_CELLS = 255;
+
+    // Sentinel obstacle offset for cells with no nearest obstacle
+    static const std::int16_t NO_OBSTACLE = INT16_MIN;
+
+    struct Brick
+    {
+        std::array<Cell, BRICK_SIZE> cells;
+
+        // whether any cell has been raised since the brick was last checked
+        // for release
+        bool dirty;
+    };
+
+    typedef std::unordered_map<std::int64_t, std::unique_ptr<Brick>> BrickMap;
+
+    int m_cell_count_x;
+    int m_cell_count_y;
+    int m_cell_count_z;
+
+    std::int64_t m_brick_count_y;
+    std::int64_t m_brick_count_z;
+
+    // Allocated bricks, keyed by brick index. Bricks are allocated separately
+    // so that pointers to their cells remain valid while other bricks are
+    // allocated during propagation.
+    BrickMap m_bricks;
+
+    // the most recently accessed brick, which is likely to contain the next
+    // cell accessed during propagation
+    std::int64_t m_cached_key;
+    Brick* m_cached_brick;
+
+    // Bricks with cells that have been raised since they were last checked for
+    // release
+    std::vector<std::int64_t> m_dirty_bricks;
+
+    double m_max_dist;
+    double m_inv_res;
+
+    int m_dmax_int;
+    int m_dmax_sqrd_int;
+
+    int m_bucket;
+    int m_no_update_dir;
+
+    // Direction offsets to each of the 27 neighbors, including (0, 0, 0).
+    // Indexed by a call to dirnum(x, y, z, 0);
+    std::array<Eigen::Vector3i, 27> m_neighbors;
+
+    // Indices of the neighbor offsets that must have distance information
+    // propagated to them, grouped by source update direction. See DistanceMap.
+    std::array<int, NEIGHBOR_LIST_SIZE> m_indices;
+
+    // Map from a source update direction to a range of m_indices
+    std::array<std::pair<int, int>, NUM_DIRECTIONS> m_neighbor_ranges;
+
+    // Map from a (source, target) update direction pair to the update direction
+    // index
+    std::array<int, NEIGHBOR_LIST_SIZE> m_neighbor_dirs;
+
+    std::vector<double> m_sqrt_table;
+
+    struct bucket_element
+    {
+        Cell* c;
+        int x;
+        int y;
+        int z;
+
+        bucket_element() { }
+        bucket_element(Cell* c, int x, int y, int z) :
+            c(c), x(x), y(y), z(z)
+        { }
+    };
+
+    // Buckets of cells, indexed by key, as in DistanceMap. Entries are not
+    // removed from their previous bucket when a cell's key changes; stale
+    // entries are instead skipped when they are popped.
+    typedef std::vector<bucket_element> bucket_type;
+    typedef std::vector<bucket_type> bucket_list;
+    bucket_list m_open;
+
+    std::vector<bucket_element> m_rem_stack;
+
+    std::int64_t brickIndex(int x, int y, int z) const;
+    int cellIndex(int x, int y, int z) const;
+
+    const Cell* getCell(int x, int y, int z) const;
+    Cell* getCell(int x, int y, int z);
+    Cell* allocCell(int x, int y, int z);
+
+    void markRaised(int x, int y, int z);
+    void releaseBricks();
+
+    bool isObstacle(const Cell& c) const;
+    bool hasValidObstacle(const Cell& c, int x, int y, int z) const;
+    void resetCell(Cell& c) const;
+
+    int distance(const Cell& s, int dx, int dy, int dz) const;
+
+    void updateVertex(Cell* c, int x, int y, int z);
+
+    void lower(Cell* s, int sx, int sy, int sz);
+    void raise(Cell* s, int sx, int sy, int sz);
+    void waveout(Cell* n, int nx, int ny, int nz);
+    void propagate();
+
+    void lowerBounded(Cell* s, int sx, int sy, int sz);
+    void propagateRemovals();
+    void propagateBounded();
+};
+
+} // namespace sbpl
+
+#endif
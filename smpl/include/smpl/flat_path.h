@@ -0,0 +1,163 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#ifndef SMPL_FLAT_PATH_H
+#define SMPL_FLAT_PATH_H
+
+// standard includes
+#include <assert.h>
+#include <stddef.h>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+// project includes
+#include <smpl/types.h>
+
+namespace sbpl {
+namespace motion {
+
+/// A path of robot states stored in a single flat buffer. The variables of
+/// each waypoint are stored contiguously, one waypoint after another, so
+/// waypoints may be appended without allocating once enough capacity has been
+/// reserved. Waypoints are accessed as pointers to their first variable.
+class FlatPath
+{
+public:
+
+    /// Random-access iterator over the waypoints of a path. Dereferencing
+    /// yields a pointer to the variables of the waypoint.
+    class const_iterator
+    {
+    public:
+
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef const double* value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const double* const* pointer;
+        typedef const double* reference;
+
+        const_iterator() : m_p(nullptr), m_stride(0) { }
+        const_iterator(const double* p, size_t stride) :
+            m_p(p), m_stride((ptrdiff_t)stride)
+        { }
+
+        reference operator*() const { return m_p; }
+        reference operator[](difference_type n) const { return m_p + n * m_stride; }
+
+        const_iterator& operator++() { m_p += m_stride; return *this; }
+        const_iterator& operator--() { m_p -= m_stride; return *this; }
+        const_iterator operator++(int) { const_iterator t(*this); ++*this; return t; }
+        const_iterator operator--(int) { const_iterator t(*this); --*this; return t; }
+
+        const_iterator& operator+=(difference_type n) { m_p += n * m_stride; return *this; }
+        const_iterator& operator-=(difference_type n) { m_p -= n * m_stride; return *this; }
+        const_iterator operator+(difference_type n) const { const_iterator t(*this); return t += n; }
+        const_iterator operator-(difference_type n) const { const_iterator t(*this); return t -= n; }
+
+        difference_type operator-(const const_iterator& o) const
+        { return m_stride ? (m_p - o.m_p) / m_stride : 0; }
+
+        bool operator==(const const_iterator& o) const { return m_p == o.m_p; }
+        bool operator!=(const const_iterator& o) const { return m_p != o.m_p; }
+        bool operator<(const const_iterator& o) const { return m_p < o.m_p; }
+        bool operator>(const const_iterator& o) const { return m_p > o.m_p; }
+        bool operator<=(const const_iterator& o) const { return m_p <= o.m_p; }
+        bool operator>=(const const_iterator& o) const { return m_p >= o.m_p; }
+
+    private:
+
+        const double* m_p;
+        ptrdiff_t m_stride;
+    };
+
+    explicit FlatPath(size_t var_count = 0) : m_var_count(var_count), m_values() { }
+
+    size_t varCount() const { return m_var_count; }
+    size_t size() const { return m_var_count ? m_values.size() / m_var_count : 0; }
+    bool empty() const { return m_values.empty(); }
+    size_t capacity() const { return m_var_count ? m_values.capacity() / m_var_count : 0; }
+
+    /// Remove all waypoints and change the number of variables per waypoint,
+    /// retaining the allocated storage.
+    void reset(size_t var_count) { m_values.clear(); m_var_count = var_count; }
+
+    void clear() { m_values.clear(); }
+    void reserve(size_t count) { m_values.reserve(count * m_var_count); }
+
+    /// Remove all waypoints after the first count waypoints.
+    void truncate(size_t count)
+    {
+        if (count < size()) {
+            m_values.resize(count * m_var_count);
+        }
+    }
+
+    void push_back(const RobotState& state)
+    {
+        assert(state.size() == m_var_count);
+        m_values.insert(m_values.end(), state.begin(), state.end());
+    }
+
+    void push_back(const double* values)
+    {
+        m_values.insert(m_values.end(), values, values + m_var_count);
+    }
+
+    const double* operator[](size_t i) const { return &m_values[i * m_var_count]; }
+    double* operator[](size_t i) { return &m_values[i * m_var_count]; }
+
+    const double* front() const { return (*this)[0]; }
+    const double* back() const { return (*this)[size() - 1]; }
+
+    const_iterator begin() const { return const_iterator(m_values.data(), m_var_count); }
+    const_iterator end() const { return const_iterator(m_values.data() + m_values.size(), m_var_count); }
+
+    /// Copy the waypoints into a sequence of robot states, reusing the storage
+    /// of the robot states already in the sequence.
+    void toPath(std::vector<RobotState>& path) const
+    {
+        path.resize(size());
+        for (size_t i = 0; i < path.size(); ++i) {
+            path[i].assign((*this)[i], (*this)[i] + m_var_count);
+        }
+    }
+
+private:
+
+    size_t m_var_count;
+    std::vector<double> m_values;
+};
+
+} // namespace motion
+} // namespace sbpl
+
+#endif
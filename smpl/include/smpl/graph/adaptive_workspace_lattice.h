@@ -120,7 +120,8 @@ namespace motion {
 class AdaptiveWorkspaceLattice :
     public WorkspaceLatticeBase,
     public AdaptiveGraphExtension,
-    public PointProjectionExtension
+    public PointProjectionExtension,
+    public ChangedEdgesExtension
 {
 public:
 
@@ -151,6 +152,11 @@ public:
     bool setPlanMode();
     ///@}
 
+    /// \name Required Public Functions from ChangedEdgesExtension
+    ///@{
+    void getChangedEdgeSources(std::vector<int>& state_ids) override;
+    ///@}
+
     /// \name Required Public Functions from RobotPlanningSpcae
     ///@{
     int getStartStateID() const override;
@@ -229,10 +235,30 @@ private:
         bool plan_hd; //planning_hd;
         bool trak_hd;
 
-        AdaptiveGridCell() : grow_count(0), plan_hd(false), trak_hd(false) { }
+        // bookkeeping for reporting changes to the dimensionality of cells
+        bool plan_changed;
+        bool trak_changed;
+        bool trak_prev;
+
+        AdaptiveGridCell() :
+            grow_count(0),
+            plan_hd(false),
+            trak_hd(false),
+            plan_changed(false),
+            trak_changed(false),
+            trak_prev(false)
+        { }
     };
     Grid3<AdaptiveGridCell> m_dim_grid;
 
+    // cells in the current tunnel
+    std::vector<Eigen::Vector3i> m_tunnel_cells;
+
+    // cells whose dimensionality changed in planning or tracking mode since
+    // the last call to getChangedEdgeSources() in that mode
+    std::vector<Eigen::Vector3i> m_plan_changes;
+    std::vector<Eigen::Vector3i> m_trak_changes;
+
     bool initMotionPrimitives();
 
     bool setGoalPose(const GoalConstraint& goal);
@@ -250,6 +276,7 @@ private:
     int reserveHashEntry(bool hid);
 
     bool isHighDimensional(int gx, int gy, int gz) const;
+    bool getStateCell(const AdaptiveState* state, Eigen::Vector3i& gp) const;
 
     AdaptiveState* getHashEntry(int state_id) const;
     AdaptiveWorkspaceState* getHiHashEntry(int state_id) const;
@@ -34,6 +34,7 @@
 
 // standard includes
 #include <cstdlib>
+#include <utility>
 #include <vector>
 
 // system includes
@@ -58,42 +59,69 @@ public:
 
 private:
 
+    // (incident edge, adjacent node) pairs
+    typedef std::pair<edge_id, node_id> adjacency;
+    typedef std::vector<adjacency> adjacency_container;
+
+    // The incident edges of each node are stored in a segment of a single
+    // adjacency array, shared by all nodes, with room for adj_capacity
+    // entries. A node whose segment fills up is moved to the end of the
+    // array, leaving its old segment unused until the array is compacted.
+    // Erased nodes are kept, without adjacency segments, until the graph is
+    // compacted; their states still split the k-d tree.
     struct Node
     {
-        typedef std::pair<edge_id, node_id> adjacency;
-        typedef std::vector<adjacency> adjacent_edge_container;
-
         RobotState state;
-        adjacent_edge_container edges;
-
-        Node(const RobotState& state) : state(state) { }
+        adjacency_container::size_type adj_offset;
+        adjacency_container::size_type adj_degree;
+        adjacency_container::size_type adj_capacity;
+        bool erased;
+
+        Node(const RobotState& state) :
+            state(state),
+            adj_offset(0),
+            adj_degree(0),
+            adj_capacity(0),
+            erased(false)
+        { }
     };
 
+    // The waypoints of each edge are stored as wp_count consecutive states in
+    // a single waypoint array, shared by all edges, beginning at wp_offset.
+    // Erased edges are kept, without waypoints, until the graph is compacted.
     struct Edge
     {
-        std::vector<RobotState> waypoints;
         node_id snode;
         node_id tnode;
-
-        Edge(node_id uid, node_id vid) : waypoints(), snode(uid), tnode(vid) { }
-
-        Edge(const std::vector<RobotState>& waypoints, node_id uid, node_id vid)
-            : waypoints(waypoints), snode(uid), tnode(vid) { }
+        std::size_t wp_offset;
+        std::size_t wp_count;
+        bool erased;
+
+        Edge(node_id uid, node_id vid, std::size_t offset, std::size_t count) :
+            snode(uid),
+            tnode(vid),
+            wp_offset(offset),
+            wp_count(count),
+            erased(false)
+        { }
     };
 
 public:
 
     typedef node_container::size_type nodes_size_type;
     typedef edge_container::size_type edges_size_type;
-    typedef Node::adjacent_edge_container::size_type degree_size_type;
+    typedef adjacency_container::size_type degree_size_type;
 
-    struct node_iterator : std::iterator<std::random_access_iterator_tag, node_id>
+    // Skips the ids of erased nodes
+    struct node_iterator : std::iterator<std::bidirectional_iterator_tag, node_id>
     {
-        node_iterator(node_id id);
+        node_iterator(const node_container* nodes, node_id id);
 
         const value_type operator*() const;
         node_iterator operator++(int);
         node_iterator& operator++();
+        node_iterator operator--(int);
+        node_iterator& operator--();
 
         node_iterator& operator+=(difference_type n);
         node_iterator& operator-=(difference_type n);
@@ -103,16 +131,20 @@ public:
 
     private:
 
+        const node_container* m_nodes;
         node_id m_id;
     };
 
-    struct edge_iterator : std::iterator<std::random_access_iterator_tag, edge_id>
+    // Skips the ids of erased edges
+    struct edge_iterator : std::iterator<std::bidirectional_iterator_tag, edge_id>
     {
-        edge_iterator(edge_id id);
+        edge_iterator(const edge_container* edges, edge_id id);
 
         const value_type operator*() const;
         edge_iterator operator++(int);
         edge_iterator& operator++();
+        edge_iterator operator--(int);
+        edge_iterator& operator--();
 
         edge_iterator& operator+=(difference_type n);
         edge_iterator& operator-=(difference_type n);
@@ -122,10 +154,11 @@ public:
 
     private:
 
+        const edge_container* m_edges;
         edge_id m_id;
     };
 
-    typedef Node::adjacent_edge_container::const_iterator adjacent_edge_iterator;
+    typedef adjacency_container::const_iterator adjacent_edge_iterator;
 
     struct incident_edge_iterator : std::iterator<std::random_access_iterator_tag, edge_id>
     {
@@ -176,11 +209,28 @@ public:
     node_id source(edge_id id) const;
     node_id target(edge_id id) const;
 
-    nodes_size_type num_nodes() const { return m_nodes.size(); }
-    edges_size_type num_edges() const { return m_edges.size(); }
+    nodes_size_type num_nodes() const { return m_node_count; }
+    edges_size_type num_edges() const { return m_edge_count; }
+
+    /// One more than the largest node id in use. Erased node ids are not
+    /// reused until the graph is compacted, so arrays indexed by node id must
+    /// be sized with this rather than num_nodes().
+    nodes_size_type node_id_bound() const { return m_nodes.size(); }
+
+    /// One more than the largest edge id in use.
+    edges_size_type edge_id_bound() const { return m_edges.size(); }
 
     bool edge(node_id uid, node_id vid) const;
 
+    void reserve(nodes_size_type node_count, edges_size_type edge_count);
+
+    bool nearest_node(const RobotState& state, node_id& id) const;
+
+    void nearest_nodes(
+        const RobotState& state,
+        double radius,
+        std::vector<node_id>& ids) const;
+
     node_id insert_node(const RobotState& state);
     void erase_node(node_id id);
 
@@ -189,30 +239,92 @@ public:
         node_id uid,
         node_id vid,
         const std::vector<RobotState>& path);
+    edge_id insert_edge(
+        node_id uid,
+        node_id vid,
+        const double* waypoints,
+        std::size_t count,
+        std::size_t dimension);
 
     void erase_edge(node_id uid, node_id vid);
     void erase_edge(edge_id id);
 
     const RobotState& state(node_id id) const { return m_nodes[id].state; }
+
+    /// Modifying a node's state through the returned reference does not
+    /// update the nearest-neighbor index.
     RobotState& state(node_id id) { return m_nodes[id].state; }
 
-    const std::vector<RobotState>& waypoints(edge_id id) const {
-        return m_edges[id].waypoints;
-    }
-    std::vector<RobotState>& waypoints(edge_id id) {
-        return m_edges[id].waypoints;
-    }
+    std::size_t waypoint_count(edge_id id) const { return m_edges[id].wp_count; }
+    const double* waypoint(edge_id id, std::size_t i) const;
+    void waypoints(edge_id id, std::vector<RobotState>& path) const;
+
+    void compact();
 
 private:
 
     std::vector<Node> m_nodes;
     std::vector<Edge> m_edges;
 
-    // cached storage for mapping edge ids to their id adjustments during node
-    // removal
-    std::vector<std::ptrdiff_t> m_shift;
+    // the number of nodes and edges that have not been erased
+    nodes_size_type m_node_count;
+    edges_size_type m_edge_count;
+
+    adjacency_container m_adjacency;
+    adjacency_container::size_type m_adjacency_unused;
+
+    // the waypoints of all edges, m_waypoint_dim values per waypoint
+    std::vector<double> m_waypoints;
+    std::size_t m_waypoint_dim;
+    std::size_t m_waypoints_unused;
+
+    static const node_id KDNull = (node_id)-1;
+
+    // k-d tree over the node states, for nearest-neighbor queries in joint
+    // space; m_kd_nodes[n] stores the children of node n, the dimension it
+    // splits its subtree on, and the size of its subtree. Subtrees that grow
+    // too unbalanced are rebuilt (as in a scapegoat tree)
+    struct KDNode
+    {
+        node_id left;
+        node_id right;
+        nodes_size_type size;
+        std::size_t split;
+    };
+
+    std::vector<KDNode> m_kd_nodes;
+    node_id m_kd_root;
+
+    // cached storage for the insertion path and the nodes of a rebuilt subtree
+    std::vector<node_id> m_kd_path;
+    std::vector<node_id> m_kd_buffer;
+
+    bool is_node(node_id id) const;
+    bool is_edge(edge_id id) const;
 
     void insert_incident_edge(edge_id eid, node_id uid, node_id vid);
+    void insert_adjacency(node_id uid, edge_id eid, node_id vid);
+    void erase_adjacency(node_id uid, edge_id eid);
+    std::size_t insert_waypoints(
+        const double* waypoints,
+        std::size_t count,
+        std::size_t dimension);
+
+    void tombstone_edge(edge_id id);
+
+    void maybe_compact();
+    void compact_ids();
+    void compact_adjacency();
+    void compact_waypoints();
+
+    void kd_insert(node_id id);
+    void kd_rebuild();
+    node_id kd_build(node_id* first, node_id* last);
+    void kd_nearest(
+        node_id n,
+        const RobotState& state,
+        node_id& best,
+        double& best_dist) const;
 };
 
 inline
@@ -352,9 +464,16 @@ ExperienceGraph::adjacency_iterator::operator!=(adjacency_iterator it) const
 }
 
 inline
-ExperienceGraph::node_iterator::node_iterator(node_id id) :
+ExperienceGraph::node_iterator::node_iterator(
+    const node_container* nodes,
+    node_id id)
+:
+    m_nodes(nodes),
     m_id(id)
 {
+    while (m_id < m_nodes->size() && (*m_nodes)[m_id].erased) {
+        ++m_id;
+    }
 }
 
 inline
@@ -368,14 +487,37 @@ inline
 ExperienceGraph::node_iterator
 ExperienceGraph::node_iterator::operator++(int)
 {
-    return node_iterator(m_id++);
+    node_iterator it(*this);
+    operator++();
+    return it;
 }
 
 inline
 ExperienceGraph::node_iterator&
 ExperienceGraph::node_iterator::operator++()
 {
-    ++m_id;
+    do {
+        ++m_id;
+    } while (m_id < m_nodes->size() && (*m_nodes)[m_id].erased);
+    return *this;
+}
+
+inline
+ExperienceGraph::node_iterator
+ExperienceGraph::node_iterator::operator--(int)
+{
+    node_iterator it(*this);
+    operator--();
+    return it;
+}
+
+inline
+ExperienceGraph::node_iterator&
+ExperienceGraph::node_iterator::operator--()
+{
+    do {
+        --m_id;
+    } while ((*m_nodes)[m_id].erased);
     return *this;
 }
 
@@ -383,7 +525,12 @@ inline
 ExperienceGraph::node_iterator&
 ExperienceGraph::node_iterator::operator+=(difference_type n)
 {
-    m_id += n;
+    for ( ; n > 0; --n) {
+        operator++();
+    }
+    for ( ; n < 0; ++n) {
+        operator--();
+    }
     return *this;
 }
 
@@ -391,15 +538,21 @@ inline
 ExperienceGraph::node_iterator&
 ExperienceGraph::node_iterator::operator-=(difference_type n)
 {
-    m_id -= n;
-    return *this;
+    return operator+=(-n);
 }
 
 inline
 ExperienceGraph::node_iterator::difference_type
 ExperienceGraph::node_iterator::operator-(node_iterator it)
 {
-    return (difference_type)m_id - (difference_type)it.m_id;
+    if (m_id < it.m_id) {
+        return -(it - *this);
+    }
+    difference_type n = 0;
+    for ( ; it.m_id != m_id; ++it) {
+        ++n;
+    }
+    return n;
 }
 
 inline
@@ -415,9 +568,16 @@ bool ExperienceGraph::node_iterator::operator!=(node_iterator it) const
 }
 
 inline
-ExperienceGraph::edge_iterator::edge_iterator(edge_id id) :
+ExperienceGraph::edge_iterator::edge_iterator(
+    const edge_container* edges,
+    edge_id id)
+:
+    m_edges(edges),
     m_id(id)
 {
+    while (m_id < m_edges->size() && (*m_edges)[m_id].erased) {
+        ++m_id;
+    }
 }
 
 inline
@@ -431,14 +591,37 @@ inline
 ExperienceGraph::edge_iterator
 ExperienceGraph::edge_iterator::operator++(int)
 {
-    return edge_iterator(m_id++);
+    edge_iterator it(*this);
+    operator++();
+    return it;
 }
 
 inline
 ExperienceGraph::edge_iterator&
 ExperienceGraph::edge_iterator::operator++()
 {
-    ++m_id;
+    do {
+        ++m_id;
+    } while (m_id < m_edges->size() && (*m_edges)[m_id].erased);
+    return *this;
+}
+
+inline
+ExperienceGraph::edge_iterator
+ExperienceGraph::edge_iterator::operator--(int)
+{
+    edge_iterator it(*this);
+    operator--();
+    return it;
+}
+
+inline
+ExperienceGraph::edge_iterator&
+ExperienceGraph::edge_iterator::operator--()
+{
+    do {
+        --m_id;
+    } while ((*m_edges)[m_id].erased);
     return *this;
 }
 
@@ -446,7 +629,12 @@ inline
 ExperienceGraph::edge_iterator&
 ExperienceGraph::edge_iterator::operator+=(difference_type n)
 {
-    m_id += n;
+    for ( ; n > 0; --n) {
+        operator++();
+    }
+    for ( ; n < 0; ++n) {
+        operator--();
+    }
     return *this;
 }
 
@@ -454,15 +642,21 @@ inline
 ExperienceGraph::edge_iterator&
 ExperienceGraph::edge_iterator::operator-=(difference_type n)
 {
-    m_id -= n;
-    return *this;
+    return operator+=(-n);
 }
 
 inline
 ExperienceGraph::edge_iterator::difference_type
 ExperienceGraph::edge_iterator::operator-(edge_iterator it)
 {
-    return (difference_type)m_id - (difference_type)it.m_id;
+    if (m_id < it.m_id) {
+        return -(it - *this);
+    }
+    difference_type n = 0;
+    for ( ; it.m_id != m_id; ++it) {
+        ++n;
+    }
+    return n;
 }
 
 inline
@@ -477,6 +671,14 @@ bool ExperienceGraph::edge_iterator::operator!=(edge_iterator it) const
     return m_id != it.m_id;
 }
 
+/// Return a pointer to the values of the i'th waypoint of an edge. The pointer
+/// is invalidated by any operation that inserts or erases edges.
+inline
+const double* ExperienceGraph::waypoint(edge_id id, std::size_t i) const
+{
+    return m_waypoints.data() + m_edges[id].wp_offset + i * m_waypoint_dim;
+}
+
 } // namespace motion
 } // namespace sbpl
 
@@ -0,0 +1,188 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#ifndef SMPL_EXPERIENCE_GRAPH_FILE_H
+#define SMPL_EXPERIENCE_GRAPH_FILE_H
+
+// standard includes
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// project includes
+#include <smpl/mapped_file.h>
+#include <smpl/types.h>
+
+namespace sbpl {
+namespace motion {
+
+/// The discretization of each joint variable, as computed by ManipLattice,
+/// under which the nodes of an experience graph file were formed.
+struct ExperienceGraphDiscretization
+{
+    std::vector<double> deltas;
+    std::vector<double> min_limits;
+    std::vector<bool> continuous;
+    std::vector<bool> bounded;
+
+    void discretize(const double* state, std::int32_t* coord) const;
+};
+
+/// A read-only view of a binary experience graph file, mapped into memory.
+///
+/// The file stores the experience graph formed from a set of demonstrated
+/// paths: the state and discrete coordinates of each node, the endpoints and
+/// intermediate waypoints of each edge, and the nodes and edges of each path,
+/// in order. States and waypoints are stored as contiguous arrays of doubles,
+/// one row per state, and are read in place from the mapping.
+class ExperienceGraphFile
+{
+public:
+
+    ExperienceGraphFile();
+
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return m_file.isOpen(); }
+
+    size_t variableCount() const { return m_variable_names.size(); }
+
+    const std::vector<std::string>& variableNames() const
+    { return m_variable_names; }
+
+    const ExperienceGraphDiscretization& discretization() const
+    { return m_discretization; }
+
+    size_t nodeCount() const { return m_node_count; }
+    const double* nodeState(size_t n) const;
+    const std::int32_t* nodeCoord(size_t n) const;
+
+    size_t edgeCount() const { return m_edge_count; }
+    size_t edgeSource(size_t e) const;
+    size_t edgeTarget(size_t e) const;
+    size_t edgeWaypointCount(size_t e) const;
+    const double* edgeWaypoints(size_t e) const;
+
+    /// \name Paths
+    /// Path p consists of the nodeCount nodes beginning at pathFirstNode(p),
+    /// each connected to its successor by consecutive edges beginning at
+    /// pathFirstEdge(p).
+    ///@{
+    size_t pathCount() const { return m_path_count; }
+    size_t pathFirstNode(size_t p) const;
+    size_t pathNodeCount(size_t p) const;
+    size_t pathFirstEdge(size_t p) const;
+    ///@}
+
+private:
+
+    MappedFile m_file;
+
+    std::vector<std::string> m_variable_names;
+    ExperienceGraphDiscretization m_discretization;
+
+    size_t m_node_count;
+    size_t m_edge_count;
+    size_t m_path_count;
+
+    const double* m_node_states;
+    const std::int32_t* m_node_coords;
+    const std::uint32_t* m_edges;
+    const std::uint32_t* m_paths;
+    const double* m_waypoints;
+};
+
+bool WriteExperienceGraphFile(
+    const std::string& path,
+    const std::vector<std::string>& variable_names,
+    const ExperienceGraphDiscretization& discretization,
+    const std::vector<std::vector<RobotState>>& paths);
+
+inline
+const double* ExperienceGraphFile::nodeState(size_t n) const
+{
+    return m_node_states + n * variableCount();
+}
+
+inline
+const std::int32_t* ExperienceGraphFile::nodeCoord(size_t n) const
+{
+    return m_node_coords + n * variableCount();
+}
+
+inline
+size_t ExperienceGraphFile::edgeSource(size_t e) const
+{
+    return m_edges[4 * e];
+}
+
+inline
+size_t ExperienceGraphFile::edgeTarget(size_t e) const
+{
+    return m_edges[4 * e + 1];
+}
+
+inline
+size_t ExperienceGraphFile::edgeWaypointCount(size_t e) const
+{
+    return m_edges[4 * e + 3];
+}
+
+inline
+const double* ExperienceGraphFile::edgeWaypoints(size_t e) const
+{
+    return m_waypoints + (size_t)m_edges[4 * e + 2] * variableCount();
+}
+
+inline
+size_t ExperienceGraphFile::pathFirstNode(size_t p) const
+{
+    return m_paths[3 * p];
+}
+
+inline
+size_t ExperienceGraphFile::pathNodeCount(size_t p) const
+{
+    return m_paths[3 * p + 1];
+}
+
+inline
+size_t ExperienceGraphFile::pathFirstEdge(size_t p) const
+{
+    return m_paths[3 * p + 2];
+}
+
+} // namespace motion
+} // namespace sbpl
+
+#endif
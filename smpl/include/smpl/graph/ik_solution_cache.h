@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#ifndef SMPL_IK_SOLUTION_CACHE_H
+#define SMPL_IK_SOLUTION_CACHE_H
+
+// standard includes
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <vector>
+
+// project includes
+#include <smpl/types.h>
+
+namespace sbpl {
+namespace motion {
+
+/// A bounded, least-recently-used cache of inverse kinematics results, keyed
+/// on a discrete coordinate. Both successful and failed solves are stored. All
+/// methods may be called concurrently.
+class IKSolutionCache
+{
+public:
+
+    typedef std::vector<int> Key;
+
+    struct Stats
+    {
+        std::size_t hits;
+        std::size_t misses;
+        std::size_t evictions;
+    };
+
+    explicit IKSolutionCache(std::size_t capacity = 0);
+
+    IKSolutionCache(const IKSolutionCache&) = delete;
+    IKSolutionCache& operator=(const IKSolutionCache&) = delete;
+
+    std::size_t capacity() const;
+    void setCapacity(std::size_t capacity);
+
+    std::size_t size() const;
+
+    bool lookup(const Key& key, bool& found, RobotState& solution);
+    void insert(const Key& key, bool found, const RobotState& solution);
+
+    void clear();
+
+    Stats stats() const;
+    void resetStats();
+
+private:
+
+    struct Entry
+    {
+        Key key;
+        bool found;
+        RobotState solution;
+    };
+
+    struct KeyHash
+    {
+        typedef Key argument_type;
+        typedef std::size_t result_type;
+        result_type operator()(const argument_type& key) const;
+    };
+
+    typedef std::list<Entry> entry_list;
+
+    mutable std::mutex m_mutex;
+
+    std::size_t m_capacity;
+
+    // entries in order of most recent use
+    entry_list m_entries;
+    hash_map<Key, entry_list::iterator, KeyHash> m_index;
+
+    Stats m_stats;
+
+    void evict(std::size_t count);
+};
+
+} // namespace motion
+} // namespace sbpl
+
+#endif
@@ -0,0 +1,153 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#ifndef SMPL_LATTICE_STATE_TABLE_H
+#define SMPL_LATTICE_STATE_TABLE_H
+
+// standard includes
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace sbpl {
+namespace motion {
+
+/// Storage for the discrete and continuous coordinates of lattice states.
+///
+/// Coordinates are stored in fixed-stride arenas allocated in blocks of
+/// states, so pointers returned by coord() and state() remain valid until the
+/// table is cleared. States are indexed by their discrete coordinates using an
+/// open-addressing hash table that is queried directly with a pointer to the
+/// coordinate. States may also be reserved without being indexed, for states,
+/// such as a representative goal state, that should not be found by lookups.
+///
+/// Clearing the table is constant time; memory is retained and reused for the
+/// states created afterwards.
+class LatticeStateTable
+{
+public:
+
+    LatticeStateTable();
+    explicit LatticeStateTable(int dimension);
+
+    /// Set the number of variables per state. Clears the table.
+    void setDimension(int dimension);
+
+    int dimension() const { return m_dim; }
+    int size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    /// Remove all states from the table.
+    void clear();
+
+    /// Return the id of the indexed state with the given coordinate or -1 if
+    /// no such state exists.
+    int find(const int* coord) const;
+
+    /// Allocate a new, unindexed state and return its id.
+    int reserve();
+
+    /// Set the coordinates of a state. Must not be called on an indexed state.
+    void assign(int state_id, const int* coord, const double* state);
+
+    /// Allocate a new state with the given coordinates, index it by its
+    /// discrete coordinate, and return its id. The coordinate must not already
+    /// be indexed.
+    int insert(const int* coord, const double* state);
+
+    const int* coord(int state_id) const;
+    const double* state(int state_id) const;
+
+private:
+
+    static const int BlockShift = 10;
+    static const int BlockSize = 1 << BlockShift;
+    static const int BlockMask = BlockSize - 1;
+
+    struct Slot
+    {
+        int id;
+        std::uint32_t hash;
+        std::uint32_t stamp;
+    };
+
+    int m_dim;
+    int m_size;
+
+    std::vector<std::unique_ptr<int[]>> m_coord_blocks;
+    std::vector<std::unique_ptr<double[]>> m_state_blocks;
+
+    // slots are occupied iff their stamp matches the current stamp
+    std::vector<Slot> m_slots;
+    int m_indexed;
+    std::uint32_t m_stamp;
+
+    std::uint32_t hashCoord(const int* coord) const;
+    bool equalCoord(const int* a, const int* b) const;
+
+    int* coordMutable(int state_id);
+    double* stateMutable(int state_id);
+
+    void rehash(std::size_t slot_count);
+};
+
+inline
+const int* LatticeStateTable::coord(int state_id) const
+{
+    return m_coord_blocks[state_id >> BlockShift].get() +
+            (state_id & BlockMask) * m_dim;
+}
+
+inline
+const double* LatticeStateTable::state(int state_id) const
+{
+    return m_state_blocks[state_id >> BlockShift].get() +
+            (state_id & BlockMask) * m_dim;
+}
+
+inline
+int* LatticeStateTable::coordMutable(int state_id)
+{
+    return m_coord_blocks[state_id >> BlockShift].get() +
+            (state_id & BlockMask) * m_dim;
+}
+
+inline
+double* LatticeStateTable::stateMutable(int state_id)
+{
+    return m_state_blocks[state_id >> BlockShift].get() +
+            (state_id & BlockMask) * m_dim;
+}
+
+} // namespace motion
+} // namespace sbpl
+
+#endif
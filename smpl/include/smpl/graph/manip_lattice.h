@@ -40,9 +40,6 @@
 #include <unordered_map>
 #include <vector>
 
-// system includes
-#include <boost/functional/hash.hpp>
-
 // project includes
 #include <smpl/angles.h>
 #include <smpl/time.h>
@@ -50,7 +47,9 @@
 #include <smpl/occupancy_grid.h>
 #include <smpl/planning_params.h>
 #include <smpl/robot_model.h>
+#include <smpl/thread_pool.h>
 #include <smpl/types.h>
+#include <smpl/graph/lattice_state_table.h>
 #include <smpl/graph/robot_planning_space.h>
 
 namespace sbpl {
@@ -60,43 +59,31 @@ class RobotHeuristic;
 
 typedef std::vector<int> RobotCoord;
 
+/// View of a state stored in a ManipLattice. The pointed-to coordinates
+/// remain valid until the lattice's states are cleared.
 struct ManipLatticeState
 {
-    RobotCoord coord;   // discrete coordinate
-    RobotState state;   // corresponding continuous coordinate
-};
-
-inline
-bool operator==(const ManipLatticeState& a, const ManipLatticeState& b)
-{
-    return a.coord == b.coord;
-}
+    const int* coord;       // discrete coordinate
+    const double* state;    // corresponding continuous coordinate
+    int size;               // number of joint variables
 
-} // namespace motion
-} // namespace sbpl
+    ManipLatticeState() : coord(nullptr), state(nullptr), size(0) { }
 
-namespace std {
+    explicit operator bool() const { return coord != nullptr; }
 
-template <>
-struct hash<sbpl::motion::ManipLatticeState>
-{
-    typedef sbpl::motion::ManipLatticeState argument_type;
-    typedef std::size_t result_type;
-    result_type operator()(const argument_type& s) const;
+    RobotCoord getCoord() const { return RobotCoord(coord, coord + size); }
+    RobotState getState() const { return RobotState(state, state + size); }
 };
 
-} // namespace std
-
-namespace sbpl {
-namespace motion {
-
 SBPL_CLASS_FORWARD(ManipLattice);
 
 /// \class Discrete space constructed by expliciting discretizing each joint
 class ManipLattice :
     public RobotPlanningSpace,
     public PoseProjectionExtension,
-    public ExtractRobotStateExtension
+    public ExtractRobotStateExtension,
+    public BatchSuccessorsExtension,
+    public ChangedEdgesExtension
 {
 public:
 
@@ -115,9 +102,16 @@ public:
 
     void getExpandedStates(std::vector<RobotState>& states) const;
 
+    virtual void clearStates();
+
     void setVisualizationFrameId(const std::string& frame_id);
     const std::string& visualizationFrameId() const;
 
+    bool setSuccessorThreadContexts(
+        const std::vector<RobotModel*>& robots,
+        const std::vector<CollisionChecker*>& checkers);
+    int successorThreadCount() const;
+
     /// \name Reimplemented Public Functions from RobotPlanningSpace
     ///@{
     void GetLazySuccs(
@@ -138,6 +132,19 @@ public:
     bool projectToPose(int state_id, Eigen::Affine3d& pos);
     ///@}
 
+    /// \name Required Public Functions from BatchSuccessorsExtension
+    ///@{
+    void GetBatchSuccs(
+        const std::vector<int>& state_ids,
+        std::vector<std::vector<int>>* succs,
+        std::vector<std::vector<int>>* costs) override;
+    ///@}
+
+    /// \name Required Public Functions from ChangedEdgesExtension
+    ///@{
+    void getChangedEdgeSources(std::vector<int>& state_ids) override;
+    ///@}
+
     /// \name Required Public Functions from RobotPlanningSpace
     ///@{
     bool setStart(const RobotState& state) override;
@@ -175,20 +182,29 @@ protected:
     void stateToCoord(const RobotState& state, RobotCoord& coord) const;
     ///@}
 
-    ManipLatticeState* getHashEntry(int state_id) const;
+    ManipLatticeState getHashEntry(int state_id) const;
 
-    int getHashEntry(const RobotCoord& coord);
+    int getHashEntry(const RobotCoord& coord) const;
     int createHashEntry(const RobotCoord& coord, const RobotState& state);
     int getOrCreateState(const RobotCoord& coord, const RobotState& state);
     int reserveHashEntry();
+    void setHashEntry(
+        int state_id,
+        const RobotCoord& coord,
+        const RobotState& state);
 
     bool computePlanningFrameFK(
         const RobotState& state,
         std::vector<double>& pose) const;
 
+    bool computePlanningFrameFK(
+        ForwardKinematicsInterface* fk_iface,
+        const RobotState& state,
+        std::vector<double>& pose) const;
+
     int cost(
-        ManipLatticeState* HashEntry1,
-        ManipLatticeState* HashEntry2,
+        const ManipLatticeState& HashEntry1,
+        const ManipLatticeState& HashEntry2,
         bool bState2IsGoal) const;
 
     bool checkAction(
@@ -196,6 +212,13 @@ protected:
         const Action& action,
         double& dist);
 
+    bool checkAction(
+        RobotModel* robot,
+        CollisionChecker* checker,
+        const RobotState& state,
+        const Action& action,
+        double& dist) const;
+
     bool isGoal(const RobotState& state, const std::vector<double>& pose);
 
     visualization_msgs::MarkerArray getStateVisualization(
@@ -204,8 +227,50 @@ protected:
 
 private:
 
+    // per-thread resources for checking successors; context 0 always refers
+    // to the robot model and collision checker of the planning space
+    struct ThreadContext
+    {
+        RobotModel* robot;
+        ForwardKinematicsInterface* fk_iface;
+        CollisionChecker* checker;
+    };
+
+    // an action to be checked and the state it is applied from
+    struct ActionCheck
+    {
+        const RobotState* state;
+        const Action* action;
+    };
+
+    // result of checking a single action, merged in action order
+    struct ActionResult
+    {
+        bool valid;
+        std::vector<double> tgt_off_pose;
+    };
+
     ForwardKinematicsInterface* m_fk_iface;
 
+    std::vector<ThreadContext> m_thread_contexts;
+    std::unique_ptr<ThreadPool> m_succ_pool;
+    std::vector<ActionCheck> m_action_checks;
+    std::vector<ActionResult> m_action_results;
+
+    // per-thread scratch for computing the planning frame poses of valid
+    // actions in batches
+    struct FKBatch
+    {
+        std::vector<int> checks;
+        std::vector<RobotState> states;
+        std::vector<std::vector<double>> poses;
+    };
+    std::vector<FKBatch> m_fk_batches;
+
+    // scratch storage for the states and actions of batched expansions
+    std::vector<RobotState> m_batch_states;
+    std::vector<std::vector<Action>> m_batch_actions;
+
     // cached from robot model
     std::vector<double> m_min_limits;
     std::vector<double> m_max_limits;
@@ -218,27 +283,53 @@ private:
     int m_goal_state_id;
     int m_start_state_id;
 
-    // maps from coords to stateID
-    typedef ManipLatticeState StateKey;
-    typedef PointerValueHash<StateKey> StateHash;
-    typedef PointerValueEqual<StateKey> StateEqual;
-    hash_map<StateKey*, int, StateHash, StateEqual> m_state_to_id;
+    // maps between coords and state ids
+    LatticeStateTable m_states;
 
-    // maps from stateID to coords
-    std::vector<ManipLatticeState*> m_states;
+    // scratch storage for states handed out by reference
+    RobotState m_parent_state;
+    RobotState m_extract_state;
 
-    // stateIDs of expanded states
+    // stateIDs of states expanded since the start state was last set
     std::vector<int> m_expanded_states;
+
+    // stateIDs of all states expanded since the last call to clearStates(),
+    // whose edges may need to be regenerated when the environment changes,
+    // each listed once
+    std::vector<int> m_edge_sources;
+    std::vector<bool> m_is_edge_source;
     bool m_near_goal;
     clock::time_point m_t_start;
 
     std::string m_viz_frame_id;
 
+    void recordExpansion(int state_id);
+
     bool setGoalPose(const GoalConstraint& goal);
     bool setGoalConfiguration(const GoalConstraint& goal);
 
     void startNewSearch();
 
+    void allocateIndexMapping(int state_id);
+
+    bool getActions(
+        int state_id,
+        RobotState& state,
+        std::vector<Action>& actions);
+
+    void checkActions();
+
+    bool isActionAffected(const RobotState& state, const Action& action);
+
+    void clearEnvironmentChanges();
+
+    void addSuccessors(
+        int state_id,
+        const std::vector<Action>& actions,
+        size_t result_offset,
+        std::vector<int>* succs,
+        std::vector<int>* costs);
+
     std::vector<double> getTargetOffsetPose(
         const std::vector<double>& tip_pose) const;
 
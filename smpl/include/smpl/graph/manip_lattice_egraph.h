@@ -34,6 +34,7 @@
 
 #include <smpl/graph/experience_graph.h>
 #include <smpl/graph/experience_graph_extension.h>
+#include <smpl/graph/experience_graph_file.h>
 #include <smpl/graph/manip_lattice.h>
 
 namespace sbpl {
@@ -50,6 +51,8 @@ public:
 
     /// \name Reimplemented Public Functions from ManipLattice
     ///@{
+    void clearStates() override;
+
     bool extractPath(
         const std::vector<int>& ids,
         std::vector<RobotState>& path) override;
@@ -117,6 +120,14 @@ private:
         const std::string& filepath,
         std::vector<RobotState>& egraph_states) const;
 
+    bool loadBinaryExperienceGraph(const std::string& filepath);
+    bool hasDiscretization(const ExperienceGraphDiscretization& disc) const;
+
+    void insertExperienceGraphPath(const std::vector<RobotState>& egraph_states);
+    ExperienceGraph::node_id insertExperienceGraphNode(
+        const RobotState& state,
+        const RobotCoord& coord);
+
     void rasterizeExperienceGraph();
 };
 
@@ -33,11 +33,13 @@
 #define SMPL_ROBOT_PLANNING_SPACE_H
 
 // standard includes
+#include <utility>
 #include <vector>
 
 // system includes
 #include <Eigen/Dense>
 #include <sbpl/discrete_space_information/environment.h>
+#include <sbpl/planners/planner.h>
 
 // project includes
 #include <smpl/collision_checker.h>
@@ -202,9 +204,67 @@ public:
 
     virtual ~ExtractRobotStateExtension() { }
 
+    /// Return the robot state corresponding to a graph state. Implementations
+    /// may reuse storage for the returned state, so the reference is only
+    /// guaranteed to be valid until the next call to extractState(), and
+    /// callers needing more than one state at a time must copy all but the
+    /// last. Implementations need not be safe to call concurrently.
     virtual const RobotState& extractState(int state_id) = 0;
 };
 
+class BatchSuccessorsExtension : public virtual Extension
+{
+public:
+
+    virtual ~BatchSuccessorsExtension() { }
+
+    /// Generate the successors of several states at once, allowing the
+    /// implementation to check the outgoing edges of all states concurrently.
+    /// The successors and costs of state_ids[i] are stored in (*succs)[i] and
+    /// (*costs)[i] and must be identical to those returned by GetSuccs().
+    virtual void GetBatchSuccs(
+        const std::vector<int>& state_ids,
+        std::vector<std::vector<int>>* succs,
+        std::vector<std::vector<int>>* costs) = 0;
+};
+
+class ChangedEdgesExtension : public virtual Extension
+{
+public:
+
+    virtual ~ChangedEdgesExtension() { }
+
+    /// Return the states, among those expanded since the states of the space
+    /// were last cleared, with an outgoing edge whose cost may have been
+    /// changed by modifications to the environment since the last call. The result may be reported to a
+    /// search via SBPLPlanner::costs_changed() using a ChangedEdgesQuery.
+    virtual void getChangedEdgeSources(std::vector<int>& state_ids) = 0;
+};
+
+/// A StateChangeQuery that reports the source states of changed edges as the
+/// predecessors of the changed states. No successors are reported; the search
+/// is expected to regenerate the edges of each source state.
+class ChangedEdgesQuery : public StateChangeQuery
+{
+public:
+
+    explicit ChangedEdgesQuery(std::vector<int> sources) :
+        m_sources(std::move(sources)),
+        m_targets()
+    { }
+
+    const std::vector<int>* getPredecessors() const override
+    { return &m_sources; }
+
+    const std::vector<int>* getSuccessors() const override
+    { return &m_targets; }
+
+private:
+
+    std::vector<int> m_sources;
+    std::vector<int> m_targets;
+};
+
 inline
 size_t RobotPlanningSpace::numHeuristics() const
 {
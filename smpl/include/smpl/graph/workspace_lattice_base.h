@@ -33,6 +33,7 @@
 #define SMPL_WORKSPACE_LATTICE_BASE_H
 
 // project includes
+#include <smpl/graph/ik_solution_cache.h>
 #include <smpl/graph/robot_planning_space.h>
 
 namespace sbpl {
@@ -94,8 +95,17 @@ protected:
     int m_dof_count;
     std::vector<std::size_t> m_fangle_indices;
 
+    // results of stateWorkspaceToRobot, keyed on the discretized pose,
+    // redundant joint variables, and seed used by the solve
+    mutable IKSolutionCache m_ik_cache;
+    std::vector<double> m_ik_cache_fangle_res;
+    double m_ik_cache_seed_res;
+    bool m_ik_cache_persistent;
+
     size_t freeAngleCount() const { return m_fangle_indices.size(); }
 
+    void startIKCacheQuery();
+
     // conversions between robot states, workspace states, and workspace coords
     void stateRobotToWorkspace(const RobotState& state, WorkspaceState& ostate) const;
     void stateRobotToCoord(const RobotState& state, WorkspaceCoord& coord) const;
@@ -107,6 +117,23 @@ protected:
     bool stateWorkspaceToRobot(
         const WorkspaceState& state, const RobotState& seed, RobotState& ostate) const;
 
+    bool statesWorkspaceToRobot(
+        const std::vector<WorkspaceState>& states,
+        const RobotState& seed,
+        std::vector<RobotState>& ostates) const;
+
+    bool computeCachedIK(
+        const SixPose& pose,
+        const RobotState& seed,
+        bool seeded,
+        RobotState& solution) const;
+
+    void makeIKCacheKey(
+        const SixPose& pose,
+        const RobotState& seed,
+        bool seeded,
+        IKSolutionCache::Key& key) const;
+
     // TODO: variants of workspace -> robot that don't restrict redundant angles
     // TODO: variants of workspace -> robot that take in a full seed state
 
@@ -91,7 +91,11 @@ private:
     int m_goal_y;
     int m_goal_z;
 
+    // version of the occupancy grid reflected in the bfs walls
+    unsigned int m_grid_version;
+
     void syncGridAndBfs();
+    bool updateWalls();
     int getBfsCostToGoal(const BFS_3D& bfs, int x, int y, int z) const;
 };
 
@@ -33,6 +33,10 @@
 #define SMPL_EGRAPH_BFS_HEURISTIC_H
 
 // standard includes
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 // project includes
@@ -55,6 +59,8 @@ public:
         const RobotPlanningSpacePtr& pspace,
         const OccupancyGrid* grid);
 
+    ~DijkstraEgraphHeuristic3D();
+
     visualization_msgs::MarkerArray getWallsVisualization();
     visualization_msgs::MarkerArray getValuesVisualization();
 
@@ -102,8 +108,12 @@ private:
     {
         int dist;
 
+        // index of the down-projected experience graph node in this cell, or
+        // -1 if no experience graph state projects to this cell
+        int egraph_node;
+
         Cell() = default;
-        explicit Cell(int d) : heap_element(), dist(d) { }
+        explicit Cell(int d) : heap_element(), dist(d), egraph_node(-1) { }
     };
 
     Grid3<Cell> m_dist_grid;
@@ -122,34 +132,61 @@ private:
     PointProjectionExtension* m_pp;
     ExperienceGraphExtension* m_eg;
 
-    // map down-projected state cells to adjacent down-projected state cells
-    struct Vector3iHash
-    {
-        typedef Eigen::Vector3i argument_type;
-        typedef std::size_t result_type;
+    // offsets, in m_dist_grid, to the 26 neighbors of a cell and the costs of
+    // the edges to them
+    int m_neighbor_offsets[26];
+    int m_neighbor_costs[26];
 
-        result_type operator()(const argument_type& s) const;
-    };
-
-    // map from experience graph nodes to their heuristic cell coordinates
+    // map from experience graph nodes to their projected points and heuristic
+    // cell coordinates ((-1, -1, -1) for points outside the grid)
+    std::vector<Eigen::Vector3d> m_projected_points;
     std::vector<Eigen::Vector3i> m_projected_nodes;
 
     // map from experience graph nodes to their component ids
     std::vector<int> m_component_ids;
     std::vector<std::vector<ExperienceGraph::node_id>> m_shortcut_nodes;
 
-    struct HeuristicNode
+    struct EgraphEdge
     {
-        std::vector<ExperienceGraph::node_id> up_nodes;
-
-        std::vector<Eigen::Vector3i> edges;
+        int cell; // index of the adjacent cell in m_dist_grid
+        int cost;
     };
 
-    hash_map<Eigen::Vector3i, HeuristicNode, Vector3iHash> m_heur_nodes;
+    // adjacency lists of the down-projected experience graph nodes, in
+    // compressed row form: the edges of node n are the entries of
+    // m_egraph_edges in [m_egraph_edge_offsets[n], m_egraph_edge_offsets[n + 1])
+    std::vector<int> m_egraph_edge_offsets;
+    std::vector<EgraphEdge> m_egraph_edges;
+
+    // experience graph nodes projected to each down-projected node, in the
+    // same form
+    std::vector<int> m_up_node_offsets;
+    std::vector<ExperienceGraph::node_id> m_up_nodes;
+
+    // the cell of each down-projected node
+    std::vector<int> m_egraph_cells;
+
+    // state of the search when run eagerly on a background thread; the
+    // distance grid and open list are guarded by m_search_mutex until
+    // m_search_done is set
+    bool m_eager;
+    std::thread m_search_thread;
+    std::mutex m_search_mutex;
+    std::condition_variable m_search_cv;
+    std::atomic<bool> m_search_done;
+    std::atomic<bool> m_search_cancel;
+    int m_search_key; // distance of the most recently expanded cell
+
+    int m_last_expand_count;
+    int m_repeat_count;
 
     void projectExperienceGraph();
     int getGoalHeuristic(const Eigen::Vector3i& dp);
 
+    void expand(Cell* cell);
+    void searchEagerly();
+    void stopSearch();
+
     void syncGridAndDijkstra();
 };
 
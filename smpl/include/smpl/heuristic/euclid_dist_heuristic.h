@@ -38,7 +38,9 @@
 namespace sbpl {
 namespace motion {
 
-class EuclidDistHeuristic : public RobotHeuristic
+class EuclidDistHeuristic :
+    public RobotHeuristic,
+    public PairwiseHeuristicExtension
 {
 public:
 
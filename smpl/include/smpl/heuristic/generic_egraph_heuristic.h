@@ -91,9 +91,17 @@ private:
     RobotHeuristicPtr m_orig_h;
 
     ExperienceGraphExtension* m_eg;
+    ExtractRobotStateExtension* m_ers;
 
     double m_eg_eps;
 
+    // joint-space radius searched for states equivalent under the original
+    // heuristic, or 0 (the default) to test every experience graph node. The
+    // radius is measured without wrapping continuous joints, and must be
+    // chosen to contain every state the original heuristic considers
+    // equivalent, or equivalent states will be missed.
+    double m_equiv_radius;
+
     std::vector<int> m_component_ids;
     std::vector<std::vector<ExperienceGraph::node_id>> m_shortcut_nodes;
 
@@ -114,6 +122,10 @@ private:
     };
 
     std::vector<HeuristicNode> m_h_nodes;
+
+    // experience graph nodes in order of increasing heuristic distance
+    std::vector<ExperienceGraph::node_id> m_nodes_by_dist;
+
     intrusive_heap<HeuristicNode, NodeCompare> m_open;
 };
 
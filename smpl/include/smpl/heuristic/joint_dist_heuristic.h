@@ -38,7 +38,9 @@
 namespace sbpl {
 namespace motion {
 
-class JointDistHeuristic : public RobotHeuristic
+class JointDistHeuristic :
+    public RobotHeuristic,
+    public PairwiseHeuristicExtension
 {
 public:
 
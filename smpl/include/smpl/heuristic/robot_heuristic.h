@@ -101,6 +101,23 @@ private:
     const OccupancyGrid* m_grid;
 };
 
+/// \brief Extension for heuristics whose GetFromToHeuristic() is a lower bound
+///     on the cost between any two states.
+///
+/// Heuristics are only required to estimate the cost to the goal or from the
+/// start, and many return 0 from GetFromToHeuristic() for other pairs of
+/// states. Heuristics that provide this extension guarantee a meaningful bound
+/// between arbitrary states, as required to test the independence of states
+/// in parallel searches.
+class PairwiseHeuristicExtension : public virtual Extension
+{
+public:
+
+    virtual ~PairwiseHeuristicExtension() { }
+
+    virtual int GetFromToHeuristic(int from_id, int to_id) = 0;
+};
+
 } // namespace motion
 } // namespace sbpl
 
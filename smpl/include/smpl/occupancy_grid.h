@@ -35,6 +35,7 @@
 
 // standard includes
 #include <algorithm>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -44,6 +45,7 @@
 #include <visualization_msgs/MarkerArray.h>
 
 // project includes
+#include <smpl/distance_map/dense_distance_query.h>
 #include <smpl/distance_map/distance_map_interface.h>
 #include <smpl/forward.h>
 
@@ -77,9 +79,29 @@ public:
         const std::vector<Eigen::Vector3d>& old_points,
         const std::vector<Eigen::Vector3d>& new_points);
 
+    void updatePointsInField(
+        const std::vector<const std::vector<Eigen::Vector3d>*>& removed,
+        const std::vector<const std::vector<Eigen::Vector3d>*>& added);
+
     void reset();
     ///@}
 
+    /// \name Persistence
+    ///@{
+    bool saveCache(const std::string& path, std::uint64_t scene_hash) const;
+    bool loadCache(const std::string& path, std::uint64_t scene_hash);
+    ///@}
+
+    /// \name Change Tracking
+    ///@{
+    unsigned int version() const { return m_version; }
+
+    bool getChangedCells(
+        unsigned int since_version,
+        int& min_x, int& min_y, int& min_z,
+        int& max_x, int& max_y, int& max_z) const;
+    ///@}
+
     /// \name Properties
     ///@{
     double originX() const { return m_grid->originX(); }
@@ -127,6 +149,8 @@ public:
     double getDistanceToBorder(int x, int y, int z) const;
 
     double getDistanceToBorder(double x, double y, double z) const;
+
+    const DenseDistanceQuery* getDenseDistanceQuery() const;
     ///@}
 
     /// \name Conversions Between Cell and Metric Coordinates
@@ -164,9 +188,33 @@ private:
     int m_y_stride;
     std::vector<int> m_counts;
 
+    // bounding boxes of the cells modified by each change, in order of
+    // increasing version
+    struct CellChange
+    {
+        unsigned int version;
+        int min_x, min_y, min_z;
+        int max_x, max_y, max_z;
+    };
+
+    unsigned int m_version;
+    std::vector<CellChange> m_changes;
+
+    // non-virtual query handle for m_grid, if it is one of the dense
+    // DistanceMap types
+    DenseDistanceQuery m_dense_query;
+    bool m_has_dense_query;
+
     void initRefCounts();
+    void initDenseQuery();
+
+    void recordChange(const std::vector<Eigen::Vector3d>& points);
+    void recordChange(
+        int min_x, int min_y, int min_z,
+        int max_x, int max_y, int max_z);
 
     int coordToIndex(int x, int y, int z) const;
+    void indexToCoord(int idx, int& x, int& y, int& z) const;
 
     int getCellCount() const;
 
@@ -212,6 +260,9 @@ void OccupancyGrid::setReferenceFrame(const std::string& frame)
 inline
 double OccupancyGrid::getDistance(int x, int y, int z) const
 {
+    if (m_has_dense_query) {
+        return m_dense_query.getCellDistance(x, y, z);
+    }
     return m_grid->getCellDistance(x, y, z);
 }
 
@@ -219,12 +270,18 @@ double OccupancyGrid::getDistance(int x, int y, int z) const
 inline
 double OccupancyGrid::getDistanceFromPoint(double x, double y, double z) const
 {
+    if (m_has_dense_query) {
+        return m_dense_query.getMetricDistance(x, y, z);
+    }
     return m_grid->getMetricDistance(x, y, z);
 }
 
 inline
 double OccupancyGrid::getSquaredDist(double x, double y, double z) const
 {
+    if (m_has_dense_query) {
+        return m_dense_query.getMetricSquaredDistance(x, y, z);
+    }
     return m_grid->getMetricSquaredDistance(x, y, z);
 }
 
@@ -249,6 +306,18 @@ double OccupancyGrid::getDistanceToBorder(double x, double y, double z) const
     return getDistanceToBorder(gx, gy, gz);
 }
 
+/// Return a non-virtual handle for querying the distance map, or nullptr if
+/// the distance map is not one of the dense DistanceMap types. Distance
+/// queries made through the handle are identical to, and considerably cheaper
+/// than, those made through the DistanceMapInterface. The handle remains
+/// valid for the lifetime of the OccupancyGrid, and is kept up to date across
+/// loadCache() and modifications made through the OccupancyGrid.
+inline
+const DenseDistanceQuery* OccupancyGrid::getDenseDistanceQuery() const
+{
+    return m_has_dense_query ? &m_dense_query : nullptr;
+}
+
 inline
 bool OccupancyGrid::isInBounds(int x, int y, int z) const
 {
@@ -269,6 +338,15 @@ int OccupancyGrid::coordToIndex(int x, int y, int z) const
     return x * m_x_stride + y * m_y_stride + z;
 }
 
+inline
+void OccupancyGrid::indexToCoord(int idx, int& x, int& y, int& z) const
+{
+    x = idx / m_x_stride;
+    idx -= x * m_x_stride;
+    y = idx / m_y_stride;
+    z = idx - y * m_y_stride;
+}
+
 inline
 int OccupancyGrid::getCellCount() const
 {
@@ -34,6 +34,7 @@
 #define SMPL_POST_PROCESSING_H
 
 // standard includes
+#include <limits>
 #include <vector>
 
 // system includes
@@ -41,6 +42,7 @@
 
 // project includes
 #include <smpl/collision_checker.h>
+#include <smpl/flat_path.h>
 #include <smpl/robot_model.h>
 #include <smpl/planning_params.h>
 #include <smpl/types.h>
@@ -48,17 +50,36 @@
 namespace sbpl {
 namespace motion {
 
+/// Shortcut a path. The validity of motions between waypoints of the path is
+/// determined at most once per call, however many shortcutting strategies
+/// consider them. Once allowed_time seconds have elapsed, motions whose
+/// validity is not yet known are no longer checked and are not used as
+/// shortcuts, so the result is the best path found so far. For
+/// JOINT_POSITION_VELOCITY_SPACE shortcutting, the divide-and-conquer strategy
+/// runs concurrently with the iterative strategy if a second collision checker,
+/// aux_cc, is given for its exclusive use.
 void ShortcutPath(
     RobotModel* rm,
     CollisionChecker* cc,
     const std::vector<RobotState>& pin,
     std::vector<RobotState>& pout,
-    ShortcutType type);
+    ShortcutType type,
+    double allowed_time = std::numeric_limits<double>::infinity(),
+    CollisionChecker* aux_cc = nullptr);
 
 bool InterpolatePath(
     CollisionChecker& cc,
     std::vector<RobotState>& path);
 
+/// Interpolate a path into opath, replacing its contents but reusing its
+/// storage. Segments whose interpolation is invalid are replaced by their
+/// endpoints; interpolation of a segment is abandoned at its first invalid
+/// waypoint.
+bool InterpolatePath(
+    CollisionChecker& cc,
+    const std::vector<RobotState>& path,
+    FlatPath& opath);
+
 bool CreatePositionVelocityPath(
     RobotModel* rm,
     const std::vector<RobotState>& path,
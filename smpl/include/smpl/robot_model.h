@@ -109,6 +109,20 @@ public:
     virtual bool computePlanningLinkFK(
         const RobotState& state,
         std::vector<double>& pose) = 0;
+
+    /// \brief Compute forward kinematics of the planning link for several
+    ///     states.
+    ///
+    /// The pose of the planning link at \p states[i] is stored in
+    /// \p poses[i]. The default implementation calls computePlanningLinkFK()
+    /// for each state; implementations may reuse computation shared between
+    /// the states.
+    ///
+    /// \return true if forward kinematics were computed for all states; false
+    ///     otherwise
+    virtual bool computeBatchPlanningLinkFK(
+        const std::vector<RobotState>& states,
+        std::vector<std::vector<double>>& poses);
 };
 
 namespace ik_option {
@@ -164,6 +178,33 @@ public:
         const std::vector<double>& pose,
         const RobotState& start,
         RobotState& solution) = 0;
+
+    /// \brief Compute inverse kinematics solutions for several poses while
+    ///     restricting all redundant joint variables to the seed state.
+    ///
+    /// Solutions are computed in order, until the first pose with no solution.
+    /// The first pose is seeded with \p start and each subsequent pose with
+    /// the solution to the pose preceding it, so that the redundant joint
+    /// variables of all solutions match those of \p start. The solutions for
+    /// the poses preceding the first failure are stored in \p solutions. The
+    /// default implementation calls computeFastIK() for each pose;
+    /// implementations may share computation between the poses.
+    ///
+    /// \return true if solutions were found for all poses; false otherwise
+    virtual bool computeBatchFastIK(
+        const std::vector<std::vector<double>>& poses,
+        const RobotState& start,
+        std::vector<RobotState>& solutions);
+
+    /// \brief Return an identifier of the inverse kinematics solution branch
+    ///     that a state lies on, such as the configuration of the elbow and
+    ///     wrist, or -1 if branches are not identified.
+    ///
+    /// computeFastIK() is expected to select the same solution for seeds on
+    /// the same branch, with the same redundant joint variables, so that the
+    /// solution may be shared between them. The default implementation
+    /// returns -1.
+    virtual int ikSolutionBranch(const RobotState& state) const;
 };
 
 /// \brief Convenience class allowing a component to implement all root
@@ -34,6 +34,7 @@
 #define SMPL_PLANNER_INTERFACE_H
 
 // standard includes
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -71,6 +72,22 @@ class PlannerInterface
 {
 public:
 
+    /// Creates a robot model and collision checker for the exclusive use of one
+    /// additional planning thread. They must describe the same robot and world
+    /// as the robot model and collision checker given to the planner interface.
+    typedef std::function<bool(
+            std::unique_ptr<RobotModel>& robot,
+            std::unique_ptr<CollisionChecker>& checker)> ThreadContextFactory;
+
+    /// Applies the planning scene of a query to the robot model and collision
+    /// checker of an additional planning thread, created for an earlier query,
+    /// as it was applied to the collision checker given to the planner
+    /// interface.
+    typedef std::function<bool(
+            RobotModel& robot,
+            CollisionChecker& checker,
+            const moveit_msgs::PlanningScene& scene)> ThreadContextUpdater;
+
     PlannerInterface(
         RobotModel* robot,
         CollisionChecker* checker,
@@ -80,6 +97,9 @@ public:
 
     bool init(const PlanningParams& params);
 
+    void setThreadContextFactory(const ThreadContextFactory& factory);
+    void setThreadContextUpdater(const ThreadContextUpdater& updater);
+
     bool solve(
         const moveit_msgs::PlanningScene& planning_scene,
         const moveit_msgs::MotionPlanRequest& req,
@@ -147,6 +167,16 @@ protected:
     std::map<std::string, HeuristicAllocatorPtr> m_heuristic_allocators;
     std::map<std::string, PlannerAllocatorPtr> m_planner_allocators;
 
+    // robot models and collision checkers of additional planning threads
+    ThreadContextFactory m_thread_context_factory;
+    ThreadContextUpdater m_thread_context_updater;
+    std::vector<std::unique_ptr<RobotModel>> m_thread_robots;
+    std::vector<std::unique_ptr<CollisionChecker>> m_thread_checkers;
+
+    // whether the contexts of additional planning threads reflect the
+    // planning scene of the current query
+    bool m_thread_contexts_synced;
+
     // planner components
 
     RobotPlanningSpacePtr m_pspace;
@@ -157,6 +187,10 @@ protected:
 
     std::string m_planner_id;
 
+    // whether the current query continues the search of the previous query,
+    // repairing it for changes to the environment, rather than starting over
+    bool m_repair_search;
+
     moveit_msgs::MotionPlanRequest m_req;
     moveit_msgs::MotionPlanResponse m_res;
 
@@ -211,6 +245,10 @@ protected:
 
     void clearGraphStateToPlannerStateMap();
     bool reinitPlanner(const std::string& planner_id);
+    bool prepareRepair(bool planner_changed);
+    size_t initThreadContexts();
+    void initSuccessorThreads();
+    void syncThreadContexts(const moveit_msgs::PlanningScene& scene);
 
     bool isPathValid(const std::vector<RobotState>& path) const;
     void postProcessPath(std::vector<RobotState>& path) const;
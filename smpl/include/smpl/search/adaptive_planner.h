@@ -34,6 +34,7 @@
 
 // standard includes
 #include <random>
+#include <vector>
 
 // system includes
 #include <sbpl/planners/planner.h>
@@ -47,6 +48,19 @@
 namespace sbpl {
 namespace motion {
 
+/// Search with adaptive dimensionality: alternate between planning a path in a
+/// graph that is high-dimensional only in selected regions and tracking that
+/// path in the high-dimensional graph, growing the high-dimensional regions
+/// where tracking fails.
+///
+/// The planning and tracking phases run one after the other on the calling
+/// thread. They expand the same graph, in different modes, and the graph is
+/// not safe to search from two threads at once: successor generation inserts
+/// into shared state tables, reads a single mode, and shares one robot model
+/// and collision checker. Running the tracker for one path while the planner
+/// searches for the next would require the graph to keep separate state for
+/// each mode and thread. Instead, each search keeps its search tree between
+/// phases (see setIncrementalRepair()).
 class AdaptivePlanner : public SBPLPlanner
 {
 public:
@@ -71,6 +85,9 @@ public:
     double get_plan_eps() const { return m_eps_plan; }
     double get_track_eps() const { return m_eps_track; }
 
+    void setIncrementalRepair(bool enabled);
+    bool incrementalRepair() const { return m_planner.incrementalRepair(); }
+
     /// \name Reimplemented Public Functions from SBPLPlanner
     ///@{
     int replan(std::vector<int>* solution, ReplanParams params) override;
@@ -107,6 +124,7 @@ private:
     ARAStar m_tracker;
 
     AdaptiveGraphExtension* m_adaptive_graph;
+    ChangedEdgesExtension* m_changed_edges;
 
     TimeParameters m_time_params;
 
@@ -117,6 +135,21 @@ private:
 
     double m_eps_plan;
     double m_eps_track;
+
+    // statistics for each planning and tracking phase of the last call to
+    // replan(), in order
+    std::vector<PlannerStats> m_phase_stats;
+
+    int runPhase(
+        ARAStar& search,
+        ARAStar::TimeParameters time_params,
+        double time_remaining,
+        bool resume,
+        const clock::time_point& phase_start,
+        std::vector<int>& path,
+        int& cost);
+    void logPhase(const std::vector<int>& path, const PlannerStats& stats) const;
+    bool updateSearchTree(ARAStar& search);
 };
 
 } // namespace motion
@@ -32,6 +32,11 @@
 #ifndef SMPL_ARASTAR_H
 #define SMPL_ARASTAR_H
 
+// standard includes
+#include <stddef.h>
+#include <memory>
+#include <vector>
+
 // system includes
 #include <sbpl/heuristics/heuristic.h>
 #include <sbpl/planners/planner.h>
@@ -72,6 +77,24 @@ namespace sbpl {
 ///
 /// * The heuristics for any encountered states remain constant, unless the goal
 ///   state ID has changed.
+///
+/// If incremental repair is enabled, the successors of each expanded state are
+/// cached for the duration of the search, and reexpansions use the cached edges
+/// instead of regenerating them. costs_changed() then repairs the search tree
+/// in place, in the spirit of AD*, rather than restarting the search. The
+/// predecessors reported by the StateChangeQuery are taken to be the states
+/// whose outgoing edges changed. Their edges are regenerated and compared to
+/// the cached edges; the subtrees below edges that were removed or became more
+/// expensive are discarded and reconnected using the cached edges of the
+/// remaining states. The following call to replan() then continues the search
+/// from the initial suboptimality bound, expanding only as much of the graph as
+/// is required to find a solution in the modified graph.
+///
+/// Search states are allocated from blocks that are kept across calls to
+/// replan(). When the search is reinitialized, all search states are released
+/// at once by advancing a generation counter and the blocks are reused by the
+/// following search. At most memoryLimit() bytes of blocks are retained
+/// between searches; the search itself may temporarily use more.
 class ARAStar : public SBPLPlanner
 {
 public:
@@ -100,6 +123,12 @@ public:
     double allowedRepairTime() const
     { return to_seconds(m_time_params.max_allowed_time); }
 
+    void setMemoryLimit(size_t bytes);
+    size_t memoryLimit() const { return m_memory_limit; }
+
+    void setIncrementalRepair(bool enabled);
+    bool incrementalRepair() const { return m_incremental; }
+
     int replan(
         const TimeParameters &params,
         std::vector<int>* solution,
@@ -142,9 +171,12 @@ private:
         unsigned int f;     // (g + eps * h) at time of insertion into OPEN
         unsigned int eg;    // g-value at time of expansion
         unsigned short iteration_closed;
-        unsigned short call_number;
+        unsigned int call_number; // search generation the state belongs to
         SearchState* bp;
         bool incons;
+        int succs_begin;    // offset of cached successors or -1 if not cached
+        int succs_count;    // number of cached successors
+        int repair_status;  // membership in the set of discarded states
     };
 
     struct SearchStateCompare
@@ -164,15 +196,28 @@ private:
     double m_delta_eps;
 
     bool m_allow_partial_solutions;
+    bool m_incremental;
 
-    std::vector<SearchState*> m_states;
+    // search states are allocated sequentially from fixed-size blocks; the
+    // first m_state_count states belong to the current search generation
+    static const int StateBlockShift = 12;
+    static const size_t StateBlockSize = size_t(1) << StateBlockShift;
+    std::vector<std::unique_ptr<SearchState[]>> m_state_blocks;
+    size_t m_state_count;
+    size_t m_memory_limit;
 
     int m_start_state_id;   // graph state id for the start state
     int m_goal_state_id;    // graph state id for the goal state
 
-    // map from graph state id to search state id, incrementally expanded
-    // as states are encountered during the search
-    std::vector<int> m_graph_to_search_map;
+    // map from graph state id to search state, incrementally expanded as
+    // states are encountered during the search. entries from previous
+    // generations are detected and replaced lazily
+    std::vector<SearchState*> m_graph_to_search_map;
+
+    // successors and edge costs of expanded states, when incremental repair
+    // is enabled
+    std::vector<int> m_succ_ids;
+    std::vector<int> m_succ_costs;
 
     // search state (not including the values of g, f, back pointers, and
     // closed list from m_stats)
@@ -181,7 +226,7 @@ private:
     double m_curr_eps;
     int m_iteration;
 
-    int m_call_number;          // for lazy reinitialization of search states
+    unsigned int m_call_number; // generation of the current search states
     int m_last_start_state_id;  // for lazy reinitialization of the search tree
     int m_last_goal_state_id;   // for updating the search tree when the goal changes
     double m_last_eps;          // for updating the search tree when heuristics change
@@ -211,14 +256,25 @@ private:
         clock::duration& elapsed_time);
 
     void expand(SearchState* s);
+    void updateSuccessor(SearchState* s, SearchState* succ_state, int cost);
+    void cacheSuccessors(
+        SearchState* s,
+        const std::vector<int>& succs,
+        const std::vector<int>& costs);
+    void compactSuccessors();
+
+    void repairSearchTree(const std::vector<int>& changed_states);
 
     void recomputeHeuristics();
     void reorderOpen();
     int computeKey(SearchState* s) const;
 
     SearchState* getSearchState(int state_id);
+    SearchState* findSearchState(int state_id) const;
     SearchState* createState(int state_id);
-    void reinitSearchState(SearchState* state);
+    SearchState* stateAt(size_t index) const;
+    void clearStates();
+    void trimStates(size_t max_bytes);
 
     void extractPath(
         SearchState* to_state,
@@ -0,0 +1,203 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#ifndef SMPL_PARALLEL_ASTAR_H
+#define SMPL_PARALLEL_ASTAR_H
+
+// standard includes
+#include <stddef.h>
+#include <memory>
+#include <vector>
+
+// system includes
+#include <sbpl/heuristics/heuristic.h>
+#include <sbpl/planners/planner.h>
+
+// project includes
+#include <smpl/intrusive_heap.h>
+#include <smpl/time.h>
+
+namespace sbpl {
+
+namespace motion {
+class BatchSuccessorsExtension;
+class PairwiseHeuristicExtension;
+} // namespace motion
+
+/// An implementation of weighted PA*SE (Parallel A* for Slow Expansions). The
+/// search expands, in rounds, a batch of states from OPEN that are provably
+/// independent of all states ahead of them in OPEN, i.e. states whose g-values
+/// can not be improved by expanding any state with a smaller f-value. A state s
+/// is independent of a state s' with a smaller f-value if
+///
+///     g(s) - g(s') <= eps * h(s', s)
+///
+/// where h(s', s) is the pairwise heuristic given by GetFromToHeuristic(). The
+/// states of a batch may then be expanded in any order or concurrently without
+/// violating the suboptimality bound eps, and no state is expanded more than
+/// once.
+///
+/// The independence test is only useful if h(s', s) bounds the cost between
+/// arbitrary states, which heuristics declare by providing
+/// motion::PairwiseHeuristicExtension. With any other heuristic, the search
+/// runs in serial mode: each round expands only the minimum state in OPEN, and
+/// the search reduces to weighted A*.
+///
+/// If the graph provides motion::BatchSuccessorsExtension, the successors of
+/// each batch are generated with a single call to GetBatchSuccs(), which allows
+/// the graph to check the outgoing edges of all states of the batch on its own
+/// threads. Otherwise, the states of a batch are expanded with GetSuccs() one
+/// at a time. The search itself, including all updates to the graph, runs on
+/// the calling thread.
+///
+/// The search is started from scratch on every call to replan() and does not
+/// improve its solution after the first one is found.
+class ParallelAStar : public SBPLPlanner
+{
+public:
+
+    ParallelAStar(DiscreteSpaceInformation* space, Heuristic* heuristic);
+    ~ParallelAStar();
+
+    void setBatchSize(int size);
+    int batchSize() const { return m_batch_size; }
+
+    void setLookahead(int count);
+    int lookahead() const { return m_lookahead; }
+
+    /// \name Required Functions from SBPLPlanner
+    ///@{
+    int replan(double allowed_time_secs, std::vector<int>* solution) override;
+    int replan(double allowed_time_secs, std::vector<int>* solution, int* solcost) override;
+    int set_goal(int state_id) override;
+    int set_start(int state_id) override;
+    int force_planning_from_scratch() override;
+    int set_search_mode(bool bSearchUntilFirstSolution) override;
+    void costs_changed(const StateChangeQuery& stateChange) override;
+    ///@}
+
+    /// \name Reimplemented Functions from SBPLPlanner
+    ///@{
+    int replan(std::vector<int>* solution, ReplanParams params) override;
+    int replan(std::vector<int>* solution, ReplanParams params, int* solcost) override;
+    int force_planning_from_scratch_and_free_memory() override;
+    double get_solution_eps() const override;
+    int get_n_expands() const override;
+    double get_initial_eps() override;
+    double get_initial_eps_planning_time() override;
+    double get_final_eps_planning_time() override;
+    int get_n_expands_init_solution() override;
+    double get_final_epsilon() override;
+    void get_search_stats(std::vector<PlannerStats>* s) override;
+    void set_initialsolution_eps(double eps) override;
+    ///@}
+
+private:
+
+    struct SearchState : public heap_element
+    {
+        int state_id;       // corresponding graph state
+        unsigned int g;     // cost-to-come
+        unsigned int h;     // estimated cost-to-go
+        unsigned int f;     // (g + eps * h) at time of insertion into OPEN
+        unsigned int call_number; // search generation the state belongs to
+        SearchState* bp;
+        bool closed;
+    };
+
+    struct SearchStateCompare
+    {
+        bool operator()(const SearchState& s1, const SearchState& s2) const {
+            return s1.f < s2.f;
+        }
+    };
+
+    DiscreteSpaceInformation* m_space;
+    Heuristic* m_heur;
+    motion::PairwiseHeuristicExtension* m_pairwise;
+    motion::BatchSuccessorsExtension* m_batch_succs;
+
+    double m_eps;
+    bool m_bounded;
+    clock::duration m_allowed_time;
+
+    int m_batch_size;   // maximum number of states expanded per round
+    int m_lookahead;    // maximum number of states examined per round
+
+    // search states are allocated sequentially from fixed-size blocks; the
+    // first m_state_count states belong to the current search generation
+    static const int StateBlockShift = 12;
+    static const size_t StateBlockSize = size_t(1) << StateBlockShift;
+    std::vector<std::unique_ptr<SearchState[]>> m_state_blocks;
+    size_t m_state_count;
+
+    int m_start_state_id;
+    int m_goal_state_id;
+
+    std::vector<SearchState*> m_graph_to_search_map;
+
+    intrusive_heap<SearchState, SearchStateCompare> m_open;
+    unsigned int m_call_number;
+
+    // scratch storage for a single round of expansions
+    std::vector<SearchState*> m_candidates;
+    std::vector<SearchState*> m_batch;
+    std::vector<int> m_batch_ids;
+    std::vector<std::vector<int>> m_batch_succs_ids;
+    std::vector<std::vector<int>> m_batch_costs;
+
+    int m_expand_count;
+    int m_round_count;
+    clock::duration m_search_time;
+    double m_satisfied_eps;
+
+    int search(SearchState* goal_state);
+
+    bool selectBatch(SearchState* goal_state);
+    bool independent(const SearchState* s, const SearchState* t);
+    void expandBatch();
+
+    int computeKey(const SearchState* s) const;
+
+    SearchState* getSearchState(int state_id);
+    SearchState* createState(int state_id);
+    SearchState* stateAt(size_t index) const;
+    void clearStates();
+
+    void extractPath(
+        SearchState* to_state,
+        std::vector<int>& solution,
+        int& cost) const;
+};
+
+} // namespace sbpl
+
+#endif
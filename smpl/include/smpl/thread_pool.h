@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#ifndef SMPL_THREAD_POOL_H
+#define SMPL_THREAD_POOL_H
+
+// standard includes
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sbpl {
+
+/// A fixed-size pool of worker threads for fork-join style data parallelism.
+///
+/// The calling thread participates in each parallel loop as worker 0, so a
+/// pool constructed with n threads runs loops on n + 1 workers. Worker indices
+/// passed to the loop body are stable for the lifetime of the pool and may be
+/// used to index per-thread resources, such as collision checkers or scratch
+/// buffers, that are not safe to share between threads.
+///
+/// The indices of a loop are divided evenly between the workers up front. Each
+/// worker visits its own indices in order and, when it runs out, steals the
+/// back half of the remaining indices of another worker, so that loops whose
+/// iterations vary in cost remain balanced without contending on a shared
+/// counter.
+///
+/// Only one parallel loop may run at a time; parallelFor() must not be called
+/// concurrently from multiple threads, nor recursively from a loop body.
+class ThreadPool
+{
+public:
+
+    typedef std::function<void(int index, int worker)> LoopBody;
+
+    explicit ThreadPool(int num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /// Return the number of workers, including the calling thread.
+    int workerCount() const { return (int)m_threads.size() + 1; }
+
+    /// Call \p body once for each index in [0, count) and block until all
+    /// calls have returned. The order in which indices are visited is
+    /// unspecified.
+    void parallelFor(int count, const LoopBody& body);
+
+private:
+
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+
+    // the indices [begin, end) not yet claimed by a worker, packed as
+    // (begin << 32) | end so that they can be updated with a single CAS;
+    // padded to keep the ranges of different workers on separate cache lines
+    struct WorkRange
+    {
+        std::atomic<uint64_t> range;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    // state of the current loop, guarded by m_mutex except where atomic
+    const LoopBody* m_body;
+    std::unique_ptr<WorkRange[]> m_ranges;
+    int m_active;
+    unsigned m_generation;
+    bool m_shutdown;
+
+    void workerMain(int worker);
+    void runLoop(int worker);
+    bool popIndex(int worker, int& index);
+    bool stealIndices(int worker);
+};
+
+} // namespace sbpl
+
+#endif
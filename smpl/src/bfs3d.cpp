@@ -32,6 +32,12 @@
 
 #include <smpl/bfs3d/bfs3d.h>
 
+// standard includes
+#include <algorithm>
+
+// project includes
+#include <smpl/thread_pool.h>
+
 namespace sbpl {
 namespace motion {
 
@@ -47,7 +53,16 @@ BFS_3D::BFS_3D(int width, int height, int length) :
     m_running(false),
     m_neighbor_offsets(),
     m_closed(),
-    m_distances()
+    m_distances(),
+    m_num_threads(1),
+    m_pool(),
+    m_next_levels(),
+    m_has_distances(false),
+    m_sources(),
+    m_changed_cells(),
+    m_repair_check(),
+    m_repair_invalid(),
+    m_repair_buckets()
 {
     if (width <= 0 || height <= 0 || length <= 0) {
         return;
@@ -135,7 +150,18 @@ void BFS_3D::setWall(int x, int y, int z)
     }
 
     int node = getNode(x, y, z);
-    m_distance_grid[node] = WALL;
+    setWall(node);
+}
+
+void BFS_3D::unsetWall(int x, int y, int z)
+{
+    if (m_running) {
+        //error "Cannot modify grid while search is running"
+        return;
+    }
+
+    int node = getNode(x, y, z);
+    unsetWall(node);
 }
 
 bool BFS_3D::isWall(int x, int y, int z) const
@@ -174,21 +200,68 @@ void BFS_3D::run(int x, int y, int z)
     // initialize starting distance
     m_distance_grid[origin] = 0;
 
-    // fire off background thread to compute bfs
-    m_search_thread = boost::thread(
-            static_cast<void (BFS_3D::*)(int, int, int volatile*, int*, int&, int&)>(&BFS_3D::search),
-            this,
-            m_dim_x,
-            m_dim_xy,
-            m_distance_grid,
-            m_queue,
-            m_queue_head,
-            m_queue_tail);
+    startSearch();
+}
+
+void BFS_3D::setNumThreads(int num_threads)
+{
+    if (m_running) {
+        ROS_WARN("Cannot change the number of BFS threads while search is running");
+        return;
+    }
+
+    m_num_threads = std::max(num_threads, 1);
+    if (m_num_threads > 1) {
+        m_pool.reset(new ThreadPool(m_num_threads - 1));
+        m_next_levels.resize(m_pool->workerCount());
+    }
+    else {
+        m_pool.reset();
+        m_next_levels.clear();
+    }
+}
+
+// Fire off the background thread to compute the bfs from the cells in the
+// queue. The search is marked as running before the thread starts so that a
+// search that completes immediately is not reported as still running.
+void BFS_3D::startSearch()
+{
+    if (m_search_thread.joinable()) {
+        m_search_thread.join();
+    }
+
+    // remember the start cells so the search may be repaired later
+    m_sources.assign(m_queue + m_queue_head, m_queue + m_queue_tail);
+    m_changed_cells.clear();
+    m_has_distances = true;
+
     m_running = true;
+    if (m_pool) {
+        m_search_thread = boost::thread(
+                &BFS_3D::parallelSearch,
+                this,
+                m_distance_grid,
+                m_queue,
+                m_queue_head,
+                m_queue_tail);
+    }
+    else {
+        m_search_thread = boost::thread(
+                static_cast<void (BFS_3D::*)(int, int, int volatile*, int*, int&, int&)>(&BFS_3D::search),
+                this,
+                m_dim_x,
+                m_dim_xy,
+                m_distance_grid,
+                m_queue,
+                m_queue_head,
+                m_queue_tail);
+    }
 }
 
 void BFS_3D::run_components(int gx, int gy, int gz)
 {
+    m_has_distances = false;
+
     for (int i = 0; i < m_dim_xyz; i++) {
         if (m_distance_grid[i] != WALL) {
             m_distance_grid[i] = UNDISCOVERED;
@@ -275,6 +348,141 @@ void BFS_3D::run_components(int gx, int gy, int gz)
     }
 }
 
+// The repair proceeds in two phases. First, cells that have lost every
+// neighbor one step closer to a start cell are invalidated, which in turn may
+// invalidate the cells they supported. Then distances are propagated, in order
+// of increasing distance, from the valid cells bordering the invalidated and
+// cleared cells. Since distances may only decrease during propagation, a cell
+// may be reached more than once; stale bucket entries are skipped.
+bool BFS_3D::repair()
+{
+    if (!m_has_distances) {
+        return false;
+    }
+
+    if (m_search_thread.joinable()) {
+        m_search_thread.join();
+    }
+
+    if (m_changed_cells.empty()) {
+        return true;
+    }
+
+    if (m_changed_cells.size() > (size_t)(m_dim_xyz / 8)) {
+        return false;
+    }
+
+    for (int source : m_sources) {
+        if (m_distance_grid[source] == WALL) {
+            return false;
+        }
+    }
+
+    int volatile* distance_grid = m_distance_grid;
+    const int* offsets = m_neighbor_offsets;
+
+    auto is_valid = [](int d) { return d >= 0 && d != WALL; };
+
+    std::vector<int>& check = m_repair_check;
+    std::vector<int>& invalid = m_repair_invalid;
+    check.clear();
+    invalid.clear();
+
+    for (int node : m_changed_cells) {
+        if (distance_grid[node] != WALL) {
+            distance_grid[node] = UNDISCOVERED;
+            invalid.push_back(node);
+        }
+        for (int n = 0; n < 26; ++n) {
+            const int nn = node + offsets[n];
+            if (is_valid(distance_grid[nn]) && distance_grid[nn] > 0) {
+                check.push_back(nn);
+            }
+        }
+    }
+    m_changed_cells.clear();
+
+    // invalidate cells without support
+    while (!check.empty()) {
+        const int node = check.back();
+        check.pop_back();
+
+        const int d = distance_grid[node];
+        if (d <= 0 || d == WALL) {
+            continue; // start cell, wall, or already invalidated
+        }
+
+        bool supported = false;
+        for (int n = 0; n < 26; ++n) {
+            if (distance_grid[node + offsets[n]] == d - 1) {
+                supported = true;
+                break;
+            }
+        }
+        if (supported) {
+            continue;
+        }
+
+        distance_grid[node] = UNDISCOVERED;
+        invalid.push_back(node);
+        for (int n = 0; n < 26; ++n) {
+            const int nn = node + offsets[n];
+            if (distance_grid[nn] == d + 1) {
+                check.push_back(nn);
+            }
+        }
+    }
+
+    std::vector<std::vector<int>>& buckets = m_repair_buckets;
+    auto push = [&](int node, int d)
+    {
+        if (d >= (int)buckets.size()) {
+            buckets.resize(d + 1);
+        }
+        buckets[d].push_back(node);
+    };
+
+    // seed the propagation with the start cells, which may have been cleared
+    // and restored, and the valid cells bordering the invalidated region
+    for (int source : m_sources) {
+        distance_grid[source] = 0;
+        push(source, 0);
+    }
+    for (int node : invalid) {
+        for (int n = 0; n < 26; ++n) {
+            const int nn = node + offsets[n];
+            const int d = distance_grid[nn];
+            if (is_valid(d)) {
+                push(nn, d);
+            }
+        }
+    }
+
+    for (size_t d = 0; d < buckets.size(); ++d) {
+        const int next_d = (int)d + 1;
+        for (size_t i = 0; i < buckets[d].size(); ++i) {
+            const int node = buckets[d][i];
+            if (distance_grid[node] != (int)d) {
+                continue;
+            }
+            for (int n = 0; n < 26; ++n) {
+                const int nn = node + offsets[n];
+                const int dd = distance_grid[nn];
+                if (dd == WALL) {
+                    continue;
+                }
+                if (dd < 0 || dd > next_d) {
+                    distance_grid[nn] = next_d;
+                    push(nn, next_d);
+                }
+            }
+        }
+        buckets[d].clear();
+    }
+
+    return true;
+}
+
 bool BFS_3D::escapeCell(int x, int y, int z)
 {
     if (!inBounds(x, y, z)) {
@@ -535,6 +743,81 @@ void BFS_3D::search(
 
 #undef EXPAND_NEIGHBOR
 
+// levels smaller than this are expanded on the search thread alone, since the
+// cost of dispatching them to the pool exceeds the cost of expanding them
+static const int MIN_PARALLEL_LEVEL_SIZE = 1024;
+
+// number of consecutive queue entries expanded by a worker as one unit of work
+static const int LEVEL_BLOCK_SIZE = 256;
+
+// Expand the search level by level. The cells of each level occupy a
+// contiguous range of the queue; the range is divided into blocks that are
+// expanded concurrently, each worker claiming undiscovered neighbors with an
+// atomic compare-and-swap and collecting them in its own buffer. The buffers
+// are then appended to the queue to form the next level. Since every cell in
+// a level has the same distance, the distance assigned to a cell does not
+// depend on which worker claims it.
+void BFS_3D::parallelSearch(
+    int volatile* distance_grid,
+    int* queue,
+    int& queue_head,
+    int& queue_tail)
+{
+    const int* offsets = m_neighbor_offsets;
+
+    while (queue_head < queue_tail) {
+        const int level_begin = queue_head;
+        const int level_end = queue_tail;
+        const int level_size = level_end - level_begin;
+
+        if (level_size < MIN_PARALLEL_LEVEL_SIZE) {
+            for (int i = level_begin; i < level_end; ++i) {
+                const int currentNode = queue[i];
+                const int currentCost = distance_grid[currentNode] + 1;
+                for (int n = 0; n < 26; ++n) {
+                    const int nn = currentNode + offsets[n];
+                    if (distance_grid[nn] < 0) {
+                        queue[queue_tail++] = nn;
+                        distance_grid[nn] = currentCost;
+                    }
+                }
+            }
+        }
+        else {
+            const int block_count =
+                    (level_size + LEVEL_BLOCK_SIZE - 1) / LEVEL_BLOCK_SIZE;
+            m_pool->parallelFor(block_count, [&](int block, int worker)
+            {
+                std::vector<int>& next = m_next_levels[worker];
+                const int begin = level_begin + block * LEVEL_BLOCK_SIZE;
+                const int end = std::min(begin + LEVEL_BLOCK_SIZE, level_end);
+                for (int i = begin; i < end; ++i) {
+                    const int currentNode = queue[i];
+                    const int currentCost = distance_grid[currentNode] + 1;
+                    for (int n = 0; n < 26; ++n) {
+                        const int nn = currentNode + offsets[n];
+                        if (distance_grid[nn] == UNDISCOVERED &&
+                            __sync_bool_compare_and_swap(
+                                    &distance_grid[nn], UNDISCOVERED, currentCost))
+                        {
+                            next.push_back(nn);
+                        }
+                    }
+                }
+            });
+
+            for (std::vector<int>& next : m_next_levels) {
+                std::copy(next.begin(), next.end(), queue + queue_tail);
+                queue_tail += (int)next.size();
+                next.clear();
+            }
+        }
+
+        queue_head = level_end;
+    }
+    m_running = false;
+}
+
 #define EXPAND_NEIGHBOR_FRONTIER(offset) \
 {\
     if (distance_grid[currentNode + offset] < 0) {\
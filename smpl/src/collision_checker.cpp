@@ -46,6 +46,46 @@ CollisionChecker::~CollisionChecker()
 {
 }
 
+bool CollisionChecker::appendInterpolatedPath(
+    const RobotState& start,
+    const RobotState& finish,
+    FlatPath& path,
+    bool& valid)
+{
+    std::vector<RobotState> ipath;
+    if (!interpolatePath(start, finish, ipath)) {
+        return false;
+    }
+
+    // the start state is checked along with the interpolated waypoints, but
+    // is expected to already be in the path
+    const size_t mark = path.size();
+    valid = true;
+    for (size_t i = 0; i < ipath.size(); ++i) {
+        double dist;
+        if (!isStateValid(ipath[i], false, false, dist)) {
+            path.truncate(mark);
+            valid = false;
+            return true;
+        }
+        if (i > 0) {
+            path.push_back(ipath[i]);
+        }
+    }
+    return true;
+}
+
+bool CollisionChecker::isStateToStateAffected(
+    const RobotState& start,
+    const RobotState& finish)
+{
+    return true;
+}
+
+void CollisionChecker::clearEnvironmentChanges()
+{
+}
+
 visualization_msgs::MarkerArray
 CollisionChecker::getCollisionModelVisualization(const RobotState& state)
 {
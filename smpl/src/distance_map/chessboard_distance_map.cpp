@@ -46,12 +46,8 @@ ChessboardDistanceMap::ChessboardDistanceMap(
 {
 }
 
-int ChessboardDistanceMap::distance(const Cell& n, const Cell& s)
+int ChessboardDistanceMap::distance(const Cell& s, int dx, int dy, int dz)
 {
-    int dx = n.x - s.x;
-    int dy = n.y - s.y;
-    int dz = n.z - s.z;
-
     return dx * dx + dy * dy + dz * dz + s.dist_new;
 }
 
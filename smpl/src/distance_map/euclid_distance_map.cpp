@@ -46,11 +46,12 @@ EuclidDistanceMap::EuclidDistanceMap(
 {
 }
 
-int EuclidDistanceMap::distance(const Cell& n, const Cell& s)
+int EuclidDistanceMap::distance(const Cell& s, int dx, int dy, int dz)
 {
-    int dx = n.x - s.obs->x;
-    int dy = n.y - s.obs->y;
-    int dz = n.z - s.obs->z;
+    // offset from the obstacle cell of s to the updated cell
+    dx -= s.obs_x;
+    dy -= s.obs_y;
+    dz -= s.obs_z;
 
     return dx * dx + dy * dy + dz * dz;
 }
@@ -0,0 +1,804 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#include <smpl/distance_map/hashed_distance_map.h>
+
+// standard includes
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+// system includes
+#include <ros/console.h>
+
+namespace sbpl {
+
+const int HashedDistanceMap::BRICK_SHIFT;
+const int HashedDistanceMap::BRICK_MASK;
+const int HashedDistanceMap::BRICK_SIZE;
+const int HashedDistanceMap::MAX_DIST_CELLS;
+const std::int16_t HashedDistanceMap::NO_OBSTACLE;
+
+HashedDistanceMap::HashedDistanceMap(
+    double origin_x, double origin_y, double origin_z,
+    double size_x, double size_y, double size_z,
+    double resolution,
+    double max_dist)
+:
+    DistanceMapInterface(
+            origin_x, origin_y, origin_z,
+            size_x, size_y, size_z,
+            resolution),
+    m_cell_count_x(0),
+    m_cell_count_y(0),
+    m_cell_count_z(0),
+    m_brick_count_y(0),
+    m_brick_count_z(0),
+    m_bricks(),
+    m_cached_key(-1),
+    m_cached_brick(nullptr),
+    m_dirty_bricks(),
+    m_max_dist(std::min(max_dist, (double)MAX_DIST_CELLS * resolution)),
+    m_inv_res(1.0 / resolution),
+    m_dmax_int(std::min((int)std::ceil(m_max_dist * m_inv_res), (int)MAX_DIST_CELLS)),
+    m_dmax_sqrd_int(m_dmax_int * m_dmax_int),
+    m_bucket(m_dmax_sqrd_int + 1),
+    m_no_update_dir(dirnum(0, 0, 0)),
+    m_neighbors(),
+    m_indices(),
+    m_neighbor_ranges(),
+    m_neighbor_dirs(),
+    m_open(),
+    m_rem_stack()
+{
+    if (max_dist > m_max_dist) {
+        ROS_WARN("Clamping maximum distance of distance map from %0.3f to %0.3f (%d cells)", max_dist, m_max_dist, MAX_DIST_CELLS);
+    }
+
+    m_cell_count_x = (int)(size_x * m_inv_res + 0.5);
+    m_cell_count_y = (int)(size_y * m_inv_res + 0.5);
+    m_cell_count_z = (int)(size_z * m_inv_res + 0.5);
+
+    m_brick_count_y = (m_cell_count_y + BRICK_MASK) >> BRICK_SHIFT;
+    m_brick_count_z = (m_cell_count_z + BRICK_MASK) >> BRICK_SHIFT;
+
+    m_open.resize(m_dmax_sqrd_int + 1);
+
+    // precompute table of sqrts for relevant distance values
+    m_sqrt_table.resize(m_dmax_sqrd_int + 1, 0.0);
+    for (int i = 0; i < m_dmax_sqrd_int + 1; ++i) {
+        m_sqrt_table[i] = m_res * std::sqrt((double)i);
+    }
+
+    // init neighbors for forward propagation
+    CreateNeighborUpdateList(m_neighbors, m_indices, m_neighbor_ranges);
+
+    for (size_t i = 0; i < m_indices.size(); ++i) {
+        const Eigen::Vector3i& neighbor = m_neighbors[m_indices[i]];
+        if (i < NON_BORDER_NEIGHBOR_LIST_SIZE) {
+            m_neighbor_dirs[i] = dirnum(neighbor.x(), neighbor.y(), neighbor.z());
+        } else {
+            m_neighbor_dirs[i] = dirnum(neighbor.x(), neighbor.y(), neighbor.z(), 1);
+        }
+    }
+}
+
+HashedDistanceMap::HashedDistanceMap(const HashedDistanceMap& o) :
+    DistanceMapInterface(o),
+    m_cell_count_x(o.m_cell_count_x),
+    m_cell_count_y(o.m_cell_count_y),
+    m_cell_count_z(o.m_cell_count_z),
+    m_brick_count_y(o.m_brick_count_y),
+    m_brick_count_z(o.m_brick_count_z),
+    m_bricks(),
+    m_cached_key(-1),
+    m_cached_brick(nullptr),
+    m_dirty_bricks(o.m_dirty_bricks),
+    m_max_dist(o.m_max_dist),
+    m_inv_res(o.m_inv_res),
+    m_dmax_int(o.m_dmax_int),
+    m_dmax_sqrd_int(o.m_dmax_sqrd_int),
+    m_bucket(o.m_bucket),
+    m_no_update_dir(o.m_no_update_dir),
+    m_neighbors(o.m_neighbors),
+    m_indices(o.m_indices),
+    m_neighbor_ranges(o.m_neighbor_ranges),
+    m_neighbor_dirs(o.m_neighbor_dirs),
+    m_sqrt_table(o.m_sqrt_table),
+    m_open(o.m_open.size()),
+    m_rem_stack()
+{
+    m_bricks.reserve(o.m_bricks.size());
+    for (const auto& entry : o.m_bricks) {
+        m_bricks.insert(std::make_pair(
+                entry.first,
+                std::unique_ptr<Brick>(new Brick(*entry.second))));
+    }
+}
+
+/// Return the distance value for an invalid cell.
+double HashedDistanceMap::maxDistance() const
+{
+    return m_max_dist;
+}
+
+/// Return the distance of a cell from its nearest obstacle. A value of 0.0 is
+/// returned for obstacle cells and cells outside of the bounding volume.
+double HashedDistanceMap::getDistance(double x, double y, double z) const
+{
+    int gx, gy, gz;
+    worldToGrid(x, y, z, gx, gy, gz);
+    return getDistance(gx, gy, gz);
+}
+
+/// Return the distance of a cell from its nearest obstacle cell. A value of 0.0
+/// is returned for obstacle cells and cells outside of the bounding volume.
+double HashedDistanceMap::getDistance(int x, int y, int z) const
+{
+    if (!isCellValid(x, y, z)) {
+        return 0.0;
+    }
+
+    const Cell* c = getCell(x, y, z);
+    return m_sqrt_table[c ? c->dist : m_dmax_sqrd_int];
+}
+
+DistanceMapInterface* HashedDistanceMap::clone() const
+{
+    return new HashedDistanceMap(*this);
+}
+
+/// Add a set of obstacle points to the distance map and update the distance
+/// values of affected cells. Points outside the map and cells that are already
+/// marked as obstacles will be ignored.
+void HashedDistanceMap::addPointsToMap(
+    const std::vector<Eigen::Vector3d>& points)
+{
+    for (const Eigen::Vector3d& p : points) {
+        int gx, gy, gz;
+        worldToGrid(p.x(), p.y(), p.z(), gx, gy, gz);
+        if (!isCellValid(gx, gy, gz)) {
+            continue;
+        }
+
+        Cell* c = allocCell(gx, gy, gz);
+        if (c->dist_new > 0) {
+            c->dir = m_no_update_dir;
+            c->dist_new = 0;
+            c->obs_x = c->obs_y = c->obs_z = 0;
+            updateVertex(c, gx, gy, gz);
+        }
+    }
+
+    propagate();
+    releaseBricks();
+}
+
+/// Remove a set of obstacle points from the distance map and update the
+/// distance values of affected cells. Points outside the map and cells that
+/// are not marked as obstacles will be ignored.
+void HashedDistanceMap::removePointsFromMap(
+    const std::vector<Eigen::Vector3d>& points)
+{
+    for (const Eigen::Vector3d& p : points) {
+        int gx, gy, gz;
+        worldToGrid(p.x(), p.y(), p.z(), gx, gy, gz);
+        if (!isCellValid(gx, gy, gz)) {
+            continue;
+        }
+
+        Cell* c = getCell(gx, gy, gz);
+        if (!c || !isObstacle(*c)) {
+            continue;
+        }
+
+        c->dist_new = m_dmax_sqrd_int;
+        c->dist = m_dmax_sqrd_int;
+        c->obs_x = c->obs_y = c->obs_z = NO_OBSTACLE;
+        c->dir = m_no_update_dir;
+        markRaised(gx, gy, gz);
+        m_rem_stack.emplace_back(c, gx, gy, gz);
+    }
+
+    propagateRemovals();
+    releaseBricks();
+}
+
+/// Add the set (new_points - old_points) of obstacle cells and remove the set
+/// (old_points - new_points) of obstacle cells and update the distance values
+/// of affected cells. Points outside the map will be ignored.
+void HashedDistanceMap::updatePointsInMap(
+    const std::vector<Eigen::Vector3d>& old_points,
+    const std::vector<Eigen::Vector3d>& new_points)
+{
+    const std::int64_t stride_y = m_cell_count_z;
+    const std::int64_t stride_x = (std::int64_t)m_cell_count_y * stride_y;
+
+    // gather the indices of the cells containing the old and new points;
+    // cell indices are ordered lexicographically by cell coordinates
+    auto to_cell_indices = [&](
+        const std::vector<Eigen::Vector3d>& points,
+        std::vector<std::int64_t>& indices)
+    {
+        indices.reserve(points.size());
+        for (const Eigen::Vector3d& wp : points) {
+            int gx, gy, gz;
+            worldToGrid(wp.x(), wp.y(), wp.z(), gx, gy, gz);
+            if (isCellValid(gx, gy, gz)) {
+                indices.push_back(gx * stride_x + gy * stride_y + gz);
+            }
+        }
+        std::sort(indices.begin(), indices.end());
+        indices.erase(
+                std::unique(indices.begin(), indices.end()), indices.end());
+    };
+
+    std::vector<std::int64_t> old_indices;
+    to_cell_indices(old_points, old_indices);
+
+    std::vector<std::int64_t> new_indices;
+    to_cell_indices(new_points, new_indices);
+
+    std::vector<std::int64_t> old_not_new;
+    std::set_difference(
+            old_indices.begin(), old_indices.end(),
+            new_indices.begin(), new_indices.end(),
+            std::back_inserter(old_not_new));
+
+    std::vector<std::int64_t> new_not_old;
+    std::set_difference(
+            new_indices.begin(), new_indices.end(),
+            old_indices.begin(), old_indices.end(),
+            std::back_inserter(new_not_old));
+
+    // remove obstacle cells that were in the old cloud but not the new cloud
+    for (std::int64_t i : old_not_new) {
+        const int x = (int)(i / stride_x);
+        const int y = (int)((i - x * stride_x) / stride_y);
+        const int z = (int)(i - x * stride_x - y * stride_y);
+        Cell* c = getCell(x, y, z);
+        if (!c || !isObstacle(*c)) {
+            continue; // skip already-free cells
+        }
+        c->dir = m_no_update_dir;
+        c->dist_new = m_dmax_sqrd_int;
+        c->dist = m_dmax_sqrd_int;
+        c->obs_x = c->obs_y = c->obs_z = NO_OBSTACLE;
+        markRaised(x, y, z);
+        m_rem_stack.emplace_back(c, x, y, z);
+    }
+
+    propagateRemovals();
+
+    // add obstacle cells that are in the new cloud but not the old cloud
+    for (std::int64_t i : new_not_old) {
+        const int x = (int)(i / stride_x);
+        const int y = (int)((i - x * stride_x) / stride_y);
+        const int z = (int)(i - x * stride_x - y * stride_y);
+        Cell* c = allocCell(x, y, z);
+        if (c->dist_new == 0) {
+            continue; // skip already-obstacle cells
+        }
+        c->dir = m_no_update_dir;
+        c->dist_new = 0;
+        c->obs_x = c->obs_y = c->obs_z = 0;
+        updateVertex(c, x, y, z);
+    }
+
+    propagate();
+    releaseBricks();
+}
+
+/// Reset all points in the distance map to their uninitialized (free) values.
+void HashedDistanceMap::reset()
+{
+    m_bricks.clear();
+    m_cached_key = -1;
+    m_cached_brick = nullptr;
+    m_dirty_bricks.clear();
+    for (bucket_type& bucket : m_open) {
+        bucket.clear();
+    }
+    m_rem_stack.clear();
+    m_bucket = m_dmax_sqrd_int + 1;
+}
+
+/// Return the number of cells along the x axis.
+int HashedDistanceMap::numCellsX() const
+{
+    return m_cell_count_x;
+}
+
+/// Return the number of cells along the y axis.
+int HashedDistanceMap::numCellsY() const
+{
+    return m_cell_count_y;
+}
+
+/// Return the number of cells along the z axis.
+int HashedDistanceMap::numCellsZ() const
+{
+    return m_cell_count_z;
+}
+
+double HashedDistanceMap::getUninitializedDistance() const
+{
+    return m_max_dist;
+}
+
+double HashedDistanceMap::getMetricDistance(double x, double y, double z) const
+{
+    return getDistance(x, y, z);
+}
+
+double HashedDistanceMap::getCellDistance(int x, int y, int z) const
+{
+    return getDistance(x, y, z);
+}
+
+double HashedDistanceMap::getMetricSquaredDistance(
+    double x, double y, double z) const
+{
+    int gx, gy, gz;
+    worldToGrid(x, y, z, gx, gy, gz);
+    return getCellSquaredDistance(gx, gy, gz);
+}
+
+double HashedDistanceMap::getCellSquaredDistance(int x, int y, int z) const
+{
+    if (!isCellValid(x, y, z)) {
+        return 0.0;
+    }
+
+    const Cell* c = getCell(x, y, z);
+    return m_res * m_res * (c ? c->dist : m_dmax_sqrd_int);
+}
+
+/// Return the point in world coordinates marking the center of the cell at the
+/// given grid coordinates.
+void HashedDistanceMap::gridToWorld(
+    int x, int y, int z,
+    double& world_x, double& world_y, double& world_z) const
+{
+    world_x = m_origin_x + x * m_res;
+    world_y = m_origin_y + y * m_res;
+    world_z = m_origin_z + z * m_res;
+}
+
+/// Return the grid coordinates of the cell containing the given point
+/// specified in world coordinates.
+void HashedDistanceMap::worldToGrid(
+    double world_x, double world_y, double world_z,
+    int& x, int& y, int& z) const
+{
+    // offset by one cell so that points just outside the lower bounds are
+    // truncated to invalid cells
+    x = (int)(m_inv_res * (world_x - (m_origin_x - m_res)) + 0.5) - 1;
+    y = (int)(m_inv_res * (world_y - (m_origin_y - m_res)) + 0.5) - 1;
+    z = (int)(m_inv_res * (world_z - (m_origin_z - m_res)) + 0.5) - 1;
+}
+
+/// Test if a cell is outside the bounding volume.
+bool HashedDistanceMap::isCellValid(int x, int y, int z) const
+{
+    // the unsigned comparisons also reject negative coordinates
+    return ((unsigned)x < (unsigned)m_cell_count_x) &
+            ((unsigned)y < (unsigned)m_cell_count_y) &
+            ((unsigned)z < (unsigned)m_cell_count_z);
+}
+
+std::int64_t HashedDistanceMap::brickIndex(int x, int y, int z) const
+{
+    return ((x >> BRICK_SHIFT) * m_brick_count_y + (y >> BRICK_SHIFT)) *
+            m_brick_count_z + (z >> BRICK_SHIFT);
+}
+
+int HashedDistanceMap::cellIndex(int x, int y, int z) const
+{
+    return ((x & BRICK_MASK) << (2 * BRICK_SHIFT)) |
+            ((y & BRICK_MASK) << BRICK_SHIFT) |
+            (z & BRICK_MASK);
+}
+
+/// Return the cell at the given grid coordinates, or nullptr if its brick is
+/// not allocated, in which case the cell has no nearest obstacle.
+const HashedDistanceMap::Cell*
+HashedDistanceMap::getCell(int x, int y, int z) const
+{
+    auto it = m_bricks.find(brickIndex(x, y, z));
+    if (it == m_bricks.end()) {
+        return nullptr;
+    }
+    return &it->second->cells[cellIndex(x, y, z)];
+}
+
+HashedDistanceMap::Cell* HashedDistanceMap::getCell(int x, int y, int z)
+{
+    const std::int64_t key = brickIndex(x, y, z);
+    if (key != m_cached_key) {
+        auto it = m_bricks.find(key);
+        if (it == m_bricks.end()) {
+            return nullptr;
+        }
+        m_cached_key = key;
+        m_cached_brick = it->second.get();
+    }
+    return &m_cached_brick->cells[cellIndex(x, y, z)];
+}
+
+/// Return the cell at the given grid coordinates, allocating its brick if
+/// necessary.
+HashedDistanceMap::Cell* HashedDistanceMap::allocCell(int x, int y, int z)
+{
+    const std::int64_t key = brickIndex(x, y, z);
+    if (key != m_cached_key) {
+        std::unique_ptr<Brick>& b = m_bricks[key];
+        if (!b) {
+            b.reset(new Brick);
+            for (Cell& c : b->cells) {
+                resetCell(c);
+            }
+            b->dirty = false;
+        }
+        m_cached_key = key;
+        m_cached_brick = b.get();
+    }
+    return &m_cached_brick->cells[cellIndex(x, y, z)];
+}
+
+/// Record that a cell may have lost its nearest obstacle, so that its brick is
+/// checked for release after propagation.
+void HashedDistanceMap::markRaised(int x, int y, int z)
+{
+    const std::int64_t key = brickIndex(x, y, z);
+    Brick* b;
+    if (key == m_cached_key) {
+        b = m_cached_brick;
+    } else {
+        auto it = m_bricks.find(key);
+        assert(it != m_bricks.end());
+        b = it->second.get();
+    }
+    if (!b->dirty) {
+        b->dirty = true;
+        m_dirty_bricks.push_back(key);
+    }
+}
+
+/// Release raised bricks with no cells within range of an obstacle. Must only
+/// be called when the open list is empty.
+void HashedDistanceMap::releaseBricks()
+{
+    for (std::int64_t key : m_dirty_bricks) {
+        auto it = m_bricks.find(key);
+        if (it == m_bricks.end()) {
+            continue;
+        }
+
+        Brick& b = *it->second;
+        b.dirty = false;
+
+        bool empty = true;
+        for (const Cell& c : b.cells) {
+            if (c.obs_x != NO_OBSTACLE || c.dist != m_dmax_sqrd_int) {
+                empty = false;
+                break;
+            }
+        }
+
+        if (empty) {
+            if (key == m_cached_key) {
+                m_cached_key = -1;
+                m_cached_brick = nullptr;
+            }
+            m_bricks.erase(it);
+        }
+    }
+    m_dirty_bricks.clear();
+}
+
+bool HashedDistanceMap::isObstacle(const Cell& c) const
+{
+    return (c.obs_x | c.obs_y | c.obs_z) == 0;
+}
+
+/// Test whether the nearest obstacle of the cell at the given grid coordinates
+/// is still an obstacle cell.
+bool HashedDistanceMap::hasValidObstacle(
+    const Cell& c, int x, int y, int z) const
+{
+    if (c.obs_x == NO_OBSTACLE) {
+        return false;
+    }
+    const Cell* o = getCell(x + c.obs_x, y + c.obs_y, z + c.obs_z);
+    return o && isObstacle(*o);
+}
+
+void HashedDistanceMap::resetCell(Cell& c) const
+{
+    c.dist = m_dmax_sqrd_int;
+    c.dist_new = m_dmax_sqrd_int;
+    c.obs_x = c.obs_y = c.obs_z = NO_OBSTACLE;
+    c.dir = m_no_update_dir;
+    c.open = 0;
+}
+
+int HashedDistanceMap::distance(const Cell& s, int dx, int dy, int dz) const
+{
+    // offset from the obstacle cell of s to the updated cell
+    dx -= s.obs_x;
+    dy -= s.obs_y;
+    dz -= s.obs_z;
+
+    return dx * dx + dy * dy + dz * dz;
+}
+
+/// Insert a cell into the open list with key min(dist, dist_new).
+void HashedDistanceMap::updateVertex(Cell* o, int x, int y, int z)
+{
+    const int key = std::min(o->dist, o->dist_new);
+    assert(key < m_open.size());
+    m_open[key].emplace_back(o, x, y, z);
+    o->open = 1;
+    if (key < m_bucket) {
+        m_bucket = key;
+    }
+}
+
+void HashedDistanceMap::lower(Cell* s, int sx, int sy, int sz)
+{
+    int nfirst, nlast;
+    std::tie(nfirst, nlast) = m_neighbor_ranges[s->dir];
+    for (int i = nfirst; i != nlast; ++i) {
+        const Eigen::Vector3i& d = m_neighbors[m_indices[i]];
+        const int nx = sx + d.x(), ny = sy + d.y(), nz = sz + d.z();
+        if (!isCellValid(nx, ny, nz)) {
+            continue;
+        }
+
+        // cells at or beyond the maximum distance are never lowered, and
+        // need not be allocated
+        const int dp = distance(*s, d.x(), d.y(), d.z());
+        if (dp >= m_dmax_sqrd_int) {
+            continue;
+        }
+
+        Cell* n = allocCell(nx, ny, nz);
+        if (dp < n->dist_new) {
+            n->dist_new = dp;
+            n->obs_x = s->obs_x - d.x();
+            n->obs_y = s->obs_y - d.y();
+            n->obs_z = s->obs_z - d.z();
+            n->dir = m_neighbor_dirs[i];
+            updateVertex(n, nx, ny, nz);
+        }
+    }
+}
+
+void HashedDistanceMap::raise(Cell* s, int sx, int sy, int sz)
+{
+    int nfirst, nlast;
+    std::tie(nfirst, nlast) = m_neighbor_ranges[m_no_update_dir];
+    for (int i = nfirst; i != nlast; ++i) {
+        const Eigen::Vector3i& d = m_neighbors[m_indices[i]];
+        const int nx = sx + d.x(), ny = sy + d.y(), nz = sz + d.z();
+        if (!isCellValid(nx, ny, nz)) {
+            continue;
+        }
+        waveout(getCell(nx, ny, nz), nx, ny, nz);
+    }
+    waveout(s, sx, sy, sz);
+}
+
+// Recompute the nearest obstacle of a cell from the nearest obstacles of its
+// neighbors. The cell may be unallocated, in which case its brick is only
+// allocated if a nearest obstacle is found.
+void HashedDistanceMap::waveout(Cell* n, int nx, int ny, int nz)
+{
+    if (n && isObstacle(*n)) {
+        return;
+    }
+
+    int dist_new = m_dmax_sqrd_int;
+    std::int16_t obs_x = NO_OBSTACLE;
+    std::int16_t obs_y = NO_OBSTACLE;
+    std::int16_t obs_z = NO_OBSTACLE;
+
+    int nfirst, nlast;
+    std::tie(nfirst, nlast) = m_neighbor_ranges[m_no_update_dir];
+    for (int i = nfirst; i != nlast; ++i) {
+        const Eigen::Vector3i& d = m_neighbors[m_indices[i]];
+        const int ax = nx + d.x(), ay = ny + d.y(), az = nz + d.z();
+        if (!isCellValid(ax, ay, az)) {
+            continue;
+        }
+        const Cell* a = getCell(ax, ay, az);
+        if (a && hasValidObstacle(*a, ax, ay, az)) {
+            int dp = distance(*a, -d.x(), -d.y(), -d.z());
+            if (dp < dist_new) {
+                dist_new = dp;
+                obs_x = a->obs_x + d.x();
+                obs_y = a->obs_y + d.y();
+                obs_z = a->obs_z + d.z();
+            }
+        }
+    }
+
+    if (!n) {
+        if (obs_x == NO_OBSTACLE) {
+            return;
+        }
+        n = allocCell(nx, ny, nz);
+    }
+
+    n->dist_new = dist_new;
+    if (obs_x != NO_OBSTACLE) {
+        n->dir = m_no_update_dir;
+    }
+
+    if (n->obs_x != obs_x || n->obs_y != obs_y || n->obs_z != obs_z) {
+        n->obs_x = obs_x;
+        n->obs_y = obs_y;
+        n->obs_z = obs_z;
+        if (obs_x == NO_OBSTACLE) {
+            markRaised(nx, ny, nz);
+        }
+        updateVertex(n, nx, ny, nz);
+    }
+}
+
+void HashedDistanceMap::propagate()
+{
+    while (m_bucket < (int)m_open.size()) {
+        while (!m_open[m_bucket].empty()) {
+            assert(m_bucket >= 0 && m_bucket < m_open.size());
+            bucket_element e = m_open[m_bucket].back();
+            m_open[m_bucket].pop_back();
+            Cell* s = e.c;
+
+            // skip stale entries
+            if (!s->open || std::min(s->dist, s->dist_new) != m_bucket) {
+                continue;
+            }
+            s->open = 0;
+
+            if (s->dist_new < s->dist) {
+                s->dist = s->dist_new;
+
+                // foreach n in adj(min)
+                lower(s, e.x, e.y, e.z);
+            } else {
+                s->dist = m_dmax_sqrd_int;
+                s->dir = m_no_update_dir;
+                markRaised(e.x, e.y, e.z);
+                raise(s, e.x, e.y, e.z);
+                if (s->dist != s->dist_new) {
+                    updateVertex(s, e.x, e.y, e.z);
+                }
+            }
+        }
+        ++m_bucket;
+    }
+}
+
+void HashedDistanceMap::lowerBounded(Cell* s, int sx, int sy, int sz)
+{
+    int nfirst, nlast;
+    std::tie(nfirst, nlast) = m_neighbor_ranges[s->dir];
+    for (int i = nfirst; i != nlast; ++i) {
+        const Eigen::Vector3i& d = m_neighbors[m_indices[i]];
+        const int nx = sx + d.x(), ny = sy + d.y(), nz = sz + d.z();
+        if (!isCellValid(nx, ny, nz)) {
+            continue;
+        }
+
+        const int dp = distance(*s, d.x(), d.y(), d.z());
+        if (dp >= m_dmax_sqrd_int) {
+            continue;
+        }
+
+        Cell* n = allocCell(nx, ny, nz);
+        if (n->dist_new > s->dist_new && dp < n->dist_new) {
+            n->dist_new = dp;
+            n->obs_x = s->obs_x - d.x();
+            n->obs_y = s->obs_y - d.y();
+            n->obs_z = s->obs_z - d.z();
+            n->dir = m_neighbor_dirs[i];
+            updateVertex(n, nx, ny, nz);
+        }
+    }
+}
+
+void HashedDistanceMap::propagateRemovals()
+{
+    while (!m_rem_stack.empty()) {
+        bucket_element e = m_rem_stack.back();
+        m_rem_stack.pop_back();
+
+        int nfirst, nlast;
+        std::tie(nfirst, nlast) = m_neighbor_ranges[m_no_update_dir];
+        for (int i = nfirst; i != nlast; ++i) {
+            const Eigen::Vector3i& d = m_neighbors[m_indices[i]];
+            const int nx = e.x + d.x(), ny = e.y + d.y(), nz = e.z + d.z();
+            if (!isCellValid(nx, ny, nz)) {
+                continue;
+            }
+
+            // unallocated cells are already free
+            Cell* n = getCell(nx, ny, nz);
+            if (!n) {
+                continue;
+            }
+
+            if (!hasValidObstacle(*n, nx, ny, nz)) {
+                if (n->dist_new != m_dmax_sqrd_int) {
+                    n->dist_new = m_dmax_sqrd_int;
+                    n->dist = m_dmax_sqrd_int;
+                    n->obs_x = n->obs_y = n->obs_z = NO_OBSTACLE;
+                    n->dir = m_no_update_dir;
+                    markRaised(nx, ny, nz);
+                    m_rem_stack.emplace_back(n, nx, ny, nz);
+                }
+            } else {
+                updateVertex(n, nx, ny, nz);
+            }
+        }
+    }
+
+    propagateBounded();
+}
+
+void HashedDistanceMap::propagateBounded()
+{
+    while (m_bucket < (int)m_open.size()) {
+        while (!m_open[m_bucket].empty()) {
+            assert(m_bucket >= 0 && m_bucket < m_open.size());
+            bucket_element e = m_open[m_bucket].back();
+            m_open[m_bucket].pop_back();
+            Cell* s = e.c;
+
+            // skip stale entries
+            if (!s->open || std::min(s->dist, s->dist_new) != m_bucket) {
+                continue;
+            }
+            s->open = 0;
+
+            assert(s->dist_new <= s->dist);
+            s->dist = s->dist_new;
+
+            // foreach n in adj(min)
+            lowerBounded(s, e.x, e.y, e.z);
+        }
+        ++m_bucket;
+    }
+}
+
+} // namespace sbpl
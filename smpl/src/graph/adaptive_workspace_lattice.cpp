@@ -31,6 +31,10 @@
 
 #include <smpl/graph/adaptive_workspace_lattice.h>
 
+// standard includes
+#include <algorithm>
+#include <cmath>
+
 // system includes
 #include <boost/functional/hash.hpp>
 #include <leatherman/print.h>
@@ -95,7 +99,10 @@ AdaptiveWorkspaceLattice::AdaptiveWorkspaceLattice(
     m_near_goal(false),
     m_region_radius(1),
     m_tunnel_radius(3),
-    m_dim_grid()
+    m_dim_grid(),
+    m_tunnel_cells(),
+    m_plan_changes(),
+    m_trak_changes()
 {
     m_dim_grid.assign(
             m_grid->numCellsX(),
@@ -210,7 +217,12 @@ bool AdaptiveWorkspaceLattice::addHighDimRegion(int state_id)
     for (int dz = -radius; dz <= radius; ++dz) {
         Eigen::Vector3i p = gp + Eigen::Vector3i(dx, dy, dz);
         if (m_grid->isInBounds(p.x(), p.y(), p.z())) {
-            m_dim_grid(p.x(), p.y(), p.z()).plan_hd = true;
+            AdaptiveGridCell& cell = m_dim_grid(p.x(), p.y(), p.z());
+            if (!cell.plan_hd && !cell.plan_changed) {
+                cell.plan_changed = true;
+                m_plan_changes.push_back(p);
+            }
+            cell.plan_hd = true;
             ++marked;
         }
     }
@@ -224,12 +236,6 @@ bool AdaptiveWorkspaceLattice::addHighDimRegion(int state_id)
 
 bool AdaptiveWorkspaceLattice::setTunnel(const std::vector<int>& states)
 {
-    // clear the tunnel grid
-    // TODO: retain the list of points in the tunnel and clear only those points
-    for (auto it = m_dim_grid.begin(); it != m_dim_grid.end(); ++it) {
-        it->trak_hd = false;
-    }
-
     std::vector<Eigen::Vector3i> tunnel;
     for (int state_id : states) {
         double px, py, pz;
@@ -266,9 +272,24 @@ bool AdaptiveWorkspaceLattice::setTunnel(const std::vector<int>& states)
         tunnel.emplace_back(gx, gy, gz);
     }
 
+    // clear the previous tunnel, remembering which cells were in it
+    for (const Eigen::Vector3i& p : m_tunnel_cells) {
+        AdaptiveGridCell& cell = m_dim_grid(p.x(), p.y(), p.z());
+        cell.trak_hd = false;
+        cell.trak_prev = true;
+    }
+
+    auto record_change = [&](const Eigen::Vector3i& p, AdaptiveGridCell& cell)
+    {
+        if (!cell.trak_changed) {
+            cell.trak_changed = true;
+            m_trak_changes.push_back(p);
+        }
+    };
+
     // TODO: dijkstra/breadth-first search out from tunnel to fill states at
     // tunnel-width away
-    int marked = 0;
+    std::vector<Eigen::Vector3i> tunnel_cells;
     for (const Eigen::Vector3i& gp : tunnel) {
         const int radius = m_tunnel_radius;
 
@@ -277,14 +298,30 @@ bool AdaptiveWorkspaceLattice::setTunnel(const std::vector<int>& states)
         for (int dz = -radius; dz <= radius; ++dz) {
             Eigen::Vector3i p = gp + Eigen::Vector3i(dx, dy, dz);
             if (m_grid->isInBounds(p.x(), p.y(), p.z())) {
-                m_dim_grid(p.x(), p.y(), p.z()).trak_hd = true;
-                ++marked;
+                AdaptiveGridCell& cell = m_dim_grid(p.x(), p.y(), p.z());
+                if (!cell.trak_hd) {
+                    cell.trak_hd = true;
+                    tunnel_cells.push_back(p);
+                    if (!cell.trak_prev) {
+                        record_change(p, cell);
+                    }
+                }
             }
         }
         }
         }
     }
-    ROS_INFO_NAMED(params()->graph_log, "Marked %d cells as tunnel cells", marked);
+
+    for (const Eigen::Vector3i& p : m_tunnel_cells) {
+        AdaptiveGridCell& cell = m_dim_grid(p.x(), p.y(), p.z());
+        if (!cell.trak_hd) {
+            record_change(p, cell);
+        }
+        cell.trak_prev = false;
+    }
+
+    m_tunnel_cells = std::move(tunnel_cells);
+    ROS_INFO_NAMED(params()->graph_log, "Marked %zu cells as tunnel cells", m_tunnel_cells.size());
 
     return true;
 }
@@ -318,6 +355,100 @@ bool AdaptiveWorkspaceLattice::setPlanMode()
     return true;
 }
 
+/// Return the states whose outgoing edges, in the current mode, may have been
+/// changed by additions of high-dimensional regions (in planning mode) or by
+/// changes to the tunnel (in tracking mode) since the last call in that mode.
+/// The edges of a state depend only on the dimensionality of the cells its
+/// motions end in, so these are the states within one motion of a changed
+/// cell, and every high-dimensional state if the cells around the goal changed
+/// and states may reach the goal via IK.
+void AdaptiveWorkspaceLattice::getChangedEdgeSources(std::vector<int>& state_ids)
+{
+    state_ids.clear();
+
+    std::vector<Eigen::Vector3i>& changes =
+            m_plan_mode ? m_plan_changes : m_trak_changes;
+    if (changes.empty()) {
+        return;
+    }
+
+    auto changed = [&](const AdaptiveGridCell& cell)
+    {
+        return m_plan_mode ? cell.plan_changed : cell.trak_changed;
+    };
+
+    // number of cells a motion may span, including rounding of its endpoints
+    const double max_res = std::max(m_res[0], std::max(m_res[1], m_res[2]));
+    const int margin = (int)std::ceil(max_res / m_grid->resolution()) + 1;
+
+    Eigen::Vector3i changes_min = changes.front();
+    Eigen::Vector3i changes_max = changes.front();
+    for (const Eigen::Vector3i& p : changes) {
+        changes_min = changes_min.cwiseMin(p);
+        changes_max = changes_max.cwiseMax(p);
+    }
+    changes_min -= Eigen::Vector3i::Constant(margin);
+    changes_max += Eigen::Vector3i::Constant(margin);
+
+    auto near_change = [&](const Eigen::Vector3i& gp)
+    {
+        if ((gp.array() < changes_min.array()).any() ||
+            (gp.array() > changes_max.array()).any())
+        {
+            return false;
+        }
+        for (int dx = -margin; dx <= margin; ++dx) {
+        for (int dy = -margin; dy <= margin; ++dy) {
+        for (int dz = -margin; dz <= margin; ++dz) {
+            Eigen::Vector3i p = gp + Eigen::Vector3i(dx, dy, dz);
+            if (m_grid->isInBounds(p.x(), p.y(), p.z()) &&
+                changed(m_dim_grid(p.x(), p.y(), p.z())))
+            {
+                return true;
+            }
+        }
+        }
+        }
+        return false;
+    };
+
+    bool goal_changed = false;
+    if (m_ik_amp_enabled) {
+        Eigen::Vector3i goal_cell;
+        m_grid->worldToGrid(
+                goal().tgt_off_pose[0], goal().tgt_off_pose[1], goal().tgt_off_pose[2],
+                goal_cell.x(), goal_cell.y(), goal_cell.z());
+        goal_changed = near_change(goal_cell);
+    }
+
+    for (size_t i = 0; i < m_states.size(); ++i) {
+        const int state_id = (int)i;
+        if (state_id == m_goal_state_id) {
+            continue;
+        }
+        const AdaptiveState* state = m_states[i];
+        Eigen::Vector3i gp;
+        if ((state->hid && goal_changed) ||
+            (getStateCell(state, gp) && near_change(gp)))
+        {
+            state_ids.push_back(state_id);
+        }
+    }
+
+    for (const Eigen::Vector3i& p : changes) {
+        AdaptiveGridCell& cell = m_dim_grid(p.x(), p.y(), p.z());
+        if (m_plan_mode) {
+            cell.plan_changed = false;
+        } else {
+            cell.trak_changed = false;
+        }
+    }
+
+    ROS_DEBUG_NAMED(params()->graph_log, "%zu cells changed dimensionality, %zu of %zu states have changed edges", changes.size(), state_ids.size(), m_states.size());
+
+    changes.clear();
+}
+
 int AdaptiveWorkspaceLattice::getStartStateID() const
 {
     return m_start_state_id;
@@ -475,7 +606,8 @@ Extension* AdaptiveWorkspaceLattice::getExtension(size_t class_code)
 {
     if (class_code == GetClassCode<RobotPlanningSpace>() ||
         class_code == GetClassCode<PointProjectionExtension>() ||
-        class_code == GetClassCode<AdaptiveGraphExtension>())
+        class_code == GetClassCode<AdaptiveGraphExtension>() ||
+        class_code == GetClassCode<ChangedEdgesExtension>())
     {
         return this;
     }
@@ -641,6 +773,8 @@ bool AdaptiveWorkspaceLattice::setGoalPose(const GoalConstraint& goal)
     m_near_goal = false;
     m_t_start = clock::now();
 
+    startIKCacheQuery();
+
     return RobotPlanningSpace::setGoal(goal);
 }
 
@@ -861,6 +995,30 @@ bool AdaptiveWorkspaceLattice::isHighDimensional(int gx, int gy, int gz) const
     }
 }
 
+// Compute the cell of the occupancy grid containing the position of a state.
+bool AdaptiveWorkspaceLattice::getStateCell(
+    const AdaptiveState* state,
+    Eigen::Vector3i& gp) const
+{
+    double px, py, pz;
+    if (state->hid) {
+        const AdaptiveWorkspaceState* hi_state =
+                (const AdaptiveWorkspaceState*)state;
+        WorkspaceState wstate;
+        stateCoordToWorkspace(hi_state->coord, wstate);
+        px = wstate[0];
+        py = wstate[1];
+        pz = wstate[2];
+    } else {
+        const AdaptiveGridState* lo_state = (const AdaptiveGridState*)state;
+        px = lo_state->x;
+        py = lo_state->y;
+        pz = lo_state->z;
+    }
+    m_grid->worldToGrid(px, py, pz, gp.x(), gp.y(), gp.z());
+    return m_grid->isInBounds(gp.x(), gp.y(), gp.z());
+}
+
 AdaptiveState* AdaptiveWorkspaceLattice::getHashEntry(int state_id) const
 {
     assert(state_id >= 0 && state_id < m_states.size());
@@ -1003,21 +1161,17 @@ bool AdaptiveWorkspaceLattice::checkAction(
     std::uint32_t violation_mask = 0x00000000;
 
     // check waypoints for ik solutions and joint limits
-    for (size_t widx = 0; widx < action.size(); ++widx) {
+    if (!statesWorkspaceToRobot(action, state, wptraj)) {
+        ROS_DEBUG_NAMED(params()->successors_log, "        -> failed to find ik solution for waypoint %zu", wptraj.size());
+        violation_mask |= 0x00000001;
+    }
+
+    for (size_t widx = 0; widx < wptraj.size(); ++widx) {
         const WorkspaceState& istate = action[widx];
 
         ROS_DEBUG_NAMED(params()->successors_log, "        %zu: %s", widx, to_string(istate).c_str());
 
-        RobotState irstate;
-        if (!stateWorkspaceToRobot(istate, state, irstate)) {
-            ROS_DEBUG_NAMED(params()->successors_log, "         -> failed to find ik solution");
-            violation_mask |= 0x00000001;
-            break;
-        }
-
-        wptraj.push_back(irstate);
-
-        if (!robot()->checkJointLimits(irstate)) {
+        if (!robot()->checkJointLimits(wptraj[widx])) {
             ROS_DEBUG_NAMED(params()->successors_log, "        -> violates joint limits");
             violation_mask |= 0x00000002;
             break;
@@ -2,12 +2,45 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <stdexcept>
 
 namespace sbpl {
 namespace motion {
 
-ExperienceGraph::ExperienceGraph()
+const ExperienceGraph::node_id ExperienceGraph::KDNull;
+
+// Return the i'th coordinate of a state, treating missing coordinates as 0
+static
+double StateCoord(const RobotState& state, std::size_t i)
+{
+    return i < state.size() ? state[i] : 0.0;
+}
+
+static
+double SquaredDistance(const RobotState& s, const RobotState& t)
+{
+    const std::size_t n = std::max(s.size(), t.size());
+    double d = 0.0;
+    for (std::size_t i = 0; i < n; ++i) {
+        const double di = StateCoord(s, i) - StateCoord(t, i);
+        d += di * di;
+    }
+    return d;
+}
+
+ExperienceGraph::ExperienceGraph() :
+    m_nodes(),
+    m_edges(),
+    m_node_count(0),
+    m_edge_count(0),
+    m_adjacency(),
+    m_adjacency_unused(0),
+    m_waypoints(),
+    m_waypoint_dim(0),
+    m_waypoints_unused(0),
+    m_kd_root(KDNull)
 {
 }
 
@@ -18,8 +51,8 @@ std::pair<
 ExperienceGraph::nodes() const
 {
     return std::make_pair(
-            node_iterator(0),
-            node_iterator(m_nodes.size()));
+            node_iterator(&m_nodes, 0),
+            node_iterator(&m_nodes, m_nodes.size()));
 }
 
 /// Return a pair of iterators to the range of edges in the graph.
@@ -29,8 +62,8 @@ std::pair<
 ExperienceGraph::edges() const
 {
     return std::make_pair(
-            edge_iterator(0),
-            edge_iterator(m_edges.size()));
+            edge_iterator(&m_edges, 0),
+            edge_iterator(&m_edges, m_edges.size()));
 }
 
 /// Return a pair of iterators to the range of incident edges for a node.
@@ -39,9 +72,10 @@ std::pair<
     ExperienceGraph::incident_edge_iterator>
 ExperienceGraph::edges(node_id id) const
 {
+    auto first = m_adjacency.begin() + m_nodes[id].adj_offset;
     return std::make_pair(
-            incident_edge_iterator(m_nodes[id].edges.begin()),
-            incident_edge_iterator(m_nodes[id].edges.end()));
+            incident_edge_iterator(first),
+            incident_edge_iterator(first + m_nodes[id].adj_degree));
 }
 
 /// Return a pair of iterators to the range of adjacent nodes for a node.
@@ -50,15 +84,16 @@ std::pair<
     ExperienceGraph::adjacency_iterator>
 ExperienceGraph::adjacent_nodes(node_id id) const
 {
+    auto first = m_adjacency.begin() + m_nodes[id].adj_offset;
     return std::make_pair(
-            adjacency_iterator(m_nodes[id].edges.begin()),
-            adjacency_iterator(m_nodes[id].edges.end()));
+            adjacency_iterator(first),
+            adjacency_iterator(first + m_nodes[id].adj_degree));
 }
 
 /// Return the degree (number of incident edges) of a node.
 ExperienceGraph::degree_size_type ExperienceGraph::degree(node_id id) const
 {
-    return m_nodes[id].edges.size();
+    return m_nodes[id].adj_degree;
 }
 
 /// Return the id of an edge's source node.
@@ -76,238 +111,650 @@ ExperienceGraph::node_id ExperienceGraph::target(edge_id id) const
 /// Test if an edge exists between two nodes.
 bool ExperienceGraph::edge(node_id uid, node_id vid) const
 {
-    if (uid >= m_nodes.size() || vid >= m_nodes.size()) {
+    if (!is_node(uid) || !is_node(vid)) {
         throw std::out_of_range("ExperienceGraph::edge called with invalid node ids");
     }
 
-    if (m_nodes[uid].edges.size() < m_nodes[vid].edges.size()) {
-        for (const auto& adj : m_nodes[uid].edges) {
-            if (adj.second == vid) {
-                return true;
-            }
-        }
-    } else {
-        for (const auto& adj : m_nodes[vid].edges) {
-            if (adj.second == uid) {
-                return true;
-            }
+    // search through the smaller of the two adjacency lists
+    const bool from_u = m_nodes[uid].adj_degree < m_nodes[vid].adj_degree;
+    const Node& n = from_u ? m_nodes[uid] : m_nodes[vid];
+    const node_id other = from_u ? vid : uid;
+    for (degree_size_type i = 0; i < n.adj_degree; ++i) {
+        if (m_adjacency[n.adj_offset + i].second == other) {
+            return true;
         }
     }
     return false;
 }
 
+/// Reserve storage for a number of nodes and edges, to avoid reallocation when
+/// a large graph is inserted.
+void ExperienceGraph::reserve(
+    nodes_size_type node_count,
+    edges_size_type edge_count)
+{
+    m_nodes.reserve(node_count);
+    m_edges.reserve(edge_count);
+    m_adjacency.reserve(2 * edge_count);
+    m_kd_nodes.reserve(node_count);
+}
+
+/// Find the node whose state is nearest, by euclidean distance in joint space,
+/// to a given state. Continuous joints are not wrapped.
+/// \return false if the graph is empty; true otherwise
+bool ExperienceGraph::nearest_node(const RobotState& state, node_id& id) const
+{
+    if (m_node_count == 0) {
+        return false;
+    }
+    id = m_kd_root;
+    double best_dist = std::numeric_limits<double>::infinity();
+    kd_nearest(m_kd_root, state, id, best_dist);
+    return true;
+}
+
+/// Append the ids of all nodes whose states are within a euclidean distance,
+/// in joint space, of a given state. Continuous joints are not wrapped.
+void ExperienceGraph::nearest_nodes(
+    const RobotState& state,
+    double radius,
+    std::vector<node_id>& ids) const
+{
+    if (m_node_count == 0) {
+        return;
+    }
+
+    const double radius_sqrd = radius * radius;
+    std::vector<node_id> open;
+    open.push_back(m_kd_root);
+    while (!open.empty()) {
+        const node_id n = open.back();
+        open.pop_back();
+
+        const KDNode& kn = m_kd_nodes[n];
+        if (!m_nodes[n].erased &&
+            SquaredDistance(state, m_nodes[n].state) <= radius_sqrd)
+        {
+            ids.push_back(n);
+        }
+
+        // the left subtree lies at or below the split value and the right
+        // subtree at or above it
+        const double diff = StateCoord(state, kn.split) -
+                StateCoord(m_nodes[n].state, kn.split);
+        if (kn.left != KDNull && diff <= radius) {
+            open.push_back(kn.left);
+        }
+        if (kn.right != KDNull && diff >= -radius) {
+            open.push_back(kn.right);
+        }
+    }
+}
+
 /// Insert a node.
 ExperienceGraph::node_id ExperienceGraph::insert_node(const RobotState& state)
 {
     m_nodes.emplace_back(state);
-    return m_nodes.size() - 1;
+    ++m_node_count;
+    const node_id id = m_nodes.size() - 1;
+    kd_insert(id);
+    return id;
 }
 
-/// Erase a node. Node iterators and ids after the erased node are invalidated.
-/// Edge iterators and ids after the lowest removed incident edge are
-/// invalidated. All incident edge and adjacenct node iterators are invalidated.
+/// Erase a node and its incident edges. The ids of the remaining nodes and
+/// edges are unchanged unless erasure leaves more erased than remaining ids,
+/// in which case the graph is compacted (see compact()). All incident edge
+/// and adjacent node iterators are invalidated.
 void ExperienceGraph::erase_node(node_id id)
 {
-    if (id >= m_nodes.size()) {
+    if (!is_node(id)) {
         throw std::out_of_range("ExperienceGraph::erase_node called with invalid node id");
     }
 
-    const Node& rem_node = m_nodes[id];
-
-    // the number of edges to be removed and the smallest id, for updating
-    // adjacency edge ids
-    if (rem_node.edges.size() > 0) {
-        auto will_remove = [id](const Edge& e) {
-            return e.snode == id | e.tnode == id;
-        };
-
-        // map from edge id to how many positions it will shift down
-        m_shift.assign(m_edges.size(), 0);
-        std::ptrdiff_t shift = 0;
-
-        // simultaneously remove deleted edges and map from original edge ids
-        // to the amount they must be shifted later
-        auto first = std::find_if(m_edges.begin(), m_edges.end(), will_remove);
-        if (first != m_edges.end()) {
-            // for every element later in the sequence
-            auto i = first;
-            auto j = std::next(m_shift.begin(), std::distance(m_edges.begin(), first));
-            ++shift;
-            // i = remainder range iterator
-            // j = corresponding shift array tracking following i
-            for ( ; ++j, ++i != m_edges.end(); ) {
-                *j = shift;
-                if (!(will_remove(*i))) {
-                    // shift this element and update the retained range
-                    *first++ = std::move(*i);
-                } else {
-                    ++shift;
-                }
-            }
-        }
-        m_edges.erase(first, m_edges.end());
-
-        for (auto& node : m_nodes) {
-            // skip the node to be removed for a small optimization
-            if (&node == &rem_node) {
-                continue;
-            }
-
-            // remove adjacency entries
-            auto it = std::remove_if(
-                    node.edges.begin(), node.edges.end(),
-                    [&](const Node::adjacency& a) {
-                        return a.second == id;
-                    });
-            node.edges.resize(std::distance(node.edges.begin(), it));
-
-            // update node and edge ids
-            for (Node::adjacency& a : node.edges) {
-                a.first -= m_shift[a.first];
-                if (a.second > id) {
-                    --a.second;
-                }
-            }
+    // remove incident edges from the adjacency lists of the adjacent nodes
+    Node& node = m_nodes[id];
+    for (degree_size_type i = 0; i < node.adj_degree; ++i) {
+        const adjacency& a = m_adjacency[node.adj_offset + i];
+        if (a.second != id) {
+            erase_adjacency(a.second, a.first);
         }
+        Edge& e = m_edges[a.first];
+        m_waypoints_unused += e.wp_count * m_waypoint_dim;
+        e.wp_count = 0;
+        e.erased = true;
+        --m_edge_count;
     }
 
-    // update the node ids stored in edges
-    for (auto& edge : m_edges) {
-        if (edge.snode > id) {
-            --edge.snode;
-        }
-        if (edge.tnode > id) {
-            --edge.tnode;
-        }
-    }
+    // leave the node's adjacency segment unused and its state in the k-d tree
+    m_adjacency_unused += node.adj_capacity;
+    node.adj_degree = 0;
+    node.adj_capacity = 0;
+    node.erased = true;
+    --m_node_count;
 
-    // remove the node
-    m_nodes.erase(m_nodes.begin() + id);
+    maybe_compact();
 }
 
 /// Insert an edge, allowing parallel edges and self-loops.
 /// \return The ID of the inserted edge
 ExperienceGraph::edge_id ExperienceGraph::insert_edge(node_id uid, node_id vid)
 {
-    if (uid >= m_nodes.size() || vid >= m_nodes.size()) {
+    return insert_edge(uid, vid, nullptr, 0, m_waypoint_dim);
+}
+
+/// Insert an edge, allowing parallel edges and self-loops.
+/// \return The ID of the inserted edge
+ExperienceGraph::edge_id ExperienceGraph::insert_edge(
+    node_id uid,
+    node_id vid,
+    const std::vector<RobotState>& path)
+{
+    if (!is_node(uid) || !is_node(vid)) {
         throw std::out_of_range("ExperienceGraph::insert_edge called with invalid node ids");
     }
 
-    m_edges.emplace_back(uid, vid);
+    if (path.empty()) {
+        return insert_edge(uid, vid, nullptr, 0, m_waypoint_dim);
+    }
+
+    const std::size_t dim = path.front().size();
+    for (const RobotState& wp : path) {
+        if (wp.size() != dim) {
+            throw std::invalid_argument("ExperienceGraph::insert_edge called with waypoints of different sizes");
+        }
+    }
+
+    const std::size_t offset = insert_waypoints(nullptr, path.size(), dim);
+    double* dst = m_waypoints.data() + offset;
+    for (const RobotState& wp : path) {
+        dst = std::copy(wp.begin(), wp.end(), dst);
+    }
+
+    m_edges.emplace_back(uid, vid, offset, path.size());
+    ++m_edge_count;
     ExperienceGraph::edge_id eid = m_edges.size() - 1;
     insert_incident_edge(eid, uid, vid);
     return eid;
 }
 
-/// Insert an edge, allowing parallel edges and self-loops.
+/// Insert an edge, allowing parallel edges and self-loops, whose waypoints are
+/// given as count consecutive states of dimension values each.
 /// \return The ID of the inserted edge
 ExperienceGraph::edge_id ExperienceGraph::insert_edge(
     node_id uid,
     node_id vid,
-    const std::vector<RobotState>& path)
+    const double* waypoints,
+    std::size_t count,
+    std::size_t dimension)
 {
-    if (uid >= m_nodes.size() || vid >= m_nodes.size()) {
+    if (!is_node(uid) || !is_node(vid)) {
         throw std::out_of_range("ExperienceGraph::insert_edge called with invalid node ids");
     }
 
-    m_edges.emplace_back(path, uid, vid);
+    const std::size_t offset = insert_waypoints(waypoints, count, dimension);
+    m_edges.emplace_back(uid, vid, offset, count);
+    ++m_edge_count;
     ExperienceGraph::edge_id eid = m_edges.size() - 1;
     insert_incident_edge(eid, uid, vid);
     return eid;
 }
 
-/// Erase the edge between two nodes, if one exists. All incident edge and
-/// adjacent node iterators for the source and target nodes, edge iterators
-/// pointing to edges after the erased edge, and edge ids greater than the
-/// erased edge id are invalidated. TODO: erase all parallel edges?
+/// Erase all edges between two nodes. The ids of the remaining edges are
+/// unchanged unless the graph is compacted, as in erase_edge(edge_id). All
+/// incident edge and adjacent node iterators are invalidated.
 void ExperienceGraph::erase_edge(node_id uid, node_id vid)
 {
-    if (uid >= m_nodes.size() || vid >= m_nodes.size()) {
+    if (!is_node(uid) || !is_node(vid)) {
         throw std::out_of_range("ExperienceGraph::erase_edge called with invalid node ids");
     }
 
-    // search through the smaller of the two adjacency lists for the edge id
-    // and call erase_edge on it when found
-    if (m_nodes[uid].edges.size() < m_nodes[vid].edges.size()) {
-        auto& out_edges = m_nodes[uid].edges;
-        auto it = std::find_if(
-                out_edges.begin(),
-                out_edges.end(),
-                [&](const Node::adjacency& a) {
-                    return a.second == vid;
-                });
-        if (it != out_edges.end()) {
-            erase_edge(it->first);
-        }
-    } else {
-        auto& out_edges = m_nodes[vid].edges;
-        auto it = std::find_if(
-                out_edges.begin(),
-                out_edges.end(),
-                [&](const Node::adjacency& a) {
-                    return a.second == uid;
-                });
-        if (it != out_edges.end()) {
-            erase_edge(it->first);
+    // search through the smaller of the two adjacency lists for the edge ids;
+    // erasing an edge removes its entry, so the same position is examined
+    // again
+    const bool from_u = m_nodes[uid].adj_degree < m_nodes[vid].adj_degree;
+    const node_id nid = from_u ? uid : vid;
+    const node_id other = from_u ? vid : uid;
+    degree_size_type i = 0;
+    while (i < m_nodes[nid].adj_degree) {
+        const adjacency& a = m_adjacency[m_nodes[nid].adj_offset + i];
+        if (a.second == other) {
+            tombstone_edge(a.first);
+        } else {
+            ++i;
         }
     }
+
+    maybe_compact();
 }
 
-/// Erase an edge. All incident edge and adjacent node iterators for the source
-/// and target nodes, edge iterators pointing to edges after the erased edge,
-/// and edge ids greater than the erased edge id are invalidated.
+/// Erase an edge. The ids of the remaining edges are unchanged unless erasure
+/// leaves more erased than remaining ids, in which case the graph is compacted
+/// (see compact()). All incident edge and adjacent node iterators are
+/// invalidated.
 void ExperienceGraph::erase_edge(edge_id id)
 {
-    if (id >= m_edges.size()) {
+    if (!is_edge(id)) {
         throw std::out_of_range("ExperienceGraph::erase_edge called with invalid edge id");
     }
 
+    tombstone_edge(id);
+    maybe_compact();
+}
+
+/// Copy the waypoints of an edge.
+void ExperienceGraph::waypoints(edge_id id, std::vector<RobotState>& path) const
+{
     const Edge& e = m_edges[id];
+    path.resize(e.wp_count);
+    for (std::size_t i = 0; i < e.wp_count; ++i) {
+        const double* wp = waypoint(id, i);
+        path[i].assign(wp, wp + m_waypoint_dim);
+    }
+}
+
+/// Release the ids of erased nodes and edges, renumbering the remaining nodes
+/// and edges in order, and move the adjacency lists of all nodes and the
+/// waypoints of all edges into contiguous storage. Node and edge ids are
+/// unchanged if no nodes or edges have been erased since the last compaction.
+/// All iterators and waypoint pointers are invalidated.
+void ExperienceGraph::compact()
+{
+    compact_ids();
+    compact_adjacency();
+    compact_waypoints();
+}
+
+bool ExperienceGraph::is_node(node_id id) const
+{
+    return id < m_nodes.size() && !m_nodes[id].erased;
+}
+
+bool ExperienceGraph::is_edge(edge_id id) const
+{
+    return id < m_edges.size() && !m_edges[id].erased;
+}
 
-    // remove incident edge from source node and update edge ids
-    assert(e.snode < m_nodes.size());
-    auto ait = std::remove_if(
-            m_nodes[e.snode].edges.begin(),
-            m_nodes[e.snode].edges.end(),
-            [&](Node::adjacency& a) {
-                bool rem = a.first == id;
-                if (a.first > id) {
-                    --a.first;
-                }
-                return rem;
-            });
-    m_nodes[e.snode].edges.erase(ait, m_nodes[e.snode].edges.end());
-
-    // for non-self-loops, remove incident edge from target node and update edge
-    // ids
+// Remove an edge from the adjacency lists of its nodes and mark it erased,
+// leaving its waypoints unused
+void ExperienceGraph::tombstone_edge(edge_id id)
+{
+    Edge& e = m_edges[id];
+    erase_adjacency(e.snode, id);
     if (e.tnode != e.snode) {
-        assert(e.tnode < m_nodes.size());
-        ait = std::remove_if(
-                m_nodes[e.tnode].edges.begin(),
-                m_nodes[e.tnode].edges.end(),
-                [&](Node::adjacency& a) {
-                    bool rem = a.first == id;
-                    if (a.first > id) {
-                        --a.first;
-                    }
-                    return rem;
-                });
-        m_nodes[e.tnode].edges.erase(ait, m_nodes[e.tnode].edges.end());
+        erase_adjacency(e.tnode, id);
     }
+    m_waypoints_unused += e.wp_count * m_waypoint_dim;
+    e.wp_count = 0;
+    e.erased = true;
+    --m_edge_count;
+}
 
-    // remove the edge
-    m_edges.erase(std::next(m_edges.begin(), id));
+// Compact the graph once erased ids outnumber the remaining ids, and compact
+// the adjacency and waypoint arrays once more than half of either is unused,
+// so that the cost of compaction is amortized over the erasures
+void ExperienceGraph::maybe_compact()
+{
+    if (m_nodes.size() - m_node_count > m_node_count ||
+        m_edges.size() - m_edge_count > m_edge_count)
+    {
+        compact();
+        return;
+    }
+    if (m_adjacency_unused > m_adjacency.size() / 2) {
+        compact_adjacency();
+    }
+    if (m_waypoints_unused > m_waypoints.size() / 2) {
+        compact_waypoints();
+    }
+}
+
+// Remove erased nodes and edges, renumbering the remaining nodes and edges in
+// order, and rebuild the k-d tree if any nodes were removed
+void ExperienceGraph::compact_ids()
+{
+    if (m_node_count == m_nodes.size() && m_edge_count == m_edges.size()) {
+        return;
+    }
+
+    std::vector<node_id> node_ids(m_nodes.size());
+    node_id ndst = 0;
+    for (node_id n = 0; n < m_nodes.size(); ++n) {
+        if (m_nodes[n].erased) {
+            continue;
+        }
+        node_ids[n] = ndst;
+        if (ndst != n) {
+            m_nodes[ndst] = std::move(m_nodes[n]);
+        }
+        ++ndst;
+    }
+    const bool nodes_erased = ndst != m_nodes.size();
+    m_nodes.erase(m_nodes.begin() + ndst, m_nodes.end());
+
+    std::vector<edge_id> edge_ids(m_edges.size());
+    edge_id edst = 0;
+    for (edge_id e = 0; e < m_edges.size(); ++e) {
+        if (m_edges[e].erased) {
+            continue;
+        }
+        edge_ids[e] = edst;
+        Edge& edge = m_edges[edst++];
+        edge = m_edges[e];
+        edge.snode = node_ids[edge.snode];
+        edge.tnode = node_ids[edge.tnode];
+    }
+    m_edges.erase(m_edges.begin() + edst, m_edges.end());
+
+    for (Node& node : m_nodes) {
+        auto first = m_adjacency.begin() + node.adj_offset;
+        for (auto it = first; it != first + node.adj_degree; ++it) {
+            it->first = edge_ids[it->first];
+            it->second = node_ids[it->second];
+        }
+    }
+
+    if (nodes_erased) {
+        kd_rebuild();
+    }
+}
+
+// Insert a node, whose state has been added to m_nodes, into the k-d tree. If
+// the node is inserted too deep in the tree, rebuild the subtree rooted at the
+// deepest ancestor whose children are unbalanced.
+void ExperienceGraph::kd_insert(node_id id)
+{
+    const double alpha = 0.7;
+
+    KDNode kn;
+    kn.left = KDNull;
+    kn.right = KDNull;
+    kn.size = 1;
+    kn.split = 0;
+    m_kd_nodes.push_back(kn);
+
+    if (m_kd_root == KDNull) {
+        m_kd_root = id;
+        return;
+    }
+
+    const RobotState& state = m_nodes[id].state;
+
+    m_kd_path.clear();
+    node_id n = m_kd_root;
+    while (n != KDNull) {
+        m_kd_path.push_back(n);
+        KDNode& parent = m_kd_nodes[n];
+        ++parent.size;
+        node_id& child =
+                StateCoord(state, parent.split) <
+                StateCoord(m_nodes[n].state, parent.split) ?
+                        parent.left : parent.right;
+        if (child == KDNull) {
+            child = id;
+            const std::size_t dim = std::max<std::size_t>(state.size(), 1);
+            m_kd_nodes[id].split = (parent.split + 1) % dim;
+            break;
+        }
+        n = child;
+    }
+
+    const double max_depth =
+            std::log((double)m_kd_nodes.size()) / std::log(1.0 / alpha);
+    if ((double)m_kd_path.size() <= max_depth) {
+        return;
+    }
+
+    // find the scapegoat
+    auto subtree_size = [&](node_id c) -> nodes_size_type {
+        return c == KDNull ? 0 : m_kd_nodes[c].size;
+    };
+    for (size_t i = m_kd_path.size(); i-- > 0; ) {
+        const KDNode& g = m_kd_nodes[m_kd_path[i]];
+        const nodes_size_type max_child =
+                std::max(subtree_size(g.left), subtree_size(g.right));
+        if ((double)max_child <= alpha * (double)g.size) {
+            continue;
+        }
+
+        // gather and rebuild the subtree
+        m_kd_buffer.clear();
+        m_kd_buffer.push_back(m_kd_path[i]);
+        for (size_t j = 0; j < m_kd_buffer.size(); ++j) {
+            const KDNode& c = m_kd_nodes[m_kd_buffer[j]];
+            if (c.left != KDNull) {
+                m_kd_buffer.push_back(c.left);
+            }
+            if (c.right != KDNull) {
+                m_kd_buffer.push_back(c.right);
+            }
+        }
+        const node_id root = kd_build(
+                m_kd_buffer.data(), m_kd_buffer.data() + m_kd_buffer.size());
+
+        if (i == 0) {
+            m_kd_root = root;
+        } else {
+            KDNode& p = m_kd_nodes[m_kd_path[i - 1]];
+            if (p.left == m_kd_path[i]) {
+                p.left = root;
+            } else {
+                p.right = root;
+            }
+        }
+        break;
+    }
+}
+
+// Rebuild the k-d tree over all nodes
+void ExperienceGraph::kd_rebuild()
+{
+    m_kd_nodes.resize(m_nodes.size());
+    m_kd_buffer.resize(m_nodes.size());
+    for (node_id n = 0; n < m_nodes.size(); ++n) {
+        m_kd_buffer[n] = n;
+    }
+    m_kd_root = kd_build(
+            m_kd_buffer.data(), m_kd_buffer.data() + m_kd_buffer.size());
+}
+
+// Build a balanced k-d tree over a set of nodes, splitting each subtree at the
+// median of its dimension of greatest spread.
+// \return The root of the tree
+ExperienceGraph::node_id ExperienceGraph::kd_build(
+    node_id* first,
+    node_id* last)
+{
+    if (first == last) {
+        return KDNull;
+    }
+
+    std::size_t dim = 0;
+    for (node_id* it = first; it != last; ++it) {
+        dim = std::max(dim, m_nodes[*it].state.size());
+    }
+
+    std::size_t split = 0;
+    double max_spread = -1.0;
+    for (std::size_t i = 0; i < dim; ++i) {
+        double lo = std::numeric_limits<double>::infinity();
+        double hi = -std::numeric_limits<double>::infinity();
+        for (node_id* it = first; it != last; ++it) {
+            const double c = StateCoord(m_nodes[*it].state, i);
+            lo = std::min(lo, c);
+            hi = std::max(hi, c);
+        }
+        if (hi - lo > max_spread) {
+            max_spread = hi - lo;
+            split = i;
+        }
+    }
+
+    node_id* mid = first + (last - first) / 2;
+    std::nth_element(first, mid, last, [&](node_id a, node_id b) {
+        return StateCoord(m_nodes[a].state, split) <
+                StateCoord(m_nodes[b].state, split);
+    });
+
+    const node_id root = *mid;
+    const node_id left = kd_build(first, mid);
+    const node_id right = kd_build(mid + 1, last);
+
+    KDNode& kn = m_kd_nodes[root];
+    kn.left = left;
+    kn.right = right;
+    kn.size = (nodes_size_type)(last - first);
+    kn.split = split;
+    return root;
+}
+
+// Search the subtree rooted at n for a node nearer to a state than the best
+// node found so far
+void ExperienceGraph::kd_nearest(
+    node_id n,
+    const RobotState& state,
+    node_id& best,
+    double& best_dist) const
+{
+    const KDNode& kn = m_kd_nodes[n];
+
+    const double d = SquaredDistance(state, m_nodes[n].state);
+    if (d < best_dist && !m_nodes[n].erased) {
+        best_dist = d;
+        best = n;
+    }
+
+    // search the side of the split containing the state first
+    const double diff = StateCoord(state, kn.split) -
+            StateCoord(m_nodes[n].state, kn.split);
+    const node_id near_child = diff < 0.0 ? kn.left : kn.right;
+    const node_id far_child = diff < 0.0 ? kn.right : kn.left;
+    if (near_child != KDNull) {
+        kd_nearest(near_child, state, best, best_dist);
+    }
+    if (far_child != KDNull && diff * diff < best_dist) {
+        kd_nearest(far_child, state, best, best_dist);
+    }
 }
 
-inline
 void ExperienceGraph::insert_incident_edge(edge_id eid, node_id uid, node_id vid)
 {
     if (vid != uid) {
-        m_nodes[uid].edges.emplace_back(eid, vid);
-        m_nodes[vid].edges.emplace_back(eid, uid);
+        insert_adjacency(uid, eid, vid);
+        insert_adjacency(vid, eid, uid);
+    } else {
+        insert_adjacency(uid, eid, vid);
+    }
+}
+
+// Append an entry to the adjacency list of a node, growing its segment of the
+// adjacency array if it is full
+void ExperienceGraph::insert_adjacency(node_id uid, edge_id eid, node_id vid)
+{
+    Node& u = m_nodes[uid];
+    if (u.adj_degree == u.adj_capacity) {
+        const degree_size_type capacity =
+                std::max<degree_size_type>(4, 2 * u.adj_capacity);
+        if (u.adj_capacity > 0 &&
+            u.adj_offset + u.adj_capacity == m_adjacency.size())
+        {
+            // the last segment may grow in place
+            m_adjacency.resize(u.adj_offset + capacity);
+        } else {
+            // move the segment to the end of the array
+            const adjacency_container::size_type offset = m_adjacency.size();
+            m_adjacency.resize(offset + capacity);
+            std::copy(
+                    m_adjacency.begin() + u.adj_offset,
+                    m_adjacency.begin() + u.adj_offset + u.adj_degree,
+                    m_adjacency.begin() + offset);
+            m_adjacency_unused += u.adj_capacity;
+            u.adj_offset = offset;
+        }
+        u.adj_capacity = capacity;
+    }
+
+    m_adjacency[u.adj_offset + u.adj_degree++] = adjacency(eid, vid);
+
+    if (m_adjacency_unused > m_adjacency.size() / 2) {
+        compact_adjacency();
+    }
+}
+
+// Remove all entries for an edge from the adjacency list of a node, preserving
+// the order of the remaining entries
+void ExperienceGraph::erase_adjacency(node_id uid, edge_id eid)
+{
+    Node& u = m_nodes[uid];
+    auto first = m_adjacency.begin() + u.adj_offset;
+    auto last = std::remove_if(
+            first, first + u.adj_degree,
+            [&](const adjacency& a) { return a.first == eid; });
+    u.adj_degree = std::distance(first, last);
+}
+
+// Append space for count waypoints of a given dimension to the waypoint array,
+// and copy them if they are given.
+// \return The offset of the first waypoint in the waypoint array
+std::size_t ExperienceGraph::insert_waypoints(
+    const double* waypoints,
+    std::size_t count,
+    std::size_t dimension)
+{
+    if (count == 0) {
+        return m_waypoints.size();
+    }
+
+    if (m_waypoint_dim == 0) {
+        m_waypoint_dim = dimension;
+    } else if (dimension != m_waypoint_dim) {
+        throw std::invalid_argument("ExperienceGraph::insert_edge called with waypoints of a different size than existing waypoints");
+    }
+
+    const std::size_t offset = m_waypoints.size();
+    if (waypoints) {
+        m_waypoints.insert(
+                m_waypoints.end(), waypoints, waypoints + count * dimension);
     } else {
-        m_nodes[uid].edges.emplace_back(eid, vid);
+        m_waypoints.resize(offset + count * dimension);
+    }
+    return offset;
+}
+
+// Rebuild the adjacency array with the adjacency lists of all nodes stored
+// contiguously, in order, without any free space
+void ExperienceGraph::compact_adjacency()
+{
+    adjacency_container adj;
+    adj.reserve(m_adjacency.size() - m_adjacency_unused);
+    for (Node& node : m_nodes) {
+        const adjacency_container::size_type offset = adj.size();
+        adj.insert(
+                adj.end(),
+                m_adjacency.begin() + node.adj_offset,
+                m_adjacency.begin() + node.adj_offset + node.adj_degree);
+        node.adj_offset = offset;
+        node.adj_capacity = node.adj_degree;
+    }
+    m_adjacency = std::move(adj);
+    m_adjacency_unused = 0;
+}
+
+// Rebuild the waypoint array with the waypoints of all edges stored
+// contiguously, in order
+void ExperienceGraph::compact_waypoints()
+{
+    std::vector<double> waypoints;
+    waypoints.reserve(m_waypoints.size() - m_waypoints_unused);
+    for (Edge& e : m_edges) {
+        const std::size_t offset = waypoints.size();
+        waypoints.insert(
+                waypoints.end(),
+                m_waypoints.begin() + e.wp_offset,
+                m_waypoints.begin() + e.wp_offset + e.wp_count * m_waypoint_dim);
+        e.wp_offset = offset;
     }
+    m_waypoints = std::move(waypoints);
+    m_waypoints_unused = 0;
 }
 
 } // namespace motion
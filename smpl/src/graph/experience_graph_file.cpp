@@ -0,0 +1,407 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#include <smpl/graph/experience_graph_file.h>
+
+// standard includes
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+// project includes
+#include <smpl/angles.h>
+
+namespace sbpl {
+namespace motion {
+
+// Layout of the header of an experience graph file. Offsets are from the
+// start of the file; every section begins at a 64-byte aligned offset.
+struct FileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t variable_count;
+    std::uint64_t node_count;
+    std::uint64_t edge_count;
+    std::uint64_t path_count;
+    std::uint64_t waypoint_count;
+    std::uint64_t names_offset;     // NUL-terminated variable names
+    std::uint64_t names_size;
+    std::uint64_t variables_offset; // FileVariable per variable
+    std::uint64_t node_states_offset;
+    std::uint64_t node_coords_offset;
+    std::uint64_t edges_offset;     // (source, target, first waypoint, waypoint count)
+    std::uint64_t paths_offset;     // (first node, node count, first edge)
+    std::uint64_t waypoints_offset;
+    std::uint64_t size;
+};
+
+struct FileVariable
+{
+    double delta;
+    double min_limit;
+    std::uint8_t continuous;
+    std::uint8_t bounded;
+    std::uint8_t pad[6];
+};
+
+static const char FILE_MAGIC[8] = { 'S', 'M', 'P', 'L', 'E', 'G', 'R', 'F' };
+static const std::uint32_t FILE_VERSION = 1;
+
+static std::uint64_t AlignOffset(std::uint64_t offset)
+{
+    return (offset + 63) & ~(std::uint64_t)63;
+}
+
+/// Compute the discrete coordinates of a state, identically to
+/// ManipLattice::stateToCoord().
+void ExperienceGraphDiscretization::discretize(
+    const double* state,
+    std::int32_t* coord) const
+{
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        if (continuous[i]) {
+            const int coord_vals = (int)std::round((2.0 * M_PI) / deltas[i]);
+            const double pos_angle = angles::normalize_angle_positive(state[i]);
+            coord[i] = (int)((pos_angle + deltas[i] * 0.5) / deltas[i]);
+            if (coord[i] == coord_vals) {
+                coord[i] = 0;
+            }
+        } else if (!bounded[i]) {
+            if (state[i] >= 0.0) {
+                coord[i] = (int)(state[i] / deltas[i] + 0.5);
+            } else {
+                coord[i] = (int)(state[i] / deltas[i] - 0.5);
+            }
+        } else {
+            coord[i] = (int)(((state[i] - min_limits[i]) / deltas[i]) + 0.5);
+        }
+    }
+}
+
+ExperienceGraphFile::ExperienceGraphFile() :
+    m_file(),
+    m_variable_names(),
+    m_discretization(),
+    m_node_count(0),
+    m_edge_count(0),
+    m_path_count(0),
+    m_node_states(nullptr),
+    m_node_coords(nullptr),
+    m_edges(nullptr),
+    m_paths(nullptr),
+    m_waypoints(nullptr)
+{
+}
+
+/// Map an experience graph file written by WriteExperienceGraphFile() and
+/// validate its contents.
+bool ExperienceGraphFile::open(const std::string& path)
+{
+    close();
+
+    if (!m_file.open(path)) {
+        return false;
+    }
+
+    auto fail = [&]() -> bool
+    {
+        close();
+        return false;
+    };
+
+    const std::uint64_t size = m_file.size();
+    if (size < sizeof(FileHeader)) {
+        return fail();
+    }
+
+    FileHeader h;
+    std::memcpy(&h, m_file.data(), sizeof(h));
+    if (std::memcmp(h.magic, FILE_MAGIC, sizeof(h.magic)) != 0 ||
+        h.version != FILE_VERSION ||
+        h.size != size)
+    {
+        return fail();
+    }
+
+    // check that a section of count elements lies within the file
+    auto section_valid = [&](
+        std::uint64_t offset,
+        std::uint64_t count,
+        std::uint64_t elem_size)
+    {
+        return offset % 8 == 0 &&
+                offset <= size &&
+                count <= (size - offset) / elem_size;
+    };
+
+    const std::uint64_t vc = h.variable_count;
+    if (vc == 0 ||
+        !section_valid(h.names_offset, h.names_size, 1) ||
+        !section_valid(h.variables_offset, vc, sizeof(FileVariable)) ||
+        !section_valid(h.node_states_offset, h.node_count, vc * sizeof(double)) ||
+        !section_valid(h.node_coords_offset, h.node_count, vc * sizeof(std::int32_t)) ||
+        !section_valid(h.edges_offset, h.edge_count, 4 * sizeof(std::uint32_t)) ||
+        !section_valid(h.paths_offset, h.path_count, 3 * sizeof(std::uint32_t)) ||
+        !section_valid(h.waypoints_offset, h.waypoint_count, vc * sizeof(double)))
+    {
+        return fail();
+    }
+
+    const char* names = m_file.data() + h.names_offset;
+    const char* names_end = names + h.names_size;
+    while (names < names_end) {
+        const char* name_end = (const char*)std::memchr(names, '\0', names_end - names);
+        if (!name_end) {
+            return fail();
+        }
+        m_variable_names.emplace_back(names, name_end);
+        names = name_end + 1;
+    }
+    if (m_variable_names.size() != vc) {
+        return fail();
+    }
+
+    m_discretization.deltas.resize(vc);
+    m_discretization.min_limits.resize(vc);
+    m_discretization.continuous.resize(vc);
+    m_discretization.bounded.resize(vc);
+    for (size_t i = 0; i < vc; ++i) {
+        FileVariable v;
+        std::memcpy(
+                &v,
+                m_file.data() + h.variables_offset + i * sizeof(FileVariable),
+                sizeof(v));
+        m_discretization.deltas[i] = v.delta;
+        m_discretization.min_limits[i] = v.min_limit;
+        m_discretization.continuous[i] = v.continuous;
+        m_discretization.bounded[i] = v.bounded;
+    }
+
+    m_node_count = h.node_count;
+    m_edge_count = h.edge_count;
+    m_path_count = h.path_count;
+    m_node_states = reinterpret_cast<const double*>(m_file.data() + h.node_states_offset);
+    m_node_coords = reinterpret_cast<const std::int32_t*>(m_file.data() + h.node_coords_offset);
+    m_edges = reinterpret_cast<const std::uint32_t*>(m_file.data() + h.edges_offset);
+    m_paths = reinterpret_cast<const std::uint32_t*>(m_file.data() + h.paths_offset);
+    m_waypoints = reinterpret_cast<const double*>(m_file.data() + h.waypoints_offset);
+
+    // validate references between sections so that accessors need not
+    for (size_t e = 0; e < m_edge_count; ++e) {
+        const std::uint64_t first_waypoint = m_edges[4 * e + 2];
+        if (edgeSource(e) >= m_node_count ||
+            edgeTarget(e) >= m_node_count ||
+            first_waypoint + edgeWaypointCount(e) > h.waypoint_count)
+        {
+            return fail();
+        }
+    }
+    for (size_t p = 0; p < m_path_count; ++p) {
+        const std::uint64_t first_node = pathFirstNode(p);
+        const std::uint64_t node_count = pathNodeCount(p);
+        const std::uint64_t first_edge = pathFirstEdge(p);
+        if (node_count == 0 ||
+            first_node + node_count > m_node_count ||
+            first_edge + node_count - 1 > m_edge_count)
+        {
+            return fail();
+        }
+    }
+
+    return true;
+}
+
+void ExperienceGraphFile::close()
+{
+    m_file.close();
+    m_variable_names.clear();
+    m_discretization = ExperienceGraphDiscretization();
+    m_node_count = 0;
+    m_edge_count = 0;
+    m_path_count = 0;
+    m_node_states = nullptr;
+    m_node_coords = nullptr;
+    m_edges = nullptr;
+    m_paths = nullptr;
+    m_waypoints = nullptr;
+}
+
+/// Form an experience graph from a set of paths and write it to a file that
+/// may be opened with ExperienceGraphFile. Consecutive states of a path that
+/// share the same discrete coordinates are merged into a single node, and the
+/// states between two nodes become the waypoints of the edge connecting them,
+/// as in ManipLatticeEgraph::loadExperienceGraph(). The file is written to a
+/// temporary path and then renamed.
+bool WriteExperienceGraphFile(
+    const std::string& path,
+    const std::vector<std::string>& variable_names,
+    const ExperienceGraphDiscretization& discretization,
+    const std::vector<std::vector<RobotState>>& paths)
+{
+    const size_t vc = variable_names.size();
+    if (vc == 0 ||
+        discretization.deltas.size() != vc ||
+        discretization.min_limits.size() != vc ||
+        discretization.continuous.size() != vc ||
+        discretization.bounded.size() != vc)
+    {
+        return false;
+    }
+
+    std::vector<double> node_states;
+    std::vector<std::int32_t> node_coords;
+    std::vector<std::uint32_t> edges;
+    std::vector<std::uint32_t> path_table;
+    std::vector<double> waypoints;
+
+    std::vector<std::int32_t> coord(vc);
+    std::vector<std::int32_t> prev_coord(vc);
+    for (const std::vector<RobotState>& states : paths) {
+        if (states.empty()) {
+            continue;
+        }
+        for (const RobotState& state : states) {
+            if (state.size() != vc) {
+                return false;
+            }
+        }
+
+        const size_t first_node = node_states.size() / vc;
+        const size_t first_edge = edges.size() / 4;
+
+        discretization.discretize(states.front().data(), prev_coord.data());
+        node_states.insert(node_states.end(), states.front().begin(), states.front().end());
+        node_coords.insert(node_coords.end(), prev_coord.begin(), prev_coord.end());
+
+        size_t first_waypoint = waypoints.size() / vc;
+        for (size_t i = 1; i < states.size(); ++i) {
+            discretization.discretize(states[i].data(), coord.data());
+            if (coord != prev_coord) {
+                const size_t node = node_states.size() / vc;
+                edges.push_back((std::uint32_t)(node - 1));
+                edges.push_back((std::uint32_t)node);
+                edges.push_back((std::uint32_t)first_waypoint);
+                edges.push_back((std::uint32_t)(waypoints.size() / vc - first_waypoint));
+
+                node_states.insert(node_states.end(), states[i].begin(), states[i].end());
+                node_coords.insert(node_coords.end(), coord.begin(), coord.end());
+                prev_coord.swap(coord);
+                first_waypoint = waypoints.size() / vc;
+            } else {
+                waypoints.insert(waypoints.end(), states[i].begin(), states[i].end());
+            }
+        }
+
+        // states following the last node are not part of any edge
+        waypoints.resize(first_waypoint * vc);
+
+        path_table.push_back((std::uint32_t)first_node);
+        path_table.push_back((std::uint32_t)(node_states.size() / vc - first_node));
+        path_table.push_back((std::uint32_t)first_edge);
+    }
+
+    const std::uint64_t max_index = std::numeric_limits<std::uint32_t>::max();
+    if (node_states.size() / vc > max_index || waypoints.size() / vc > max_index) {
+        return false;
+    }
+
+    std::string names;
+    for (const std::string& name : variable_names) {
+        names += name;
+        names += '\0';
+    }
+
+    FileHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, FILE_MAGIC, sizeof(h.magic));
+    h.version = FILE_VERSION;
+    h.variable_count = (std::uint32_t)vc;
+    h.node_count = node_states.size() / vc;
+    h.edge_count = edges.size() / 4;
+    h.path_count = path_table.size() / 3;
+    h.waypoint_count = waypoints.size() / vc;
+    h.names_offset = AlignOffset(sizeof(FileHeader));
+    h.names_size = names.size();
+    h.variables_offset = AlignOffset(h.names_offset + h.names_size);
+    h.node_states_offset = AlignOffset(h.variables_offset + vc * sizeof(FileVariable));
+    h.node_coords_offset = AlignOffset(h.node_states_offset + node_states.size() * sizeof(double));
+    h.edges_offset = AlignOffset(h.node_coords_offset + node_coords.size() * sizeof(std::int32_t));
+    h.paths_offset = AlignOffset(h.edges_offset + edges.size() * sizeof(std::uint32_t));
+    h.waypoints_offset = AlignOffset(h.paths_offset + path_table.size() * sizeof(std::uint32_t));
+    h.size = h.waypoints_offset + waypoints.size() * sizeof(double);
+
+    std::vector<FileVariable> variables(vc);
+    for (size_t i = 0; i < vc; ++i) {
+        std::memset(&variables[i], 0, sizeof(FileVariable));
+        variables[i].delta = discretization.deltas[i];
+        variables[i].min_limit = discretization.min_limits[i];
+        variables[i].continuous = discretization.continuous[i];
+        variables[i].bounded = discretization.bounded[i];
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+        return false;
+    }
+
+    std::uint64_t pos = 0;
+    auto write_section = [&](std::uint64_t offset, const void* data, size_t size)
+    {
+        static const char zeros[64] = { 0 };
+        ofs.write(zeros, offset - pos);
+        ofs.write(reinterpret_cast<const char*>(data), size);
+        pos = offset + size;
+    };
+
+    write_section(0, &h, sizeof(h));
+    write_section(h.names_offset, names.data(), names.size());
+    write_section(h.variables_offset, variables.data(), variables.size() * sizeof(FileVariable));
+    write_section(h.node_states_offset, node_states.data(), node_states.size() * sizeof(double));
+    write_section(h.node_coords_offset, node_coords.data(), node_coords.size() * sizeof(std::int32_t));
+    write_section(h.edges_offset, edges.data(), edges.size() * sizeof(std::uint32_t));
+    write_section(h.paths_offset, path_table.data(), path_table.size() * sizeof(std::uint32_t));
+    write_section(h.waypoints_offset, waypoints.data(), waypoints.size() * sizeof(double));
+
+    ofs.close();
+    if (!ofs || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace motion
+} // namespace sbpl
@@ -0,0 +1,169 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#include <smpl/graph/ik_solution_cache.h>
+
+// system includes
+#include <boost/functional/hash.hpp>
+
+namespace sbpl {
+namespace motion {
+
+auto IKSolutionCache::KeyHash::operator()(const argument_type& key) const ->
+    result_type
+{
+    return boost::hash_range(key.begin(), key.end());
+}
+
+/// Construct a cache holding up to capacity entries. A cache with a capacity
+/// of 0 stores nothing.
+IKSolutionCache::IKSolutionCache(std::size_t capacity) :
+    m_mutex(),
+    m_capacity(capacity),
+    m_entries(),
+    m_index(),
+    m_stats()
+{
+    resetStats();
+}
+
+std::size_t IKSolutionCache::capacity() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_capacity;
+}
+
+/// Set the maximum number of entries, evicting the least recently used entries
+/// beyond the new capacity.
+void IKSolutionCache::setCapacity(std::size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = capacity;
+    if (m_entries.size() > m_capacity) {
+        evict(m_entries.size() - m_capacity);
+    }
+}
+
+std::size_t IKSolutionCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+/// Look up the result stored for a key, marking it as the most recently used.
+/// \param found Whether the solve for this key succeeded
+/// \param solution The solution, if the solve succeeded
+/// \return false if no result is stored for the key; true otherwise
+bool IKSolutionCache::lookup(const Key& key, bool& found, RobotState& solution)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        ++m_stats.misses;
+        return false;
+    }
+
+    ++m_stats.hits;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    found = it->second->found;
+    if (found) {
+        solution = it->second->solution;
+    }
+    return true;
+}
+
+/// Store the result of a solve, replacing any result already stored for the
+/// key and evicting the least recently used entry if the cache is full.
+void IKSolutionCache::insert(
+    const Key& key,
+    bool found,
+    const RobotState& solution)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_capacity == 0) {
+        return;
+    }
+
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        it->second->found = found;
+        it->second->solution = solution;
+        return;
+    }
+
+    if (m_entries.size() >= m_capacity) {
+        evict(m_entries.size() - m_capacity + 1);
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.found = found;
+    if (found) {
+        entry.solution = solution;
+    }
+    m_entries.push_front(std::move(entry));
+    m_index[key] = m_entries.begin();
+}
+
+void IKSolutionCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+}
+
+auto IKSolutionCache::stats() const -> Stats
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void IKSolutionCache::resetStats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.hits = 0;
+    m_stats.misses = 0;
+    m_stats.evictions = 0;
+}
+
+// Remove the count least recently used entries. Requires m_mutex.
+void IKSolutionCache::evict(std::size_t count)
+{
+    for (std::size_t i = 0; i < count && !m_entries.empty(); ++i) {
+        m_index.erase(m_entries.back().key);
+        m_entries.pop_back();
+        ++m_stats.evictions;
+    }
+}
+
+} // namespace motion
+} // namespace sbpl
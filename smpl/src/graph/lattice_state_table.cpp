@@ -0,0 +1,179 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#include <smpl/graph/lattice_state_table.h>
+
+// standard includes
+#include <algorithm>
+#include <cassert>
+#include <functional>
+
+namespace sbpl {
+namespace motion {
+
+LatticeStateTable::LatticeStateTable() :
+    m_dim(0),
+    m_size(0),
+    m_coord_blocks(),
+    m_state_blocks(),
+    m_slots(),
+    m_indexed(0),
+    m_stamp(1)
+{
+}
+
+LatticeStateTable::LatticeStateTable(int dimension) : LatticeStateTable()
+{
+    setDimension(dimension);
+}
+
+void LatticeStateTable::setDimension(int dimension)
+{
+    m_dim = dimension;
+    m_coord_blocks.clear();
+    m_state_blocks.clear();
+    m_slots.clear();
+    m_size = 0;
+    m_indexed = 0;
+    m_stamp = 1;
+}
+
+void LatticeStateTable::clear()
+{
+    m_size = 0;
+    m_indexed = 0;
+
+    // invalidate all slots at once; on the rare wraparound, clear them for
+    // real so that stale stamps can't be mistaken for live ones
+    if (++m_stamp == 0) {
+        std::fill(m_slots.begin(), m_slots.end(), Slot{ -1, 0, 0 });
+        m_stamp = 1;
+    }
+}
+
+int LatticeStateTable::find(const int* coord) const
+{
+    if (m_slots.empty()) {
+        return -1;
+    }
+
+    const std::uint32_t hash = hashCoord(coord);
+    const std::size_t mask = m_slots.size() - 1;
+    for (std::size_t i = hash & mask; ; i = (i + 1) & mask) {
+        const Slot& slot = m_slots[i];
+        if (slot.stamp != m_stamp) {
+            return -1;
+        }
+        if (slot.hash == hash && equalCoord(this->coord(slot.id), coord)) {
+            return slot.id;
+        }
+    }
+}
+
+int LatticeStateTable::reserve()
+{
+    const int state_id = m_size;
+    const std::size_t block = state_id >> BlockShift;
+    if (block == m_coord_blocks.size()) {
+        const std::size_t block_vars = (std::size_t)BlockSize * m_dim;
+        m_coord_blocks.emplace_back(new int[block_vars]);
+        m_state_blocks.emplace_back(new double[block_vars]);
+    }
+    ++m_size;
+    return state_id;
+}
+
+void LatticeStateTable::assign(
+    int state_id,
+    const int* coord,
+    const double* state)
+{
+    assert(state_id >= 0 && state_id < m_size);
+    std::copy(coord, coord + m_dim, coordMutable(state_id));
+    std::copy(state, state + m_dim, stateMutable(state_id));
+}
+
+int LatticeStateTable::insert(const int* coord, const double* state)
+{
+    assert(find(coord) < 0);
+
+    // keep the load factor at or below 1/2
+    if (2 * (std::size_t)(m_indexed + 1) > m_slots.size()) {
+        rehash(std::max<std::size_t>(64, 2 * m_slots.size()));
+    }
+
+    const int state_id = reserve();
+    assign(state_id, coord, state);
+
+    const std::uint32_t hash = hashCoord(coord);
+    const std::size_t mask = m_slots.size() - 1;
+    std::size_t i = hash & mask;
+    while (m_slots[i].stamp == m_stamp) {
+        i = (i + 1) & mask;
+    }
+    m_slots[i] = Slot{ state_id, hash, m_stamp };
+    ++m_indexed;
+    return state_id;
+}
+
+std::uint32_t LatticeStateTable::hashCoord(const int* coord) const
+{
+    std::size_t seed = 0;
+    for (int i = 0; i < m_dim; ++i) {
+        seed ^= std::hash<int>()(coord[i]) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+    return (std::uint32_t)(seed ^ (seed >> 32));
+}
+
+bool LatticeStateTable::equalCoord(const int* a, const int* b) const
+{
+    return std::equal(a, a + m_dim, b);
+}
+
+void LatticeStateTable::rehash(std::size_t slot_count)
+{
+    std::vector<Slot> slots(slot_count, Slot{ -1, 0, 0 });
+    const std::size_t mask = slot_count - 1;
+    for (const Slot& slot : m_slots) {
+        if (slot.stamp != m_stamp) {
+            continue;
+        }
+        std::size_t i = slot.hash & mask;
+        while (slots[i].stamp == m_stamp) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+    m_slots = std::move(slots);
+}
+
+} // namespace motion
+} // namespace sbpl
@@ -33,6 +33,7 @@
 #include <smpl/graph/manip_lattice.h>
 
 // standard includes
+#include <algorithm>
 #include <sstream>
 
 // system includes
@@ -46,14 +47,6 @@
 #include <smpl/debug/visualize.h>
 #include "../profiling.h"
 
-auto std::hash<sbpl::motion::ManipLatticeState>::operator()(
-    const argument_type& s) const -> result_type
-{
-    size_t seed = 0;
-    boost::hash_combine(seed, boost::hash_range(s.coord.begin(), s.coord.end()));
-    return seed;
-}
-
 namespace sbpl {
 namespace motion {
 
@@ -66,20 +59,38 @@ ManipLattice::ManipLattice(
     RobotPlanningSpace(robot_model, checker, _params),
     PoseProjectionExtension(),
     ExtractRobotStateExtension(),
+    BatchSuccessorsExtension(),
+    ChangedEdgesExtension(),
     m_fk_iface(nullptr),
+    m_thread_contexts(),
+    m_succ_pool(),
+    m_action_checks(),
+    m_action_results(),
+    m_batch_states(),
+    m_batch_actions(),
     m_min_limits(),
     m_max_limits(),
     m_continuous(),
     m_goal_state_id(-1),
     m_start_state_id(-1),
     m_states(),
+    m_parent_state(),
+    m_extract_state(),
     m_expanded_states(),
+    m_edge_sources(),
+    m_is_edge_source(),
     m_near_goal(false),
     m_t_start(),
     m_viz_frame_id()
 {
     m_fk_iface = robot()->getExtension<ForwardKinematicsInterface>();
 
+    ThreadContext context;
+    context.robot = robot();
+    context.fk_iface = m_fk_iface;
+    context.checker = collisionChecker();
+    m_thread_contexts.push_back(context);
+
     m_min_limits.resize(robot()->jointVariableCount());
     m_max_limits.resize(robot()->jointVariableCount());
     m_continuous.resize(robot()->jointVariableCount());
@@ -91,6 +102,8 @@ ManipLattice::ManipLattice(
         m_bounded[jidx] = robot_model->hasPosLimit(jidx);
     }
 
+    m_states.setDimension(robot()->jointVariableCount());
+
     m_goal_state_id = reserveHashEntry();
     ROS_DEBUG_NAMED(params()->graph_log, "  goal state has state ID %d", m_goal_state_id);
 
@@ -100,12 +113,8 @@ ManipLattice::ManipLattice(
 
 ManipLattice::~ManipLattice()
 {
-    for (size_t i = 0; i < m_states.size(); i++) {
-        delete m_states[i];
-        m_states[i] = nullptr;
-    }
-    m_states.clear();
-    m_state_to_id.clear();
+    // join the workers before the contexts they use go away
+    m_succ_pool.reset();
 }
 
 bool ManipLattice::init(const std::vector<double>& var_res)
@@ -145,7 +154,7 @@ void ManipLattice::PrintState(int stateID, bool verbose, FILE* fout)
         fout = stdout;
     }
 
-    ManipLatticeState* entry = m_states[stateID];
+    const ManipLatticeState entry = getHashEntry(stateID);
 
     std::stringstream ss;
 
@@ -163,9 +172,9 @@ void ManipLattice::PrintState(int stateID, bool verbose, FILE* fout)
         ss << " }>";
     } else {
         ss << "{ ";
-        for (size_t i = 0; i < entry->state.size(); ++i) {
-            ss << std::setprecision(3) << entry->state[i];
-            if (i != entry->state.size() - 1) {
+        for (int i = 0; i < entry.size; ++i) {
+            ss << std::setprecision(3) << entry.state[i];
+            if (i != entry.size - 1) {
                 ss << ", ";
             }
         }
@@ -193,66 +202,149 @@ void ManipLattice::GetSuccs(
 
     ROS_DEBUG_NAMED(params()->expands_log, "expanding state %d", state_id);
 
+    std::vector<Action> actions;
+    if (!getActions(state_id, m_parent_state, actions)) {
+        return;
+    }
+
+    // check actions for validity
+    m_action_checks.clear();
+    for (const Action& action : actions) {
+        m_action_checks.push_back(ActionCheck{ &m_parent_state, &action });
+    }
+    checkActions();
+
+    addSuccessors(state_id, actions, 0, succs, costs);
+
+    recordExpansion(state_id);
+}
+
+/// Generate the successors of a batch of states. The actions of all states are
+/// checked together, so that the successor threads remain busy even when the
+/// states have few valid actions each.
+void ManipLattice::GetBatchSuccs(
+    const std::vector<int>& state_ids,
+    std::vector<std::vector<int>>* succs,
+    std::vector<std::vector<int>>* costs)
+{
+    succs->resize(state_ids.size());
+    costs->resize(state_ids.size());
+
+    // gather actions for all states before taking references to them
+    if (m_batch_states.size() < state_ids.size()) {
+        m_batch_states.resize(state_ids.size());
+        m_batch_actions.resize(state_ids.size());
+    }
+    for (size_t i = 0; i < state_ids.size(); ++i) {
+        const int state_id = state_ids[i];
+        assert(state_id >= 0 && state_id < m_states.size());
+
+        (*succs)[i].clear();
+        (*costs)[i].clear();
+        m_batch_actions[i].clear();
+
+        ROS_DEBUG_NAMED(params()->expands_log, "expanding state %d", state_id);
+
+        if (!getActions(state_id, m_batch_states[i], m_batch_actions[i])) {
+            m_batch_actions[i].clear();
+        }
+    }
+
+    // check actions for validity
+    m_action_checks.clear();
+    for (size_t i = 0; i < state_ids.size(); ++i) {
+        for (const Action& action : m_batch_actions[i]) {
+            m_action_checks.push_back(ActionCheck{ &m_batch_states[i], &action });
+        }
+    }
+    checkActions();
+
+    size_t result_offset = 0;
+    for (size_t i = 0; i < state_ids.size(); ++i) {
+        addSuccessors(
+                state_ids[i],
+                m_batch_actions[i],
+                result_offset,
+                &(*succs)[i],
+                &(*costs)[i]);
+        result_offset += m_batch_actions[i].size();
+        recordExpansion(state_ids[i]);
+    }
+}
+
+// Retrieve the continuous state of a state being expanded and the actions
+// applicable from it. Returns false if the state has no successors.
+bool ManipLattice::getActions(
+    int state_id,
+    RobotState& state,
+    std::vector<Action>& actions)
+{
     ActionSpacePtr action_space = actionSpace();
     if (!action_space) {
-        return;
+        return false;
     }
 
     // goal state should be absorbing
     if (state_id == m_goal_state_id) {
-        return;
+        return false;
     }
 
-    ManipLatticeState* parent_entry = m_states[state_id];
+    const ManipLatticeState entry = getHashEntry(state_id);
+    assert(entry);
 
-    assert(parent_entry);
-    assert(parent_entry->coord.size() >= robot()->jointVariableCount());
+    state.assign(entry.state, entry.state + entry.size);
 
     // log expanded state details
-    ROS_DEBUG_NAMED(params()->expands_log, "  coord: %s", to_string(parent_entry->coord).c_str());
-    ROS_DEBUG_NAMED(params()->expands_log, "  angles: %s", to_string(parent_entry->state).c_str());
+    ROS_DEBUG_NAMED(params()->expands_log, "  coord: %s", to_string(entry.getCoord()).c_str());
+    ROS_DEBUG_NAMED(params()->expands_log, "  angles: %s", to_string(state).c_str());
     ROS_DEBUG_NAMED(params()->expands_log, "  heur: %d", GetGoalHeuristic(state_id));
 
-    SV_SHOW_DEBUG(getStateVisualization(parent_entry->state, "expansion"));
-
-    int goal_succ_count = 0;
+    SV_SHOW_DEBUG(getStateVisualization(state, "expansion"));
 
-    std::vector<Action> actions;
-    if (!action_space->apply(parent_entry->state, actions)) {
+    if (!action_space->apply(state, actions)) {
         ROS_WARN("Failed to get actions");
-        return;
+        return false;
     }
 
     ROS_DEBUG_NAMED(params()->expands_log, "  actions: %zu", actions.size());
+    return true;
+}
+
+// Create successor states for the valid actions of a state, in action order,
+// independent of the order in which the actions were checked. The results for
+// the actions begin at m_action_results[result_offset].
+void ManipLattice::addSuccessors(
+    int state_id,
+    const std::vector<Action>& actions,
+    size_t result_offset,
+    std::vector<int>* succs,
+    std::vector<int>* costs)
+{
+    const ManipLatticeState parent_entry = getHashEntry(state_id);
+
+    int goal_succ_count = 0;
 
-    // check actions for validity
     RobotCoord succ_coord(robot()->jointVariableCount(), 0);
     for (size_t i = 0; i < actions.size(); ++i) {
         const Action& action = actions[i];
+        const ActionResult& result = m_action_results[result_offset + i];
 
         ROS_DEBUG_NAMED(params()->expands_log, "    action %zu:", i);
         ROS_DEBUG_NAMED(params()->expands_log, "      waypoints: %zu", action.size());
 
-        double dist;
-        if (!checkAction(parent_entry->state, action, dist)) {
+        if (!result.valid) {
             continue;
         }
 
         // compute destination coords
         stateToCoord(action.back(), succ_coord);
 
-        // get the successor
-
         // get pose of planning link
-        std::vector<double> tgt_off_pose;
-        if (!computePlanningFrameFK(action.back(), tgt_off_pose)) {
-            ROS_WARN("Failed to compute FK for planning frame");
-            continue;
-        }
+        const std::vector<double>& tgt_off_pose = result.tgt_off_pose;
 
         // check if hash entry already exists, if not then create one
         int succ_state_id = getOrCreateState(succ_coord, action.back());
-        ManipLatticeState* succ_entry = getHashEntry(succ_state_id);
+        const ManipLatticeState succ_entry = getHashEntry(succ_state_id);
 
         // check if this state meets the goal criteria
         const bool is_goal_succ = isGoal(action.back(), tgt_off_pose);
@@ -273,7 +365,7 @@ void ManipLattice::GetSuccs(
         ROS_DEBUG_NAMED(params()->expands_log, "      succ: %zu", i);
         ROS_DEBUG_NAMED(params()->expands_log, "        id: %5i", succ_state_id);
         ROS_DEBUG_NAMED(params()->expands_log, "        coord: %s", to_string(succ_coord).c_str());
-        ROS_DEBUG_NAMED(params()->expands_log, "        state: %s", to_string(succ_entry->state).c_str());
+        ROS_DEBUG_NAMED(params()->expands_log, "        state: %s", to_string(succ_entry.getState()).c_str());
         ROS_DEBUG_NAMED(params()->expands_log, "        pose: %s", to_string(tgt_off_pose).c_str());
         ROS_DEBUG_NAMED(params()->expands_log, "        heur: %2d", GetGoalHeuristic(succ_state_id));
         ROS_DEBUG_NAMED(params()->expands_log, "        cost: %5d", cost(parent_entry, succ_entry, is_goal_succ));
@@ -282,8 +374,6 @@ void ManipLattice::GetSuccs(
     if (goal_succ_count > 0) {
         ROS_DEBUG_NAMED(params()->expands_log, "Got %d goal successors!", goal_succ_count);
     }
-
-    m_expanded_states.push_back(state_id);
 }
 
 Stopwatch GetLazySuccsStopwatch("GetLazySuccs", 10);
@@ -315,17 +405,17 @@ void ManipLattice::GetLazySuccs(
         return;
     }
 
-    ManipLatticeState* state_entry = m_states[SourceStateID];
-
+    const ManipLatticeState state_entry = getHashEntry(SourceStateID);
     assert(state_entry);
-    assert(state_entry->coord.size() >= robot()->jointVariableCount());
+
+    const RobotState& source_angles = m_parent_state;
+    m_parent_state.assign(state_entry.state, state_entry.state + state_entry.size);
 
     // log expanded state details
-    ROS_DEBUG_NAMED(params()->expands_log, "  coord: %s", to_string(state_entry->coord).c_str());
-    ROS_DEBUG_NAMED(params()->expands_log, "  angles: %s", to_string(state_entry->state).c_str());
+    ROS_DEBUG_NAMED(params()->expands_log, "  coord: %s", to_string(state_entry.getCoord()).c_str());
+    ROS_DEBUG_NAMED(params()->expands_log, "  angles: %s", to_string(source_angles).c_str());
     ROS_DEBUG_NAMED(params()->expands_log, "  heur: %d", GetGoalHeuristic(SourceStateID));
 
-    const RobotState& source_angles = state_entry->state;
     SV_SHOW_DEBUG(getStateVisualization(source_angles, "expansion"));
 
     std::vector<Action> actions;
@@ -358,7 +448,7 @@ void ManipLattice::GetLazySuccs(
         }
 
         int succ_state_id = getOrCreateState(succ_coord, action.back());
-        ManipLatticeState* succ_entry = getHashEntry(succ_state_id);
+        const ManipLatticeState succ_entry = getHashEntry(succ_state_id);
 
         if (succ_is_goal_state) {
             SuccIDV->push_back(m_goal_state_id);
@@ -372,7 +462,7 @@ void ManipLattice::GetLazySuccs(
         ROS_DEBUG_NAMED(params()->expands_log, "      succ: %zu", i);
         ROS_DEBUG_NAMED(params()->expands_log, "        id: %5i", succ_state_id);
         ROS_DEBUG_NAMED(params()->expands_log, "        coord: %s", to_string(succ_coord).c_str());
-        ROS_DEBUG_NAMED(params()->expands_log, "        state: %s", to_string(succ_entry->state).c_str());
+        ROS_DEBUG_NAMED(params()->expands_log, "        state: %s", to_string(succ_entry.getState()).c_str());
         ROS_DEBUG_NAMED(params()->expands_log, "        pose: %s", to_string(tgt_off_pose).c_str());
         ROS_DEBUG_NAMED(params()->expands_log, "        heur: %2d", GetGoalHeuristic(succ_state_id));
         ROS_DEBUG_NAMED(params()->expands_log, "        cost: %5d", cost(state_entry, succ_entry, succ_is_goal_state));
@@ -382,7 +472,7 @@ void ManipLattice::GetLazySuccs(
         ROS_DEBUG_NAMED(params()->expands_log, "Got %d goal successors!", goal_succ_count);
     }
 
-    m_expanded_states.push_back(SourceStateID);
+    recordExpansion(SourceStateID);
 }
 
 Stopwatch GetTrueCostStopwatch("GetTrueCost", 10);
@@ -397,12 +487,13 @@ int ManipLattice::GetTrueCost(int parentID, int childID)
     assert(parentID >= 0 && parentID < (int)m_states.size());
     assert(childID >= 0 && childID < (int)m_states.size());
 
-    ManipLatticeState* parent_entry = m_states[parentID];
-    ManipLatticeState* child_entry = m_states[childID];
-    assert(parent_entry && parent_entry->coord.size() >= robot()->jointVariableCount());
-    assert(child_entry && child_entry->coord.size() >= robot()->jointVariableCount());
+    const ManipLatticeState parent_entry = getHashEntry(parentID);
+    const ManipLatticeState child_entry = getHashEntry(childID);
+    assert(parent_entry);
+    assert(child_entry);
 
-    const RobotState& parent_angles = parent_entry->state;
+    const RobotState& parent_angles = m_parent_state;
+    m_parent_state.assign(parent_entry.state, parent_entry.state + parent_entry.size);
     SV_SHOW_DEBUG(getStateVisualization(parent_angles, "expansion"));
 
     ActionSpacePtr action_space = actionSpace();
@@ -442,7 +533,7 @@ int ManipLattice::GetTrueCost(int parentID, int childID)
             }
         } else {
             // skip actions which don't end up at the child state
-            if (succ_coord != child_entry->coord) {
+            if (!std::equal(succ_coord.begin(), succ_coord.end(), child_entry.coord)) {
                 continue;
             }
         }
@@ -457,7 +548,7 @@ int ManipLattice::GetTrueCost(int parentID, int childID)
 
         // get the unique state
         int succ_state_id = goal_edge ? getHashEntry(succ_coord) : childID;
-        ManipLatticeState* succ_entry = getHashEntry(succ_state_id);
+        const ManipLatticeState succ_entry = getHashEntry(succ_state_id);
         assert(succ_entry);
 
         const int edge_cost = cost(parent_entry, succ_entry, goal_edge);
@@ -473,9 +564,15 @@ int ManipLattice::GetTrueCost(int parentID, int childID)
     }
 }
 
+/// The returned reference is to storage owned by the planning space and is
+/// only valid until the next call to extractState(), which overwrites it.
+/// Callers that need two states at once must copy the first. Not safe to call
+/// concurrently; the successor threads never call it.
 const RobotState& ManipLattice::extractState(int state_id)
 {
-    return m_states[state_id]->state;
+    const ManipLatticeState entry = getHashEntry(state_id);
+    m_extract_state.assign(entry.state, entry.state + entry.size);
+    return m_extract_state;
 }
 
 bool ManipLattice::projectToPose(int state_id, Eigen::Affine3d& pose)
@@ -498,7 +595,7 @@ bool ManipLattice::projectToPose(int state_id, Eigen::Affine3d& pose)
     }
 
     std::vector<double> vpose;
-    if (!computePlanningFrameFK(m_states[state_id]->state, vpose)) {
+    if (!computePlanningFrameFK(getHashEntry(state_id).getState(), vpose)) {
         ROS_WARN("Failed to compute fk for state %d", state_id);
         return false;
     }
@@ -519,41 +616,35 @@ void ManipLattice::GetPreds(
     ROS_WARN("GetPreds unimplemented");
 }
 
-ManipLatticeState* ManipLattice::getHashEntry(int state_id) const
+/// Return a view of the state with the given id. The view evaluates to false
+/// if no such state exists.
+ManipLatticeState ManipLattice::getHashEntry(int state_id) const
 {
-    if (state_id < 0 || state_id >= (int)m_states.size()) {
-        return nullptr;
+    ManipLatticeState entry;
+    if (state_id >= 0 && state_id < m_states.size()) {
+        entry.coord = m_states.coord(state_id);
+        entry.state = m_states.state(state_id);
+        entry.size = m_states.dimension();
     }
-
-    return m_states[state_id];
+    return entry;
 }
 
 /// Return the state id of the state with the given coordinate or -1 if the
 /// state has not yet been allocated.
-int ManipLattice::getHashEntry(const RobotCoord& coord)
+int ManipLattice::getHashEntry(const RobotCoord& coord) const
 {
-    ManipLatticeState state;
-    state.coord = coord;
-    auto sit = m_state_to_id.find(&state);
-    if (sit == m_state_to_id.end()) {
-        return -1;
-    }
-    return sit->second;
+    assert(coord.size() == m_states.dimension());
+    return m_states.find(coord.data());
 }
 
 int ManipLattice::createHashEntry(
     const RobotCoord& coord,
     const RobotState& state)
 {
-    int state_id = reserveHashEntry();
-    ManipLatticeState* entry = getHashEntry(state_id);
-
-    entry->coord = coord;
-    entry->state = state;
-
-    // map state -> state id
-    m_state_to_id[entry] = state_id;
-
+    assert(coord.size() == m_states.dimension());
+    assert(state.size() == m_states.dimension());
+    const int state_id = m_states.insert(coord.data(), state.data());
+    allocateIndexMapping(state_id);
     return state_id;
 }
 
@@ -568,20 +659,41 @@ int ManipLattice::getOrCreateState(
     return state_id;
 }
 
+/// Allocate a state that is not indexed by its coordinate. The coordinates of
+/// the state are zero until set via setHashEntry().
 int ManipLattice::reserveHashEntry()
 {
-    ManipLatticeState* entry = new ManipLatticeState;
-    int state_id = (int)m_states.size();
-
-    // map state id -> state
-    m_states.push_back(entry);
+    const int state_id = m_states.reserve();
+    const RobotCoord zero_coord(m_states.dimension(), 0);
+    const RobotState zero_state(m_states.dimension(), 0.0);
+    m_states.assign(state_id, zero_coord.data(), zero_state.data());
+    allocateIndexMapping(state_id);
+    return state_id;
+}
 
-    // map planner state -> graph state
-    int* pinds = new int[NUMOFINDICES_STATEID2IND];
-    std::fill(pinds, pinds + NUMOFINDICES_STATEID2IND, -1);
-    StateID2IndexMapping.push_back(pinds);
+/// Set the coordinates of a state allocated via reserveHashEntry().
+void ManipLattice::setHashEntry(
+    int state_id,
+    const RobotCoord& coord,
+    const RobotState& state)
+{
+    assert(coord.size() == m_states.dimension());
+    assert(state.size() == m_states.dimension());
+    m_states.assign(state_id, coord.data(), state.data());
+}
 
-    return state_id;
+// map planner state -> graph state, reusing mappings from states released by
+// clearStates()
+void ManipLattice::allocateIndexMapping(int state_id)
+{
+    if (state_id < (int)StateID2IndexMapping.size()) {
+        int* pinds = StateID2IndexMapping[state_id];
+        std::fill(pinds, pinds + NUMOFINDICES_STATEID2IND, -1);
+    } else {
+        int* pinds = new int[NUMOFINDICES_STATEID2IND];
+        std::fill(pinds, pinds + NUMOFINDICES_STATEID2IND, -1);
+        StateID2IndexMapping.push_back(pinds);
+    }
 }
 
 /// NOTE: const although RobotModel::computePlanningLinkFK used underneath may
@@ -589,10 +701,21 @@ int ManipLattice::reserveHashEntry()
 bool ManipLattice::computePlanningFrameFK(
     const RobotState& state,
     std::vector<double>& pose) const
+{
+    return computePlanningFrameFK(m_fk_iface, state, pose);
+}
+
+/// Compute the planning frame pose using the given forward kinematics
+/// interface, for use from threads that may not share the planning space's
+/// robot model.
+bool ManipLattice::computePlanningFrameFK(
+    ForwardKinematicsInterface* fk_iface,
+    const RobotState& state,
+    std::vector<double>& pose) const
 {
     assert(state.size() == robot()->jointVariableCount());
 
-    if (!m_fk_iface || !m_fk_iface->computePlanningLinkFK(state, pose)) {
+    if (!fk_iface || !fk_iface->computePlanningLinkFK(state, pose)) {
         return false;
     }
 
@@ -603,8 +726,8 @@ bool ManipLattice::computePlanningFrameFK(
 }
 
 int ManipLattice::cost(
-    ManipLatticeState* HashEntry1,
-    ManipLatticeState* HashEntry2,
+    const ManipLatticeState& HashEntry1,
+    const ManipLatticeState& HashEntry2,
     bool bState2IsGoal) const
 {
     const int DefaultCostMultiplier = 1000;
@@ -615,6 +738,20 @@ bool ManipLattice::checkAction(
     const RobotState& state,
     const Action& action,
     double& dist)
+{
+    return checkAction(robot(), collisionChecker(), state, action, dist);
+}
+
+/// Check an action for joint limit violations and collisions using the given
+/// robot model and collision checker. Does not modify the planning space, so
+/// may be called concurrently given distinct robot models and collision
+/// checkers.
+bool ManipLattice::checkAction(
+    RobotModel* robot,
+    CollisionChecker* checker,
+    const RobotState& state,
+    const Action& action,
+    double& dist) const
 {
     std::uint32_t violation_mask = 0x00000000;
     int plen = 0;
@@ -627,7 +764,7 @@ bool ManipLattice::checkAction(
         ROS_DEBUG_NAMED(params()->expands_log, "        %zu: %s", iidx, to_string(istate).c_str());
 
         // check joint limits
-        if (!robot()->checkJointLimits(istate)) {
+        if (!robot->checkJointLimits(istate)) {
             ROS_DEBUG_NAMED(params()->expands_log, "        -> violates joint limits");
             violation_mask |= 0x00000001;
             break;
@@ -654,7 +791,7 @@ bool ManipLattice::checkAction(
     }
 
     // check for collisions along path from parent to first waypoint
-    if (!collisionChecker()->isStateToStateValid(state, action[0], plen, nchecks, dist)) {
+    if (!checker->isStateToStateValid(state, action[0], plen, nchecks, dist)) {
         ROS_DEBUG_NAMED(params()->expands_log, "        -> path to first waypoint in collision (dist: %0.3f, path_length: %d)", dist, plen);
         violation_mask |= 0x00000004;
     }
@@ -667,7 +804,7 @@ bool ManipLattice::checkAction(
     for (size_t j = 1; j < action.size(); ++j) {
         const RobotState& prev_istate = action[j - 1];
         const RobotState& curr_istate = action[j];
-        if (!collisionChecker()->isStateToStateValid(
+        if (!checker->isStateToStateValid(
                 prev_istate, curr_istate, plen, nchecks, dist))
         {
             ROS_DEBUG_NAMED(params()->expands_log, "        -> path between waypoints %zu and %zu in collision (dist: %0.3f, path_length: %d)", j - 1, j, dist, plen);
@@ -809,6 +946,9 @@ bool ManipLattice::setStart(const RobotState& state)
 
     m_start_state_id = getOrCreateState(start_coord, state);
 
+    // a new search begins from the start state
+    m_expanded_states.clear();
+
     // notify observers of updated start state
     return RobotPlanningSpace::setStart(state);
 }
@@ -832,14 +972,44 @@ void ManipLattice::getExpandedStates(std::vector<RobotState>& states) const
     RobotState state(robot()->jointVariableCount(), 0);
 
     for (size_t i = 0; i < m_expanded_states.size(); ++i) {
-        const ManipLatticeState* entry = getHashEntry(m_expanded_states[i]);
+        const ManipLatticeState entry = getHashEntry(m_expanded_states[i]);
         if (entry) {
-            states.push_back(entry->state);
+            states.push_back(entry.getState());
         }
         states.push_back(state);
     }
 }
 
+// Record the expansion of a state by the current search and, the first time it
+// is expanded, as a source of edges that may be changed by the environment
+void ManipLattice::recordExpansion(int state_id)
+{
+    m_expanded_states.push_back(state_id);
+    if (state_id >= (int)m_is_edge_source.size()) {
+        m_is_edge_source.resize(state_id + 1, false);
+    }
+    if (!m_is_edge_source[state_id]) {
+        m_is_edge_source[state_id] = true;
+        m_edge_sources.push_back(state_id);
+    }
+}
+
+/// \brief Release all states created since construction or the last call to
+///     clearStates().
+///
+/// Constant time with respect to the number of states; storage is retained for
+/// the states created by later queries. Invalidates all state ids except that
+/// of the goal state, so searches over this space must be restarted.
+void ManipLattice::clearStates()
+{
+    m_states.clear();
+    m_goal_state_id = reserveHashEntry();
+    m_start_state_id = -1;
+    m_expanded_states.clear();
+    m_edge_sources.clear();
+    m_is_edge_source.clear();
+}
+
 void ManipLattice::setVisualizationFrameId(const std::string& frame_id)
 {
     m_viz_frame_id = frame_id;
@@ -850,6 +1020,65 @@ const std::string& ManipLattice::visualizationFrameId() const
     return m_viz_frame_id;
 }
 
+/// \brief Check successors concurrently using additional robot models and
+///     collision checkers.
+///
+/// One worker thread is started for each robot model/collision checker pair.
+/// The thread calling GetSuccs() also checks actions, using the robot model
+/// and collision checker of this planning space. Each robot model must provide
+/// forward kinematics and no two contexts may share mutable state. State ids
+/// are still created by the calling thread and successors are returned in the
+/// same order regardless of the number of threads. Passing empty lists
+/// restores serial successor checking.
+bool ManipLattice::setSuccessorThreadContexts(
+    const std::vector<RobotModel*>& robots,
+    const std::vector<CollisionChecker*>& checkers)
+{
+    if (robots.size() != checkers.size()) {
+        ROS_ERROR_NAMED(params()->graph_log, "Mismatched number of robot models (%zu) and collision checkers (%zu) for successor threads", robots.size(), checkers.size());
+        return false;
+    }
+
+    std::vector<ThreadContext> contexts;
+    contexts.push_back(m_thread_contexts.front());
+    for (size_t i = 0; i < robots.size(); ++i) {
+        if (!robots[i] || !checkers[i]) {
+            ROS_ERROR_NAMED(params()->graph_log, "Successor thread context %zu is null", i);
+            return false;
+        }
+        if (robots[i]->jointVariableCount() != robot()->jointVariableCount()) {
+            ROS_ERROR_NAMED(params()->graph_log, "Successor thread robot model %zu has %zu variables (expected %zu)", i, robots[i]->jointVariableCount(), robot()->jointVariableCount());
+            return false;
+        }
+
+        ThreadContext context;
+        context.robot = robots[i];
+        context.fk_iface = robots[i]->getExtension<ForwardKinematicsInterface>();
+        context.checker = checkers[i];
+        if (!context.fk_iface) {
+            ROS_ERROR_NAMED(params()->graph_log, "Successor thread robot model %zu does not support forward kinematics", i);
+            return false;
+        }
+        contexts.push_back(context);
+    }
+
+    m_succ_pool.reset();
+    m_thread_contexts = std::move(contexts);
+    if (!robots.empty()) {
+        m_succ_pool.reset(new ThreadPool((int)robots.size()));
+    }
+
+    ROS_INFO_NAMED(params()->graph_log, "Checking successors with %d threads", successorThreadCount());
+    return true;
+}
+
+/// Return the number of threads used to check successors, including the
+/// thread calling GetSuccs().
+int ManipLattice::successorThreadCount() const
+{
+    return (int)m_thread_contexts.size();
+}
+
 void ManipLattice::computeCostPerCell()
 {
     ROS_WARN("yeah...");
@@ -871,19 +1100,19 @@ bool ManipLattice::extractPath(
         const int state_id = idpath[0];
 
         if (state_id == getGoalStateID()) {
-            const ManipLatticeState* entry = getHashEntry(getStartStateID());
+            const ManipLatticeState entry = getHashEntry(getStartStateID());
             if (!entry) {
                 ROS_ERROR_NAMED(params()->graph_log, "Failed to get state entry for state %d", getStartStateID());
                 return false;
             }
-            opath.push_back(entry->state);
+            opath.push_back(entry.getState());
         } else {
-            const ManipLatticeState* entry = getHashEntry(state_id);
+            const ManipLatticeState entry = getHashEntry(state_id);
             if (!entry) {
                 ROS_ERROR_NAMED(params()->graph_log, "Failed to get state entry for state %d", state_id);
                 return false;
             }
-            opath.push_back(entry->state);
+            opath.push_back(entry.getState());
         }
 
         SV_SHOW_INFO(getStateVisualization(opath.back(), "goal_state"));
@@ -897,12 +1126,12 @@ bool ManipLattice::extractPath(
 
     // grab the first point
     {
-        const ManipLatticeState* entry = getHashEntry(idpath[0]);
+        const ManipLatticeState entry = getHashEntry(idpath[0]);
         if (!entry) {
             ROS_ERROR_NAMED(params()->graph_log, "Failed to get state entry for state %d", idpath[0]);
             return false;
         }
-        opath.push_back(entry->state);
+        opath.push_back(entry.getState());
     }
 
     ActionSpacePtr action_space = actionSpace();
@@ -925,8 +1154,8 @@ bool ManipLattice::extractPath(
         if (curr_id == getGoalStateID()) {
             ROS_DEBUG_NAMED(params()->graph_log, "Search for transition to goal state");
 
-            ManipLatticeState* prev_entry = m_states[prev_id];
-            const RobotState& prev_state = prev_entry->state;
+            const ManipLatticeState prev_entry = getHashEntry(prev_id);
+            const RobotState prev_state = prev_entry.getState();
 
             std::vector<Action> actions;
             if (!action_space->apply(prev_state, actions)) {
@@ -935,7 +1164,7 @@ bool ManipLattice::extractPath(
             }
 
             // find the goal state corresponding to the cheapest valid action
-            ManipLatticeState* best_goal_state = nullptr;
+            ManipLatticeState best_goal_state;
             RobotCoord succ_coord(robot()->jointVariableCount());
             int best_cost = std::numeric_limits<int>::max();
             for (size_t aidx = 0; aidx < actions.size(); ++aidx) {
@@ -960,7 +1189,7 @@ bool ManipLattice::extractPath(
 
                 stateToCoord(action.back(), succ_coord);
                 int succ_state_id = getHashEntry(succ_coord);
-                ManipLatticeState* succ_entry = getHashEntry(succ_state_id);
+                const ManipLatticeState succ_entry = getHashEntry(succ_state_id);
                 assert(succ_entry);
 
                 const int edge_cost = cost(prev_entry, succ_entry, true);
@@ -971,20 +1200,20 @@ bool ManipLattice::extractPath(
             }
 
             if (!best_goal_state) {
-                ROS_ERROR_NAMED(params()->graph_log, "Failed to find valid goal successor from state %s during path extraction", to_string(prev_entry->state).c_str());
+                ROS_ERROR_NAMED(params()->graph_log, "Failed to find valid goal successor from state %s during path extraction", to_string(prev_state).c_str());
                 return false;
             }
 
-            opath.push_back(best_goal_state->state);
+            opath.push_back(best_goal_state.getState());
         } else {
-            const ManipLatticeState* entry = getHashEntry(curr_id);
+            const ManipLatticeState entry = getHashEntry(curr_id);
             if (!entry) {
                 ROS_ERROR_NAMED(params()->graph_log, "Failed to get state entry state %d", curr_id);
                 return false;
             }
 
-            ROS_DEBUG_NAMED(params()->graph_log, "Extract successor state %s", to_string(entry->state).c_str());
-            opath.push_back(entry->state);
+            opath.push_back(entry.getState());
+            ROS_DEBUG_NAMED(params()->graph_log, "Extract successor state %s", to_string(opath.back()).c_str());
         }
     }
 
@@ -1000,7 +1229,9 @@ Extension* ManipLattice::getExtension(size_t class_code)
         class_code == GetClassCode<PointProjectionExtension>() ||
         class_code == GetClassCode<ExtractRobotStateExtension>() ||
         class_code == GetClassCode<ManipLattice>() ||
-        class_code == GetClassCode<PoseProjectionExtension>())
+        class_code == GetClassCode<PoseProjectionExtension>() ||
+        class_code == GetClassCode<BatchSuccessorsExtension>() ||
+        class_code == GetClassCode<ChangedEdgesExtension>())
     {
         return this;
     }
@@ -1027,7 +1258,7 @@ int ManipLattice::getStartStateID() const
 RobotState ManipLattice::getStartConfiguration() const
 {
     if (m_start_state_id >= 0) {
-        return getHashEntry(m_start_state_id)->state;
+        return getHashEntry(m_start_state_id).getState();
     } else {
         return RobotState();
     }
@@ -1081,12 +1312,168 @@ bool ManipLattice::setGoalConfiguration(const GoalConstraint& goal)
     return RobotPlanningSpace::setGoal(goal);
 }
 
+/// Check the validity of each action in m_action_checks and compute the
+/// planning frame pose at its final waypoint, storing the results in
+/// m_action_results.
+///
+/// The actions are checked for collisions individually, and the poses of the
+/// valid actions are then computed in one batch per thread, allowing the robot
+/// model to reuse kinematics computation shared between the final waypoints.
+void ManipLattice::checkActions()
+{
+    m_action_results.resize(m_action_checks.size());
+
+    auto check = [&](int cidx, int worker)
+    {
+        const ThreadContext& context = m_thread_contexts[worker];
+        const ActionCheck& ac = m_action_checks[cidx];
+        ActionResult& result = m_action_results[cidx];
+
+        double dist;
+        result.valid = checkAction(
+                context.robot, context.checker, *ac.state, *ac.action, dist);
+    };
+
+    const int worker_count = m_succ_pool ? m_succ_pool->workerCount() : 1;
+    if (m_fk_batches.size() < (size_t)worker_count) {
+        m_fk_batches.resize(worker_count);
+    }
+
+    const int check_count = (int)m_action_checks.size();
+    auto compute_poses = [&](int chunk, int worker)
+    {
+        const ThreadContext& context = m_thread_contexts[worker];
+        FKBatch& batch = m_fk_batches[worker];
+        const int begin = chunk * check_count / worker_count;
+        const int end = (chunk + 1) * check_count / worker_count;
+
+        batch.checks.clear();
+        for (int cidx = begin; cidx < end; ++cidx) {
+            if (m_action_results[cidx].valid) {
+                batch.checks.push_back(cidx);
+            }
+        }
+        if (batch.checks.empty()) {
+            return;
+        }
+
+        batch.states.resize(batch.checks.size());
+        for (size_t i = 0; i < batch.checks.size(); ++i) {
+            batch.states[i] = m_action_checks[batch.checks[i]].action->back();
+        }
+
+        if (context.fk_iface &&
+            context.fk_iface->computeBatchPlanningLinkFK(
+                    batch.states, batch.poses))
+        {
+            for (size_t i = 0; i < batch.checks.size(); ++i) {
+                ActionResult& result = m_action_results[batch.checks[i]];
+                result.tgt_off_pose = getTargetOffsetPose(batch.poses[i]);
+            }
+            return;
+        }
+
+        // identify the actions whose poses could not be computed
+        for (size_t i = 0; i < batch.checks.size(); ++i) {
+            ActionResult& result = m_action_results[batch.checks[i]];
+            if (!computePlanningFrameFK(
+                    context.fk_iface, batch.states[i], result.tgt_off_pose))
+            {
+                ROS_WARN("Failed to compute FK for planning frame");
+                result.valid = false;
+            }
+        }
+    };
+
+    if (m_succ_pool) {
+        m_succ_pool->parallelFor(check_count, check);
+        m_succ_pool->parallelFor(worker_count, compute_poses);
+    } else {
+        for (int cidx = 0; cidx < check_count; ++cidx) {
+            check(cidx, 0);
+        }
+        compute_poses(0, 0);
+    }
+}
+
+/// Find the expanded states with an action whose validity may have been
+/// changed by modifications to the environment, as reported by the collision
+/// checker, and forget those modifications.
+void ManipLattice::getChangedEdgeSources(std::vector<int>& state_ids)
+{
+    state_ids.clear();
+
+    ActionSpacePtr action_space = actionSpace();
+    if (!action_space) {
+        clearEnvironmentChanges();
+        return;
+    }
+
+    RobotState state;
+    std::vector<Action> actions;
+    for (int state_id : m_edge_sources) {
+        if (state_id == m_goal_state_id) {
+            continue;
+        }
+
+        const ManipLatticeState entry = getHashEntry(state_id);
+        state.assign(entry.state, entry.state + entry.size);
+
+        actions.clear();
+        if (!action_space->apply(state, actions)) {
+            continue;
+        }
+
+        for (const Action& action : actions) {
+            if (isActionAffected(state, action)) {
+                state_ids.push_back(state_id);
+                break;
+            }
+        }
+    }
+
+    ROS_DEBUG_NAMED(params()->graph_log, "%zu of %zu expanded states have changed edges", state_ids.size(), m_edge_sources.size());
+
+    clearEnvironmentChanges();
+}
+
+// Test whether any segment of an action may have been affected by changes to
+// the environment.
+bool ManipLattice::isActionAffected(
+    const RobotState& state,
+    const Action& action)
+{
+    CollisionChecker* checker = collisionChecker();
+    const RobotState* prev = &state;
+    for (const RobotState& waypoint : action) {
+        if (checker->isStateToStateAffected(*prev, waypoint)) {
+            return true;
+        }
+        prev = &waypoint;
+    }
+    return false;
+}
+
+// Forget environment changes recorded by the collision checkers of all
+// successor threads.
+void ManipLattice::clearEnvironmentChanges()
+{
+    for (const ThreadContext& context : m_thread_contexts) {
+        context.checker->clearEnvironmentChanges();
+    }
+}
+
 // Reset any variables that should be set just before a new search is started.
+// The expanded states are kept until the states are cleared, since a search
+// repaired across queries retains the edges of states expanded by earlier
+// queries.
 void ManipLattice::startNewSearch()
 {
-    m_expanded_states.clear();
     m_near_goal = false;
     m_t_start = clock::now();
+
+    // changes made before the search began can't affect its edges
+    clearEnvironmentChanges();
 }
 
 /// \brief Return the 6-dof goal pose for the offset from the tip link.
@@ -61,6 +61,27 @@ ManipLatticeEgraph::ManipLatticeEgraph(
 {
 }
 
+/// Release all lattice states, recreating the states corresponding to
+/// experience graph nodes.
+void ManipLatticeEgraph::clearStates()
+{
+    ManipLattice::clearStates();
+
+    m_state_to_node.clear();
+    RobotCoord coord(robot()->jointVariableCount());
+    auto nodes = m_egraph.nodes();
+    for (auto nit = nodes.first; nit != nodes.second; ++nit) {
+        const RobotState& state = m_egraph.state(*nit);
+        stateToCoord(state, coord);
+
+        int entry_id = reserveHashEntry();
+        setHashEntry(entry_id, coord, state);
+
+        m_egraph_state_ids[*nit] = entry_id;
+        m_state_to_node[entry_id] = *nit;
+    }
+}
+
 bool ManipLatticeEgraph::extractPath(
     const std::vector<int>& idpath,
     std::vector<RobotState>& path)
@@ -77,19 +98,19 @@ bool ManipLatticeEgraph::extractPath(
 
         if (state_id == getGoalStateID()) {
             RobotState angles;
-            const ManipLatticeState* entry = getHashEntry(getStartStateID());
+            const ManipLatticeState entry = getHashEntry(getStartStateID());
             if (!entry) {
                 ROS_ERROR_NAMED(params()->graph_log, "Failed to get state entry for state %d", getStartStateID());
                 return false;
             }
-            path.push_back(entry->state);
+            path.push_back(entry.getState());
         } else {
-            const ManipLatticeState* entry = getHashEntry(state_id);
+            const ManipLatticeState entry = getHashEntry(state_id);
             if (!entry) {
                 ROS_ERROR_NAMED(params()->graph_log, "Failed to get state entry for state %d", state_id);
                 return false;
             }
-            path.push_back(entry->state);
+            path.push_back(entry.getState());
         }
 
         SV_SHOW_INFO(getStateVisualization(path.back(), "goal_state"));
@@ -106,12 +127,12 @@ bool ManipLatticeEgraph::extractPath(
     // grab the first point
     {
         RobotState angles;
-        const ManipLatticeState* entry = getHashEntry(idpath[0]);
+        const ManipLatticeState entry = getHashEntry(idpath[0]);
         if (!entry) {
             ROS_ERROR_NAMED(params()->graph_log, "Failed to get state entry for state %d", idpath[0]);
             return false;
         }
-        opath.push_back(entry->state);
+        opath.push_back(entry.getState());
     }
 
     ActionSpacePtr action_space = actionSpace();
@@ -132,8 +153,8 @@ bool ManipLatticeEgraph::extractPath(
 
         // find the successor state corresponding to the cheapest valid action
 
-        ManipLatticeState* prev_entry = getHashEntry(prev_id);
-        const RobotState& prev_state = prev_entry->state;
+        const ManipLatticeState prev_entry = getHashEntry(prev_id);
+        const RobotState prev_state = prev_entry.getState();
 
         std::vector<Action> actions;
         if (!action_space->apply(prev_state, actions)) {
@@ -142,7 +163,7 @@ bool ManipLatticeEgraph::extractPath(
         }
 
         ROS_DEBUG_NAMED(params()->graph_log, "Check for transition via normal successors");
-        ManipLatticeState* best_state = nullptr;
+        ManipLatticeState best_state;
         RobotCoord succ_coord(robot()->jointVariableCount());
         int best_cost = std::numeric_limits<int>::max();
         for (const Action& action : actions) {
@@ -167,7 +188,7 @@ bool ManipLatticeEgraph::extractPath(
 
                 stateToCoord(action.back(), succ_coord);
                 int succ_state_id = getHashEntry(succ_coord);
-                ManipLatticeState* succ_entry = getHashEntry(succ_state_id);
+                const ManipLatticeState succ_entry = getHashEntry(succ_state_id);
                 assert(succ_entry);
 
                 const int edge_cost = cost(prev_entry, succ_entry, true);
@@ -178,7 +199,7 @@ bool ManipLatticeEgraph::extractPath(
             } else {
                 stateToCoord(action.back(), succ_coord);
                 int succ_state_id = getHashEntry(succ_coord);
-                ManipLatticeState* succ_entry = getHashEntry(succ_state_id);
+                const ManipLatticeState succ_entry = getHashEntry(succ_state_id);
                 assert(succ_entry);
                 if (succ_state_id != curr_id) {
                     continue;
@@ -193,22 +214,18 @@ bool ManipLatticeEgraph::extractPath(
         }
 
         if (best_state) {
-            ROS_DEBUG_NAMED(params()->graph_log, "Extract successor state %s", to_string(best_state->state).c_str());
-            opath.push_back(best_state->state);
+            ROS_DEBUG_NAMED(params()->graph_log, "Extract successor state %s", to_string(best_state.getState()).c_str());
+            opath.push_back(best_state.getState());
             continue;
         }
 
         bool found = false;
         // check for shortcut transition
-        auto pnit = std::find(m_egraph_state_ids.begin(), m_egraph_state_ids.end(), prev_id);
-        auto cnit = std::find(m_egraph_state_ids.begin(), m_egraph_state_ids.end(), curr_id);
-        if (pnit != m_egraph_state_ids.end() &&
-            cnit != m_egraph_state_ids.end())
-        {
-            ExperienceGraph::node_id pn =
-                    std::distance(m_egraph_state_ids.begin(), pnit);
-            ExperienceGraph::node_id cn =
-                    std::distance(m_egraph_state_ids.begin(), cnit);
+        auto pnit = m_state_to_node.find(prev_id);
+        auto cnit = m_state_to_node.find(curr_id);
+        if (pnit != m_state_to_node.end() && cnit != m_state_to_node.end()) {
+            ExperienceGraph::node_id pn = pnit->second;
+            ExperienceGraph::node_id cn = cnit->second;
 
             ROS_INFO("Check for shortcut from %d to %d (egraph %zu -> %zu)!", prev_id, curr_id, pn, cn);
 
@@ -217,9 +234,9 @@ bool ManipLatticeEgraph::extractPath(
             if (found) {
                 for (ExperienceGraph::node_id n : node_path) {
                     int state_id = m_egraph_state_ids[n];
-                    ManipLatticeState* entry = getHashEntry(state_id);
+                    const ManipLatticeState entry = getHashEntry(state_id);
                     assert(entry);
-                    opath.push_back(entry->state);
+                    opath.push_back(entry.getState());
                 }
             }
         }
@@ -232,9 +249,9 @@ bool ManipLatticeEgraph::extractPath(
         int cost;
         if (snap(prev_id, curr_id, cost)) {
             ROS_ERROR("Snap from %d to %d with cost %d", prev_id, curr_id, cost);
-            ManipLatticeState* entry = getHashEntry(curr_id);
+            const ManipLatticeState entry = getHashEntry(curr_id);
             assert(entry);
-            opath.push_back(entry->state);
+            opath.push_back(entry.getState());
             continue;
         }
 
@@ -248,11 +265,18 @@ bool ManipLatticeEgraph::extractPath(
     return true;
 }
 
+/// Load an experience graph from either a directory of CSV files, each
+/// containing one path, or a binary experience graph file written by
+/// WriteExperienceGraphFile().
 bool ManipLatticeEgraph::loadExperienceGraph(const std::string& path)
 {
     ROS_INFO("Load Experience Graph at %s", path.c_str());
 
     boost::filesystem::path p(path);
+    if (boost::filesystem::is_regular_file(p)) {
+        return loadBinaryExperienceGraph(path);
+    }
+
     if (!boost::filesystem::is_directory(p)) {
         ROS_ERROR("'%s' is not a directory", path.c_str());
         return false;
@@ -272,53 +296,7 @@ bool ManipLatticeEgraph::loadExperienceGraph(const std::string& path)
         }
 
         ROS_INFO("Create hash entries for experience graph states");
-
-        const RobotState& pp = egraph_states.front();  // previous robot state
-        RobotCoord pdp(robot()->jointVariableCount()); // previous robot coord
-        stateToCoord(egraph_states.front(), pdp);
-
-        ExperienceGraph::node_id pid = m_egraph.insert_node(pp);
-        m_coord_to_nodes[pdp].push_back(pid);
-
-        int entry_id = reserveHashEntry();
-        ManipLatticeState* entry = getHashEntry(entry_id);
-        entry->coord = pdp;
-        entry->state = pp;
-
-        // map state id <-> experience graph state
-        m_egraph_state_ids.resize(pid + 1, -1);
-        m_egraph_state_ids[pid] = entry_id;
-        m_state_to_node[entry_id] = pid;
-
-        std::vector<RobotState> edge_data;
-        for (size_t i = 1; i < egraph_states.size(); ++i) {
-            const RobotState& p = egraph_states[i];
-            RobotCoord dp(robot()->jointVariableCount());
-            stateToCoord(p, dp);
-            if (dp != pdp) {
-                // found a new discrete state along the path
-
-                ExperienceGraph::node_id id = m_egraph.insert_node(p);
-                m_coord_to_nodes[dp].push_back(id);
-
-                int entry_id = reserveHashEntry();
-                ManipLatticeState* entry = getHashEntry(entry_id);
-                entry->coord = dp;
-                entry->state = p;
-
-                m_egraph_state_ids.resize(id + 1, -1);
-                m_egraph_state_ids[id] = entry_id;
-                m_state_to_node[entry_id] = id;
-                m_egraph.insert_edge(pid, id, edge_data);
-
-                pdp = dp;
-                pid = id;
-                edge_data.clear();
-            } else {
-                // gather intermediate robot states
-                edge_data.push_back(p);
-            }
-        }
+        insertExperienceGraphPath(egraph_states);
     }
 
     ROS_INFO("Experience graph contains %zu nodes and %zu edges", m_egraph.num_nodes(), m_egraph.num_edges());
@@ -340,16 +318,16 @@ bool ManipLatticeEgraph::shortcut(
     int second_id,
     int& cost)
 {
-    ManipLatticeState* first_entry = getHashEntry(first_id);
-    ManipLatticeState* second_entry = getHashEntry(second_id);
+    const ManipLatticeState first_entry = getHashEntry(first_id);
+    const ManipLatticeState second_entry = getHashEntry(second_id);
     if (!first_entry | !second_entry) {
         ROS_WARN("No state entries for state %d or state %d", first_id, second_id);
         return false;
     }
 
-    ROS_INFO("Shortcut %s -> %s", to_string(first_entry->state).c_str(), to_string(second_entry->state).c_str());
-    SV_SHOW_INFO(getStateVisualization(first_entry->state, "shortcut_from"));
-    SV_SHOW_INFO(getStateVisualization(second_entry->state, "shortcut_to"));
+    ROS_INFO("Shortcut %s -> %s", to_string(first_entry.getState()).c_str(), to_string(second_entry.getState()).c_str());
+    SV_SHOW_INFO(getStateVisualization(first_entry.getState(), "shortcut_from"));
+    SV_SHOW_INFO(getStateVisualization(second_entry.getState(), "shortcut_to"));
 
     ROS_INFO("  Shortcut %d -> %d!", first_id, second_id);
     cost = 1000;
@@ -361,21 +339,24 @@ bool ManipLatticeEgraph::snap(
     int second_id,
     int& cost)
 {
-    ManipLatticeState* first_entry = getHashEntry(first_id);
-    ManipLatticeState* second_entry = getHashEntry(second_id);
+    const ManipLatticeState first_entry = getHashEntry(first_id);
+    const ManipLatticeState second_entry = getHashEntry(second_id);
     if (!first_entry | !second_entry) {
         ROS_WARN("No state entries for state %d or state %d", first_id, second_id);
         return false;
     }
 
-    ROS_INFO("Snap %s -> %s", to_string(first_entry->state).c_str(), to_string(second_entry->state).c_str());
-    SV_SHOW_INFO(getStateVisualization(first_entry->state, "snap_from"));
-    SV_SHOW_INFO(getStateVisualization(second_entry->state, "snap_to"));
+    const RobotState first_state = first_entry.getState();
+    const RobotState second_state = second_entry.getState();
+
+    ROS_INFO("Snap %s -> %s", to_string(first_state).c_str(), to_string(second_state).c_str());
+    SV_SHOW_INFO(getStateVisualization(first_state, "snap_from"));
+    SV_SHOW_INFO(getStateVisualization(second_state, "snap_to"));
 
     int plen, check_count;
     double dist;
     if (!collisionChecker()->isStateToStateValid(
-        first_entry->state, second_entry->state, plen, check_count, dist))
+        first_state, second_state, plen, check_count, dist))
     {
         ROS_WARN("Failed snap!");
         return false;
@@ -443,7 +424,7 @@ bool ManipLatticeEgraph::findShortestExperienceGraphPath(
 
     typedef intrusive_heap<ExperienceGraphSearchNode, NodeCompare> heap_type;
 
-    std::vector<ExperienceGraphSearchNode> search_nodes(m_egraph.num_nodes());
+    std::vector<ExperienceGraphSearchNode> search_nodes(m_egraph.node_id_bound());
 
     heap_type open;
 
@@ -545,6 +526,155 @@ bool ManipLatticeEgraph::parseExperienceGraphFile(
     return true;
 }
 
+// Load an experience graph from a binary file. If the file was discretized
+// identically to this lattice, its nodes, coordinates, and edges are inserted
+// as they are; otherwise, its paths are reassembled and inserted as if they
+// had been read from CSV files.
+bool ManipLatticeEgraph::loadBinaryExperienceGraph(const std::string& filepath)
+{
+    ExperienceGraphFile file;
+    if (!file.open(filepath)) {
+        ROS_ERROR("Failed to open experience graph file '%s'", filepath.c_str());
+        return false;
+    }
+
+    if (file.variableNames() != robot()->getPlanningJoints()) {
+        ROS_ERROR("Variables of experience graph file '%s' do not match the planning joints", filepath.c_str());
+        return false;
+    }
+
+    const size_t jvar_count = file.variableCount();
+
+    if (!hasDiscretization(file.discretization())) {
+        ROS_WARN("Experience graph file '%s' was discretized differently than the lattice. Rediscretize its paths", filepath.c_str());
+        std::vector<RobotState> egraph_states;
+        for (size_t p = 0; p < file.pathCount(); ++p) {
+            egraph_states.clear();
+            const size_t first_node = file.pathFirstNode(p);
+            const size_t node_count = file.pathNodeCount(p);
+            for (size_t i = 0; i < node_count; ++i) {
+                const double* state = file.nodeState(first_node + i);
+                egraph_states.emplace_back(state, state + jvar_count);
+                if (i + 1 == node_count) {
+                    break;
+                }
+                const size_t e = file.pathFirstEdge(p) + i;
+                const double* wp = file.edgeWaypoints(e);
+                for (size_t w = 0; w < file.edgeWaypointCount(e); ++w) {
+                    egraph_states.emplace_back(wp, wp + jvar_count);
+                    wp += jvar_count;
+                }
+            }
+            insertExperienceGraphPath(egraph_states);
+        }
+        ROS_INFO("Experience graph contains %zu nodes and %zu edges", m_egraph.num_nodes(), m_egraph.num_edges());
+        return true;
+    }
+
+    const ExperienceGraph::node_id first_node = m_egraph.node_id_bound();
+    m_egraph.reserve(
+            m_egraph.node_id_bound() + file.nodeCount(),
+            m_egraph.edge_id_bound() + file.edgeCount());
+
+    RobotState state(jvar_count);
+    RobotCoord coord(jvar_count);
+    for (size_t n = 0; n < file.nodeCount(); ++n) {
+        state.assign(file.nodeState(n), file.nodeState(n) + jvar_count);
+        coord.assign(file.nodeCoord(n), file.nodeCoord(n) + jvar_count);
+        insertExperienceGraphNode(state, coord);
+    }
+
+    // the mapping is closed when the file goes out of scope, and the graph
+    // may later erase and compact its edges, so the waypoints of each edge are
+    // copied, as one block, into the graph's own waypoint pool
+    for (size_t e = 0; e < file.edgeCount(); ++e) {
+        m_egraph.insert_edge(
+                first_node + file.edgeSource(e),
+                first_node + file.edgeTarget(e),
+                file.edgeWaypoints(e),
+                file.edgeWaypointCount(e),
+                jvar_count);
+    }
+
+    ROS_INFO("Experience graph contains %zu nodes and %zu edges", m_egraph.num_nodes(), m_egraph.num_edges());
+    return true;
+}
+
+// Return whether the coordinates of an experience graph file, computed with a
+// given discretization, are valid coordinates in this lattice.
+bool ManipLatticeEgraph::hasDiscretization(
+    const ExperienceGraphDiscretization& disc) const
+{
+    for (size_t i = 0; i < disc.deltas.size(); ++i) {
+        if (disc.deltas[i] != resolutions()[i] ||
+            disc.continuous[i] != robot()->isContinuous(i) ||
+            disc.bounded[i] != robot()->hasPosLimit(i))
+        {
+            return false;
+        }
+        if (disc.bounded[i] && !disc.continuous[i] &&
+            disc.min_limits[i] != robot()->minPosLimit(i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Insert a path into the experience graph. Consecutive states in the same
+// discrete state are merged into a single node; the states between two nodes
+// are stored as the waypoints of the edge connecting them.
+void ManipLatticeEgraph::insertExperienceGraphPath(
+    const std::vector<RobotState>& egraph_states)
+{
+    if (egraph_states.empty()) {
+        return;
+    }
+
+    RobotCoord pdp(robot()->jointVariableCount()); // previous robot coord
+    stateToCoord(egraph_states.front(), pdp);
+
+    ExperienceGraph::node_id pid =
+            insertExperienceGraphNode(egraph_states.front(), pdp);
+
+    std::vector<RobotState> edge_data;
+    RobotCoord dp(robot()->jointVariableCount());
+    for (size_t i = 1; i < egraph_states.size(); ++i) {
+        const RobotState& p = egraph_states[i];
+        stateToCoord(p, dp);
+        if (dp != pdp) {
+            // found a new discrete state along the path
+            ExperienceGraph::node_id id = insertExperienceGraphNode(p, dp);
+            m_egraph.insert_edge(pid, id, edge_data);
+
+            pdp = dp;
+            pid = id;
+            edge_data.clear();
+        } else {
+            // gather intermediate robot states
+            edge_data.push_back(p);
+        }
+    }
+}
+
+// Insert a node into the experience graph and create its lattice state
+ExperienceGraph::node_id ManipLatticeEgraph::insertExperienceGraphNode(
+    const RobotState& state,
+    const RobotCoord& coord)
+{
+    ExperienceGraph::node_id id = m_egraph.insert_node(state);
+    m_coord_to_nodes[coord].push_back(id);
+
+    int entry_id = reserveHashEntry();
+    setHashEntry(entry_id, coord, state);
+
+    // map state id <-> experience graph state
+    m_egraph_state_ids.resize(id + 1, -1);
+    m_egraph_state_ids[id] = entry_id;
+    m_state_to_node[entry_id] = id;
+    return id;
+}
+
 /// An attempt to construct the discrete experience graph by discretizing all
 /// input continuous states and connecting them via edges available in the
 /// canonical action set. This turns out to not work very well since the points
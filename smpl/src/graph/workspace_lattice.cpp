@@ -654,6 +654,8 @@ bool WorkspaceLattice::setGoalPose(const GoalConstraint& goal)
     m_near_goal = false;
     m_t_start = clock::now();
 
+    startIKCacheQuery();
+
     return RobotPlanningSpace::setGoal(goal);
 }
 
@@ -829,21 +831,17 @@ bool WorkspaceLattice::checkAction(
     std::uint32_t violation_mask = 0x00000000;
 
     // check waypoints for ik solutions and joint limits
-    for (size_t widx = 0; widx < action.size(); ++widx) {
+    if (!statesWorkspaceToRobot(action, state, wptraj)) {
+        ROS_DEBUG_NAMED(params()->expands_log, "        -> failed to find ik solution for waypoint %zu", wptraj.size());
+        violation_mask |= 0x00000001;
+    }
+
+    for (size_t widx = 0; widx < wptraj.size(); ++widx) {
         const WorkspaceState& istate = action[widx];
 
         ROS_DEBUG_NAMED(params()->expands_log, "        %zu: %s", widx, to_string(istate).c_str());
 
-        RobotState irstate;
-        if (!stateWorkspaceToRobot(istate, state, irstate)) {
-            ROS_DEBUG_NAMED(params()->expands_log, "         -> failed to find ik solution");
-            violation_mask |= 0x00000001;
-            break;
-        }
-
-        wptraj.push_back(irstate);
-
-        if (!robot()->checkJointLimits(irstate)) {
+        if (!robot()->checkJointLimits(wptraj[widx])) {
             ROS_DEBUG_NAMED(params()->expands_log, "        -> violates joint limits");
             violation_mask |= 0x00000002;
             break;
@@ -900,21 +898,17 @@ bool WorkspaceLattice::checkLazyAction(
     std::uint32_t violation_mask = 0x00000000;
 
     // check waypoints for ik solutions and joint limits
-    for (size_t widx = 0; widx < action.size(); ++widx) {
+    if (!statesWorkspaceToRobot(action, state, wptraj)) {
+        ROS_DEBUG_NAMED(params()->expands_log, "        -> failed to find ik solution for waypoint %zu", wptraj.size());
+        violation_mask |= 0x00000001;
+    }
+
+    for (size_t widx = 0; widx < wptraj.size(); ++widx) {
         const WorkspaceState& istate = action[widx];
 
         ROS_DEBUG_NAMED(params()->expands_log, "        %zu: %s", widx, to_string(istate).c_str());
 
-        RobotState irstate;
-        if (!stateWorkspaceToRobot(istate, state, irstate)) {
-            ROS_DEBUG_NAMED(params()->expands_log, "         -> failed to find ik solution");
-            violation_mask |= 0x00000001;
-            break;
-        }
-
-        wptraj.push_back(irstate);
-
-        if (!robot()->checkJointLimits(irstate)) {
+        if (!robot()->checkJointLimits(wptraj[widx])) {
             ROS_DEBUG_NAMED(params()->expands_log, "        -> violates joint limits");
             violation_mask |= 0x00000002;
             break;
@@ -31,6 +31,10 @@
 
 #include <smpl/graph/workspace_lattice_base.h>
 
+// standard includes
+#include <algorithm>
+#include <cmath>
+
 // system includes
 #include <Eigen/Dense>
 #include <leatherman/print.h>
@@ -53,7 +57,11 @@ WorkspaceLatticeBase::WorkspaceLatticeBase(
     m_res(),
     m_val_count(),
     m_dof_count(0),
-    m_fangle_indices()
+    m_fangle_indices(),
+    m_ik_cache(),
+    m_ik_cache_fangle_res(),
+    m_ik_cache_seed_res(0.0),
+    m_ik_cache_persistent(false)
 {
 }
 
@@ -119,6 +127,17 @@ bool WorkspaceLatticeBase::init(const Params& _params)
         ROS_INFO("  J%d: { res: %0.3f, count: %d }", i, m_res[6 + i], m_val_count[6 + i]);
     }
 
+    int ik_cache_size;
+    params()->param("ik_cache_size", ik_cache_size, 0);
+    params()->param("ik_cache_seed_res", m_ik_cache_seed_res, 0.05);
+    params()->param("ik_cache_persistent", m_ik_cache_persistent, false);
+    ROS_INFO("ik cache: { size: %d, seed res: %0.3f, persistent: %s }", ik_cache_size, m_ik_cache_seed_res, m_ik_cache_persistent ? "true" : "false");
+
+    m_ik_cache.clear();
+    m_ik_cache.resetStats();
+    m_ik_cache.setCapacity((size_t)std::max(ik_cache_size, 0));
+    m_ik_cache_fangle_res = _params.free_angle_res;
+
     return true;
 }
 
@@ -162,7 +181,7 @@ bool WorkspaceLatticeBase::stateWorkspaceToRobot(
         seed[m_fangle_indices[fai]] = state[6 + fai];
     }
 
-    return m_rm_iface->computeFastIK(pose, seed, ostate);
+    return computeCachedIK(pose, seed, false, ostate);
 }
 
 void WorkspaceLatticeBase::stateWorkspaceToCoord(
@@ -200,7 +219,149 @@ bool WorkspaceLatticeBase::stateWorkspaceToRobot(
     SixPose pose(state.begin(), state.begin() + 6);
 
     // TODO: unrestricted variant?
-    return m_rm_iface->computeFastIK(pose, seed, ostate);
+    return computeCachedIK(pose, seed, true, ostate);
+}
+
+// Compute an ik solution, restricting redundant joint variables to the seed
+// state, or return the result of an earlier solve for the same discretized
+// pose, redundant joint variables, and seed.
+bool WorkspaceLatticeBase::computeCachedIK(
+    const SixPose& pose,
+    const RobotState& seed,
+    bool seeded,
+    RobotState& solution) const
+{
+    if (m_ik_cache.capacity() == 0) {
+        return m_rm_iface->computeFastIK(pose, seed, solution);
+    }
+
+    IKSolutionCache::Key key;
+    makeIKCacheKey(pose, seed, seeded, key);
+
+    bool found;
+    if (m_ik_cache.lookup(key, found, solution)) {
+        return found;
+    }
+
+    found = m_rm_iface->computeFastIK(pose, seed, solution);
+    m_ik_cache.insert(key, found, solution);
+    return found;
+}
+
+// Convert the waypoints of an action, as by successive calls to
+// stateWorkspaceToRobot(), with the first waypoint seeded with the given state
+// and each subsequent waypoint seeded with the solution to the waypoint
+// preceding it, stopping at the first waypoint with no ik solution. Waypoints
+// following the first miss in the ik cache are computed in a single batch.
+bool WorkspaceLatticeBase::statesWorkspaceToRobot(
+    const std::vector<WorkspaceState>& states,
+    const RobotState& seed,
+    std::vector<RobotState>& ostates) const
+{
+    std::vector<SixPose> poses(states.size());
+    for (size_t i = 0; i < states.size(); ++i) {
+        poses[i].assign(states[i].begin(), states[i].begin() + 6);
+    }
+
+    if (m_ik_cache.capacity() == 0) {
+        return m_rm_iface->computeBatchFastIK(poses, seed, ostates);
+    }
+
+    // look up the leading waypoints whose solutions are cached
+    ostates.resize(states.size());
+    IKSolutionCache::Key key;
+    size_t first_miss = 0;
+    for (; first_miss < states.size(); ++first_miss) {
+        const RobotState& prev = first_miss == 0 ? seed : ostates[first_miss - 1];
+        makeIKCacheKey(poses[first_miss], prev, true, key);
+        bool found;
+        if (!m_ik_cache.lookup(key, found, ostates[first_miss])) {
+            break;
+        }
+        if (!found) {
+            ostates.resize(first_miss);
+            return false;
+        }
+    }
+
+    if (first_miss == states.size()) {
+        return true;
+    }
+
+    // solve the remaining waypoints, seeded from the last cached solution
+    const RobotState& batch_seed = first_miss == 0 ? seed : ostates[first_miss - 1];
+    std::vector<SixPose> miss_poses(poses.begin() + first_miss, poses.end());
+    std::vector<RobotState> solutions;
+    m_rm_iface->computeBatchFastIK(miss_poses, batch_seed, solutions);
+
+    for (size_t mi = 0; mi < solutions.size(); ++mi) {
+        const size_t i = first_miss + mi;
+        const RobotState& prev = i == 0 ? seed : ostates[i - 1];
+        makeIKCacheKey(poses[i], prev, true, key);
+        m_ik_cache.insert(key, true, solutions[mi]);
+        ostates[i] = solutions[mi];
+    }
+
+    const size_t count = first_miss + solutions.size();
+    if (count < states.size()) {
+        const RobotState& prev = count == 0 ? seed : ostates[count - 1];
+        makeIKCacheKey(poses[count], prev, true, key);
+        m_ik_cache.insert(key, false, RobotState());
+    }
+
+    ostates.resize(count);
+    return count == states.size();
+}
+
+// Construct the ik cache key for a solve. Since the remaining seed variables
+// may select among several solutions, seeded solves are also keyed on the
+// solution branch of the seed, or, if the robot model does not identify its
+// branches, on those variables, discretized at ik_cache_seed_res. Seeded
+// solves are cached separately from unseeded solves, whose seeds are
+// determined by the redundant variables.
+void WorkspaceLatticeBase::makeIKCacheKey(
+    const SixPose& pose,
+    const RobotState& seed,
+    bool seeded,
+    IKSolutionCache::Key& key) const
+{
+    key.resize(6 + freeAngleCount() + 1);
+    poseWorkspaceToCoord(&pose[0], &key[0]);
+    for (size_t fai = 0; fai < freeAngleCount(); ++fai) {
+        const double res = m_ik_cache_fangle_res[fai];
+        const double fa = angles::normalize_angle_positive(seed[m_fangle_indices[fai]]);
+        key[6 + fai] = (int)std::round(fa / res) % (int)std::round(2.0 * M_PI / res);
+    }
+    key.back() = seeded ? 1 : 0;
+    if (seeded) {
+        const int branch = m_rm_iface->ikSolutionBranch(seed);
+        if (branch >= 0) {
+            key.push_back(branch);
+            return;
+        }
+        for (size_t vidx = 0; vidx < seed.size(); ++vidx) {
+            if (std::find(m_fangle_indices.begin(), m_fangle_indices.end(), vidx) ==
+                m_fangle_indices.end())
+            {
+                key.push_back((int)std::round(seed[vidx] / m_ik_cache_seed_res));
+            }
+        }
+    }
+}
+
+// Prepare the ik cache for a new planning query, reporting the statistics of
+// the last query. Cached results are discarded unless the cache is persistent.
+void WorkspaceLatticeBase::startIKCacheQuery()
+{
+    const IKSolutionCache::Stats stats = m_ik_cache.stats();
+    const size_t lookups = stats.hits + stats.misses;
+    if (lookups > 0) {
+        ROS_INFO_NAMED(params()->graph_log, "ik cache: %zu hits, %zu misses (%0.1f%% hit rate), %zu evictions", stats.hits, stats.misses, 100.0 * (double)stats.hits / (double)lookups, stats.evictions);
+    }
+    m_ik_cache.resetStats();
+    if (!m_ik_cache_persistent) {
+        m_ik_cache.clear();
+    }
 }
 
 void WorkspaceLatticeBase::posWorkspaceToCoord(const double* wp, int* gp) const
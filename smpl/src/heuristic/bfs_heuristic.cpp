@@ -31,6 +31,10 @@
 
 #include <smpl/heuristic/bfs_heuristic.h>
 
+// standard includes
+#include <algorithm>
+#include <cmath>
+
 // system includes
 #include <leatherman/viz.h>
 
@@ -50,7 +54,8 @@ BfsHeuristic::BfsHeuristic(
     m_bfs(),
     m_goal_x(-1),
     m_goal_y(-1),
-    m_goal_z(-1)
+    m_goal_z(-1),
+    m_grid_version(0)
 {
     m_pp = ps->getExtension<PointProjectionExtension>();
     if (m_pp) {
@@ -77,6 +82,21 @@ void BfsHeuristic::updateGoal(const GoalConstraint& goal)
         ROS_ERROR_NAMED(params()->heuristic_log, "Heuristic goal is out of BFS bounds");
     }
 
+    const bool walls_changed = updateWalls();
+
+    // reuse the previous distances if the goal remains in the same cell,
+    // repairing them if the walls have changed
+    if (gx == m_goal_x && gy == m_goal_y && gz == m_goal_z) {
+        if (!walls_changed) {
+            ROS_DEBUG_NAMED(params()->heuristic_log, "Reuse BFS distances");
+            return;
+        }
+        if (m_bfs->repair()) {
+            ROS_DEBUG_NAMED(params()->heuristic_log, "Repaired BFS distances");
+            return;
+        }
+    }
+
     m_goal_x = gx;
     m_goal_y = gy;
     m_goal_z = gz;
@@ -351,6 +371,9 @@ void BfsHeuristic::syncGridAndBfs()
     const int zc = grid()->numCellsZ();
 //    ROS_DEBUG_NAMED(params()->heuristic_log_, "Initializing BFS of size %d x %d x %d = %d", xc, yc, zc, xc * yc * zc);
     m_bfs.reset(new BFS_3D(xc, yc, zc));
+    int bfs_threads;
+    params()->param("bfs_threads", bfs_threads, 1);
+    m_bfs->setNumThreads(bfs_threads);
     const int cell_count = xc * yc * zc;
     int wall_count = 0;
     for (int z = 0; z < zc; ++z) {
@@ -366,6 +389,54 @@ void BfsHeuristic::syncGridAndBfs()
     }
 
     ROS_DEBUG_NAMED(params()->heuristic_log, "%d/%d (%0.3f%%) walls in the bfs heuristic", wall_count, cell_count, 100.0 * (double)wall_count / cell_count);
+
+    m_grid_version = grid()->version();
+}
+
+/// Update the bfs walls to reflect changes to the occupancy grid since the
+/// walls were last updated. Only cells within the planning link sphere radius
+/// of a modified cell are re-examined.
+///
+/// \return true if any walls were set or cleared
+bool BfsHeuristic::updateWalls()
+{
+    int min_x, min_y, min_z, max_x, max_y, max_z;
+    if (!grid()->getChangedCells(
+            m_grid_version, min_x, min_y, min_z, max_x, max_y, max_z))
+    {
+        return false;
+    }
+    m_grid_version = grid()->version();
+
+    const double radius = params()->planning_link_sphere_radius;
+    const int pad = (int)std::ceil(radius / grid()->resolution()) + 1;
+    min_x = std::max(min_x - pad, 0);
+    min_y = std::max(min_y - pad, 0);
+    min_z = std::max(min_z - pad, 0);
+    max_x = std::min(max_x + pad, grid()->numCellsX() - 1);
+    max_y = std::min(max_y + pad, grid()->numCellsY() - 1);
+    max_z = std::min(max_z + pad, grid()->numCellsZ() - 1);
+
+    int set_count = 0;
+    int cleared_count = 0;
+    for (int z = min_z; z <= max_z; ++z) {
+        for (int y = min_y; y <= max_y; ++y) {
+            for (int x = min_x; x <= max_x; ++x) {
+                const bool wall = grid()->getDistance(x, y, z) <= radius;
+                if (wall && !m_bfs->isWall(x, y, z)) {
+                    m_bfs->setWall(x, y, z);
+                    ++set_count;
+                }
+                else if (!wall && m_bfs->isWall(x, y, z)) {
+                    m_bfs->unsetWall(x, y, z);
+                    ++cleared_count;
+                }
+            }
+        }
+    }
+
+    ROS_DEBUG_NAMED(params()->heuristic_log, "Set %d and cleared %d walls in the bfs heuristic", set_count, cleared_count);
+    return set_count > 0 || cleared_count > 0;
 }
 
 int BfsHeuristic::getBfsCostToGoal(const BFS_3D& bfs, int x, int y, int z) const
@@ -31,7 +31,12 @@
 
 #include <smpl/heuristic/egraph_bfs_heuristic.h>
 
-#include <boost/functional/hash.hpp>
+// standard includes
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// system includes
 #include <leatherman/print.h>
 #include <leatherman/viz.h>
 #include <smpl/debug/visualize.h>
@@ -39,15 +44,9 @@
 namespace sbpl {
 namespace motion {
 
-auto DijkstraEgraphHeuristic3D::Vector3iHash::operator()(const argument_type& s) const
-    -> result_type
-{
-    std::size_t seed = 0;
-    boost::hash_combine(seed, std::hash<int>()(s.x()));
-    boost::hash_combine(seed, std::hash<int>()(s.y()));
-    boost::hash_combine(seed, std::hash<int>()(s.z()));
-    return seed;
-}
+// number of cells expanded by the eager search between notifications of
+// threads waiting for a distance
+static const int EAGER_EXPANSION_BATCH = 1024;
 
 DijkstraEgraphHeuristic3D::DijkstraEgraphHeuristic3D(
     const RobotPlanningSpacePtr& ps,
@@ -56,11 +55,23 @@ DijkstraEgraphHeuristic3D::DijkstraEgraphHeuristic3D(
     Extension(),
     RobotHeuristic(ps, _grid),
     ExperienceGraphHeuristicExtension(),
-    m_pp(nullptr)
+    m_pp(nullptr),
+    m_eg(nullptr),
+    m_eager(false),
+    m_search_done(true),
+    m_search_cancel(false),
+    m_search_key(0),
+    m_last_expand_count(0),
+    m_repeat_count(1)
 {
     params()->param("egraph_epsilon", m_eg_eps, 1.0);
     ROS_INFO_NAMED(params()->heuristic_log, "egraph_epsilon: %0.3f", m_eg_eps);
 
+    // run the search to completion on a background thread after the goal is
+    // updated, rather than on demand as distances are requested
+    params()->param("egraph_heuristic_eager", m_eager, false);
+    ROS_INFO_NAMED(params()->heuristic_log, "egraph_heuristic_eager: %s", m_eager ? "true" : "false");
+
     m_pp = ps->getExtension<PointProjectionExtension>();
     m_eg = ps->getExtension<ExperienceGraphExtension>();
 
@@ -79,6 +90,22 @@ DijkstraEgraphHeuristic3D::DijkstraEgraphHeuristic3D(
 
     ROS_INFO("Create dijkstra distance grid of size %zu x %zu x %zu", num_cells_x, num_cells_y, num_cells_z);
 
+    const int center = m_dist_grid.coord_to_index(1, 1, 1);
+    int n = 0;
+    for (int dx = -1; dx <= 1; ++dx) {
+    for (int dy = -1; dy <= 1; ++dy) {
+    for (int dz = -1; dz <= 1; ++dz) {
+        if (dx == 0 && dy == 0 && dz == 0) {
+            continue;
+        }
+        m_neighbor_offsets[n] =
+                (int)m_dist_grid.coord_to_index(1 + dx, 1 + dy, 1 + dz) - center;
+        m_neighbor_costs[n] = (int)(m_eg_eps * 1000.0 * std::sqrt((double)(dx * dx + dy * dy + dz * dz)));
+        ++n;
+    }
+    }
+    }
+
     syncGridAndDijkstra();
 
     auto add_wall = [&](int x, int y, int z) {
@@ -106,6 +133,11 @@ DijkstraEgraphHeuristic3D::DijkstraEgraphHeuristic3D(
     }
 }
 
+DijkstraEgraphHeuristic3D::~DijkstraEgraphHeuristic3D()
+{
+    stopSearch();
+}
+
 void DijkstraEgraphHeuristic3D::getEquivalentStates(
     int state_id,
     std::vector<int>& ids)
@@ -119,13 +151,13 @@ void DijkstraEgraphHeuristic3D::getEquivalentStates(
     }
     dp += Eigen::Vector3i::Ones();
 
-    auto hit = m_heur_nodes.find(dp);
-    if (hit == m_heur_nodes.end()) {
+    const int n = m_dist_grid(dp.x(), dp.y(), dp.z()).egraph_node;
+    if (n < 0) {
         return;
     }
 
-    for (ExperienceGraph::node_id n : hit->second.up_nodes) {
-        int id = m_eg->getStateID(n);
+    for (int i = m_up_node_offsets[n]; i != m_up_node_offsets[n + 1]; ++i) {
+        int id = m_eg->getStateID(m_up_nodes[i]);
         if (id != state_id) {
             ids.push_back(id);
         }
@@ -325,6 +357,8 @@ void DijkstraEgraphHeuristic3D::updateGoal(const GoalConstraint& goal)
 {
     ROS_INFO_NAMED(params()->heuristic_log, "Update EGraphBfsHeuristic goal");
 
+    stopSearch();
+
     // reset all distances
     for (size_t x = 1; x < m_dist_grid.xsize() - 1; ++x) {
     for (size_t y = 1; y < m_dist_grid.ysize() - 1; ++y) {
@@ -334,6 +368,7 @@ void DijkstraEgraphHeuristic3D::updateGoal(const GoalConstraint& goal)
             c.dist = Unknown;
         }
     } } }
+    m_open.clear();
 
     projectExperienceGraph();
 
@@ -344,7 +379,7 @@ void DijkstraEgraphHeuristic3D::updateGoal(const GoalConstraint& goal)
     grid()->worldToGrid(gp.x(), gp.y(), gp.z(), dgp.x(), dgp.y(), dgp.z());
 
     // precompute shortcuts
-    assert(m_component_ids.size() == m_eg->getExperienceGraph()->num_nodes());
+    assert(m_component_ids.size() == m_eg->getExperienceGraph()->node_id_bound());
     ExperienceGraph* eg = m_eg->getExperienceGraph();
     auto nodes = eg->nodes();
     for (auto nit = nodes.first; nit != nodes.second; ++nit) {
@@ -355,15 +390,10 @@ void DijkstraEgraphHeuristic3D::updateGoal(const GoalConstraint& goal)
         }
 
         // get the distance of this node to the goal
-        Eigen::Vector3d p;
-        m_pp->projectToPoint(m_eg->getStateID(*nit), p);
-
-        const double dist = (gp - p).squaredNorm();
+        const double dist = (gp - m_projected_points[*nit]).squaredNorm();
 
-        Eigen::Vector3d lp;
-        m_pp->projectToPoint(m_eg->getStateID(m_shortcut_nodes[comp_id].front()), lp);
-
-        const double curr_dist = (gp - lp).squaredNorm();
+        const ExperienceGraph::node_id ln = m_shortcut_nodes[comp_id].front();
+        const double curr_dist = (gp - m_projected_points[ln]).squaredNorm();
 
         if (dist < curr_dist) {
             m_shortcut_nodes[comp_id].clear();
@@ -380,10 +410,16 @@ void DijkstraEgraphHeuristic3D::updateGoal(const GoalConstraint& goal)
 
     dgp += Eigen::Vector3i::Ones();
 
-    m_open.clear();
     Cell* c = &m_dist_grid(dgp.x(), dgp.y(), dgp.z());
     c->dist = 0;
     m_open.push(c);
+    m_search_key = 0;
+
+    if (m_eager) {
+        m_search_done = false;
+        m_search_cancel = false;
+        m_search_thread = std::thread(&DijkstraEgraphHeuristic3D::searchEagerly, this);
+    }
 
     ROS_INFO_NAMED(params()->heuristic_log, "Updated EGraphBfsHeuristic goal");
 }
@@ -420,7 +456,14 @@ int DijkstraEgraphHeuristic3D::GetFromToHeuristic(int from_id, int to_id)
 // frame is determined according to the planning link and a fixed offset)
 void DijkstraEgraphHeuristic3D::projectExperienceGraph()
 {
-    m_heur_nodes.clear();
+    for (int cidx : m_egraph_cells) {
+        m_dist_grid[cidx].egraph_node = -1;
+    }
+    m_egraph_cells.clear();
+    m_egraph_edge_offsets.clear();
+    m_egraph_edges.clear();
+    m_up_node_offsets.clear();
+    m_up_nodes.clear();
 
     std::vector<geometry_msgs::Point> viz_points;
 
@@ -433,10 +476,11 @@ void DijkstraEgraphHeuristic3D::projectExperienceGraph()
     // origin experience graph code)
     //
     // (2) embed an adjacency list in the dense grid structure as a
-    // precomputation
+    // precomputation (method used here; each cell stores the index of its
+    // down-projected node into flat arrays of edges and states)
     //
     // (3) maintain an external adjacency list mapping cells with projections
-    // from experience graph states to adjacent cells (method used here)
+    // from experience graph states to adjacent cells
     ROS_INFO("Project experience graph into three-dimensional grid");
     ExperienceGraph* eg = m_eg->getExperienceGraph();
     if (!eg) {
@@ -444,17 +488,17 @@ void DijkstraEgraphHeuristic3D::projectExperienceGraph()
         return;
     }
 
-    m_projected_nodes.resize(eg->num_nodes());
+    m_projected_points.resize(eg->node_id_bound());
+    m_projected_nodes.resize(eg->node_id_bound());
 
-    size_t proj_node_count = 0;
-    size_t proj_edge_count = 0;
+    // project each experience graph state to a point and discretize it, once;
+    // the projections are reused for the edges and the shortcut nodes
     auto nodes = eg->nodes();
     for (auto nit = nodes.first; nit != nodes.second; ++nit) {
-        // project experience graph state to point and discretize
-        int first_id = m_eg->getStateID(*nit);
-        ROS_DEBUG_NAMED(params()->heuristic_log, "Project experience graph state %d %s into 3D", first_id, to_string(eg->state(*nit)).c_str());
-        Eigen::Vector3d p;
-        m_pp->projectToPoint(first_id, p);
+        int state_id = m_eg->getStateID(*nit);
+        ROS_DEBUG_NAMED(params()->heuristic_log, "Project experience graph state %d %s into 3D", state_id, to_string(eg->state(*nit)).c_str());
+        Eigen::Vector3d& p = m_projected_points[*nit];
+        m_pp->projectToPoint(state_id, p);
         ROS_DEBUG_NAMED(params()->heuristic_log, "Discretize point (%0.3f, %0.3f, %0.3f)", p.x(), p.y(), p.z());
         Eigen::Vector3i dp;
         grid()->worldToGrid(p.x(), p.y(), p.z(), dp.x(), dp.y(), dp.z());
@@ -463,56 +507,91 @@ void DijkstraEgraphHeuristic3D::projectExperienceGraph()
         grid()->gridToWorld(dp.x(), dp.y(), dp.z(), viz_pt.x, viz_pt.y, viz_pt.z);
         viz_points.push_back(viz_pt);
 
-        dp += Eigen::Vector3i::Ones();
+        if (grid()->isInBounds(dp.x(), dp.y(), dp.z())) {
+            m_projected_nodes[*nit] = dp + Eigen::Vector3i::Ones();
+        } else {
+            m_projected_nodes[*nit] = Eigen::Vector3i(-1, -1, -1);
+        }
+    }
+
+    // (down-projected node, adjacent cell) and (down-projected node,
+    // experience graph node) pairs, gathered before being compressed
+    std::vector<std::pair<int, int>> edges;
+    std::vector<std::pair<int, ExperienceGraph::node_id>> up_nodes;
 
-        m_projected_nodes[*nit] = dp;
+    for (auto nit = nodes.first; nit != nodes.second; ++nit) {
+        const Eigen::Vector3i& dp = m_projected_nodes[*nit];
+        if (dp.x() < 0) {
+            continue;
+        }
 
         // insert node into down-projected experience graph
-        HeuristicNode empty;
-        auto ent = m_heur_nodes.insert(std::make_pair(dp, std::move(empty)));
-        auto eit = ent.first;
-        if (ent.second) {
+        const int cidx = m_dist_grid.coord_to_index(dp.x(), dp.y(), dp.z());
+        Cell& cell = m_dist_grid[cidx];
+        if (cell.egraph_node < 0) {
             ROS_DEBUG_NAMED(params()->heuristic_log, "Inserted down-projected cell (%d, %d, %d) into experience graph heuristic", dp.x(), dp.y(), dp.z());
-            ++proj_node_count;
+            cell.egraph_node = (int)m_egraph_cells.size();
+            m_egraph_cells.push_back(cidx);
         } else {
             ROS_DEBUG_NAMED(params()->heuristic_log, "Duplicate down-projected cell (%d, %d, %d)", dp.x(), dp.y(), dp.z());
         }
 
-        HeuristicNode& hnode = eit->second;
-
-        hnode.up_nodes.push_back(*nit);
+        up_nodes.emplace_back(cell.egraph_node, *nit);
 
         auto adj = eg->adjacent_nodes(*nit);
         for (auto ait = adj.first; ait != adj.second; ++ait) {
-            // project adjacent experience graph state and discretize
-            int second_id = m_eg->getStateID(*ait);
-            ROS_DEBUG_NAMED(params()->heuristic_log, "  Project experience graph edge to state %d", second_id);
-            Eigen::Vector3d q;
-            m_pp->projectToPoint(second_id, q);
-            Eigen::Vector3i dq;
-            grid()->worldToGrid(q.x(), q.y(), q.z(), dq.x(), dq.y(), dq.z());
-            if (!grid()->isInBounds(dq.x(), dq.y(), dq.z())) {
+            const Eigen::Vector3i& dq = m_projected_nodes[*ait];
+            if (dq.x() < 0) {
                 continue;
             }
-            dq += Eigen::Vector3i::Ones();
-
-            // insert adjacent edge
-            if (std::find(hnode.edges.begin(), hnode.edges.end(), dq) ==
-                hnode.edges.end())
-            {
-                ++proj_edge_count;
-                ROS_DEBUG_NAMED(params()->heuristic_log, "  Insert edge to state %d", second_id);
-                hnode.edges.push_back(dq);
-            } else {
-                ROS_DEBUG_NAMED(params()->heuristic_log, "  Duplicate edge to state %d", second_id);
-            }
+            edges.emplace_back(
+                    cell.egraph_node,
+                    (int)m_dist_grid.coord_to_index(dq.x(), dq.y(), dq.z()));
         }
     }
 
-    ROS_INFO("Projected experience graph contains %zu nodes and %zu edges", proj_node_count, proj_edge_count);
+    const int proj_node_count = (int)m_egraph_cells.size();
+
+    // compress edges, dropping duplicates
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    m_egraph_edge_offsets.assign(proj_node_count + 1, 0);
+    m_egraph_edges.reserve(edges.size());
+    for (const std::pair<int, int>& e : edges) {
+        ++m_egraph_edge_offsets[e.first + 1];
+
+        size_t sx, sy, sz, tx, ty, tz;
+        m_dist_grid.index_to_coord(m_egraph_cells[e.first], sx, sy, sz);
+        m_dist_grid.index_to_coord(e.second, tx, ty, tz);
+        const int dx = (int)tx - (int)sx;
+        const int dy = (int)ty - (int)sy;
+        const int dz = (int)tz - (int)sz;
+
+        EgraphEdge edge;
+        edge.cell = e.second;
+        edge.cost = (int)(1000.0 * std::sqrt((double)(dx * dx + dy * dy + dz * dz)));
+        m_egraph_edges.push_back(edge);
+    }
+
+    // compress up-projections
+    std::sort(up_nodes.begin(), up_nodes.end());
+    m_up_node_offsets.assign(proj_node_count + 1, 0);
+    m_up_nodes.reserve(up_nodes.size());
+    for (const std::pair<int, ExperienceGraph::node_id>& u : up_nodes) {
+        ++m_up_node_offsets[u.first + 1];
+        m_up_nodes.push_back(u.second);
+    }
+
+    for (int i = 0; i < proj_node_count; ++i) {
+        m_egraph_edge_offsets[i + 1] += m_egraph_edge_offsets[i];
+        m_up_node_offsets[i + 1] += m_up_node_offsets[i];
+    }
+
+    const size_t proj_edge_count = m_egraph_edges.size();
+    ROS_INFO("Projected experience graph contains %d nodes and %zu edges", proj_node_count, proj_edge_count);
 
     int comp_count = 0;
-    m_component_ids.assign(eg->num_nodes(), -1);
+    m_component_ids.assign(eg->node_id_bound(), -1);
     for (auto nit = nodes.first; nit != nodes.second; ++nit) {
         if (m_component_ids[*nit] != -1) {
             continue;
@@ -556,98 +635,117 @@ int DijkstraEgraphHeuristic3D::getGoalHeuristic(const Eigen::Vector3i& dp)
 {
     Cell* cell = &m_dist_grid(dp.x(), dp.y(), dp.z());
 
+    if (m_eager) {
+        std::unique_lock<std::mutex> lock(m_search_mutex, std::defer_lock);
+        if (!m_search_done) {
+            // a cell's distance is final once it is no greater than that of
+            // the most recently expanded cell
+            lock.lock();
+            m_search_cv.wait(lock, [&]()
+            {
+                return m_search_done ||
+                        cell->dist == Wall ||
+                        cell->dist <= m_search_key;
+            });
+        }
+        return std::min(cell->dist, (int)Infinity);
+    }
+
     if (cell->dist == Wall) {
         return Infinity;
     }
 
-    static int last_expand_count = 0;
     int expand_count = 0;
-    static int repeat_count = 1;
     while (cell->dist == Unknown && !m_open.empty()) {
         ++expand_count;
         Cell* curr_cell = m_open.min();
         m_open.pop();
+        expand(curr_cell);
+    }
 
-        int cidx = std::distance(m_dist_grid.data(), curr_cell);
-        size_t cx, cy, cz;
-        m_dist_grid.index_to_coord(cidx, cx, cy, cz);
-        ROS_DEBUG_NAMED(params()->heuristic_log, "Expand cell (%zu, %zu, %zu)", cx, cy, cz);
-
-        // relax experience graph adjacency edges
-        auto it = m_heur_nodes.find(Eigen::Vector3i(cx, cy, cz));
-        if (it != m_heur_nodes.end()) {
-            const HeuristicNode& hnode = it->second;
-            ROS_DEBUG_NAMED(params()->heuristic_log, "  %zu adjacent egraph cells", hnode.edges.size());
-            for (const Eigen::Vector3i& adj : hnode.edges) {
-                const int dx = adj.x() - cx;
-                const int dy = adj.y() - cy;
-                const int dz = adj.z() - cz;
-                Cell* ncell = &m_dist_grid(adj.x(), adj.y(), adj.z());
-
-                const int cost = (int)(1000.0 * std::sqrt((double)(dx * dx + dy * dy + dz * dz)));
-                const int new_cost = curr_cell->dist + cost;
-                if (new_cost < ncell->dist) {
-                    ncell->dist = new_cost;
-                    if (m_open.contains(ncell)) {
-                        ROS_DEBUG_NAMED(params()->heuristic_log, "  Update cell (%d, %d, %d) with egraph edge (-> %d)", adj.x(), adj.y(), adj.z(), new_cost);
-                        m_open.decrease(ncell);
-                    } else {
-                        ROS_DEBUG_NAMED(params()->heuristic_log, "  Insert cell (%d, %d, %d) with egraph edge (-> %d)", adj.x(), adj.y(), adj.z(), new_cost);
-                        m_open.push(ncell);
-                    }
-                }
-            }
-        }
-
-        // relax neighboring edges
-        for (int dx = -1; dx <= 1; ++dx) {
-        for (int dy = -1; dy <= 1; ++dy) {
-        for (int dz = -1; dz <= 1; ++dz) {
-            if (dx == 0 & dy == 0 & dz == 0) {
-                continue;
-            }
-
-            const int sx = cx + dx;
-            const int sy = cy + dy;
-            const int sz = cz + dz;
+    if (m_last_expand_count != expand_count) {
+        ROS_DEBUG_NAMED(params()->heuristic_log, "Computed heuristic in %d expansions (after %d lookups)", expand_count, m_repeat_count);
+        m_last_expand_count = expand_count;
+        m_repeat_count = 1;
+    } else {
+        ++m_repeat_count;
+    }
 
-            Cell* ncell = &m_dist_grid(sx, sy, sz);
+    if (cell->dist > Infinity) {
+        return Infinity;
+    }
+    return cell->dist;
+}
 
-            // bounds and obstacle check
-            if (ncell->dist == Wall) {
-                continue;
+// Relax the experience graph edges and the edges to the neighbors of a cell
+// removed from the open list
+void DijkstraEgraphHeuristic3D::expand(Cell* curr_cell)
+{
+    auto relax = [&](Cell* ncell, int new_cost)
+    {
+        if (new_cost < ncell->dist) {
+            ncell->dist = new_cost;
+            if (m_open.contains(ncell)) {
+                m_open.decrease(ncell);
+            } else {
+                m_open.push(ncell);
             }
+        }
+    };
 
-            const int cost = (int)(m_eg_eps * 1000.0 * std::sqrt((double)(dx * dx + dy * dy + dz * dz)));
-            const int new_cost = curr_cell->dist + cost;
-
-            if (new_cost < ncell->dist) {
-                ncell->dist = new_cost;
-                if (m_open.contains(ncell)) {
-                    ROS_DEBUG_NAMED(params()->heuristic_log, "  Update cell (%d, %d, %d) with normal edge (-> %d)", sx, sy, sz, new_cost);
-                    m_open.decrease(ncell);
-                } else {
-                    ROS_DEBUG_NAMED(params()->heuristic_log, "  Insert cell (%d, %d, %d) with normal edge (-> %d)", sx, sy, sz, new_cost);
-                    m_open.push(ncell);
-                }
+    // relax experience graph adjacency edges
+    const int n = curr_cell->egraph_node;
+    if (n >= 0) {
+        for (int i = m_egraph_edge_offsets[n]; i != m_egraph_edge_offsets[n + 1]; ++i) {
+            const EgraphEdge& edge = m_egraph_edges[i];
+            Cell* ncell = &m_dist_grid[edge.cell];
+            if (ncell->dist != Wall) {
+                relax(ncell, curr_cell->dist + edge.cost);
             }
         }
-        }
+    }
+
+    // relax neighboring edges; the border of the grid is padded with walls
+    for (int i = 0; i < 26; ++i) {
+        Cell* ncell = curr_cell + m_neighbor_offsets[i];
+        if (ncell->dist != Wall) {
+            relax(ncell, curr_cell->dist + m_neighbor_costs[i]);
         }
     }
+}
 
-    if (last_expand_count != expand_count) {
-        ROS_INFO("Computed heuristic in %d expansions (after %d lookups)", expand_count, repeat_count);
-        last_expand_count = expand_count;
-        repeat_count = 1;
-    } else {
-        ++repeat_count;
+// Run the search to completion, periodically releasing the distance grid to
+// threads waiting for the distance of a cell
+void DijkstraEgraphHeuristic3D::searchEagerly()
+{
+    std::unique_lock<std::mutex> lock(m_search_mutex);
+    int expand_count = 0;
+    while (!m_open.empty() && !m_search_cancel) {
+        Cell* curr_cell = m_open.min();
+        m_open.pop();
+        m_search_key = curr_cell->dist;
+        expand(curr_cell);
+
+        if (++expand_count % EAGER_EXPANSION_BATCH == 0) {
+            lock.unlock();
+            m_search_cv.notify_all();
+            lock.lock();
+        }
     }
+    m_search_done = true;
+    lock.unlock();
+    m_search_cv.notify_all();
 
-    if (cell->dist > Infinity) {
-        return Infinity;
+    ROS_DEBUG_NAMED(params()->heuristic_log, "Computed heuristic eagerly in %d expansions", expand_count);
+}
+
+void DijkstraEgraphHeuristic3D::stopSearch()
+{
+    if (m_search_thread.joinable()) {
+        m_search_cancel = true;
+        m_search_thread.join();
     }
-    return cell->dist;
+    m_search_done = true;
 }
 
 void DijkstraEgraphHeuristic3D::syncGridAndDijkstra()
@@ -95,6 +95,11 @@ Extension* EuclidDistHeuristic::getExtension(size_t class_code)
     if (class_code == GetClassCode<RobotHeuristic>()) {
         return this;
     }
+    if (class_code == GetClassCode<PairwiseHeuristicExtension>() &&
+        (m_pose_ext || m_point_ext))
+    {
+        return this;
+    }
     return nullptr;
 }
 
@@ -176,21 +181,21 @@ int EuclidDistHeuristic::GetFromToHeuristic(int from_id, int to_id)
         if (from_id == planningSpace()->getGoalStateID()) {
             Eigen::Vector3d gp(createPoint(planningSpace()->goal().pose));
             Eigen::Vector3d p;
-            if (!m_pose_ext->projectToPoint(to_id, p)) {
+            if (!m_point_ext->projectToPoint(to_id, p)) {
                 return 0;
             }
             return (int)(FIXED_POINT_RATIO * computeDistance(gp, p));
         } else if (to_id == planningSpace()->getGoalStateID()) {
             Eigen::Vector3d gp(createPoint(planningSpace()->goal().pose));
             Eigen::Vector3d p;
-            if (!m_pose_ext->projectToPoint(from_id, p)) {
+            if (!m_point_ext->projectToPoint(from_id, p)) {
                 return 0;
             }
             return (int)(FIXED_POINT_RATIO * computeDistance(p, gp));
         } else {
             Eigen::Vector3d a, b;
-            if (!m_pose_ext->projectToPoint(from_id, a) ||
-                !m_pose_ext->projectToPoint(to_id, b))
+            if (!m_point_ext->projectToPoint(from_id, a) ||
+                !m_point_ext->projectToPoint(to_id, b))
             {
                 return 0;
             }
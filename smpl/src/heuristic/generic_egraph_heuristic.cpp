@@ -48,15 +48,22 @@ GenericEgraphHeuristic::GenericEgraphHeuristic(
     ExperienceGraphHeuristicExtension(),
     m_orig_h(h),
     m_eg(nullptr),
+    m_ers(nullptr),
     m_eg_eps(1.0),
+    m_equiv_radius(0.0),
     m_component_ids(),
     m_shortcut_nodes(),
     m_h_nodes(),
+    m_nodes_by_dist(),
     m_open()
 {
     params()->param("egraph_epsilon", m_eg_eps, 1.0);
+    params()->param("egraph_equivalence_radius", m_equiv_radius, 0.0);
 
     ROS_INFO_NAMED(params()->heuristic_log, "egraph_epsilon: %0.3f", m_eg_eps);
+    ROS_INFO_NAMED(params()->heuristic_log, "egraph_equivalence_radius: %0.3f", m_equiv_radius);
+
+    m_ers = pspace->getExtension<ExtractRobotStateExtension>();
 
     m_eg = pspace->getExtension<ExperienceGraphExtension>();
     if (!m_eg) {
@@ -69,15 +76,30 @@ void GenericEgraphHeuristic::getEquivalentStates(
     std::vector<int>& ids)
 {
     ExperienceGraph* eg = m_eg->getExperienceGraph();
-    auto nodes = eg->nodes();
-    int best_h = std::numeric_limits<int>::max();
     const int equiv_thresh = 100;
+
+    // the original heuristic is opaque; when configured with a joint-space
+    // radius that contains all equivalent states, test only the experience
+    // graph nodes within it
+    if (m_ers && m_equiv_radius > 0.0) {
+        // the extracted state is only used by nearest_nodes; the original
+        // heuristic may extract other states afterwards
+        std::vector<ExperienceGraph::node_id> equiv_nodes;
+        eg->nearest_nodes(m_ers->extractState(state_id), m_equiv_radius, equiv_nodes);
+        for (ExperienceGraph::node_id n : equiv_nodes) {
+            int egraph_state_id = m_eg->getStateID(n);
+            int h = m_orig_h->GetFromToHeuristic(state_id, egraph_state_id);
+            if (h <= equiv_thresh) {
+                ids.push_back(egraph_state_id);
+            }
+        }
+        return;
+    }
+
+    auto nodes = eg->nodes();
     for (auto nit = nodes.first; nit != nodes.second; ++nit) {
         int egraph_state_id = m_eg->getStateID(*nit);
         int h = m_orig_h->GetFromToHeuristic(state_id, egraph_state_id);
-        if (h < best_h) {
-            best_h = h;
-        }
         if (h <= equiv_thresh) {
             ids.push_back(egraph_state_id);
         }
@@ -141,7 +163,7 @@ void GenericEgraphHeuristic::updateGoal(const GoalConstraint& goal)
     //////////////////////////////////////////////////////////
 
     int comp_count = 0;
-    m_component_ids.assign(eg->num_nodes(), -1);
+    m_component_ids.assign(eg->node_id_bound(), -1);
     auto nodes = eg->nodes();
     for (auto nit = nodes.first; nit != nodes.second; ++nit) {
         if (m_component_ids[*nit] != -1) {
@@ -201,7 +223,8 @@ void GenericEgraphHeuristic::updateGoal(const GoalConstraint& goal)
     // Compute Heuristic Distances for Experience Graph Nodes //
     ////////////////////////////////////////////////////////////
 
-    m_h_nodes.assign(eg->num_nodes() + 1, HeuristicNode(Unknown));
+    m_h_nodes.assign(eg->node_id_bound() + 1, HeuristicNode(Unknown));
+    m_nodes_by_dist.clear();
     m_open.clear();
     m_h_nodes[0].dist = 0;
     m_open.push(&m_h_nodes[0]);
@@ -210,6 +233,12 @@ void GenericEgraphHeuristic::updateGoal(const GoalConstraint& goal)
         m_open.pop();
 
         int nidx = std::distance(m_h_nodes.data(), s);
+        if (nidx != 0) {
+            // nodes are finalized in order of increasing heuristic distance,
+            // so GetGoalHeuristic() may stop once no remaining node can
+            // improve the heuristic
+            m_nodes_by_dist.push_back(nidx - 1);
+        }
         if (nidx == 0) {
             // neighbors: inflated edges to all experience graph states
             // unconditionally relaxed (goal node is the first node removed)
@@ -271,11 +300,13 @@ int GenericEgraphHeuristic::GetGoalHeuristic(int state_id)
     }
 
     int best_h = (int)(m_eg_eps * m_orig_h->GetGoalHeuristic(state_id));
-    auto nodes = eg->nodes();
-    for (auto nit = nodes.first; nit != nodes.second; ++nit) {
-        const int egraph_state_id = m_eg->getStateID(*nit);
+    for (ExperienceGraph::node_id n : m_nodes_by_dist) {
+        const int dist = m_h_nodes[n + 1].dist;
+        if (dist >= best_h) {
+            break;
+        }
+        const int egraph_state_id = m_eg->getStateID(n);
         const int h = m_orig_h->GetFromToHeuristic(state_id, egraph_state_id);
-        const int dist = m_h_nodes[*nit + 1].dist;
         const int new_h = dist + (int)(m_eg_eps * h);
         if (new_h < best_h) {
             best_h = new_h;
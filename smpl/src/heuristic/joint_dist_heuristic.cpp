@@ -64,6 +64,11 @@ Extension* JointDistHeuristic::getExtension(size_t class_code)
     if (class_code == GetClassCode<RobotHeuristic>()) {
         return this;
     }
+    if (class_code == GetClassCode<PairwiseHeuristicExtension>() &&
+        (m_ers))
+    {
+        return this;
+    }
     return nullptr;
 }
 
@@ -117,7 +122,8 @@ int JointDistHeuristic::GetFromToHeuristic(int from_id, int to_id)
         const RobotState& t = planningSpace()->goal().angles;
         return (int)(FIXED_POINT_RATIO * computeJointDistance(s, t));
     } else {
-        const RobotState& s = m_ers->extractState(from_id);
+        // copy the first state; extracted states may share storage
+        const RobotState s = m_ers->extractState(from_id);
         const RobotState& t = m_ers->extractState(to_id);
         return (int)(FIXED_POINT_RATIO * computeJointDistance(s, t));
     }
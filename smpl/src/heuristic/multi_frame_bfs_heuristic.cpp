@@ -338,6 +338,10 @@ void MultiFrameBfsHeuristic::syncGridAndBfs()
     const int zc = grid()->numCellsZ();
     m_bfs.reset(new BFS_3D(xc, yc, zc));
     m_ee_bfs.reset(new BFS_3D(xc, yc, zc));
+    int bfs_threads;
+    params()->param("bfs_threads", bfs_threads, 1);
+    m_bfs->setNumThreads(bfs_threads);
+    m_ee_bfs->setNumThreads(bfs_threads);
     const int cell_count = xc * yc * zc;
     int wall_count = 0;
     for (int z = 0; z < zc; ++z) {
@@ -33,6 +33,11 @@
 #include <smpl/occupancy_grid.h>
 
 // standard includes
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 #include <memory>
 
 // system includes
@@ -40,6 +45,10 @@
 #include <leatherman/viz.h>
 
 // project includes
+#include <smpl/distance_map/chessboard_distance_map.h>
+#include <smpl/distance_map/edge_euclid_distance_map.h>
+#include <smpl/distance_map/euclid_distance_map.h>
+#include <smpl/mapped_file.h>
 #include <smpl/ros/propagation_distance_field.h>
 
 namespace sbpl {
@@ -69,6 +78,67 @@ namespace sbpl {
 /// An arbitrary distance map implementation may be used with this class. If
 /// none is specified, by calling the verbose constructor, an instance of
 /// sbpl::PropagationDistanceField is constructed.
+///
+/// The third additional feature is change tracking. Each modification made
+/// through the OccupancyGrid increments its version and records the bounds of
+/// the modified cells, so that clients deriving data from the grid may update
+/// only the affected cells. Modifications made directly to the distance map
+/// are not tracked.
+///
+/// The fourth additional feature is persistence. If the distance map is one of
+/// the dense DistanceMap types, the contents of the grid may be saved to a
+/// cache file, tagged with a hash of the scene they were built from, and later
+/// restored by mapping the file into memory, rather than by recomputing the
+/// distance field.
+
+// maximum number of changes remembered before the oldest are merged
+static const size_t MAX_TRACKED_CHANGES = 32;
+
+// Layout of the header of a cache file written by saveCache(). The header is
+// followed by the section written by the distance map and by the nonzero
+// reference counts, as (cell index, count) pairs.
+struct CacheHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t dmap_type;
+    std::uint64_t scene_hash;
+    std::uint32_t ref_counted;
+    std::uint32_t cell_count;
+    std::uint64_t dmap_offset;
+    std::uint64_t dmap_size;
+    std::uint64_t counts_offset;
+    std::uint64_t counts_size;
+};
+
+static const char CACHE_MAGIC[8] = { 'S', 'M', 'P', 'L', 'O', 'G', 'R', 'D' };
+static const std::uint32_t CACHE_VERSION = 1;
+static const std::uint64_t CACHE_DMAP_OFFSET = 64;
+
+static_assert(
+        sizeof(CacheHeader) <= CACHE_DMAP_OFFSET,
+        "cache header must fit before the distance map section");
+
+enum CacheDistanceMapType : std::uint32_t
+{
+    CACHE_DMAP_NONE = 0,
+    CACHE_DMAP_EUCLID,
+    CACHE_DMAP_EDGE_EUCLID,
+    CACHE_DMAP_CHESSBOARD,
+};
+
+static std::uint32_t GetCacheDistanceMapType(const DistanceMapInterface* dm)
+{
+    if (dynamic_cast<const EuclidDistanceMap*>(dm)) {
+        return CACHE_DMAP_EUCLID;
+    } else if (dynamic_cast<const EdgeEuclidDistanceMap*>(dm)) {
+        return CACHE_DMAP_EDGE_EUCLID;
+    } else if (dynamic_cast<const ChessboardDistanceMap*>(dm)) {
+        return CACHE_DMAP_CHESSBOARD;
+    } else {
+        return CACHE_DMAP_NONE;
+    }
+}
 
 /// Construct an Occupancy Grid.
 ///
@@ -100,7 +170,11 @@ OccupancyGrid::OccupancyGrid(
     m_ref_counted(ref_counted),
     m_x_stride(m_grid->numCellsY() * m_grid->numCellsZ()),
     m_y_stride(m_grid->numCellsZ()),
-    m_counts()
+    m_counts(),
+    m_version(0),
+    m_changes(),
+    m_dense_query(),
+    m_has_dense_query(false)
 {
     // distance field guaranteed to be empty -> faster initialization
     if (m_ref_counted) {
@@ -121,9 +195,14 @@ OccupancyGrid::OccupancyGrid(
     m_ref_counted(ref_counted),
     m_x_stride(m_grid->numCellsY() * m_grid->numCellsZ()),
     m_y_stride(m_grid->numCellsZ()),
-    m_counts()
+    m_counts(),
+    m_version(0),
+    m_changes(),
+    m_dense_query(),
+    m_has_dense_query(false)
 {
     initRefCounts();
+    initDenseQuery();
 }
 
 /// Copy constructor. Constructs the Occupancy Grid with a deep copy of the
@@ -136,6 +215,9 @@ OccupancyGrid::OccupancyGrid(const OccupancyGrid& o)
     m_x_stride = o.m_x_stride;
     m_y_stride = o.m_y_stride;
     m_counts = o.m_counts;
+    m_version = o.m_version;
+    m_changes = o.m_changes;
+    initDenseQuery();
 }
 
 /// Reset the grid, removing all obstacles setting distances to their
@@ -143,9 +225,210 @@ OccupancyGrid::OccupancyGrid(const OccupancyGrid& o)
 void OccupancyGrid::reset()
 {
     m_grid->reset();
+    initDenseQuery();
     if (m_ref_counted) {
         m_counts.assign(getCellCount(), 0);
     }
+    recordChange(
+            0, 0, 0,
+            numCellsX() - 1, numCellsY() - 1, numCellsZ() - 1);
+}
+
+/// Save the contents of the grid to a cache file, which may be restored by
+/// loadCache() into a grid with the same distance map type and parameters.
+/// The file is written to a temporary path and then renamed, so that a
+/// partially written cache is never observed.
+///
+/// \param path Path to the cache file
+/// \param scene_hash Identifies the scene the grid was built from
+/// \return false if the distance map is not one of the dense DistanceMap
+///     types or the file could not be written
+bool OccupancyGrid::saveCache(
+    const std::string& path,
+    std::uint64_t scene_hash) const
+{
+    const std::uint32_t dmap_type = GetCacheDistanceMapType(m_grid.get());
+    if (dmap_type == CACHE_DMAP_NONE) {
+        return false;
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+        return false;
+    }
+
+    CacheHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+    h.version = CACHE_VERSION;
+    h.dmap_type = dmap_type;
+    h.scene_hash = scene_hash;
+    h.ref_counted = m_ref_counted;
+    h.cell_count = getCellCount();
+    h.dmap_offset = CACHE_DMAP_OFFSET;
+
+    // write the header last, once the section sizes are known
+    const char zeros[CACHE_DMAP_OFFSET] = { 0 };
+    ofs.write(zeros, sizeof(zeros));
+
+    const DistanceMapInterface* dm = m_grid.get();
+    bool saved = false;
+    switch (dmap_type) {
+    case CACHE_DMAP_EUCLID:
+        saved = static_cast<const EuclidDistanceMap*>(dm)->save(ofs);
+        break;
+    case CACHE_DMAP_EDGE_EUCLID:
+        saved = static_cast<const EdgeEuclidDistanceMap*>(dm)->save(ofs);
+        break;
+    case CACHE_DMAP_CHESSBOARD:
+        saved = static_cast<const ChessboardDistanceMap*>(dm)->save(ofs);
+        break;
+    }
+    if (!saved) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+
+    h.counts_offset = (std::uint64_t)ofs.tellp();
+    h.dmap_size = h.counts_offset - h.dmap_offset;
+
+    if (m_ref_counted) {
+        for (size_t i = 0; i < m_counts.size(); ++i) {
+            if (m_counts[i] > 0) {
+                const std::int32_t pair[2] = { (std::int32_t)i, m_counts[i] };
+                ofs.write(reinterpret_cast<const char*>(pair), sizeof(pair));
+                h.counts_size += sizeof(pair);
+            }
+        }
+    }
+
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    ofs.close();
+    if (!ofs || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/// Restore the contents of the grid from a cache file written by saveCache().
+/// The distances are read directly from the mapped file until the grid is
+/// next modified. The entire grid is recorded as changed.
+///
+/// \param path Path to the cache file
+/// \param scene_hash Identifies the scene the grid is expected to represent
+/// \return false, leaving the grid unmodified, if the file does not exist or
+///     does not match the scene hash or the type and parameters of the grid
+bool OccupancyGrid::loadCache(
+    const std::string& path,
+    std::uint64_t scene_hash)
+{
+    const std::uint32_t dmap_type = GetCacheDistanceMapType(m_grid.get());
+    if (dmap_type == CACHE_DMAP_NONE) {
+        return false;
+    }
+
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path) || file->size() < CACHE_DMAP_OFFSET) {
+        return false;
+    }
+
+    CacheHeader h;
+    std::memcpy(&h, file->data(), sizeof(h));
+    if (std::memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) != 0 ||
+        h.version != CACHE_VERSION ||
+        h.dmap_type != dmap_type ||
+        h.scene_hash != scene_hash ||
+        h.ref_counted != (std::uint32_t)m_ref_counted ||
+        h.cell_count != (std::uint32_t)getCellCount() ||
+        h.dmap_offset != CACHE_DMAP_OFFSET ||
+        h.counts_offset != h.dmap_offset + h.dmap_size ||
+        h.counts_offset % sizeof(std::int32_t) != 0 ||
+        h.counts_size % (2 * sizeof(std::int32_t)) != 0 ||
+        h.counts_offset + h.counts_size != file->size())
+    {
+        return false;
+    }
+
+    // validate the reference counts before modifying the grid
+    const std::int32_t* counts =
+            reinterpret_cast<const std::int32_t*>(file->data() + h.counts_offset);
+    const size_t count_pair_count = h.counts_size / (2 * sizeof(std::int32_t));
+    for (size_t i = 0; i < count_pair_count; ++i) {
+        const std::int32_t idx = counts[2 * i];
+        if (idx < 0 || idx >= getCellCount() || counts[2 * i + 1] <= 0) {
+            return false;
+        }
+    }
+
+    DistanceMapInterface* dm = m_grid.get();
+    bool loaded = false;
+    size_t dmap_size;
+    switch (dmap_type) {
+    case CACHE_DMAP_EUCLID:
+        loaded = static_cast<EuclidDistanceMap*>(dm)->load(
+                file, h.dmap_offset, dmap_size);
+        break;
+    case CACHE_DMAP_EDGE_EUCLID:
+        loaded = static_cast<EdgeEuclidDistanceMap*>(dm)->load(
+                file, h.dmap_offset, dmap_size);
+        break;
+    case CACHE_DMAP_CHESSBOARD:
+        loaded = static_cast<ChessboardDistanceMap*>(dm)->load(
+                file, h.dmap_offset, dmap_size);
+        break;
+    }
+    if (!loaded) {
+        return false;
+    }
+
+    if (m_ref_counted) {
+        m_counts.assign(getCellCount(), 0);
+        for (size_t i = 0; i < count_pair_count; ++i) {
+            m_counts[counts[2 * i]] = counts[2 * i + 1];
+        }
+    }
+
+    initDenseQuery();
+    recordChange(
+            0, 0, 0,
+            numCellsX() - 1, numCellsY() - 1, numCellsZ() - 1);
+    return true;
+}
+
+/// Get the bounds of the cells modified since a given version of the grid.
+///
+/// The bounds may include cells that have not been modified.
+///
+/// \return true if any cells have been modified since \p since_version
+bool OccupancyGrid::getChangedCells(
+    unsigned int since_version,
+    int& min_x, int& min_y, int& min_z,
+    int& max_x, int& max_y, int& max_z) const
+{
+    bool changed = false;
+    for (const CellChange& change : m_changes) {
+        if (change.version <= since_version) {
+            continue;
+        }
+        if (!changed) {
+            min_x = change.min_x; min_y = change.min_y; min_z = change.min_z;
+            max_x = change.max_x; max_y = change.max_y; max_z = change.max_z;
+            changed = true;
+        }
+        else {
+            min_x = std::min(min_x, change.min_x);
+            min_y = std::min(min_y, change.min_y);
+            min_z = std::min(min_z, change.min_z);
+            max_x = std::max(max_x, change.max_x);
+            max_y = std::max(max_y, change.max_y);
+            max_z = std::max(max_z, change.max_z);
+        }
+    }
+    return changed;
 }
 
 /// Count the number of obstacles in the occupancy grid.
@@ -440,11 +723,13 @@ void OccupancyGrid::addPointsToField(
             }
         }
         m_grid->addPointsToMap(pts);
+        recordChange(pts);
     }
     else {
         m_grid->addPointsToMap(points);
+        recordChange(points);
     }
-
+    initDenseQuery();
 }
 
 /// Remove a set of obstacle cells from the occupancy grid.
@@ -470,10 +755,13 @@ void OccupancyGrid::removePointsFromField(
             }
         }
         m_grid->removePointsFromMap(pts);
+        recordChange(pts);
     }
     else {
         m_grid->removePointsFromMap(points);
+        recordChange(points);
     }
+    initDenseQuery();
 }
 
 /// Update the occupancy grid, removing obstacles that exist in the old obstacle
@@ -483,8 +771,121 @@ void OccupancyGrid::updatePointsInField(
     const std::vector<Eigen::Vector3d>& old_points,
     const std::vector<Eigen::Vector3d>& new_points)
 {
-    // TODO: ref counting
+    std::vector<const std::vector<Eigen::Vector3d>*> removed(1, &old_points);
+    std::vector<const std::vector<Eigen::Vector3d>*> added(1, &new_points);
+    updatePointsInField(removed, added);
+}
+
+/// Remove several sets of obstacle cells from, and add several sets of obstacle
+/// cells to, the occupancy grid, with a single update of the distance map. All
+/// removals are applied before all additions. When the grid is reference
+/// counted, only cells whose occupancy changes as a result of the entire batch
+/// are passed on to the distance map.
+void OccupancyGrid::updatePointsInField(
+    const std::vector<const std::vector<Eigen::Vector3d>*>& removed,
+    const std::vector<const std::vector<Eigen::Vector3d>*>& added)
+{
+    // gather the indices of the in-bounds cells containing a set of points,
+    // with one entry per point
+    auto to_cell_indices = [&](
+        const std::vector<const std::vector<Eigen::Vector3d>*>& point_lists,
+        std::vector<int>& indices)
+    {
+        int gx, gy, gz;
+        for (const std::vector<Eigen::Vector3d>* points : point_lists) {
+            for (const Eigen::Vector3d& v : *points) {
+                worldToGrid(v.x(), v.y(), v.z(), gx, gy, gz);
+                if (isInBounds(gx, gy, gz)) {
+                    indices.push_back(coordToIndex(gx, gy, gz));
+                }
+            }
+        }
+    };
+
+    std::vector<int> rem_indices;
+    to_cell_indices(removed, rem_indices);
+
+    std::vector<int> add_indices;
+    to_cell_indices(added, add_indices);
+
+    auto to_points = [&](const std::vector<int>& indices)
+        -> std::vector<Eigen::Vector3d>
+    {
+        std::vector<Eigen::Vector3d> points;
+        points.reserve(indices.size());
+        int gx, gy, gz;
+        double wx, wy, wz;
+        for (int idx : indices) {
+            indexToCoord(idx, gx, gy, gz);
+            gridToWorld(gx, gy, gz, wx, wy, wz);
+            points.emplace_back(wx, wy, wz);
+        }
+        return points;
+    };
+
+    std::vector<int> removed_cells;
+    std::vector<int> added_cells;
+
+    if (m_ref_counted) {
+        // record the occupancy of every touched cell before the update
+        std::vector<int> touched;
+        touched.reserve(rem_indices.size() + add_indices.size());
+        touched.insert(touched.end(), rem_indices.begin(), rem_indices.end());
+        touched.insert(touched.end(), add_indices.begin(), add_indices.end());
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+        std::vector<bool> was_occupied(touched.size());
+        for (size_t i = 0; i < touched.size(); ++i) {
+            was_occupied[i] = m_counts[touched[i]] > 0;
+        }
+
+        for (int idx : rem_indices) {
+            if (m_counts[idx] > 0) {
+                --m_counts[idx];
+            }
+        }
+        for (int idx : add_indices) {
+            ++m_counts[idx];
+        }
+
+        for (size_t i = 0; i < touched.size(); ++i) {
+            const bool occupied = m_counts[touched[i]] > 0;
+            if (was_occupied[i] && !occupied) {
+                removed_cells.push_back(touched[i]);
+            }
+            else if (!was_occupied[i] && occupied) {
+                added_cells.push_back(touched[i]);
+            }
+        }
+    }
+    else {
+        // cells that are both removed and added remain occupied
+        std::sort(rem_indices.begin(), rem_indices.end());
+        rem_indices.erase(
+                std::unique(rem_indices.begin(), rem_indices.end()),
+                rem_indices.end());
+        std::sort(add_indices.begin(), add_indices.end());
+        add_indices.erase(
+                std::unique(add_indices.begin(), add_indices.end()),
+                add_indices.end());
+        std::set_difference(
+                rem_indices.begin(), rem_indices.end(),
+                add_indices.begin(), add_indices.end(),
+                std::back_inserter(removed_cells));
+        added_cells = std::move(add_indices);
+    }
+
+    if (removed_cells.empty() && added_cells.empty()) {
+        return;
+    }
+
+    const std::vector<Eigen::Vector3d> old_points = to_points(removed_cells);
+    const std::vector<Eigen::Vector3d> new_points = to_points(added_cells);
     m_grid->updatePointsInMap(old_points, new_points);
+    initDenseQuery();
+    recordChange(old_points);
+    recordChange(new_points);
 }
 
 void OccupancyGrid::initRefCounts()
@@ -507,6 +908,89 @@ void OccupancyGrid::initRefCounts()
     });
 }
 
+// Obtain a non-virtual query handle if the distance map is one of the dense
+// DistanceMap types. The storage of a dense DistanceMap may move when it is
+// first modified after being loaded from a cache file, so the handle is
+// refreshed after every modification.
+void OccupancyGrid::initDenseQuery()
+{
+    const DistanceMapInterface* dm = m_grid.get();
+    if (auto* edm = dynamic_cast<const EuclidDistanceMap*>(dm)) {
+        m_dense_query = edm->denseQuery();
+        m_has_dense_query = true;
+    } else if (auto* eedm = dynamic_cast<const EdgeEuclidDistanceMap*>(dm)) {
+        m_dense_query = eedm->denseQuery();
+        m_has_dense_query = true;
+    } else if (auto* cdm = dynamic_cast<const ChessboardDistanceMap*>(dm)) {
+        m_dense_query = cdm->denseQuery();
+        m_has_dense_query = true;
+    } else {
+        m_dense_query = DenseDistanceQuery();
+        m_has_dense_query = false;
+    }
+}
+
+void OccupancyGrid::recordChange(const std::vector<Eigen::Vector3d>& points)
+{
+    if (points.empty()) {
+        return;
+    }
+
+    int min_x = numCellsX(), min_y = numCellsY(), min_z = numCellsZ();
+    int max_x = -1, max_y = -1, max_z = -1;
+    int gx, gy, gz;
+    for (const Eigen::Vector3d& v : points) {
+        worldToGrid(v.x(), v.y(), v.z(), gx, gy, gz);
+        min_x = std::min(min_x, gx);
+        min_y = std::min(min_y, gy);
+        min_z = std::min(min_z, gz);
+        max_x = std::max(max_x, gx);
+        max_y = std::max(max_y, gy);
+        max_z = std::max(max_z, gz);
+    }
+
+    // clamp to the grid; points outside the grid do not modify any cells
+    min_x = std::max(min_x, 0);
+    min_y = std::max(min_y, 0);
+    min_z = std::max(min_z, 0);
+    max_x = std::min(max_x, numCellsX() - 1);
+    max_y = std::min(max_y, numCellsY() - 1);
+    max_z = std::min(max_z, numCellsZ() - 1);
+    if (min_x > max_x || min_y > max_y || min_z > max_z) {
+        return;
+    }
+
+    recordChange(min_x, min_y, min_z, max_x, max_y, max_z);
+}
+
+void OccupancyGrid::recordChange(
+    int min_x, int min_y, int min_z,
+    int max_x, int max_y, int max_z)
+{
+    // merge the two oldest changes, as the newer of the two
+    if (m_changes.size() >= MAX_TRACKED_CHANGES) {
+        CellChange& a = m_changes[0];
+        CellChange& b = m_changes[1];
+        b.min_x = std::min(a.min_x, b.min_x);
+        b.min_y = std::min(a.min_y, b.min_y);
+        b.min_z = std::min(a.min_z, b.min_z);
+        b.max_x = std::max(a.max_x, b.max_x);
+        b.max_y = std::max(a.max_y, b.max_y);
+        b.max_z = std::max(a.max_z, b.max_z);
+        m_changes.erase(m_changes.begin());
+    }
+
+    CellChange change;
+    change.version = ++m_version;
+    change.min_x = min_x;
+    change.min_y = min_y;
+    change.min_z = min_z;
+    change.max_x = max_x;
+    change.max_y = max_y;
+    change.max_z = max_z;
+    m_changes.push_back(change);
+}
+
 template <typename CellFunction>
 void OccupancyGrid::iterateCells(CellFunction f) const
 {
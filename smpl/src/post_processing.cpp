@@ -34,6 +34,13 @@
 
 // standard includes
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
 
 // system includes
 #include <Eigen/Dense>
@@ -94,13 +101,109 @@ double pv_distance(
     return pweight * dist + vweight * vdist;
 }
 
+// Memoizes the validity of motions between waypoints of the path being
+// shortcut, keyed by the indices of the waypoints. Motions between states that
+// are not waypoints of the path are not memoized. Once the deadline has passed,
+// motions whose validity is not known are reported as invalid without being
+// checked. Safe to use from multiple threads.
+class SegmentValidityCache
+{
+public:
+
+    SegmentValidityCache(
+        const std::vector<RobotState>& path,
+        const clock::time_point& deadline)
+    :
+        m_path(&path),
+        m_deadline(deadline),
+        m_mutex(),
+        m_valid(),
+        m_hits(0),
+        m_misses(0)
+    { }
+
+    bool timedOut() const { return clock::now() >= m_deadline; }
+
+    template <typename CheckFun>
+    bool isValid(const RobotState& start, const RobotState& finish, CheckFun check)
+    {
+        const int sidx = index(start);
+        const int fidx = index(finish);
+        if (sidx < 0 || fidx < 0) {
+            return !timedOut() && check();
+        }
+
+        const std::uint64_t key =
+                ((std::uint64_t)sidx << 32) | (std::uint64_t)(std::uint32_t)fidx;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_valid.find(key);
+            if (it != m_valid.end()) {
+                ++m_hits;
+                return it->second;
+            }
+        }
+
+        if (timedOut()) {
+            return false;
+        }
+
+        const bool valid = check();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_misses;
+        m_valid[key] = valid;
+        return valid;
+    }
+
+    int hits() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_hits;
+    }
+
+    int misses() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_misses;
+    }
+
+private:
+
+    const std::vector<RobotState>* m_path;
+    clock::time_point m_deadline;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::uint64_t, bool> m_valid;
+    int m_hits;
+    int m_misses;
+
+    // Return the index of a waypoint in the path or -1 if the state is not
+    // stored in the path.
+    int index(const RobotState& state) const
+    {
+        std::less<const RobotState*> less;
+        const RobotState* first = m_path->data();
+        const RobotState* last = first + m_path->size();
+        if (less(&state, first) || !less(&state, last)) {
+            return -1;
+        }
+        return (int)(&state - first);
+    }
+};
+
 class JointPositionShortcutPathGenerator
 {
 public:
 
-    JointPositionShortcutPathGenerator(RobotModel* rm, CollisionChecker* cc) :
+    JointPositionShortcutPathGenerator(
+        RobotModel* rm,
+        CollisionChecker* cc,
+        SegmentValidityCache* cache)
+    :
         m_robot(rm),
-        m_cc(cc)
+        m_cc(cc),
+        m_cache(cache)
     { }
 
     template <typename OutputIt>
@@ -111,10 +214,12 @@ public:
         int path_length;
         int num_checks;
         double dist;
-        const size_t var_count = m_robot->getPlanningJoints().size();
-        if (m_cc->isStateToStateValid(
-                start, finish, path_length, num_checks, dist))
+        auto check = [&]()
         {
+            return m_cc->isStateToStateValid(
+                    start, finish, path_length, num_checks, dist);
+        };
+        if (m_cache->isValid(start, finish, check)) {
             *ofirst++ = start;
             *ofirst++ = finish;
             cost = distance(*m_robot, start, finish);
@@ -129,6 +234,7 @@ private:
 
     RobotModel* m_robot;
     CollisionChecker* m_cc;
+    SegmentValidityCache* m_cache;
 };
 
 class JointPositionVelocityShortcutPathGenerator
@@ -137,10 +243,12 @@ public:
 
     JointPositionVelocityShortcutPathGenerator(
         RobotModel* rm,
-        CollisionChecker* cc)
+        CollisionChecker* cc,
+        SegmentValidityCache* cache)
     :
         m_robot(rm),
-        m_cc(cc)
+        m_cc(cc),
+        m_cache(cache)
     { }
 
     template <typename OutputIt>
@@ -152,11 +260,14 @@ public:
         int num_checks;
         double dist;
         const size_t var_count = m_robot->getPlanningJoints().size();
-        const RobotState pstart(start.begin(), start.begin() + var_count);
-        const RobotState pend(finish.begin(), finish.begin() + var_count);
-        if (m_cc->isStateToStateValid(
-                pstart, pend, path_length, num_checks, dist))
+        auto check = [&]()
         {
+            const RobotState pstart(start.begin(), start.begin() + var_count);
+            const RobotState pend(finish.begin(), finish.begin() + var_count);
+            return m_cc->isStateToStateValid(
+                    pstart, pend, path_length, num_checks, dist);
+        };
+        if (m_cache->isValid(start, finish, check)) {
             *ofirst++ = start;
             *ofirst++ = finish;
             cost = pv_distance(*m_robot, start, finish);
@@ -171,15 +282,21 @@ private:
 
     RobotModel* m_robot;
     CollisionChecker* m_cc;
+    SegmentValidityCache* m_cache;
 };
 
 class EuclidShortcutPathGenerator
 {
 public:
 
-    EuclidShortcutPathGenerator(RobotModel* rm, CollisionChecker* cc) :
+    EuclidShortcutPathGenerator(
+        RobotModel* rm,
+        CollisionChecker* cc,
+        SegmentValidityCache* cache)
+    :
         m_rm(rm),
         m_cc(cc),
+        m_cache(cache),
         m_fk_iface(nullptr),
         m_ik_iface(nullptr)
     {
@@ -192,7 +309,9 @@ public:
         const RobotState& start, const RobotState& end,
         OutputIt ofirst, double& cost) const
     {
-        if (!m_fk_iface || !m_ik_iface) {
+        // the interpolated waypoints are not waypoints of the original path,
+        // so only the deadline applies
+        if (!m_fk_iface || !m_ik_iface || m_cache->timedOut()) {
             return false;
         }
 
@@ -286,6 +405,7 @@ private:
 
     RobotModel* m_rm;
     CollisionChecker* m_cc;
+    SegmentValidityCache* m_cache;
 
     ForwardKinematicsInterface* m_fk_iface;
     InverseKinematicsInterface* m_ik_iface;
@@ -296,7 +416,9 @@ void ShortcutPath(
     CollisionChecker* cc,
     const std::vector<RobotState>& pin,
     std::vector<RobotState>& pout,
-    ShortcutType type)
+    ShortcutType type,
+    double allowed_time,
+    CollisionChecker* aux_cc)
 {
     if (pin.size() < 2) {
         pout = pin;
@@ -304,30 +426,39 @@ void ShortcutPath(
     }
 
     auto then = clock::now();
+    const clock::time_point deadline = std::isfinite(allowed_time) ?
+            then + to_duration(std::max(0.0, allowed_time)) :
+            clock::time_point::max();
+
+    int cache_hits = 0, cache_misses = 0;
     double prev_cost = 0.0, next_cost = 0.0;
     switch (type) {
     case ShortcutType::JOINT_SPACE:
     {
         std::vector<double> costs;
         ComputePositionPathCosts(rm, pin, costs);
+        SegmentValidityCache cache(pin, deadline);
         JointPositionShortcutPathGenerator generators[] =
         {
-            JointPositionShortcutPathGenerator(rm, cc)
+            JointPositionShortcutPathGenerator(rm, cc, &cache)
         };
         shortcut::ShortcutPath(
                 pin.begin(), pin.end(),
                 costs.begin(), costs.end(),
                 generators, generators + 1,
                 std::back_inserter(pout));
+        cache_hits = cache.hits();
+        cache_misses = cache.misses();
     }   break;
     case ShortcutType::EUCLID_SPACE:
     {
         std::vector<double> costs;
         ComputePositionPathCosts(rm, pin, costs);
+        SegmentValidityCache cache(pin, deadline);
 
         EuclidShortcutPathGenerator generators[] =
         {
-            EuclidShortcutPathGenerator(rm, cc)
+            EuclidShortcutPathGenerator(rm, cc, &cache)
         };
 
         shortcut::ShortcutPath(
@@ -345,9 +476,31 @@ void ShortcutPath(
         ComputePositionVelocityPathCosts(rm, pv_path, costs);
         prev_cost = std::accumulate(costs.begin(), costs.end(), 0.0);
 
+        // both strategies share the validity of the segments they check
+        SegmentValidityCache cache(pv_path, deadline);
+
+        std::vector<RobotState> opvpath_dnc;
+        auto shortcut_dnc = [&](CollisionChecker* checker)
+        {
+            JointPositionVelocityShortcutPathGenerator generators[] =
+            {
+                JointPositionVelocityShortcutPathGenerator(rm, checker, &cache)
+            };
+            shortcut::DivideAndConquerShortcutPath(
+                    pv_path.begin(), pv_path.end(),
+                    costs.begin(), costs.end(),
+                    generators, generators + 1,
+                    std::back_inserter(opvpath_dnc));
+        };
+
+        std::thread dnc_thread;
+        if (aux_cc) {
+            dnc_thread = std::thread(shortcut_dnc, aux_cc);
+        }
+
         JointPositionVelocityShortcutPathGenerator generators[] =
         {
-            JointPositionVelocityShortcutPathGenerator(rm, cc)
+            JointPositionVelocityShortcutPathGenerator(rm, cc, &cache)
         };
 
         std::vector<RobotState> opvpath;
@@ -357,12 +510,14 @@ void ShortcutPath(
                 generators, generators + 1,
                 std::back_inserter(opvpath));
 
-        std::vector<RobotState> opvpath_dnc;
-        shortcut::DivideAndConquerShortcutPath(
-                pv_path.begin(), pv_path.end(),
-                costs.begin(), costs.end(),
-                generators, generators + 1,
-                std::back_inserter(opvpath_dnc));
+        if (aux_cc) {
+            dnc_thread.join();
+        } else {
+            shortcut_dnc(cc);
+        }
+
+        cache_hits = cache.hits();
+        cache_misses = cache.misses();
 
         std::vector<double> new_costs;
         ComputePositionVelocityPathCosts(rm, opvpath, new_costs);
@@ -385,6 +540,10 @@ void ShortcutPath(
 
     auto now = clock::now();
     ROS_INFO("Path shortcutting took %0.3f seconds", std::chrono::duration<double>(now - then).count());
+    if (now >= deadline) {
+        ROS_INFO("Path shortcutting ran out of time (%0.3f seconds allowed)", allowed_time);
+    }
+    ROS_INFO("Checked %d segments (%d reused)", cache_misses, cache_hits);
 
     ROS_INFO("Original path: waypoint count: %zu, cost: %0.3f", pin.size(), prev_cost);
     ROS_INFO("Shortcutted path: waypount_count: %zu, cost: %0.3f", pout.size(), next_cost);
@@ -475,8 +634,22 @@ bool ComputePositionVelocityPathCosts(
 }
 
 bool InterpolatePath(CollisionChecker& cc, std::vector<RobotState>& path)
+{
+    FlatPath opath;
+    if (!InterpolatePath(cc, path, opath)) {
+        return false;
+    }
+    opath.toPath(path);
+    return true;
+}
+
+bool InterpolatePath(
+    CollisionChecker& cc,
+    const std::vector<RobotState>& path,
+    FlatPath& opath)
 {
     if (path.empty()) {
+        opath.clear();
         return true;
     }
 
@@ -488,7 +661,8 @@ bool InterpolatePath(CollisionChecker& cc, std::vector<RobotState>& path)
         }
     }
 
-    std::vector<RobotState> opath;
+    opath.reset(num_joints);
+    opath.reserve(path.size());
 
     // tack on the first point of the trajectory
     opath.push_back(path.front());
@@ -500,40 +674,26 @@ bool InterpolatePath(CollisionChecker& cc, std::vector<RobotState>& path)
 
         ROS_DEBUG_STREAM("Interpolating between " << start << " and " << end);
 
-        std::vector<RobotState> ipath;
-        if (!cc.interpolatePath(start, end, ipath)) {
+        // append the interpolated waypoints after start (we already have the
+        // first waypoint in the path from last iteration), checking them for
+        // collisions as they are generated, as the interpolator may take a
+        // slightly different path than the one that was checked
+        bool valid;
+        if (!cc.appendInterpolatedPath(start, end, opath, valid)) {
             ROS_ERROR("Failed to interpolate between waypoint %zu and %zu because it's infeasible given the limits.", i, i + 1);
             return false;
         }
 
-        // check the interpolated path for collisions, as the interpolator may
-        // take a slightly different
-        bool collision = false;
-        for (const auto& point : ipath) {
-            double dist;
-            if (!cc.isStateValid(point, false, false, dist)) {
-                collision = true;
-                break;
-            }
-        }
-
-        if (collision) {
+        if (!valid) {
             ROS_ERROR("Interpolated path collides. Resorting to original waypoints");
             opath.push_back(end);
             continue;
         }
 
-        if (!ipath.empty()) {
-            // concatenate current path and the intermediate path (we already
-            // have the first waypoint in the path from last iteration)
-            opath.insert(opath.end(), std::next(ipath.begin()), ipath.end());
-        }
-
         ROS_DEBUG("[%zu] path length: %zu", i, opath.size());
     }
 
     ROS_INFO("Original path length: %zu   Interpolated path length: %zu", path.size(), opath.size());
-    path = std::move(opath);
     return true;
 }
 
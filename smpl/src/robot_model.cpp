@@ -81,9 +81,45 @@ ForwardKinematicsInterface::~ForwardKinematicsInterface()
 {
 }
 
+bool ForwardKinematicsInterface::computeBatchPlanningLinkFK(
+    const std::vector<RobotState>& states,
+    std::vector<std::vector<double>>& poses)
+{
+    poses.resize(states.size());
+    bool res = true;
+    for (size_t i = 0; i < states.size(); ++i) {
+        if (!computePlanningLinkFK(states[i], poses[i])) {
+            res = false;
+        }
+    }
+    return res;
+}
+
 InverseKinematicsInterface::~InverseKinematicsInterface()
 {
 }
 
+bool RedundantManipulatorInterface::computeBatchFastIK(
+    const std::vector<std::vector<double>>& poses,
+    const RobotState& start,
+    std::vector<RobotState>& solutions)
+{
+    solutions.resize(poses.size());
+    for (size_t i = 0; i < poses.size(); ++i) {
+        const RobotState& seed = i == 0 ? start : solutions[i - 1];
+        if (!computeFastIK(poses[i], seed, solutions[i])) {
+            solutions.resize(i);
+            return false;
+        }
+    }
+    return true;
+}
+
+int RedundantManipulatorInterface::ikSolutionBranch(
+    const RobotState& state) const
+{
+    return -1;
+}
+
 } // namespace motion
 } // namespace sbpl
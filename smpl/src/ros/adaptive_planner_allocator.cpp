@@ -53,6 +53,11 @@ SBPLPlannerPtr AdaptivePlannerAllocator::allocate(
     pspace->params()->param("epsilon_track", epsilon_track, 1.0);
     search->set_track_eps(epsilon_track);
 
+    bool incremental_repair;
+    pspace->params()->param(
+            "incremental_repair", incremental_repair, search->incrementalRepair());
+    search->setIncrementalRepair(incremental_repair);
+
     AdaptivePlanner::TimeParameters tparams;
     tparams.planning.bounded = true;
     tparams.planning.improve = false;
@@ -58,6 +58,16 @@ SBPLPlannerPtr ARAPlannerAllocator::allocate(
         search->setAllowedRepairTime(repair_time);
     }
 
+    bool incremental_repair;
+    pspace->params()->param("incremental_repair", incremental_repair, false);
+    search->setIncrementalRepair(incremental_repair);
+
+    // megabytes of search state storage retained between queries
+    double memory_limit_mb;
+    if (pspace->params()->getParam("search_memory_limit", memory_limit_mb)) {
+        search->setMemoryLimit((size_t)(memory_limit_mb * 1024.0 * 1024.0));
+    }
+
     return search;
 }
 
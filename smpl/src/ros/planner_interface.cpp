@@ -37,6 +37,7 @@
 #include <algorithm>
 #include <fstream>
 #include <chrono>
+#include <limits>
 #include <utility>
 
 // system includes
@@ -56,6 +57,7 @@
 #include <smpl/types.h>
 
 #include <smpl/debug/visualize.h>
+#include <smpl/graph/manip_lattice.h>
 
 #include <smpl/heuristic/bfs_heuristic.h>
 #include <smpl/heuristic/egraph_bfs_heuristic.h>
@@ -75,6 +77,7 @@
 #include <smpl/ros/manip_lattice_egraph_allocator.h>
 #include <smpl/ros/mhaplanner_allocator.h>
 #include <smpl/ros/multi_frame_bfs_heuristic_allocator.h>
+#include <smpl/ros/parallel_astar_allocator.h>
 #include <smpl/ros/workspace_lattice_allocator.h>
 
 namespace sbpl {
@@ -82,6 +85,30 @@ namespace motion {
 
 const char* PI_LOGGER = "simple";
 
+static bool IsSameGoal(const GoalConstraint& a, const GoalConstraint& b)
+{
+    if (a.type != b.type) {
+        return false;
+    }
+    switch (a.type) {
+    case GoalType::JOINT_STATE_GOAL:
+        return a.angles == b.angles && a.angle_tolerances == b.angle_tolerances;
+    case GoalType::XYZ_GOAL:
+    case GoalType::XYZ_RPY_GOAL:
+        for (int i = 0; i < 3; ++i) {
+            if (a.xyz_offset[i] != b.xyz_offset[i] ||
+                a.xyz_tolerance[i] != b.xyz_tolerance[i] ||
+                a.rpy_tolerance[i] != b.rpy_tolerance[i])
+            {
+                return false;
+            }
+        }
+        return a.pose == b.pose && a.tgt_off_pose == b.tgt_off_pose;
+    default:
+        return false;
+    }
+}
+
 PlannerInterface::PlannerInterface(
     RobotModel* robot,
     CollisionChecker* checker,
@@ -93,11 +120,17 @@ PlannerInterface::PlannerInterface(
     m_fk_iface(nullptr),
     m_params(),
     m_initialized(false),
+    m_thread_context_factory(),
+    m_thread_context_updater(),
+    m_thread_robots(),
+    m_thread_checkers(),
+    m_thread_contexts_synced(false),
     m_pspace(),
     m_heuristics(),
     m_planner(),
     m_sol_cost(INFINITECOST),
     m_planner_id(),
+    m_repair_search(false),
     m_req(),
     m_res()
 {
@@ -147,6 +180,8 @@ PlannerInterface::PlannerInterface(
             "egwastar", std::make_shared<ExperienceGraphPlannerAllocator>()));
     m_planner_allocators.insert(std::make_pair(
             "padastar", std::make_shared<AdaptivePlannerAllocator>()));
+    m_planner_allocators.insert(std::make_pair(
+            "pase", std::make_shared<ParallelAStarAllocator>()));
 }
 
 PlannerInterface::~PlannerInterface()
@@ -183,6 +218,38 @@ bool PlannerInterface::init(const PlanningParams& params)
     return m_initialized;
 }
 
+/// \brief Set the function used to create the robot models and collision
+///     checkers of additional planning threads.
+///
+/// When the "num_threads" param is greater than 1, planning spaces that support
+/// it check successors concurrently on num_threads - 1 additional threads, each
+/// with its own robot model and collision checker created by the factory. The
+/// created instances must reflect the current state of the collision checker
+/// given to the planner interface. They are owned by the planner interface and
+/// are brought up to date with the planning scene of each later query by the
+/// thread context updater, or recreated if no updater is set. The collision
+/// checker of the first additional thread is also used to shortcut the planned
+/// path concurrently, and only once it has been brought up to date.
+void PlannerInterface::setThreadContextFactory(
+    const ThreadContextFactory& factory)
+{
+    m_thread_context_factory = factory;
+}
+
+/// \brief Set the function used to update the robot models and collision
+///     checkers of additional planning threads with the planning scene of
+///     each query.
+///
+/// The planning scene passed to solve() is assumed to describe the changes
+/// made to the collision checker given to the planner interface since the
+/// previous query. Changes to the world need not be applied when the collision
+/// checkers share the underlying world state.
+void PlannerInterface::setThreadContextUpdater(
+    const ThreadContextUpdater& updater)
+{
+    m_thread_context_updater = updater;
+}
+
 bool PlannerInterface::checkConstructionArgs() const
 {
     if (!m_robot) {
@@ -227,12 +294,27 @@ bool PlannerInterface::solve(
         return true;
     }
 
+    // bring the planning thread contexts of previous queries up to date
+    m_thread_contexts_synced = false;
+    syncThreadContexts(planning_scene);
+
     // TODO: lazily reinitialize planner when algorithm changes
+    const bool planner_changed = req.planner_id != m_planner_id;
     if (!reinitPlanner(req.planner_id)) {
         res.error_code.val = moveit_msgs::MoveItErrorCodes::FAILURE;
         return false;
     }
 
+    // release graph states created by previous queries, unless the search of
+    // the previous query is to be repaired
+    m_repair_search = prepareRepair(planner_changed);
+    if (!m_repair_search) {
+        ManipLattice* lattice = m_pspace->getExtension<ManipLattice>();
+        if (lattice) {
+            lattice->clearStates();
+        }
+    }
+
     // plan
     res.trajectory_start = planning_scene.robot_state;
     ROS_INFO_NAMED(PI_LOGGER, "Allowed Time (s): %0.3f", req.allowed_planning_time);
@@ -409,6 +491,9 @@ bool PlannerInterface::setGoalConfiguration(
     }
 
     // set sbpl environment goal
+    if (m_repair_search && !IsSameGoal(goal, m_pspace->goal())) {
+        m_repair_search = false;
+    }
     if (!m_pspace->setGoal(goal)) {
         ROS_ERROR("Failed to set goal");
         return false;
@@ -486,6 +571,9 @@ bool PlannerInterface::setGoalPosition(
         goal.pose[5]
     };
 
+    if (m_repair_search && !IsSameGoal(goal, m_pspace->goal())) {
+        m_repair_search = false;
+    }
     if (!m_pspace->setGoal(goal)) {
         ROS_ERROR("Failed to set goal");
         return false;
@@ -518,8 +606,10 @@ bool PlannerInterface::plan(double allowed_time, std::vector<RobotState>& path)
     bool b_ret = false;
     std::vector<int> solution_state_ids;
 
-    // reinitialize the search space
-    m_planner->force_planning_from_scratch();
+    // reinitialize the search space, unless the search is being repaired
+    if (!m_repair_search) {
+        m_planner->force_planning_from_scratch();
+    }
 
     // plan
     b_ret = m_planner->replan(allowed_time, &solution_state_ids, &m_sol_cost);
@@ -1032,6 +1122,8 @@ bool PlannerInterface::reinitPlanner(const std::string& planner_id)
         return false;
     }
 
+    initSuccessorThreads();
+
     auto hait = m_heuristic_allocators.find(heuristic_name);
     if (hait == m_heuristic_allocators.end()) {
         ROS_ERROR("Unrecognized heuristic name '%s'", heuristic_name.c_str());
@@ -1130,6 +1222,133 @@ void PlannerInterface::profilePath(
     }
 }
 
+// Decide whether the search of the previous query may be continued for this
+// query and, if so, notify the search of the edges whose validity may have
+// been changed by updates to the environment since the previous query. Must be
+// called before the start and goal are set, which discard the recorded
+// environment changes. The search is still restarted if the goal turns out to
+// differ from that of the previous query.
+bool PlannerInterface::prepareRepair(bool planner_changed)
+{
+    bool incremental_repair;
+    m_params.param("incremental_repair", incremental_repair, false);
+    if (!incremental_repair || planner_changed) {
+        return false;
+    }
+
+    ChangedEdgesExtension* changed_edges =
+            m_pspace->getExtension<ChangedEdgesExtension>();
+    if (!changed_edges) {
+        ROS_WARN_NAMED(PI_LOGGER, "Planning space does not report changed edges. Planning from scratch");
+        return false;
+    }
+
+    std::vector<int> sources;
+    changed_edges->getChangedEdgeSources(sources);
+    ROS_INFO_NAMED(PI_LOGGER, "Repair search for %zu states with changed edges", sources.size());
+    m_planner->costs_changed(ChangedEdgesQuery(std::move(sources)));
+    return true;
+}
+
+// Create the robot models and collision checkers for the additional threads
+// requested by the "num_threads" param, if they have not been created already,
+// and return the number of additional threads that may be used.
+size_t PlannerInterface::initThreadContexts()
+{
+    int num_threads;
+    m_params.param("num_threads", num_threads, 1);
+    if (num_threads <= 1) {
+        return 0;
+    }
+
+    const size_t extra_count = (size_t)(num_threads - 1);
+    if (m_thread_checkers.size() < extra_count && !m_thread_context_factory) {
+        ROS_WARN_NAMED(PI_LOGGER, "No thread context factory set. Ignoring request for %d planning threads", num_threads);
+        return m_thread_checkers.size();
+    }
+
+    while (m_thread_checkers.size() < extra_count) {
+        std::unique_ptr<RobotModel> robot;
+        std::unique_ptr<CollisionChecker> checker;
+        if (!m_thread_context_factory(robot, checker) || !robot || !checker) {
+            ROS_WARN_NAMED(PI_LOGGER, "Failed to create context for planning thread %zu", m_thread_checkers.size() + 1);
+            break;
+        }
+        m_thread_robots.push_back(std::move(robot));
+        m_thread_checkers.push_back(std::move(checker));
+    }
+
+    return std::min(extra_count, m_thread_checkers.size());
+}
+
+// Give the planning space, if it checks successors concurrently, the robot
+// models and collision checkers of the additional planning threads
+void PlannerInterface::initSuccessorThreads()
+{
+    ManipLattice* lattice = m_pspace->getExtension<ManipLattice>();
+    if (!lattice) {
+        return;
+    }
+
+    const size_t thread_count = initThreadContexts();
+    std::vector<RobotModel*> robots;
+    std::vector<CollisionChecker*> checkers;
+    for (size_t i = 0; i < thread_count; ++i) {
+        robots.push_back(m_thread_robots[i].get());
+        checkers.push_back(m_thread_checkers[i].get());
+    }
+    if (!lattice->setSuccessorThreadContexts(robots, checkers)) {
+        ROS_WARN_NAMED(PI_LOGGER, "Failed to set successor thread contexts. Successors will be checked serially");
+    }
+}
+
+// Apply the planning scene of a query to the thread contexts created for
+// previous queries. If any context can not be updated, all contexts are
+// discarded and recreated by the factory, which reflects the current state.
+void PlannerInterface::syncThreadContexts(
+    const moveit_msgs::PlanningScene& scene)
+{
+    if (m_thread_checkers.empty()) {
+        // contexts created for this query are created from the current state
+        m_thread_contexts_synced = true;
+        return;
+    }
+
+    if (m_thread_context_updater) {
+        bool updated = true;
+        for (size_t i = 0; i < m_thread_checkers.size(); ++i) {
+            if (!m_thread_context_updater(
+                    *m_thread_robots[i], *m_thread_checkers[i], scene))
+            {
+                ROS_WARN_NAMED(PI_LOGGER, "Failed to update context for planning thread %zu", i + 1);
+                updated = false;
+                break;
+            }
+        }
+        if (updated) {
+            m_thread_contexts_synced = true;
+            return;
+        }
+    }
+
+    ROS_INFO_NAMED(PI_LOGGER, "Recreate contexts for %zu planning threads", m_thread_checkers.size());
+
+    // release the planning space's references to the discarded contexts
+    ManipLattice* lattice =
+            m_pspace ? m_pspace->getExtension<ManipLattice>() : nullptr;
+    if (lattice) {
+        lattice->setSuccessorThreadContexts({ }, { });
+    }
+
+    m_thread_checkers.clear();
+    m_thread_robots.clear();
+
+    if (lattice) {
+        initSuccessorThreads();
+    }
+    m_thread_contexts_synced = true;
+}
+
 bool PlannerInterface::isPathValid(
     const std::vector<RobotState>& path) const
 {
@@ -1151,26 +1370,54 @@ void PlannerInterface::postProcessPath(std::vector<RobotState>& path) const
         ROS_ERROR("Planned path is invalid");
     }
 
+    // interpolation buffer shared by both interpolation passes
+    FlatPath ibuf;
+
     // shortcut path
     if (m_params.shortcut_path) {
-        if (!InterpolatePath(*m_checker, path)) {
+        // seconds allowed for shortcutting, unbounded by default
+        double shortcut_time;
+        m_params.param(
+                "shortcut_time",
+                shortcut_time,
+                std::numeric_limits<double>::infinity());
+
+        std::vector<RobotState> ipath;
+        if (!InterpolatePath(*m_checker, path, ibuf)) {
             ROS_WARN_NAMED(PI_LOGGER, "Failed to interpolate planned path with %zu waypoints before shortcutting.", path.size());
-            std::vector<RobotState> ipath = path;
-            path.clear();
-            ShortcutPath(m_robot, m_checker, ipath, path, m_params.shortcut_type);
+            ipath = path;
         }
         else {
-            std::vector<RobotState> ipath = path;
-            path.clear();
-            ShortcutPath(m_robot, m_checker, ipath, path, m_params.shortcut_type);
+            ibuf.toPath(ipath);
         }
+        path.clear();
+
+        // the first planning thread's collision checker is idle after
+        // planning and allows shortcutting strategies to run concurrently,
+        // but only if it has been brought up to date with this query's
+        // planning scene; otherwise, shortcutting runs serially
+        CollisionChecker* aux_checker = nullptr;
+        if (m_thread_contexts_synced && !m_thread_checkers.empty()) {
+            aux_checker = m_thread_checkers[0].get();
+        }
+        ShortcutPath(
+                m_robot,
+                m_checker,
+                ipath,
+                path,
+                m_params.shortcut_type,
+                shortcut_time,
+                aux_checker);
     }
 
     // interpolate path
     if (m_params.interpolate_path) {
-        if (!InterpolatePath(*m_checker, path)) {
+        if (!InterpolatePath(*m_checker, path, ibuf)) {
             ROS_WARN_NAMED(PI_LOGGER, "Failed to interpolate trajectory");
         }
+        else {
+            ibuf.toPath(path);
+        }
     }
 }
 
@@ -49,15 +49,23 @@ AdaptivePlanner::AdaptivePlanner(
     m_planner(pspace.get(), heur.get()),
     m_tracker(pspace.get(), heur.get()),
     m_adaptive_graph(nullptr),
+    m_changed_edges(nullptr),
     m_start_state_id(-1),
     m_goal_state_id(-1),
     m_eps_plan(1.0),
-    m_eps_track(1.0)
+    m_eps_track(1.0),
+    m_phase_stats()
 {
     m_adaptive_graph = pspace->getExtension<AdaptiveGraphExtension>();
     if (!m_adaptive_graph) {
         ROS_WARN("Adaptive Planner recommends Adaptive Graph Extension");
     }
+
+    // keep the search trees of both searches between iterations when the
+    // graph can report the edges changed by adding high-dimensional regions
+    // and moving the tunnel
+    m_changed_edges = pspace->getExtension<ChangedEdgesExtension>();
+    setIncrementalRepair(m_changed_edges != nullptr);
 }
 
 AdaptivePlanner::~AdaptivePlanner()
@@ -65,6 +73,19 @@ AdaptivePlanner::~AdaptivePlanner()
 
 }
 
+/// Enable or disable repairing the search trees of the planning and tracking
+/// searches between iterations. This requires the graph to implement
+/// ChangedEdgesExtension. When disabled, every phase restarts its search.
+void AdaptivePlanner::setIncrementalRepair(bool enabled)
+{
+    if (enabled && !m_changed_edges) {
+        ROS_WARN("Incremental repair requires the Changed Edges Extension");
+        enabled = false;
+    }
+    m_planner.setIncrementalRepair(enabled);
+    m_tracker.setIncrementalRepair(enabled);
+}
+
 int AdaptivePlanner::replan(std::vector<int>* solution, ReplanParams params)
 {
     int cost;
@@ -91,7 +112,11 @@ double AdaptivePlanner::get_solution_eps() const
 
 int AdaptivePlanner::get_n_expands() const
 {
-    return 0;
+    int expands = 0;
+    for (const PlannerStats& stats : m_phase_stats) {
+        expands += stats.expands;
+    }
+    return expands;
 }
 
 double AdaptivePlanner::get_initial_eps()
@@ -106,7 +131,11 @@ double AdaptivePlanner::get_initial_eps_planning_time()
 
 double AdaptivePlanner::get_final_eps_planning_time()
 {
-    return 0.0;
+    double time = 0.0;
+    for (const PlannerStats& stats : m_phase_stats) {
+        time += stats.time;
+    }
+    return time;
 }
 
 int AdaptivePlanner::get_n_expands_init_solution()
@@ -119,9 +148,11 @@ double AdaptivePlanner::get_final_epsilon()
     return 0.0;
 }
 
+/// Return the statistics of each phase of the last call to replan(). Phases
+/// alternate between planning and tracking, beginning with planning.
 void AdaptivePlanner::get_search_stats(std::vector<PlannerStats>* s)
 {
-
+    s->insert(s->end(), m_phase_stats.begin(), m_phase_stats.end());
 }
 
 void AdaptivePlanner::set_initialsolution_eps(double initialsolution_eps)
@@ -153,6 +184,8 @@ int AdaptivePlanner::replan(
     std::vector<int>* solution,
     int* cost)
 {
+    m_phase_stats.clear();
+
     if (m_start_state_id == -1 || m_goal_state_id == -1) {
         ROS_ERROR("Start or goal state is not set");
         return !NO_START_OR_GOAL_SET;
@@ -167,6 +200,10 @@ int AdaptivePlanner::replan(
 
     m_tracker.allowPartialSolutions(true);
 
+    // the goal may have changed without changing the goal state id
+    m_planner.force_planning_from_scratch();
+    m_tracker.force_planning_from_scratch();
+
     m_adaptive_graph->addHighDimRegion(m_start_state_id);
     m_adaptive_graph->addHighDimRegion(m_goal_state_id);
 
@@ -197,24 +234,16 @@ int AdaptivePlanner::replan(
     while (!done) {
         ++iter_count;
 
-        plan_path.clear();
         int plan_cost = -1;
         auto plan_start = clock::now();
         m_adaptive_graph->setPlanMode();
-        m_planner.force_planning_from_scratch();
         ROS_INFO("Time remaining: %0.3fs. Plan low-dimensional path", time_remaining);
-        ARAStar::TimeParameters time_params = m_time_params.planning;
-        time_params.max_allowed_time_init = to_duration(time_remaining);
-        time_params.max_allowed_time = std::min(time_params.max_allowed_time, to_duration(time_remaining));
-        res = m_planner.replan(time_params, &plan_path, &plan_cost);
-        auto plan_finish = clock::now();
-
+        res = runPhase(
+                m_planner, m_time_params.planning, time_remaining,
+                iter_count > 1, plan_start, plan_path, plan_cost);
+        const PlannerStats plan_stats = m_phase_stats.back();
         ROS_INFO("Planner terminated");
-        ROS_INFO("  Path: %s", to_string(plan_path).c_str());
-        ROS_INFO("  Cost: %d", plan_cost);
-        ROS_INFO("  Time: %0.3f", m_planner.get_final_eps_planning_time());
-        ROS_INFO("  Expansions: %d", m_planner.get_n_expands());
-        ROS_INFO("  Suboptimality Bound: %0.3f", m_planner.get_solution_eps());
+        logPhase(plan_path, plan_stats);
 
         if (!res) {
             ROS_WARN("Failed to find least-cost path in G^ad");
@@ -228,7 +257,7 @@ int AdaptivePlanner::replan(
             return !SUCCESS;
         }
 
-        time_remaining -= to_seconds(plan_finish - plan_start);
+        time_remaining -= plan_stats.time;
         time_remaining = std::max(0.0, time_remaining);
 
         if (time_remaining == 0.0) {
@@ -236,26 +265,18 @@ int AdaptivePlanner::replan(
             return !TIMED_OUT;
         }
 
-        track_path.clear();
         int track_cost = -1;
         auto track_start = clock::now();
         m_adaptive_graph->setTrackMode(plan_path);
-        m_tracker.force_planning_from_scratch();
         ROS_INFO("Time remaining: %0.3fs. Track low-dimensional path", time_remaining);
-        time_params = m_time_params.tracking;
-        time_params.max_allowed_time_init = to_duration(time_remaining);
-        time_params.max_allowed_time = std::min(time_params.max_allowed_time, to_duration(time_remaining));
-        res = m_tracker.replan(time_params, &track_path, &track_cost);
-        auto track_finish = clock::now();
-
+        res = runPhase(
+                m_tracker, m_time_params.tracking, time_remaining,
+                iter_count > 1, track_start, track_path, track_cost);
+        const PlannerStats track_stats = m_phase_stats.back();
         ROS_INFO("Tracker terminated");
-        ROS_INFO("  Path: %s", to_string(track_path).c_str());
-        ROS_INFO("  Cost: %d", track_cost);
-        ROS_INFO("  Time: %0.3f", m_tracker.get_final_eps_planning_time());
-        ROS_INFO("  Expansions: %d", m_tracker.get_n_expands());
-        ROS_INFO("  Suboptimality Bound: %0.3f", m_tracker.get_solution_eps());
+        logPhase(track_path, track_stats);
 
-        time_remaining -= to_seconds(plan_finish - plan_start);
+        time_remaining -= track_stats.time;
         time_remaining = std::max(0.0, time_remaining);
 
         auto select_random_path_state = [this](const std::vector<int>& path)
@@ -342,5 +363,70 @@ void AdaptivePlanner::costs_changed(const StateChangeQuery& state_change)
 
 }
 
+// Run one planning or tracking phase, beginning at phase_start, within the
+// remaining time, and record its statistics. The search resumes from its
+// previous phase if resume is true and the graph is unchanged since then.
+int AdaptivePlanner::runPhase(
+    ARAStar& search,
+    ARAStar::TimeParameters time_params,
+    double time_remaining,
+    bool resume,
+    const clock::time_point& phase_start,
+    std::vector<int>& path,
+    int& cost)
+{
+    // expansion counts are reset when the search is restarted or repaired
+    const bool resumed = updateSearchTree(search) && resume;
+    const int prev_expands = resumed ? search.get_n_expands() : 0;
+
+    time_params.max_allowed_time_init = to_duration(time_remaining);
+    time_params.max_allowed_time = std::min(time_params.max_allowed_time, to_duration(time_remaining));
+
+    path.clear();
+    const int res = search.replan(time_params, &path, &cost);
+    const auto phase_finish = clock::now();
+
+    PlannerStats stats;
+    stats.eps = search.get_solution_eps();
+    stats.cost = cost;
+    stats.time = to_seconds(phase_finish - phase_start);
+    stats.expands = search.get_n_expands() - prev_expands;
+    m_phase_stats.push_back(stats);
+    return res;
+}
+
+void AdaptivePlanner::logPhase(
+    const std::vector<int>& path,
+    const PlannerStats& stats) const
+{
+    ROS_INFO("  Path: %s", to_string(path).c_str());
+    ROS_INFO("  Cost: %d", stats.cost);
+    ROS_INFO("  Time: %0.3f", stats.time);
+    ROS_INFO("  Expansions: %d", stats.expands);
+    ROS_INFO("  Suboptimality Bound: %0.3f", stats.eps);
+}
+
+// Notify a search of the edges changed since it last searched the graph in the
+// current mode, so that it may repair its search tree, or restart the search
+// if the changes can't be determined or incremental repair is disabled.
+// Return whether the graph is unchanged and the search may resume as it left
+// off.
+bool AdaptivePlanner::updateSearchTree(ARAStar& search)
+{
+    if (!m_changed_edges || !search.incrementalRepair()) {
+        search.force_planning_from_scratch();
+        return false;
+    }
+
+    std::vector<int> changed_states;
+    m_changed_edges->getChangedEdgeSources(changed_states);
+    if (changed_states.empty()) {
+        return true;
+    }
+
+    search.costs_changed(ChangedEdgesQuery(std::move(changed_states)));
+    return false;
+}
+
 } // namespace motion
 } // namespace sbpl
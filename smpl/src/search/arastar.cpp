@@ -31,6 +31,11 @@
 
 #include <smpl/search/arastar.h>
 
+// standard includes
+#include <algorithm>
+#include <limits>
+#include <new>
+
 // system includes
 #include <ros/console.h>
 #include <sbpl/utils/key.h>
@@ -55,10 +60,15 @@ ARAStar::ARAStar(
     m_final_eps(1.0),
     m_delta_eps(1.0),
     m_allow_partial_solutions(false),
-    m_states(),
+    m_incremental(false),
+    m_state_blocks(),
+    m_state_count(0),
+    m_memory_limit(std::numeric_limits<size_t>::max()),
     m_start_state_id(-1),
     m_goal_state_id(-1),
     m_graph_to_search_map(),
+    m_succ_ids(),
+    m_succ_costs(),
     m_open(),
     m_incons(),
     m_curr_eps(1.0),
@@ -86,8 +96,23 @@ ARAStar::ARAStar(
 
 ARAStar::~ARAStar()
 {
-    for (SearchState* s : m_states) {
-        delete s;
+}
+
+/// Set the maximum number of bytes of search state storage retained between
+/// searches. Storage in excess of the limit is released when the search is
+/// next reinitialized.
+void ARAStar::setMemoryLimit(size_t bytes)
+{
+    m_memory_limit = bytes;
+}
+
+/// Enable or disable caching of successors and repair of the search tree in
+/// costs_changed(). Changing the mode restarts the search from scratch.
+void ARAStar::setIncrementalRepair(bool enabled)
+{
+    if (enabled != m_incremental) {
+        m_incremental = enabled;
+        force_planning_from_scratch();
     }
 }
 
@@ -119,18 +144,17 @@ int ARAStar::replan(
 
     m_time_params = params;
 
-    SearchState* start_state = getSearchState(m_start_state_id);
-    SearchState* goal_state = getSearchState(m_goal_state_id);
-
     if (m_start_state_id != m_last_start_state_id) {
         ROS_DEBUG_NAMED(SLOG, "Reinitialize search");
         m_open.clear();
         m_incons.clear();
-        ++m_call_number; // trigger state reinitializations
+        clearStates();
+    }
 
-        reinitSearchState(start_state);
-        reinitSearchState(goal_state);
+    SearchState* start_state = getSearchState(m_start_state_id);
+    SearchState* goal_state = getSearchState(m_goal_state_id);
 
+    if (m_start_state_id != m_last_start_state_id) {
         start_state->g = 0;
         start_state->f = computeKey(start_state);
         m_open.push(start_state);
@@ -286,13 +310,9 @@ int ARAStar::force_planning_from_scratch_and_free_memory()
 {
     force_planning_from_scratch();
     m_open.clear();
-    m_graph_to_search_map.clear();
-    m_graph_to_search_map.shrink_to_fit();
-    for (SearchState* s : m_states) {
-        delete s;
-    }
-    m_states.clear();
-    m_states.shrink_to_fit();
+    m_incons.clear();
+    clearStates();
+    trimStates(0);
     return 0;
 }
 
@@ -385,16 +405,36 @@ int ARAStar::set_search_mode(bool first_solution_unbounded)
     return 0;
 }
 
-/// Notify the search of changes to edge costs in the graph.
+/// Notify the search of changes to edge costs in the graph. The predecessors
+/// reported by the query are the states whose outgoing edges changed. Unless
+/// incremental repair is enabled, the search is restarted from scratch. The
+/// heuristics of all states are reevaluated by the next call to replan().
 void ARAStar::costs_changed(const StateChangeQuery& changes)
 {
-    force_planning_from_scratch();
+    const std::vector<int>* changed_states = changes.getPredecessors();
+    if (!m_incremental || !changed_states) {
+        force_planning_from_scratch();
+        return;
+    }
+
+    // the search tree is discarded anyway if the start state has changed
+    if (m_last_start_state_id < 0 ||
+        m_start_state_id != m_last_start_state_id)
+    {
+        return;
+    }
+
+    repairSearchTree(*changed_states);
+
+    // heuristics may depend on the environment that changed
+    m_last_goal_state_id = -1;
 }
 
 // Recompute heuristics for all states.
 void ARAStar::recomputeHeuristics()
 {
-    for (SearchState* s : m_states) {
+    for (size_t i = 0; i < m_state_count; ++i) {
+        SearchState* s = stateAt(i);
         s->h = m_heur->GetGoalHeuristic(s->state_id);
     }
 }
@@ -520,36 +560,260 @@ int ARAStar::improvePath(
 // and INCONS list appropriately.
 void ARAStar::expand(SearchState* s)
 {
+    if (m_incremental && s->succs_begin >= 0) {
+        ROS_DEBUG_NAMED(SELOG, "  %d cached successors", s->succs_count);
+        const int succs_end = s->succs_begin + s->succs_count;
+        for (int i = s->succs_begin; i < succs_end; ++i) {
+            updateSuccessor(s, getSearchState(m_succ_ids[i]), m_succ_costs[i]);
+        }
+        return;
+    }
+
     std::vector<int> succs;
     std::vector<int> costs;
     m_space->GetSuccs(s->state_id, &succs, &costs);
 
     ROS_DEBUG_NAMED(SELOG, "  %zu successors", succs.size());
 
+    if (m_incremental) {
+        cacheSuccessors(s, succs, costs);
+    }
+
     for (size_t sidx = 0; sidx < succs.size(); ++sidx) {
-        int succ_state_id = succs[sidx];
-        int cost = costs[sidx];
-
-        SearchState* succ_state = getSearchState(succ_state_id);
-        reinitSearchState(succ_state);
-
-        int new_cost = s->eg + cost;
-        ROS_DEBUG_NAMED(SELOG, "Compare new cost %d vs old cost %d", new_cost, succ_state->g);
-        if (new_cost < succ_state->g) {
-            succ_state->g = new_cost;
-            succ_state->bp = s;
-            if (succ_state->iteration_closed != m_iteration) {
-                succ_state->f = computeKey(succ_state);
-                if (m_open.contains(succ_state)) {
-                    m_open.decrease(succ_state);
-                } else {
-                    m_open.push(succ_state);
+        updateSuccessor(s, getSearchState(succs[sidx]), costs[sidx]);
+    }
+}
+
+// Update the cost-to-come of a successor of an expanded state, placing it into
+// OPEN or INCONS as appropriate.
+void ARAStar::updateSuccessor(SearchState* s, SearchState* succ_state, int cost)
+{
+    int new_cost = s->eg + cost;
+    ROS_DEBUG_NAMED(SELOG, "Compare new cost %d vs old cost %d", new_cost, succ_state->g);
+    if (new_cost < succ_state->g) {
+        succ_state->g = new_cost;
+        succ_state->bp = s;
+        if (succ_state->iteration_closed != m_iteration) {
+            succ_state->f = computeKey(succ_state);
+            if (m_open.contains(succ_state)) {
+                m_open.decrease(succ_state);
+            } else {
+                m_open.push(succ_state);
+            }
+        } else if (!succ_state->incons) {
+            succ_state->incons = true;
+            m_incons.push_back(succ_state);
+        }
+    }
+}
+
+// Store the successors of a state, replacing any previously cached successors.
+void ARAStar::cacheSuccessors(
+    SearchState* s,
+    const std::vector<int>& succs,
+    const std::vector<int>& costs)
+{
+    s->succs_begin = (int)m_succ_ids.size();
+    s->succs_count = (int)succs.size();
+    m_succ_ids.insert(m_succ_ids.end(), succs.begin(), succs.end());
+    m_succ_costs.insert(m_succ_costs.end(), costs.begin(), costs.end());
+}
+
+// Discard the successors cached for states whose successors have since been
+// regenerated, once they make up more than half of the cache.
+void ARAStar::compactSuccessors()
+{
+    size_t live_count = 0;
+    for (size_t i = 0; i < m_state_count; ++i) {
+        const SearchState* s = stateAt(i);
+        if (s->succs_begin >= 0) {
+            live_count += s->succs_count;
+        }
+    }
+
+    if (2 * live_count >= m_succ_ids.size()) {
+        return;
+    }
+
+    std::vector<int> succ_ids;
+    std::vector<int> succ_costs;
+    succ_ids.reserve(live_count);
+    succ_costs.reserve(live_count);
+    for (size_t i = 0; i < m_state_count; ++i) {
+        SearchState* s = stateAt(i);
+        if (s->succs_begin < 0) {
+            continue;
+        }
+        const int succs_end = s->succs_begin + s->succs_count;
+        const int succs_begin = (int)succ_ids.size();
+        succ_ids.insert(
+                succ_ids.end(),
+                m_succ_ids.begin() + s->succs_begin,
+                m_succ_ids.begin() + succs_end);
+        succ_costs.insert(
+                succ_costs.end(),
+                m_succ_costs.begin() + s->succs_begin,
+                m_succ_costs.begin() + succs_end);
+        s->succs_begin = succs_begin;
+    }
+
+    ROS_DEBUG_NAMED(SLOG, "Compacted successor cache from %zu to %zu entries", m_succ_ids.size(), succ_ids.size());
+    m_succ_ids.swap(succ_ids);
+    m_succ_costs.swap(succ_costs);
+}
+
+enum RepairStatus
+{
+    REPAIR_UNKNOWN = 0,
+    REPAIR_KEPT,
+    REPAIR_DISCARDED
+};
+
+// Regenerate the outgoing edges of states whose edges changed, discard the
+// parts of the search tree reached through edges that were removed or became
+// more expensive, and reconnect the discarded states through the cached edges
+// of the remaining states. A new search iteration is then begun from the
+// initial suboptimality bound.
+void ARAStar::repairSearchTree(const std::vector<int>& changed_states)
+{
+    for (size_t i = 0; i < m_state_count; ++i) {
+        stateAt(i)->repair_status = REPAIR_UNKNOWN;
+    }
+
+    std::vector<int> changed_ids(changed_states);
+    std::sort(changed_ids.begin(), changed_ids.end());
+    changed_ids.erase(
+            std::unique(changed_ids.begin(), changed_ids.end()),
+            changed_ids.end());
+
+    // regenerate the edges of states that have been expanded and discard the
+    // tree children whose edges were removed or became more expensive. states
+    // that haven't been expanded will generate their new edges when expanded
+    std::vector<SearchState*> sources;
+    std::vector<int> succs;
+    std::vector<int> costs;
+    for (int state_id : changed_ids) {
+        SearchState* s = findSearchState(state_id);
+        if (!s || s->succs_begin < 0) {
+            continue;
+        }
+
+        m_space->GetSuccs(state_id, &succs, &costs);
+
+        const int succs_end = s->succs_begin + s->succs_count;
+        for (int i = s->succs_begin; i < succs_end; ++i) {
+            SearchState* t = findSearchState(m_succ_ids[i]);
+            if (!t || t->bp != s) {
+                continue;
+            }
+
+            int new_cost = INFINITECOST;
+            for (size_t j = 0; j < succs.size(); ++j) {
+                if (succs[j] == m_succ_ids[i]) {
+                    new_cost = std::min(new_cost, costs[j]);
                 }
-            } else if (!succ_state->incons) {
-                m_incons.push_back(succ_state);
+            }
+            if (new_cost > m_succ_costs[i]) {
+                t->repair_status = REPAIR_DISCARDED;
+            }
+        }
+
+        cacheSuccessors(s, succs, costs);
+        sources.push_back(s);
+    }
+
+    // the regenerated edges replace, rather than overwrite, the cached edges
+    compactSuccessors();
+
+    // discard every state whose back pointer chain passes through a discarded
+    // state
+    std::vector<SearchState*> chain;
+    size_t discard_count = 0;
+    for (size_t i = 0; i < m_state_count; ++i) {
+        chain.clear();
+        SearchState* a = stateAt(i);
+        while (a && a->repair_status == REPAIR_UNKNOWN) {
+            chain.push_back(a);
+            a = a->bp;
+        }
+        const int status = (a && a->repair_status == REPAIR_DISCARDED) ?
+                REPAIR_DISCARDED : REPAIR_KEPT;
+        for (SearchState* c : chain) {
+            c->repair_status = status;
+        }
+    }
+
+    for (size_t i = 0; i < m_state_count; ++i) {
+        SearchState* s = stateAt(i);
+        if (s->repair_status != REPAIR_DISCARDED) {
+            continue;
+        }
+        if (m_open.contains(s)) {
+            m_open.erase(s);
+        }
+        s->g = INFINITECOST;
+        s->f = INFINITECOST;
+        s->eg = INFINITECOST;
+        s->iteration_closed = 0;
+        s->bp = nullptr;
+        s->incons = false;
+        ++discard_count;
+    }
+
+    auto discarded = [](SearchState* s) {
+        return s->repair_status == REPAIR_DISCARDED;
+    };
+    m_incons.erase(
+            std::remove_if(m_incons.begin(), m_incons.end(), discarded),
+            m_incons.end());
+
+    // reconnect discarded states through the cached edges of the remaining
+    // expanded states
+    for (size_t i = 0; i < m_state_count; ++i) {
+        SearchState* s = stateAt(i);
+        if (s->repair_status == REPAIR_DISCARDED ||
+            s->succs_begin < 0 ||
+            s->eg == INFINITECOST)
+        {
+            continue;
+        }
+        const int succs_end = s->succs_begin + s->succs_count;
+        for (int j = s->succs_begin; j < succs_end; ++j) {
+            SearchState* t = findSearchState(m_succ_ids[j]);
+            if (t && t->repair_status == REPAIR_DISCARDED) {
+                updateSuccessor(s, t, m_succ_costs[j]);
             }
         }
     }
+
+    // propagate decreased costs along the regenerated edges
+    for (SearchState* s : sources) {
+        if (s->repair_status == REPAIR_DISCARDED || s->eg == INFINITECOST) {
+            continue;
+        }
+        const int succs_end = s->succs_begin + s->succs_count;
+        for (int j = s->succs_begin; j < succs_end; ++j) {
+            updateSuccessor(s, getSearchState(m_succ_ids[j]), m_succ_costs[j]);
+        }
+    }
+
+    ROS_DEBUG_NAMED(SLOG, "Repaired search tree: regenerated edges of %zu states, discarded %zu of %zu states", sources.size(), discard_count, m_state_count);
+
+    // begin a new search iteration
+    ++m_iteration;
+    m_curr_eps = m_initial_eps;
+    m_satisfied_eps = std::numeric_limits<double>::infinity();
+    for (SearchState* s : m_incons) {
+        s->incons = false;
+        m_open.push(s);
+    }
+    m_incons.clear();
+    reorderOpen();
+
+    m_expand_count_init = 0;
+    m_search_time_init = clock::duration::zero();
+    m_expand_count = 0;
+    m_search_time = clock::duration::zero();
 }
 
 // Recompute the f-values of all states in OPEN and reorder OPEN.
@@ -567,18 +831,35 @@ int ARAStar::computeKey(SearchState* s) const
 }
 
 // Get the search state corresponding to a graph state, creating a new state if
-// one has not been created yet.
+// one has not been created yet in the current generation.
 ARAStar::SearchState* ARAStar::getSearchState(int state_id)
 {
     if (m_graph_to_search_map.size() <= state_id) {
-        m_graph_to_search_map.resize(state_id + 1, -1);
+        m_graph_to_search_map.resize(state_id + 1, nullptr);
     }
 
-    if (m_graph_to_search_map[state_id] == -1) {
-        return createState(state_id);
+    // entries may refer to storage reused by another graph state since the
+    // generation in which they were created
+    SearchState* s = m_graph_to_search_map[state_id];
+    if (s && s->call_number == m_call_number && s->state_id == state_id) {
+        return s;
     } else {
-        return m_states[m_graph_to_search_map[state_id]];
+        return createState(state_id);
+    }
+}
+
+// Return the search state corresponding to a graph state, or nullptr if one
+// has not been created in the current generation.
+ARAStar::SearchState* ARAStar::findSearchState(int state_id) const
+{
+    if (state_id < 0 || state_id >= m_graph_to_search_map.size()) {
+        return nullptr;
     }
+    SearchState* s = m_graph_to_search_map[state_id];
+    if (s && s->call_number == m_call_number && s->state_id == state_id) {
+        return s;
+    }
+    return nullptr;
 }
 
 // Create a new search state for a graph state.
@@ -586,29 +867,79 @@ ARAStar::SearchState* ARAStar::createState(int state_id)
 {
     assert(state_id < m_graph_to_search_map.size());
 
-    m_graph_to_search_map[state_id] = (int)m_states.size();
+    if (m_state_count == m_state_blocks.size() * StateBlockSize) {
+        m_state_blocks.emplace_back(new SearchState[StateBlockSize]);
+    }
 
-    SearchState* ss = new SearchState;
+    SearchState* ss = new (stateAt(m_state_count++)) SearchState;
     ss->state_id = state_id;
-    ss->call_number = 0;
-    m_states.push_back(ss);
-
+    ss->g = INFINITECOST;
+    ss->h = m_heur->GetGoalHeuristic(state_id);
+    ss->f = INFINITECOST;
+    ss->eg = INFINITECOST;
+    ss->iteration_closed = 0;
+    ss->call_number = m_call_number;
+    ss->bp = nullptr;
+    ss->incons = false;
+    ss->succs_begin = -1;
+    ss->succs_count = 0;
+    ss->repair_status = 0;
+
+    m_graph_to_search_map[state_id] = ss;
     return ss;
 }
 
-// Lazily (re)initialize a search state.
-void ARAStar::reinitSearchState(SearchState* state)
+ARAStar::SearchState* ARAStar::stateAt(size_t index) const
 {
-    if (state->call_number != m_call_number) {
-        ROS_DEBUG_NAMED(SELOG, "Reinitialize state %d", state->state_id);
-        state->g = INFINITECOST;
-        state->h = m_heur->GetGoalHeuristic(state->state_id);
-        state->f = INFINITECOST;
-        state->eg = INFINITECOST;
-        state->iteration_closed = 0;
-        state->call_number = m_call_number;
-        state->bp = nullptr;
-        state->incons = false;
+    return &m_state_blocks[index >> StateBlockShift][index & (StateBlockSize - 1)];
+}
+
+// Release all search states, retaining their storage for the next search up to
+// the memory limit.
+void ARAStar::clearStates()
+{
+    ++m_call_number; // invalidates all entries in the state map
+    m_state_count = 0;
+    m_succ_ids.clear();
+    m_succ_costs.clear();
+    trimStates(m_memory_limit);
+}
+
+// Release search state storage in excess of max_bytes. All search states must
+// have been released.
+void ARAStar::trimStates(size_t max_bytes)
+{
+    assert(m_state_count == 0);
+
+    const size_t block_bytes = StateBlockSize * sizeof(SearchState);
+    const size_t map_bytes =
+            m_graph_to_search_map.capacity() * sizeof(SearchState*);
+    const size_t cache_bytes =
+            (m_succ_ids.capacity() + m_succ_costs.capacity()) * sizeof(int);
+
+    const size_t keep_blocks =
+            std::min(m_state_blocks.size(), max_bytes / block_bytes);
+    size_t remaining_bytes = max_bytes - keep_blocks * block_bytes;
+
+    if (keep_blocks < m_state_blocks.size()) {
+        ROS_DEBUG_NAMED(SLOG, "Release %zu search state blocks", m_state_blocks.size() - keep_blocks);
+        m_state_blocks.resize(keep_blocks);
+        m_state_blocks.shrink_to_fit();
+
+        // the state map may refer to released blocks
+        m_graph_to_search_map.clear();
+    }
+
+    if (map_bytes > remaining_bytes) {
+        m_graph_to_search_map.clear();
+        m_graph_to_search_map.shrink_to_fit();
+    } else {
+        remaining_bytes -= map_bytes;
+    }
+
+    if (cache_bytes > remaining_bytes) {
+        m_succ_ids.shrink_to_fit();
+        m_succ_costs.shrink_to_fit();
     }
 }
 
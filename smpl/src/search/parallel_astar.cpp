@@ -0,0 +1,519 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#include <smpl/search/parallel_astar.h>
+
+// standard includes
+#include <algorithm>
+#include <limits>
+#include <new>
+
+// system includes
+#include <ros/console.h>
+
+// project includes
+#include <smpl/extension.h>
+#include <smpl/graph/robot_planning_space.h>
+#include <smpl/heuristic/robot_heuristic.h>
+
+namespace sbpl {
+
+static const char* SLOG = "search";
+static const char* SELOG = "search.expansions";
+
+enum ReplanResultCode
+{
+    SUCCESS = 0,
+    START_NOT_SET,
+    GOAL_NOT_SET,
+    TIMED_OUT,
+    EXHAUSTED_OPEN_LIST
+};
+
+ParallelAStar::ParallelAStar(
+    DiscreteSpaceInformation* space,
+    Heuristic* heur)
+:
+    SBPLPlanner(),
+    m_space(space),
+    m_heur(heur),
+    m_pairwise(nullptr),
+    m_batch_succs(nullptr),
+    m_eps(1.0),
+    m_bounded(true),
+    m_allowed_time(clock::duration::zero()),
+    m_batch_size(16),
+    m_lookahead(64),
+    m_state_blocks(),
+    m_state_count(0),
+    m_start_state_id(-1),
+    m_goal_state_id(-1),
+    m_graph_to_search_map(),
+    m_open(),
+    m_call_number(0),
+    m_candidates(),
+    m_batch(),
+    m_batch_ids(),
+    m_batch_succs_ids(),
+    m_batch_costs(),
+    m_expand_count(0),
+    m_round_count(0),
+    m_search_time(clock::duration::zero()),
+    m_satisfied_eps(std::numeric_limits<double>::infinity())
+{
+    environment_ = space;
+
+    motion::Extension* ext = dynamic_cast<motion::Extension*>(space);
+    if (ext) {
+        m_batch_succs = ext->getExtension<motion::BatchSuccessorsExtension>();
+    }
+    if (!m_batch_succs) {
+        ROS_DEBUG_NAMED(SLOG, "Graph does not support batch successor generation. States will be expanded serially");
+    }
+
+    motion::Extension* heur_ext = dynamic_cast<motion::Extension*>(heur);
+    if (heur_ext) {
+        m_pairwise = heur_ext->getExtension<motion::PairwiseHeuristicExtension>();
+    }
+    if (!m_pairwise) {
+        ROS_WARN_NAMED(SLOG, "Heuristic does not bound the cost between arbitrary states. Batches will contain a single state");
+    }
+}
+
+ParallelAStar::~ParallelAStar()
+{
+}
+
+/// Set the maximum number of states expanded in a single round.
+void ParallelAStar::setBatchSize(int size)
+{
+    m_batch_size = std::max(1, size);
+    m_lookahead = std::max(m_lookahead, m_batch_size);
+}
+
+/// Set the maximum number of states examined from the front of OPEN when
+/// selecting the states to expand in a single round. Each examined state is
+/// tested for independence against all states examined before it.
+void ParallelAStar::setLookahead(int count)
+{
+    m_lookahead = std::max(m_batch_size, count);
+}
+
+int ParallelAStar::replan(
+    double allowed_time,
+    std::vector<int>* solution)
+{
+    int cost;
+    return replan(allowed_time, solution, &cost);
+}
+
+int ParallelAStar::replan(
+    double allowed_time,
+    std::vector<int>* solution,
+    int* cost)
+{
+    ROS_DEBUG_NAMED(SLOG, "Find path to goal");
+
+    if (m_start_state_id < 0) {
+        ROS_ERROR_NAMED(SLOG, "Start state not set");
+        return !START_NOT_SET;
+    }
+    if (m_goal_state_id < 0) {
+        ROS_ERROR_NAMED(SLOG, "Goal state not set");
+        return !GOAL_NOT_SET;
+    }
+
+    m_allowed_time = to_duration(allowed_time);
+
+    m_open.clear();
+    clearStates();
+
+    SearchState* start_state = getSearchState(m_start_state_id);
+    SearchState* goal_state = getSearchState(m_goal_state_id);
+
+    start_state->g = 0;
+    start_state->f = computeKey(start_state);
+    m_open.push(start_state);
+
+    m_expand_count = 0;
+    m_round_count = 0;
+    m_satisfied_eps = std::numeric_limits<double>::infinity();
+
+    auto start_time = clock::now();
+    int err = search(goal_state);
+    m_search_time = clock::now() - start_time;
+
+    ROS_DEBUG_NAMED(SLOG, "Expanded %d states in %d rounds", m_expand_count, m_round_count);
+
+    if (err) {
+        return !err;
+    }
+
+    m_satisfied_eps = m_eps;
+    extractPath(goal_state, *solution, *cost);
+    return !SUCCESS;
+}
+
+int ParallelAStar::replan(
+    std::vector<int>* solution,
+    ReplanParams params)
+{
+    int cost;
+    return replan(solution, params, &cost);
+}
+
+int ParallelAStar::replan(
+    std::vector<int>* solution,
+    ReplanParams params,
+    int* cost)
+{
+    m_eps = params.initial_eps;
+    m_bounded = !params.return_first_solution;
+    return replan(params.max_time, solution, cost);
+}
+
+/// Force the planner to free all memory allocated during previous searches.
+int ParallelAStar::force_planning_from_scratch_and_free_memory()
+{
+    m_open.clear();
+    clearStates();
+    m_state_blocks.clear();
+    m_state_blocks.shrink_to_fit();
+    m_graph_to_search_map.clear();
+    m_graph_to_search_map.shrink_to_fit();
+    return 0;
+}
+
+/// Return the suboptimality bound of the current solution.
+double ParallelAStar::get_solution_eps() const
+{
+    return m_satisfied_eps;
+}
+
+/// Return the number of expansions made by the last search.
+int ParallelAStar::get_n_expands() const
+{
+    return m_expand_count;
+}
+
+/// Return the suboptimality bound of the search.
+double ParallelAStar::get_initial_eps()
+{
+    return m_eps;
+}
+
+/// Return the time consumed by the last search.
+double ParallelAStar::get_initial_eps_planning_time()
+{
+    return to_seconds(m_search_time);
+}
+
+/// Return the time consumed by the last search.
+double ParallelAStar::get_final_eps_planning_time()
+{
+    return to_seconds(m_search_time);
+}
+
+/// Return the number of expansions made by the last search.
+int ParallelAStar::get_n_expands_init_solution()
+{
+    return m_expand_count;
+}
+
+/// Return the suboptimality bound of the search.
+double ParallelAStar::get_final_epsilon()
+{
+    return m_eps;
+}
+
+/// Return statistics for the last search.
+void ParallelAStar::get_search_stats(std::vector<PlannerStats>* s)
+{
+    PlannerStats stats;
+    stats.eps = m_eps;
+    stats.cost = 0;
+    stats.expands = m_expand_count;
+    stats.time = to_seconds(m_search_time);
+    s->push_back(stats);
+}
+
+/// Set the suboptimality bound of the search.
+void ParallelAStar::set_initialsolution_eps(double eps)
+{
+    m_eps = eps;
+}
+
+/// Set the goal state.
+int ParallelAStar::set_goal(int goal_state_id)
+{
+    m_goal_state_id = goal_state_id;
+    return 1;
+}
+
+/// Set the start state.
+int ParallelAStar::set_start(int start_state_id)
+{
+    m_start_state_id = start_state_id;
+    return 1;
+}
+
+/// The search is always started from scratch.
+int ParallelAStar::force_planning_from_scratch()
+{
+    return 0;
+}
+
+/// Set whether the search is bounded by the allowed time.
+int ParallelAStar::set_search_mode(bool first_solution_unbounded)
+{
+    m_bounded = !first_solution_unbounded;
+    return 0;
+}
+
+/// The search is always started from scratch, so changes to edge costs
+/// require no action.
+void ParallelAStar::costs_changed(const StateChangeQuery& changes)
+{
+}
+
+// Expand batches of independent states until the goal state is expanded, time
+// runs out, or no solution exists.
+int ParallelAStar::search(SearchState* goal_state)
+{
+    auto start_time = clock::now();
+    while (!m_open.empty()) {
+        SearchState* min_state = m_open.min();
+
+        // path to goal found
+        if (min_state->f >= goal_state->f || min_state == goal_state) {
+            ROS_DEBUG_NAMED(SLOG, "Found path to goal");
+            return SUCCESS;
+        }
+
+        if (m_bounded && clock::now() - start_time >= m_allowed_time) {
+            ROS_DEBUG_NAMED(SLOG, "Ran out of time");
+            return TIMED_OUT;
+        }
+
+        if (!selectBatch(goal_state)) {
+            // only states that can not improve the goal remain in OPEN
+            ROS_DEBUG_NAMED(SLOG, "Found path to goal");
+            return SUCCESS;
+        }
+        expandBatch();
+    }
+
+    return EXHAUSTED_OPEN_LIST;
+}
+
+// Remove a batch of mutually independent states from the front of OPEN and
+// mark them closed. States examined but not selected are returned to OPEN. The
+// minimum state in OPEN is always selected, unless it can not improve the
+// solution through the goal state. Without a pairwise heuristic, only the
+// minimum state is selected. Returns false if no state was selected.
+bool ParallelAStar::selectBatch(SearchState* goal_state)
+{
+    m_candidates.clear();
+    m_batch.clear();
+
+    const int batch_size = m_pairwise ? m_batch_size : 1;
+    const int lookahead = m_pairwise ? m_lookahead : 1;
+
+    while (!m_open.empty() &&
+        (int)m_batch.size() < batch_size &&
+        (int)m_candidates.size() < lookahead)
+    {
+        SearchState* s = m_open.min();
+        if (s == goal_state || s->f >= goal_state->f) {
+            break;
+        }
+
+        m_open.pop();
+
+        // every state with a smaller f-value than s is either in OPEN or has
+        // been examined during this round
+        bool is_independent = true;
+        for (SearchState* t : m_candidates) {
+            if (!independent(s, t)) {
+                is_independent = false;
+                break;
+            }
+        }
+
+        m_candidates.push_back(s);
+        if (is_independent) {
+            s->closed = true;
+            m_batch.push_back(s);
+        }
+    }
+
+    for (SearchState* s : m_candidates) {
+        if (!s->closed) {
+            m_open.push(s);
+        }
+    }
+
+    ROS_DEBUG_NAMED(SELOG, "Selected %zu of %zu states for expansion", m_batch.size(), m_candidates.size());
+    return !m_batch.empty();
+}
+
+// Test whether the g-value of s can not be improved (beyond the suboptimality
+// bound) by expanding t, or any state on a path from t to s.
+bool ParallelAStar::independent(const SearchState* s, const SearchState* t)
+{
+    const int h = m_pairwise->GetFromToHeuristic(t->state_id, s->state_id);
+    return (double)s->g - (double)t->g <= m_eps * (double)h;
+}
+
+// Expand all states of the current batch. Edge validation for the batch is
+// delegated to the graph in a single call when supported. The successors are
+// then relaxed on this thread; since the states are independent, the order in
+// which they are relaxed doesn't affect the bound.
+void ParallelAStar::expandBatch()
+{
+    m_batch_ids.clear();
+    for (SearchState* s : m_batch) {
+        ROS_DEBUG_NAMED(SELOG, "Expand state %d", s->state_id);
+        m_batch_ids.push_back(s->state_id);
+    }
+
+    if (m_batch_succs) {
+        m_batch_succs->GetBatchSuccs(
+                m_batch_ids, &m_batch_succs_ids, &m_batch_costs);
+    } else {
+        if (m_batch_succs_ids.size() < m_batch_ids.size()) {
+            m_batch_succs_ids.resize(m_batch_ids.size());
+            m_batch_costs.resize(m_batch_ids.size());
+        }
+        for (size_t i = 0; i < m_batch_ids.size(); ++i) {
+            m_space->GetSuccs(
+                    m_batch_ids[i], &m_batch_succs_ids[i], &m_batch_costs[i]);
+        }
+    }
+
+    for (size_t i = 0; i < m_batch.size(); ++i) {
+        SearchState* s = m_batch[i];
+        const std::vector<int>& succs = m_batch_succs_ids[i];
+        const std::vector<int>& costs = m_batch_costs[i];
+
+        ROS_DEBUG_NAMED(SELOG, "  %zu successors", succs.size());
+
+        for (size_t sidx = 0; sidx < succs.size(); ++sidx) {
+            SearchState* succ_state = getSearchState(succs[sidx]);
+            if (succ_state->closed) {
+                continue;
+            }
+
+            unsigned int new_cost = s->g + costs[sidx];
+            if (new_cost < succ_state->g) {
+                succ_state->g = new_cost;
+                succ_state->bp = s;
+                succ_state->f = computeKey(succ_state);
+                if (m_open.contains(succ_state)) {
+                    m_open.decrease(succ_state);
+                } else {
+                    m_open.push(succ_state);
+                }
+            }
+        }
+    }
+
+    m_expand_count += (int)m_batch.size();
+    ++m_round_count;
+}
+
+int ParallelAStar::computeKey(const SearchState* s) const
+{
+    return s->g + (unsigned int)(m_eps * s->h);
+}
+
+// Get the search state corresponding to a graph state, creating a new state if
+// one has not been created yet in the current generation.
+ParallelAStar::SearchState* ParallelAStar::getSearchState(int state_id)
+{
+    if (m_graph_to_search_map.size() <= state_id) {
+        m_graph_to_search_map.resize(state_id + 1, nullptr);
+    }
+
+    SearchState* s = m_graph_to_search_map[state_id];
+    if (s && s->call_number == m_call_number && s->state_id == state_id) {
+        return s;
+    } else {
+        return createState(state_id);
+    }
+}
+
+// Create a new search state for a graph state.
+ParallelAStar::SearchState* ParallelAStar::createState(int state_id)
+{
+    if (m_state_count == m_state_blocks.size() * StateBlockSize) {
+        m_state_blocks.emplace_back(new SearchState[StateBlockSize]);
+    }
+
+    SearchState* ss = new (stateAt(m_state_count++)) SearchState;
+    ss->state_id = state_id;
+    ss->g = INFINITECOST;
+    ss->h = m_heur->GetGoalHeuristic(state_id);
+    ss->f = INFINITECOST;
+    ss->call_number = m_call_number;
+    ss->bp = nullptr;
+    ss->closed = false;
+
+    m_graph_to_search_map[state_id] = ss;
+    return ss;
+}
+
+ParallelAStar::SearchState* ParallelAStar::stateAt(size_t index) const
+{
+    return &m_state_blocks[index >> StateBlockShift][index & (StateBlockSize - 1)];
+}
+
+// Release all search states, retaining their storage for the next search.
+void ParallelAStar::clearStates()
+{
+    ++m_call_number; // invalidates all entries in the state map
+    m_state_count = 0;
+}
+
+// Extract the path from the start state up to a new state.
+void ParallelAStar::extractPath(
+    SearchState* to_state,
+    std::vector<int>& solution,
+    int& cost) const
+{
+    for (SearchState* s = to_state; s; s = s->bp) {
+        solution.push_back(s->state_id);
+    }
+    std::reverse(solution.begin(), solution.end());
+    cost = to_state->g;
+}
+
+} // namespace sbpl
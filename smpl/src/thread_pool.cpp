@@ -0,0 +1,189 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#include <smpl/thread_pool.h>
+
+namespace sbpl {
+
+ThreadPool::ThreadPool(int num_threads) :
+    m_threads(),
+    m_mutex(),
+    m_work_cv(),
+    m_done_cv(),
+    m_body(nullptr),
+    m_ranges(new WorkRange[num_threads + 1]),
+    m_active(0),
+    m_generation(0),
+    m_shutdown(false)
+{
+    for (int i = 0; i < num_threads + 1; ++i) {
+        m_ranges[i].range = 0;
+    }
+
+    m_threads.reserve(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+        m_threads.emplace_back(&ThreadPool::workerMain, this, i + 1);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_shutdown = true;
+    }
+    m_work_cv.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const LoopBody& body)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    // avoid waking the workers for loops with nothing to share
+    if (m_threads.empty() || count == 1) {
+        for (int i = 0; i < count; ++i) {
+            body(i, 0);
+        }
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_body = &body;
+        const int worker_count = workerCount();
+        for (int w = 0; w < worker_count; ++w) {
+            const uint64_t begin = (uint64_t)count * w / worker_count;
+            const uint64_t end = (uint64_t)count * (w + 1) / worker_count;
+            m_ranges[w].range = (begin << 32) | end;
+        }
+        m_active = (int)m_threads.size();
+        ++m_generation;
+    }
+    m_work_cv.notify_all();
+
+    runLoop(0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [&]() { return m_active == 0; });
+    m_body = nullptr;
+}
+
+void ThreadPool::workerMain(int worker)
+{
+    unsigned seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_work_cv.wait(lock, [&]() {
+                return m_shutdown || m_generation != seen_generation;
+            });
+            if (m_shutdown) {
+                return;
+            }
+            seen_generation = m_generation;
+        }
+
+        runLoop(worker);
+
+        bool last;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            last = (--m_active == 0);
+        }
+        if (last) {
+            m_done_cv.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runLoop(int worker)
+{
+    const LoopBody& body = *m_body;
+    int index;
+    do {
+        while (popIndex(worker, index)) {
+            body(index, worker);
+        }
+    } while (stealIndices(worker));
+}
+
+// Claim the first unclaimed index of a worker's own range.
+bool ThreadPool::popIndex(int worker, int& index)
+{
+    std::atomic<uint64_t>& range = m_ranges[worker].range;
+    uint64_t r = range.load();
+    while (true) {
+        const uint64_t begin = r >> 32;
+        const uint64_t end = r & 0xFFFFFFFF;
+        if (begin >= end) {
+            return false;
+        }
+        if (range.compare_exchange_weak(r, ((begin + 1) << 32) | end)) {
+            index = (int)begin;
+            return true;
+        }
+    }
+}
+
+// Move the back half of the unclaimed indices of some other worker into the
+// (empty) range of this worker. Returns false if no other worker has any
+// unclaimed indices left. Indices claimed by a worker are always visited by
+// that worker, so the loop completes even if a worker gives up while another
+// is still moving stolen indices into its own range.
+bool ThreadPool::stealIndices(int worker)
+{
+    const int worker_count = workerCount();
+    for (int i = 1; i < worker_count; ++i) {
+        const int victim = (worker + i) % worker_count;
+        std::atomic<uint64_t>& range = m_ranges[victim].range;
+        uint64_t r = range.load();
+        while (true) {
+            const uint64_t begin = r >> 32;
+            const uint64_t end = r & 0xFFFFFFFF;
+            if (begin >= end) {
+                break;
+            }
+            const uint64_t mid = begin + (end - begin) / 2;
+            if (range.compare_exchange_weak(r, (begin << 32) | mid)) {
+                m_ranges[worker].range = (mid << 32) | end;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+} // namespace sbpl
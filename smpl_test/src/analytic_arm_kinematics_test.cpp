@@ -0,0 +1,345 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+// standard includes
+#include <cmath>
+#include <random>
+#include <vector>
+
+#define BOOST_TEST_MODULE AnalyticArmKinematicsTest
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+// system includes
+#include <kdl/chain.hpp>
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+#include <sbpl_pr2_robot_model/analytic_arm_kinematics.h>
+
+namespace smpl = sbpl::motion;
+
+typedef smpl::AnalyticArmKinematics::JointVector JointVector;
+
+static const double PoseTolerance = 1e-6;
+
+static
+KDL::Segment MakeRevoluteSegment(
+    const std::string& name,
+    const KDL::Vector& offset,
+    const KDL::Vector& axis)
+{
+    // constructed as by kdl_parser, with the joint axis through the origin
+    // of the joint frame
+    const KDL::Frame origin(offset);
+    return KDL::Segment(
+            name, KDL::Joint(name, origin.p, axis, KDL::Joint::RotAxis), origin);
+}
+
+// Construct the kinematic chain of the PR2 right arm, from the torso lift link
+// to the gripper palm
+static
+KDL::Chain MakePR2ArmChain()
+{
+    KDL::Chain chain;
+    chain.addSegment(MakeRevoluteSegment(
+            "r_shoulder_pan_link", KDL::Vector(0.0, -0.188, 0.0), KDL::Vector(0.0, 0.0, 1.0)));
+    chain.addSegment(MakeRevoluteSegment(
+            "r_shoulder_lift_link", KDL::Vector(0.1, 0.0, 0.0), KDL::Vector(0.0, 1.0, 0.0)));
+    chain.addSegment(MakeRevoluteSegment(
+            "r_upper_arm_roll_link", KDL::Vector(0.0, 0.0, 0.0), KDL::Vector(1.0, 0.0, 0.0)));
+    chain.addSegment(MakeRevoluteSegment(
+            "r_elbow_flex_link", KDL::Vector(0.4, 0.0, 0.0), KDL::Vector(0.0, 1.0, 0.0)));
+    chain.addSegment(MakeRevoluteSegment(
+            "r_forearm_roll_link", KDL::Vector(0.0, 0.0, 0.0), KDL::Vector(1.0, 0.0, 0.0)));
+    chain.addSegment(MakeRevoluteSegment(
+            "r_wrist_flex_link", KDL::Vector(0.321, 0.0, 0.0), KDL::Vector(0.0, 1.0, 0.0)));
+    chain.addSegment(MakeRevoluteSegment(
+            "r_wrist_roll_link", KDL::Vector(0.0, 0.0, 0.0), KDL::Vector(1.0, 0.0, 0.0)));
+    chain.addSegment(KDL::Segment(
+            "r_gripper_palm_link",
+            KDL::Joint(KDL::Joint::None),
+            KDL::Frame(KDL::Vector(0.0, 0.0, 0.0))));
+    chain.addSegment(KDL::Segment(
+            "r_gripper_tool_frame",
+            KDL::Joint(KDL::Joint::None),
+            KDL::Frame(KDL::Vector(0.18, 0.0, 0.0))));
+    return chain;
+}
+
+struct JointLimits
+{
+    std::vector<double> min;
+    std::vector<double> max;
+    std::vector<bool> continuous;
+};
+
+static
+JointLimits PR2ArmLimits()
+{
+    JointLimits limits;
+    limits.min = { -2.1353, -0.3536, -3.75, -2.1213, -M_PI, -2.0, -M_PI };
+    limits.max = { 0.5646, 1.2963, 0.65, -0.15, M_PI, -0.1, M_PI };
+    limits.continuous = { false, false, false, false, true, false, true };
+    return limits;
+}
+
+// Limits admitting the configurations with the elbow and wrist outstretched,
+// where the roll joint axes align
+static
+JointLimits WideArmLimits()
+{
+    JointLimits limits;
+    limits.min = { -M_PI, -M_PI, -M_PI, -M_PI, -M_PI, -M_PI, -M_PI };
+    limits.max = { M_PI, M_PI, M_PI, M_PI, M_PI, M_PI, M_PI };
+    limits.continuous = { false, false, false, false, true, false, true };
+    return limits;
+}
+
+static
+JointVector RandomConfiguration(const JointLimits& limits, std::mt19937& rng)
+{
+    JointVector q;
+    for (int i = 0; i < smpl::AnalyticArmKinematics::DOF; ++i) {
+        std::uniform_real_distribution<double> dist(limits.min[i], limits.max[i]);
+        q[i] = dist(rng);
+    }
+    return q;
+}
+
+static
+Eigen::Affine3d ComputeKDLFK(const KDL::Chain& chain, const JointVector& q)
+{
+    KDL::ChainFkSolverPos_recursive fk_solver(chain);
+    KDL::JntArray jnt_array(chain.getNrOfJoints());
+    for (unsigned int i = 0; i < chain.getNrOfJoints(); ++i) {
+        jnt_array(i) = q[i];
+    }
+    KDL::Frame frame;
+    BOOST_REQUIRE(fk_solver.JntToCart(jnt_array, frame) >= 0);
+    Eigen::Affine3d pose;
+    smpl::KDLFrameToTransform(frame, pose);
+    return pose;
+}
+
+static
+bool PosesMatch(const Eigen::Affine3d& a, const Eigen::Affine3d& b)
+{
+    return a.translation().isApprox(b.translation(), PoseTolerance) &&
+            (a.linear() - b.linear()).norm() < PoseTolerance;
+}
+
+// Check that the solution computed for the pose of a configuration reaches
+// the same pose
+static
+void CheckRoundTrip(
+    const smpl::AnalyticArmKinematics& kin,
+    const JointVector& q,
+    const JointVector& seed)
+{
+    Eigen::Affine3d pose;
+    kin.computeFK(q, pose);
+
+    JointVector solution;
+    const double free_angle = q[smpl::AnalyticArmKinematics::FREE_ANGLE_INDEX];
+    BOOST_REQUIRE(kin.computeIK(pose, free_angle, seed, solution));
+    BOOST_CHECK_EQUAL(
+            solution[smpl::AnalyticArmKinematics::FREE_ANGLE_INDEX], free_angle);
+
+    Eigen::Affine3d reached;
+    kin.computeFK(solution, reached);
+    BOOST_CHECK(PosesMatch(pose, reached));
+
+    BOOST_REQUIRE(kin.computeIKSearch(pose, seed, 0.02, solution));
+    kin.computeFK(solution, reached);
+    BOOST_CHECK(PosesMatch(pose, reached));
+}
+
+BOOST_AUTO_TEST_CASE(InitTest)
+{
+    const KDL::Chain chain = MakePR2ArmChain();
+    const JointLimits limits = PR2ArmLimits();
+
+    smpl::AnalyticArmKinematics kin;
+    BOOST_CHECK(!kin.initialized());
+    BOOST_CHECK(kin.init(chain, limits.min, limits.max, limits.continuous));
+    BOOST_CHECK(kin.initialized());
+
+    // the upper arm roll and elbow flex joints are swapped
+    KDL::Chain bad_chain;
+    for (unsigned int i = 0; i < chain.getNrOfSegments(); ++i) {
+        const unsigned int sidx = i == 2 ? 3 : i == 3 ? 2 : i;
+        bad_chain.addSegment(chain.getSegment(sidx));
+    }
+    BOOST_CHECK(!kin.init(bad_chain, limits.min, limits.max, limits.continuous));
+    BOOST_CHECK(!kin.initialized());
+}
+
+BOOST_AUTO_TEST_CASE(FKMatchesKDLTest)
+{
+    const KDL::Chain chain = MakePR2ArmChain();
+    const JointLimits limits = WideArmLimits();
+
+    smpl::AnalyticArmKinematics kin;
+    BOOST_REQUIRE(kin.init(chain, limits.min, limits.max, limits.continuous));
+
+    std::mt19937 rng(1);
+    for (int i = 0; i < 1000; ++i) {
+        const JointVector q = RandomConfiguration(limits, rng);
+        Eigen::Affine3d pose;
+        kin.computeFK(q, pose);
+        BOOST_CHECK(PosesMatch(pose, ComputeKDLFK(chain, q)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(IKRoundTripTest)
+{
+    const KDL::Chain chain = MakePR2ArmChain();
+    const JointLimits limits = PR2ArmLimits();
+
+    smpl::AnalyticArmKinematics kin;
+    BOOST_REQUIRE(kin.init(chain, limits.min, limits.max, limits.continuous));
+
+    std::mt19937 rng(2);
+    std::normal_distribution<double> noise(0.0, 0.05);
+    for (int i = 0; i < 1000; ++i) {
+        const JointVector q = RandomConfiguration(limits, rng);
+
+        // the nearest solution to the configuration is the configuration
+        Eigen::Affine3d pose;
+        kin.computeFK(q, pose);
+        JointVector solution;
+        BOOST_REQUIRE(kin.computeIK(
+                pose, q[smpl::AnalyticArmKinematics::FREE_ANGLE_INDEX], q, solution));
+        BOOST_CHECK(solution.isApprox(q, 1e-6));
+
+        JointVector seed = q;
+        for (int j = 0; j < smpl::AnalyticArmKinematics::DOF; ++j) {
+            seed[j] += noise(rng);
+        }
+        CheckRoundTrip(kin, q, seed);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SingularIKRoundTripTest)
+{
+    const KDL::Chain chain = MakePR2ArmChain();
+    const JointLimits limits = WideArmLimits();
+
+    smpl::AnalyticArmKinematics kin;
+    BOOST_REQUIRE(kin.init(chain, limits.min, limits.max, limits.continuous));
+
+    std::mt19937 rng(3);
+    for (int i = 0; i < 100; ++i) {
+        const JointVector q = RandomConfiguration(limits, rng);
+
+        // wrist flex at zero aligns the forearm roll and wrist roll axes
+        JointVector wrist_singular = q;
+        wrist_singular[5] = 0.0;
+        CheckRoundTrip(kin, wrist_singular, q);
+
+        // elbow flex at zero aligns the upper arm roll and forearm roll axes
+        JointVector elbow_singular = q;
+        elbow_singular[3] = 0.0;
+        CheckRoundTrip(kin, elbow_singular, q);
+
+        JointVector outstretched = q;
+        outstretched[3] = 0.0;
+        outstretched[5] = 0.0;
+        CheckRoundTrip(kin, outstretched, q);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BatchIKSeedsFromPreviousTest)
+{
+    const KDL::Chain chain = MakePR2ArmChain();
+    const JointLimits limits = WideArmLimits();
+
+    smpl::AnalyticArmKinematics kin;
+    BOOST_REQUIRE(kin.init(chain, limits.min, limits.max, limits.continuous));
+
+    // sample paths with the elbow and wrist bent, away from the singular
+    // configurations where the solution branches meet
+    JointLimits bent = limits;
+    bent.min[3] = bent.min[5] = -2.5;
+    bent.max[3] = bent.max[5] = -0.3;
+
+    // consecutive solutions along a finely interpolated path should remain on
+    // the same branch, even where the solution nearest the start does not
+    const double max_step = 0.5;
+    const int count = 50;
+    int branch_switch_count = 0;
+    std::mt19937 rng(4);
+    for (int i = 0; i < 100; ++i) {
+        const JointVector start = RandomConfiguration(bent, rng);
+        JointVector goal = RandomConfiguration(bent, rng);
+        goal[smpl::AnalyticArmKinematics::FREE_ANGLE_INDEX] =
+                start[smpl::AnalyticArmKinematics::FREE_ANGLE_INDEX];
+
+        std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d>> poses(count);
+        for (int j = 0; j < count; ++j) {
+            const double alpha = (double)(j + 1) / (double)count;
+            kin.computeFK((1.0 - alpha) * start + alpha * goal, poses[j]);
+        }
+
+        std::vector<JointVector> solutions(count);
+        BOOST_REQUIRE_EQUAL(
+                kin.computeIK(poses.data(), count, start, solutions.data()),
+                count);
+
+        const double free_angle =
+                start[smpl::AnalyticArmKinematics::FREE_ANGLE_INDEX];
+        JointVector prev = start;
+        JointVector prev_unchained = start;
+        bool switched = false;
+        for (int j = 0; j < count; ++j) {
+            Eigen::Affine3d reached;
+            kin.computeFK(solutions[j], reached);
+            BOOST_CHECK(PosesMatch(poses[j], reached));
+            BOOST_CHECK_LT((solutions[j] - prev).norm(), max_step);
+            prev = solutions[j];
+
+            JointVector unchained;
+            BOOST_REQUIRE(kin.computeIK(poses[j], free_angle, start, unchained));
+            if ((unchained - prev_unchained).norm() > max_step) {
+                switched = true;
+            }
+            prev_unchained = unchained;
+        }
+        if (switched) {
+            ++branch_switch_count;
+        }
+    }
+
+    // the paths should include some along which the solution nearest the
+    // start switches branches
+    BOOST_CHECK_GT(branch_switch_count, 0);
+}
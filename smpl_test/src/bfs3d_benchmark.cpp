@@ -0,0 +1,117 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <smpl/bfs3d/bfs3d.h>
+
+// Compare the time to compute a bfs on a randomly populated grid using the
+// single-threaded search and the parallel level-synchronous search, and verify
+// that both searches compute the same distances.
+//
+// usage: bfs3d_benchmark [size] [wall percentage] [threads] [trials]
+
+typedef std::chrono::high_resolution_clock clock_type;
+
+void InitBfs(sbpl::motion::BFS_3D& bfs, int size, int wall_pct)
+{
+    std::default_random_engine rng(1234);
+    std::uniform_int_distribution<int> dist(0, 99);
+    for (int z = 0; z < size; ++z) {
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                if (dist(rng) < wall_pct) {
+                    bfs.setWall(x, y, z);
+                }
+            }
+        }
+    }
+}
+
+double TimeBfs(sbpl::motion::BFS_3D& bfs, int size, int trials)
+{
+    const int cx = size / 2, cy = size / 2, cz = size / 2;
+    double total = 0.0;
+    for (int i = 0; i < trials; ++i) {
+        auto start = clock_type::now();
+        bfs.run(cx, cy, cz);
+        while (bfs.isRunning()) {
+            std::this_thread::yield();
+        }
+        auto finish = clock_type::now();
+        total += std::chrono::duration<double>(finish - start).count();
+    }
+    return total / trials;
+}
+
+int main(int argc, char* argv[])
+{
+    const int size = argc > 1 ? atoi(argv[1]) : 300;
+    const int wall_pct = argc > 2 ? atoi(argv[2]) : 20;
+    const int threads = argc > 3 ?
+            atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+    const int trials = argc > 4 ? atoi(argv[4]) : 5;
+
+    sbpl::motion::BFS_3D serial_bfs(size, size, size);
+    sbpl::motion::BFS_3D parallel_bfs(size, size, size);
+    InitBfs(serial_bfs, size, wall_pct);
+    InitBfs(parallel_bfs, size, wall_pct);
+    parallel_bfs.setNumThreads(threads);
+
+    // both grids are left with the distances of the last trial
+    const double serial_time = TimeBfs(serial_bfs, size, trials);
+    const double parallel_time = TimeBfs(parallel_bfs, size, trials);
+
+    int mismatches = 0;
+    for (int z = 0; z < size; ++z) {
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                if (serial_bfs.getDistance(x, y, z) !=
+                    parallel_bfs.getDistance(x, y, z))
+                {
+                    ++mismatches;
+                }
+            }
+        }
+    }
+
+    printf("grid: %d^3 cells, %d%% walls\n", size, wall_pct);
+    printf("serial:   %0.3f s\n", serial_time);
+    printf("parallel: %0.3f s (%d threads, %0.2fx)\n",
+            parallel_time, threads, serial_time / parallel_time);
+    printf("mismatched distances: %d\n", mismatches);
+
+    return mismatches == 0 ? 0 : 1;
+}
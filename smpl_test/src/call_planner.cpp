@@ -45,6 +45,7 @@
 #include <smpl/ros/planner_interface.h>
 #include <smpl/distance_map/edge_euclid_distance_map.h>
 #include <smpl/distance_map/euclid_distance_map.h>
+#include <smpl/distance_map/hashed_distance_map.h>
 #include <smpl/ros/propagation_distance_field.h>
 #include <sbpl_collision_checking/collision_space.h>
 #include <sbpl_kdl_robot_model/kdl_robot_model.h>
@@ -286,6 +287,7 @@ struct RobotModelConfig
     std::string planning_link;
     std::string kinematics_frame;
     std::string chain_tip_link;
+    bool use_analytic_kinematics;
 };
 
 bool ReadRobotModelConfig(const ros::NodeHandle &nh, RobotModelConfig &config)
@@ -319,6 +321,7 @@ bool ReadRobotModelConfig(const ros::NodeHandle &nh, RobotModelConfig &config)
     // only required for generic kdl robot model?
     nh.getParam("kinematics_frame", config.kinematics_frame);
     nh.getParam("chain_tip_link", config.chain_tip_link);
+    nh.param("use_analytic_kinematics", config.use_analytic_kinematics, false);
     return true;
 }
 
@@ -405,10 +408,14 @@ std::unique_ptr<smpl::KDLRobotModel> SetupRobotModel(
 
     if (config.group_name == "right_arm") {
         ROS_INFO("Construct PR2 Robot Model");
-        rm.reset(new smpl::PR2KDLRobotModel);
+        smpl::PR2KDLRobotModel* pr2_rm = new smpl::PR2KDLRobotModel;
+        pr2_rm->setUseAnalyticKinematics(config.use_analytic_kinematics);
+        rm.reset(pr2_rm);
     } else if (config.group_name == "arm") {
         ROS_INFO("Construct UBR1 Robot Model");
-        rm.reset(new smpl::UBR1KDLRobotModel);
+        smpl::UBR1KDLRobotModel* ubr1_rm = new smpl::UBR1KDLRobotModel;
+        ubr1_rm->setUseAnalyticKinematics(config.use_analytic_kinematics);
+        rm.reset(ubr1_rm);
     } else {
         ROS_INFO("Construct Generic KDL Robot Model");
         rm.reset(new sbpl::motion::KDLRobotModel);
@@ -1594,6 +1601,7 @@ int main(int argc, char* argv[])
 
 //    typedef sbpl::EdgeEuclidDistanceMap DistanceMapType;
     typedef sbpl::EuclidDistanceMap DistanceMapType;
+//    typedef sbpl::HashedDistanceMap DistanceMapType;
 //    typedef sbpl::PropagationDistanceField DistanceMapType;
 
     ROS_INFO("Create distance map");
@@ -1603,6 +1611,10 @@ int main(int argc, char* argv[])
             df_res,
             max_distance);
 
+    int df_threads;
+    ph.param("distance_map_threads", df_threads, 1);
+    df->setNumThreads(df_threads);
+
     ROS_INFO("Create grid");
     const bool ref_counted = false;
     sbpl::OccupancyGrid grid(df, ref_counted);
@@ -1657,8 +1669,11 @@ int main(int argc, char* argv[])
 
     cc->setWorldToModelTransform(Eigen::Affine3d::Identity());
 
-    // set planning scene
-    if (!cc->setPlanningScene(scene)) {
+    // set planning scene, restoring the distance field of its world from the
+    // cache, if one exists
+    std::string distance_field_cache;
+    ph.param<std::string>("distance_field_cache", distance_field_cache, "");
+    if (!builder.setPlanningScene(*cc, scene, distance_field_cache)) {
         ROS_ERROR("Failed to update Collision Checker from Planning Scene");
         return false;
     }
@@ -1669,6 +1684,8 @@ int main(int argc, char* argv[])
     // configuration as a multi-dof transform...this is to account for the kdl
     // robot model not generating forward kinematics for the robot as a whole
     const auto &multi_dof_joint_state(scene.robot_state.multi_dof_joint_state);
+    KDL::Frame kinematics_to_planning = KDL::Frame::Identity();
+    bool found_kinematics_to_planning = false;
     if (multi_dof_joint_state.header.frame_id == planning_frame) {
         ROS_INFO("Search for planning -> kinematics transform in multi-dof joint state");
         bool found = false;
@@ -1679,6 +1696,8 @@ int main(int argc, char* argv[])
                 KDL::Frame f;
                 tf::transformMsgToKDL(transform, f);
                 rm->setKinematicsToPlanningTransform(f, "what?");
+                kinematics_to_planning = f;
+                found_kinematics_to_planning = true;
                 found = true;
                 break;
             }
@@ -1711,6 +1730,57 @@ int main(int argc, char* argv[])
 
     smpl::PlannerInterface planner(rm.get(), cc.get(), &grid);
 
+    // additional planning threads get their own robot model and collision
+    // checker; the collision checkers share the occupancy grid, which already
+    // contains the collision world, so only the robot state is copied to them
+    moveit_msgs::PlanningScene thread_scene;
+    thread_scene.robot_model_name = scene.robot_model_name;
+    thread_scene.robot_state = scene.robot_state;
+    thread_scene.is_diff = true;
+    planner.setThreadContextFactory([&](
+        std::unique_ptr<sbpl::motion::RobotModel>& robot,
+        std::unique_ptr<sbpl::motion::CollisionChecker>& checker)
+    {
+        auto thread_rm = SetupRobotModel(urdf, rm_config, planning_frame);
+        if (!thread_rm) {
+            return false;
+        }
+        if (found_kinematics_to_planning) {
+            thread_rm->setKinematicsToPlanningTransform(
+                    kinematics_to_planning, "what?");
+        }
+
+        auto thread_cc = builder.build(
+                &grid, urdf, cc_conf, group_name, planning_joints);
+        if (!thread_cc) {
+            return false;
+        }
+        if (thread_cc->robotCollisionModel()->name() == "pr2") {
+            initAllowedCollisionsPR2(*thread_cc);
+        }
+        thread_cc->setWorldToModelTransform(Eigen::Affine3d::Identity());
+        if (!thread_cc->setPlanningScene(thread_scene)) {
+            return false;
+        }
+
+        robot = std::move(thread_rm);
+        checker = std::move(thread_cc);
+        return true;
+    });
+
+    // later scene updates are applied to the collision checkers of additional
+    // planning threads without the world, which they already share
+    planner.setThreadContextUpdater([&](
+        sbpl::motion::RobotModel& robot,
+        sbpl::motion::CollisionChecker& checker,
+        const moveit_msgs::PlanningScene& scene)
+    {
+        moveit_msgs::PlanningScene thread_diff = scene;
+        thread_diff.world = moveit_msgs::PlanningSceneWorld();
+        auto& thread_cc = static_cast<sbpl::collision::CollisionSpace&>(checker);
+        return thread_cc.setPlanningScene(thread_diff);
+    });
+
     smpl::PlanningParams params;
     params.planning_frame = planning_frame;
 
@@ -1730,6 +1800,18 @@ int main(int argc, char* argv[])
 
     params.addParam("epsilon", 100.0);
 
+    int num_threads;
+    ph.param("num_threads", num_threads, 1);
+    params.addParam("num_threads", num_threads);
+
+    int bfs_threads;
+    ph.param("bfs_threads", bfs_threads, 1);
+    params.addParam("bfs_threads", bfs_threads);
+
+    bool incremental_repair;
+    ph.param("incremental_repair", incremental_repair, false);
+    params.addParam("incremental_repair", incremental_repair);
+
     if (!planner.init(params)) {
         ROS_ERROR("Failed to initialize Planner Interface");
         return 1;
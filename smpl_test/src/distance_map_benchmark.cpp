@@ -0,0 +1,214 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <smpl/distance_map/euclid_distance_map.h>
+#include <smpl/distance_map/hashed_distance_map.h>
+#include <smpl/distance_map/sparse_distance_map.h>
+
+// Compare the time to build, update, and query a distance map of a large,
+// mostly empty workspace using the dense, octree-based, and brick-hashed
+// distance maps, and verify that the dense and brick-hashed maps compute the
+// same distances away from the boundary of the workspace, which only the dense
+// map treats as an obstacle.
+//
+// usage: distance_map_benchmark [size_x] [size_y] [size_z] [res] [boxes] [sparse]
+
+typedef std::chrono::high_resolution_clock clock_type;
+
+struct Box
+{
+    Eigen::Vector3d min;
+    Eigen::Vector3d max;
+};
+
+std::vector<Box> MakeBoxes(
+    double size_x, double size_y, double size_z, int count)
+{
+    std::default_random_engine rng(1234);
+    std::uniform_real_distribution<double> px(0.0, size_x);
+    std::uniform_real_distribution<double> py(0.0, size_y);
+    std::uniform_real_distribution<double> side(0.2, 1.0);
+    std::uniform_real_distribution<double> height(0.2, size_z);
+
+    std::vector<Box> boxes;
+    for (int i = 0; i < count; ++i) {
+        Box b;
+        b.min = Eigen::Vector3d(px(rng), py(rng), 0.0);
+        b.max = b.min + Eigen::Vector3d(side(rng), side(rng), height(rng));
+        boxes.push_back(b);
+    }
+    return boxes;
+}
+
+std::vector<Eigen::Vector3d> VoxelizeBoxes(
+    const std::vector<Box>& boxes, const Eigen::Vector3d& offset, double res)
+{
+    std::vector<Eigen::Vector3d> points;
+    for (const Box& b : boxes) {
+        for (double x = b.min.x(); x < b.max.x(); x += res) {
+        for (double y = b.min.y(); y < b.max.y(); y += res) {
+        for (double z = b.min.z(); z < b.max.z(); z += res) {
+            points.push_back(Eigen::Vector3d(x, y, z) + offset);
+        }
+        }
+        }
+    }
+    return points;
+}
+
+template <typename Clock>
+double Seconds(typename Clock::time_point start, typename Clock::time_point finish)
+{
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+struct Timings
+{
+    double build;
+    double update;
+    double query;
+    double checksum;
+};
+
+// Build the map from one set of obstacles, move them to another set, and then
+// query the distances at a set of random points.
+Timings TimeMap(
+    sbpl::DistanceMapInterface& dmap,
+    const std::vector<Eigen::Vector3d>& points,
+    const std::vector<Eigen::Vector3d>& moved_points,
+    const std::vector<Eigen::Vector3d>& queries)
+{
+    Timings t;
+
+    auto start = clock_type::now();
+    dmap.addPointsToMap(points);
+    auto finish = clock_type::now();
+    t.build = Seconds<clock_type>(start, finish);
+
+    start = clock_type::now();
+    dmap.updatePointsInMap(points, moved_points);
+    finish = clock_type::now();
+    t.update = Seconds<clock_type>(start, finish);
+
+    double sum = 0.0;
+    start = clock_type::now();
+    for (const Eigen::Vector3d& q : queries) {
+        sum += dmap.getMetricDistance(q.x(), q.y(), q.z());
+    }
+    finish = clock_type::now();
+    t.query = Seconds<clock_type>(start, finish);
+    t.checksum = sum;
+
+    return t;
+}
+
+void PrintTimings(const char* name, const Timings& t, size_t query_count)
+{
+    printf("%-8s build: %0.3f s, update: %0.3f s, query: %0.1f ns\n",
+            name, t.build, t.update, 1e9 * t.query / query_count);
+}
+
+int main(int argc, char* argv[])
+{
+    const double size_x = argc > 1 ? atof(argv[1]) : 20.0;
+    const double size_y = argc > 2 ? atof(argv[2]) : 20.0;
+    const double size_z = argc > 3 ? atof(argv[3]) : 2.0;
+    const double res = argc > 4 ? atof(argv[4]) : 0.05;
+    const int box_count = argc > 5 ? atoi(argv[5]) : 50;
+    const bool run_sparse = argc > 6 ? atoi(argv[6]) != 0 : true;
+
+    const double max_dist = 0.4;
+    const size_t query_count = 10000000;
+
+    const std::vector<Box> boxes =
+            MakeBoxes(size_x - 1.0, size_y - 1.0, size_z, box_count);
+    const std::vector<Eigen::Vector3d> points =
+            VoxelizeBoxes(boxes, Eigen::Vector3d::Zero(), res);
+    const std::vector<Eigen::Vector3d> moved_points =
+            VoxelizeBoxes(boxes, Eigen::Vector3d(0.1, 0.1, 0.0), res);
+
+    std::default_random_engine rng(4321);
+    std::uniform_real_distribution<double> qx(0.0, size_x);
+    std::uniform_real_distribution<double> qy(0.0, size_y);
+    std::uniform_real_distribution<double> qz(0.0, size_z);
+    std::vector<Eigen::Vector3d> queries(query_count);
+    for (Eigen::Vector3d& q : queries) {
+        q = Eigen::Vector3d(qx(rng), qy(rng), qz(rng));
+    }
+
+    sbpl::EuclidDistanceMap dense(
+            0.0, 0.0, 0.0, size_x, size_y, size_z, res, max_dist);
+    sbpl::HashedDistanceMap hashed(
+            0.0, 0.0, 0.0, size_x, size_y, size_z, res, max_dist);
+
+    const Timings dense_t = TimeMap(dense, points, moved_points, queries);
+    const Timings hashed_t = TimeMap(hashed, points, moved_points, queries);
+
+    const size_t cell_count =
+            (size_t)dense.numCellsX() * dense.numCellsY() * dense.numCellsZ();
+    printf("workspace: %d x %d x %d cells, %d boxes, %zu obstacle points\n",
+            dense.numCellsX(), dense.numCellsY(), dense.numCellsZ(),
+            box_count, points.size());
+    PrintTimings("dense", dense_t, query_count);
+    PrintTimings("hashed", hashed_t, query_count);
+    if (run_sparse) {
+        sbpl::SparseDistanceMap sparse(
+                0.0, 0.0, 0.0, size_x, size_y, size_z, res, max_dist);
+        const Timings sparse_t = TimeMap(sparse, points, moved_points, queries);
+        PrintTimings("sparse", sparse_t, query_count);
+    }
+    printf("hashed cells allocated: %zu (%0.1f%% of the workspace)\n",
+            hashed.numAllocatedCells(),
+            100.0 * hashed.numAllocatedCells() / cell_count);
+
+    // skip cells within range of the boundary of the workspace
+    const int border = (int)std::ceil(max_dist / res) + 1;
+    int mismatches = 0;
+    for (int x = border; x < dense.numCellsX() - border; ++x) {
+        for (int y = border; y < dense.numCellsY() - border; ++y) {
+            for (int z = border; z < dense.numCellsZ() - border; ++z) {
+                if (dense.getCellDistance(x, y, z) !=
+                    hashed.getCellDistance(x, y, z))
+                {
+                    ++mismatches;
+                }
+            }
+        }
+    }
+    printf("mismatched distances: %d\n", mismatches);
+
+    return mismatches == 0 ? 0 : 1;
+}
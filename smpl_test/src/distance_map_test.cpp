@@ -0,0 +1,194 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+// standard includes
+#include <memory>
+#include <random>
+#include <vector>
+
+#define BOOST_TEST_MODULE DistanceMapTest
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+// system includes
+#include <Eigen/Dense>
+#include <smpl/distance_map/euclid_distance_map.h>
+
+const double size_x = 0.8, size_y = 0.8, size_z = 0.8;
+const double res = 0.02;
+const double origin_x = -0.4, origin_y = -0.4, origin_z = 0.0;
+const double max_distance = 0.2;
+
+static
+std::vector<Eigen::Vector3d> RandomPoints(std::mt19937& rng, int count)
+{
+    std::uniform_real_distribution<double> dx(origin_x, origin_x + size_x);
+    std::uniform_real_distribution<double> dy(origin_y, origin_y + size_y);
+    std::uniform_real_distribution<double> dz(origin_z, origin_z + size_z);
+    std::vector<Eigen::Vector3d> points;
+    for (int i = 0; i < count; ++i) {
+        points.emplace_back(dx(rng), dy(rng), dz(rng));
+    }
+    return points;
+}
+
+// Add or remove points one at a time, so that the changes are propagated
+// cell by cell rather than by recomputing the distance transform
+static
+void AddPointsIncrementally(
+    sbpl::EuclidDistanceMap& dmap,
+    const std::vector<Eigen::Vector3d>& points)
+{
+    for (const Eigen::Vector3d& p : points) {
+        dmap.addPointsToMap(std::vector<Eigen::Vector3d>(1, p));
+    }
+}
+
+static
+void RemovePointsIncrementally(
+    sbpl::EuclidDistanceMap& dmap,
+    const std::vector<Eigen::Vector3d>& points)
+{
+    for (const Eigen::Vector3d& p : points) {
+        dmap.removePointsFromMap(std::vector<Eigen::Vector3d>(1, p));
+    }
+}
+
+static
+void CheckDistancesEqual(
+    const sbpl::EuclidDistanceMap& expected,
+    const sbpl::EuclidDistanceMap& actual)
+{
+    BOOST_REQUIRE_EQUAL(expected.numCellsX(), actual.numCellsX());
+    BOOST_REQUIRE_EQUAL(expected.numCellsY(), actual.numCellsY());
+    BOOST_REQUIRE_EQUAL(expected.numCellsZ(), actual.numCellsZ());
+
+    int mismatches = 0;
+    for (int x = 0; x < expected.numCellsX(); ++x) {
+    for (int y = 0; y < expected.numCellsY(); ++y) {
+    for (int z = 0; z < expected.numCellsZ(); ++z) {
+        if (expected.getDistance(x, y, z) != actual.getDistance(x, y, z)) {
+            ++mismatches;
+        }
+    }
+    }
+    }
+    BOOST_CHECK_EQUAL(mismatches, 0);
+}
+
+BOOST_AUTO_TEST_CASE(ParallelTransformMatchesPropagationTest)
+{
+    std::mt19937 rng(1);
+    const std::vector<Eigen::Vector3d> points = RandomPoints(rng, 300);
+    const std::vector<Eigen::Vector3d> removed(
+            points.begin(), points.begin() + 200);
+
+    sbpl::EuclidDistanceMap propagated(
+            origin_x, origin_y, origin_z,
+            size_x, size_y, size_z,
+            res,
+            max_distance);
+
+    sbpl::EuclidDistanceMap serial(
+            origin_x, origin_y, origin_z,
+            size_x, size_y, size_z,
+            res,
+            max_distance);
+
+    sbpl::EuclidDistanceMap parallel(
+            origin_x, origin_y, origin_z,
+            size_x, size_y, size_z,
+            res,
+            max_distance);
+    parallel.setNumThreads(4);
+
+    AddPointsIncrementally(propagated, points);
+    serial.addPointsToMap(points);
+    parallel.addPointsToMap(points);
+
+    CheckDistancesEqual(propagated, serial);
+    CheckDistancesEqual(propagated, parallel);
+
+    RemovePointsIncrementally(propagated, removed);
+    serial.removePointsFromMap(removed);
+    parallel.removePointsFromMap(removed);
+
+    CheckDistancesEqual(propagated, serial);
+    CheckDistancesEqual(propagated, parallel);
+
+    // a copy computes its transforms with its own workers
+    std::unique_ptr<sbpl::EuclidDistanceMap> copy(
+            static_cast<sbpl::EuclidDistanceMap*>(parallel.clone()));
+    BOOST_CHECK_EQUAL(copy->numThreads(), 4);
+
+    const std::vector<Eigen::Vector3d> more_points = RandomPoints(rng, 300);
+    AddPointsIncrementally(propagated, more_points);
+    copy->addPointsToMap(more_points);
+    parallel.addPointsToMap(more_points);
+
+    CheckDistancesEqual(propagated, *copy);
+    CheckDistancesEqual(propagated, parallel);
+}
+
+BOOST_AUTO_TEST_CASE(DiscardPropagationStateTest)
+{
+    std::mt19937 rng(2);
+    const std::vector<Eigen::Vector3d> points = RandomPoints(rng, 300);
+    const std::vector<Eigen::Vector3d> removed(
+            points.begin(), points.begin() + 20);
+
+    sbpl::EuclidDistanceMap retained(
+            origin_x, origin_y, origin_z,
+            size_x, size_y, size_z,
+            res,
+            max_distance);
+
+    sbpl::EuclidDistanceMap released(
+            origin_x, origin_y, origin_z,
+            size_x, size_y, size_z,
+            res,
+            max_distance);
+    BOOST_CHECK(released.hasPropagationState());
+    released.setRetainPropagationState(false);
+    BOOST_CHECK(!released.hasPropagationState());
+
+    AddPointsIncrementally(retained, points);
+    released.addPointsToMap(points);
+    BOOST_CHECK(retained.hasPropagationState());
+    BOOST_CHECK(!released.hasPropagationState());
+    CheckDistancesEqual(retained, released);
+
+    // modifications rebuild the propagation state from the obstacles
+    RemovePointsIncrementally(retained, removed);
+    RemovePointsIncrementally(released, removed);
+    BOOST_CHECK(!released.hasPropagationState());
+    CheckDistancesEqual(retained, released);
+}
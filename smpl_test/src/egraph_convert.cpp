@@ -0,0 +1,221 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <smpl/csv_parser.h>
+#include <smpl/graph/experience_graph_file.h>
+#include <urdf/model.h>
+
+// Convert a set of experience graph demonstrations, stored as csv files with
+// a header row of joint variable names, to the binary experience graph format
+// read by ManipLatticeEgraph. The discretization of the graph is computed from
+// the joint limits in the urdf and the joint resolutions, in the same way as
+// ManipLattice, so that the stored coordinates may be used directly.
+//
+// usage: egraph_convert <urdf> <"joint res joint res ..."> <output> <csv|dir>...
+
+bool ParseResolutions(
+    const std::string& str,
+    std::map<std::string, double>& resolutions)
+{
+    std::stringstream ss(str);
+    std::string name;
+    double res;
+    while (ss >> name) {
+        if (!(ss >> res) || res <= 0.0) {
+            fprintf(stderr, "invalid resolution for joint '%s'\n", name.c_str());
+            return false;
+        }
+        resolutions[name] = res;
+    }
+    return true;
+}
+
+bool MakeDiscretization(
+    const urdf::Model& model,
+    const std::vector<std::string>& variable_names,
+    const std::map<std::string, double>& resolutions,
+    sbpl::motion::ExperienceGraphDiscretization& disc)
+{
+    for (const std::string& name : variable_names) {
+        auto joint = model.getJoint(name);
+        if (!joint) {
+            fprintf(stderr, "joint '%s' not found in urdf\n", name.c_str());
+            return false;
+        }
+        auto rit = resolutions.find(name);
+        if (rit == resolutions.end()) {
+            fprintf(stderr, "no resolution for joint '%s'\n", name.c_str());
+            return false;
+        }
+        const double res = rit->second;
+
+        const bool continuous = joint->type == urdf::Joint::CONTINUOUS;
+        const bool bounded = !continuous && joint->limits &&
+                (joint->type == urdf::Joint::REVOLUTE ||
+                joint->type == urdf::Joint::PRISMATIC);
+
+        double delta = res;
+        double min_limit = 0.0;
+        if (continuous) {
+            delta = (2.0 * M_PI) / std::round((2.0 * M_PI) / res);
+        } else if (bounded) {
+            const double span =
+                    std::fabs(joint->limits->upper - joint->limits->lower);
+            delta = span / std::round(span / res);
+            min_limit = joint->limits->lower;
+        }
+
+        disc.deltas.push_back(delta);
+        disc.min_limits.push_back(min_limit);
+        disc.continuous.push_back(continuous);
+        disc.bounded.push_back(bounded);
+    }
+    return true;
+}
+
+bool ReadPath(
+    const std::string& path,
+    std::vector<std::string>& variable_names,
+    std::vector<sbpl::motion::RobotState>& states)
+{
+    std::ifstream ifs(path);
+    if (!ifs.is_open()) {
+        fprintf(stderr, "failed to open %s\n", path.c_str());
+        return false;
+    }
+
+    sbpl::CSVParser parser;
+    if (!parser.parseStream(ifs, true)) {
+        fprintf(stderr, "failed to parse %s\n", path.c_str());
+        return false;
+    }
+
+    std::vector<std::string> names;
+    for (size_t i = 0; i < parser.fieldCount(); ++i) {
+        names.push_back(parser.nameAt(i));
+    }
+
+    if (variable_names.empty()) {
+        variable_names = names;
+    } else if (names != variable_names) {
+        fprintf(stderr, "variables in %s do not match\n", path.c_str());
+        return false;
+    }
+
+    states.resize(parser.recordCount());
+    for (size_t r = 0; r < parser.recordCount(); ++r) {
+        states[r].resize(parser.fieldCount());
+        for (size_t f = 0; f < parser.fieldCount(); ++f) {
+            try {
+                states[r][f] = std::stod(parser.fieldAt(r, f));
+            } catch (const std::exception&) {
+                fprintf(stderr, "invalid value in %s\n", path.c_str());
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 5) {
+        printf("Usage: egraph_convert <urdf> <\"joint res joint res ...\"> <output> <csv|dir>...\n");
+        return 0;
+    }
+
+    urdf::Model model;
+    if (!model.initFile(argv[1])) {
+        fprintf(stderr, "failed to load urdf %s\n", argv[1]);
+        return 1;
+    }
+
+    std::map<std::string, double> resolutions;
+    if (!ParseResolutions(argv[2], resolutions)) {
+        return 1;
+    }
+
+    std::vector<std::string> inputs;
+    for (int i = 4; i < argc; ++i) {
+        boost::filesystem::path p(argv[i]);
+        if (boost::filesystem::is_directory(p)) {
+            std::vector<std::string> files;
+            for (boost::filesystem::directory_iterator dit(p);
+                dit != boost::filesystem::directory_iterator(); ++dit)
+            {
+                if (boost::filesystem::is_regular_file(dit->path()) &&
+                    dit->path().extension() == ".csv")
+                {
+                    files.push_back(dit->path().string());
+                }
+            }
+            std::sort(files.begin(), files.end());
+            inputs.insert(inputs.end(), files.begin(), files.end());
+        } else {
+            inputs.push_back(p.string());
+        }
+    }
+
+    std::vector<std::string> variable_names;
+    std::vector<std::vector<sbpl::motion::RobotState>> paths;
+    for (const std::string& input : inputs) {
+        std::vector<sbpl::motion::RobotState> states;
+        if (!ReadPath(input, variable_names, states)) {
+            return 1;
+        }
+        paths.push_back(std::move(states));
+    }
+
+    sbpl::motion::ExperienceGraphDiscretization disc;
+    if (!MakeDiscretization(model, variable_names, resolutions, disc)) {
+        return 1;
+    }
+
+    if (!sbpl::motion::WriteExperienceGraphFile(
+            argv[3], variable_names, disc, paths))
+    {
+        fprintf(stderr, "failed to write %s\n", argv[3]);
+        return 1;
+    }
+
+    printf("wrote %zu paths to %s\n", paths.size(), argv[3]);
+    return 0;
+}
@@ -0,0 +1,287 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+// standard includes
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define BOOST_TEST_MODULE ExperienceGraphFileTest
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+// system includes
+#include <boost/filesystem.hpp>
+#include <smpl/graph/experience_graph.h>
+#include <smpl/graph/experience_graph_file.h>
+
+namespace smpl = sbpl::motion;
+
+// byte offsets of fields in the header of an experience graph file
+const size_t version_offset = 8;
+const size_t edges_offset_offset = 88;
+const size_t paths_offset_offset = 96;
+
+struct TempFile
+{
+    std::string path;
+
+    TempFile() :
+        path((boost::filesystem::temp_directory_path() /
+                boost::filesystem::unique_path("egraph_file_test_%%%%%%%%")).string())
+    { }
+
+    ~TempFile() { boost::filesystem::remove(path); }
+};
+
+static
+smpl::ExperienceGraphDiscretization MakeDiscretization()
+{
+    smpl::ExperienceGraphDiscretization disc;
+    disc.deltas = { 0.1, 0.1 };
+    disc.min_limits = { -1.0, 0.0 };
+    disc.continuous = { false, true };
+    disc.bounded = { true, false };
+    return disc;
+}
+
+static
+std::vector<std::vector<smpl::RobotState>> MakePaths()
+{
+    // the second and third states of the first path share discrete
+    // coordinates with the first, and become waypoints of its first edge
+    return {
+        { { 0.0, 0.0 }, { 0.01, 0.01 }, { 0.02, 0.0 }, { 0.2, 0.3 }, { 0.4, 0.3 } },
+        { { -0.5, 6.2 }, { -0.3, 6.0 } },
+        { { 0.5, 0.5 } },
+    };
+}
+
+static
+bool WriteTestFile(const std::string& path)
+{
+    return smpl::WriteExperienceGraphFile(
+            path, { "j1", "j2" }, MakeDiscretization(), MakePaths());
+}
+
+static
+std::vector<char> ReadBytes(const std::string& path)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    return std::vector<char>(
+            std::istreambuf_iterator<char>(ifs),
+            std::istreambuf_iterator<char>());
+}
+
+static
+void WriteBytes(const std::string& path, const std::vector<char>& bytes)
+{
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    ofs.write(bytes.data(), bytes.size());
+}
+
+template <typename T>
+static
+T ReadField(const std::vector<char>& bytes, size_t offset)
+{
+    T value;
+    std::memcpy(&value, bytes.data() + offset, sizeof(value));
+    return value;
+}
+
+template <typename T>
+static
+void WriteField(std::vector<char>& bytes, size_t offset, T value)
+{
+    std::memcpy(bytes.data() + offset, &value, sizeof(value));
+}
+
+static
+std::vector<double> StateAt(const smpl::ExperienceGraphFile& file, size_t n)
+{
+    return std::vector<double>(
+            file.nodeState(n), file.nodeState(n) + file.variableCount());
+}
+
+BOOST_AUTO_TEST_CASE(RoundTripTest)
+{
+    TempFile tmp;
+    BOOST_REQUIRE(WriteTestFile(tmp.path));
+
+    smpl::ExperienceGraphFile file;
+    BOOST_REQUIRE(file.open(tmp.path));
+    BOOST_CHECK(file.isOpen());
+
+    BOOST_CHECK(file.variableNames() == std::vector<std::string>({ "j1", "j2" }));
+    const smpl::ExperienceGraphDiscretization disc = MakeDiscretization();
+    BOOST_CHECK(file.discretization().deltas == disc.deltas);
+    BOOST_CHECK(file.discretization().min_limits == disc.min_limits);
+    BOOST_CHECK(file.discretization().continuous == disc.continuous);
+    BOOST_CHECK(file.discretization().bounded == disc.bounded);
+
+    const std::vector<std::vector<smpl::RobotState>> paths = MakePaths();
+    BOOST_REQUIRE_EQUAL(file.nodeCount(), 6);
+    BOOST_REQUIRE_EQUAL(file.edgeCount(), 3);
+    BOOST_REQUIRE_EQUAL(file.pathCount(), 3);
+
+    BOOST_CHECK(StateAt(file, 0) == paths[0][0]);
+    BOOST_CHECK(StateAt(file, 1) == paths[0][3]);
+    BOOST_CHECK(StateAt(file, 2) == paths[0][4]);
+    BOOST_CHECK(StateAt(file, 3) == paths[1][0]);
+    BOOST_CHECK(StateAt(file, 4) == paths[1][1]);
+    BOOST_CHECK(StateAt(file, 5) == paths[2][0]);
+
+    for (size_t n = 0; n < file.nodeCount(); ++n) {
+        std::int32_t coord[2];
+        disc.discretize(file.nodeState(n), coord);
+        BOOST_CHECK_EQUAL(file.nodeCoord(n)[0], coord[0]);
+        BOOST_CHECK_EQUAL(file.nodeCoord(n)[1], coord[1]);
+    }
+
+    BOOST_CHECK_EQUAL(file.pathFirstNode(0), 0);
+    BOOST_CHECK_EQUAL(file.pathNodeCount(0), 3);
+    BOOST_CHECK_EQUAL(file.pathFirstEdge(0), 0);
+    BOOST_CHECK_EQUAL(file.pathFirstNode(1), 3);
+    BOOST_CHECK_EQUAL(file.pathNodeCount(1), 2);
+    BOOST_CHECK_EQUAL(file.pathFirstEdge(1), 2);
+    BOOST_CHECK_EQUAL(file.pathFirstNode(2), 5);
+    BOOST_CHECK_EQUAL(file.pathNodeCount(2), 1);
+    BOOST_CHECK_EQUAL(file.pathFirstEdge(2), 3);
+
+    BOOST_CHECK_EQUAL(file.edgeSource(0), 0);
+    BOOST_CHECK_EQUAL(file.edgeTarget(0), 1);
+    BOOST_CHECK_EQUAL(file.edgeSource(1), 1);
+    BOOST_CHECK_EQUAL(file.edgeTarget(1), 2);
+    BOOST_CHECK_EQUAL(file.edgeSource(2), 3);
+    BOOST_CHECK_EQUAL(file.edgeTarget(2), 4);
+    BOOST_CHECK_EQUAL(file.edgeWaypointCount(0), 2);
+    BOOST_CHECK_EQUAL(file.edgeWaypointCount(1), 0);
+    BOOST_CHECK_EQUAL(file.edgeWaypointCount(2), 0);
+
+    // insert the file into an experience graph, as ManipLatticeEgraph does
+    smpl::ExperienceGraph eg;
+    for (size_t n = 0; n < file.nodeCount(); ++n) {
+        eg.insert_node(StateAt(file, n));
+    }
+    for (size_t e = 0; e < file.edgeCount(); ++e) {
+        eg.insert_edge(
+                file.edgeSource(e),
+                file.edgeTarget(e),
+                file.edgeWaypoints(e),
+                file.edgeWaypointCount(e),
+                file.variableCount());
+    }
+    file.close();
+    BOOST_CHECK(!file.isOpen());
+
+    // the graph keeps its waypoints after the file is closed
+    std::vector<smpl::RobotState> waypoints;
+    eg.waypoints(0, waypoints);
+    BOOST_CHECK(waypoints == std::vector<smpl::RobotState>({ paths[0][1], paths[0][2] }));
+    eg.waypoints(1, waypoints);
+    BOOST_CHECK(waypoints.empty());
+}
+
+BOOST_AUTO_TEST_CASE(RejectCorruptFileTest)
+{
+    TempFile tmp;
+    BOOST_REQUIRE(WriteTestFile(tmp.path));
+    const std::vector<char> valid = ReadBytes(tmp.path);
+
+    smpl::ExperienceGraphFile file;
+    BOOST_REQUIRE(file.open(tmp.path));
+
+    auto open_rejects = [&](const std::vector<char>& bytes) {
+        WriteBytes(tmp.path, bytes);
+        const bool opened = file.open(tmp.path);
+        return !opened &&
+                !file.isOpen() &&
+                file.nodeCount() == 0 &&
+                file.edgeCount() == 0 &&
+                file.pathCount() == 0 &&
+                file.variableCount() == 0;
+    };
+
+    // missing file
+    BOOST_CHECK(!file.open(tmp.path + ".missing"));
+    BOOST_CHECK(!file.isOpen());
+
+    // empty and truncated files
+    BOOST_CHECK(open_rejects(std::vector<char>()));
+    BOOST_CHECK(open_rejects(std::vector<char>(valid.begin(), valid.begin() + 64)));
+    BOOST_CHECK(open_rejects(std::vector<char>(valid.begin(), valid.end() - 8)));
+
+    // trailing data
+    std::vector<char> bytes = valid;
+    bytes.push_back(0);
+    BOOST_CHECK(open_rejects(bytes));
+
+    // bad magic
+    bytes = valid;
+    bytes[0] = 'X';
+    BOOST_CHECK(open_rejects(bytes));
+
+    // unknown version
+    bytes = valid;
+    WriteField<std::uint32_t>(bytes, version_offset, 2);
+    BOOST_CHECK(open_rejects(bytes));
+
+    // misaligned section
+    bytes = valid;
+    const std::uint64_t edges_offset =
+            ReadField<std::uint64_t>(valid, edges_offset_offset);
+    WriteField<std::uint64_t>(bytes, edges_offset_offset, edges_offset + 4);
+    BOOST_CHECK(open_rejects(bytes));
+
+    // edge referring to a node past the end of the node table
+    bytes = valid;
+    WriteField<std::uint32_t>(bytes, edges_offset, 6);
+    BOOST_CHECK(open_rejects(bytes));
+
+    // edge referring to waypoints past the end of the waypoint table
+    bytes = valid;
+    WriteField<std::uint32_t>(bytes, edges_offset + 3 * sizeof(std::uint32_t), 3);
+    BOOST_CHECK(open_rejects(bytes));
+
+    // path referring to nodes past the end of the node table
+    bytes = valid;
+    const std::uint64_t paths_offset =
+            ReadField<std::uint64_t>(valid, paths_offset_offset);
+    WriteField<std::uint32_t>(bytes, paths_offset + sizeof(std::uint32_t), 7);
+    BOOST_CHECK(open_rejects(bytes));
+
+    // a valid file may still be opened after failures
+    WriteBytes(tmp.path, valid);
+    BOOST_CHECK(file.open(tmp.path));
+    BOOST_CHECK_EQUAL(file.nodeCount(), 6);
+}
@@ -31,6 +31,9 @@
 
 // standard includes
 #include <algorithm>
+#include <cmath>
+#include <random>
+#include <tuple>
 
 #define BOOST_TEST_MODULE ExperienceGraphTest
 #define BOOST_TEST_DYN_LINK
@@ -43,22 +46,22 @@ namespace smpl = sbpl::motion;
 
 bool IteratedAllNodes(const smpl::ExperienceGraph& eg)
 {
-    std::vector<bool> found(eg.num_nodes(), false);
+    std::vector<bool> found(eg.node_id_bound(), false);
     auto nodes = eg.nodes();
     for (auto it = nodes.first; it != nodes.second; ++it) {
         found[*it] = true;
     }
-    return std::count(found.begin(), found.end(), true) == found.size();
+    return std::count(found.begin(), found.end(), true) == eg.num_nodes();
 }
 
 bool IteratedAllEdges(const smpl::ExperienceGraph& eg)
 {
-    std::vector<bool> found(eg.num_edges(), false);
+    std::vector<bool> found(eg.edge_id_bound(), false);
     auto edges = eg.edges();
     for (auto it = edges.first; it != edges.second; ++it) {
         found[*it] = true;
     }
-    return std::count(found.begin(), found.end(), true) == found.size();
+    return std::count(found.begin(), found.end(), true) == eg.num_edges();
 }
 
 BOOST_AUTO_TEST_CASE(DefaultConstructorTest)
@@ -229,17 +232,17 @@ BOOST_AUTO_TEST_CASE(RemoveInteriorNodesWithEdgeUpdatesTest)
     BOOST_CHECK_EQUAL(*eg.adjacent_nodes(n3).first, n2);
 
     // all edges go between the two nodes, assert that
-    std::vector<bool> found(eg.num_edges(), false);
+    std::vector<bool> found(eg.edge_id_bound(), false);
     for (auto it = eg.edges(n2).first; it != eg.edges(n2).second; ++it) {
         found[*it] = true;
     }
-    BOOST_CHECK_EQUAL(std::count(found.begin(), found.end(), true), found.size());
+    BOOST_CHECK_EQUAL(std::count(found.begin(), found.end(), true), eg.num_edges());
 
-    found.assign(eg.num_edges(), false);
+    found.assign(eg.edge_id_bound(), false);
     for (auto it = eg.edges(n3).first; it != eg.edges(n3).second; ++it) {
         found[*it] = true;
     }
-    BOOST_CHECK_EQUAL(std::count(found.begin(), found.end(), true), found.size());
+    BOOST_CHECK_EQUAL(std::count(found.begin(), found.end(), true), eg.num_edges());
 
     BOOST_CHECK(eg.source(e3) == n2 && eg.target(e3) == n3 ||
                 eg.source(e3) == n3 && eg.target(e3) == n2);
@@ -367,9 +370,291 @@ BOOST_AUTO_TEST_CASE(ParallelEdgeTest)
     BOOST_CHECK_EQUAL(*++adjacent_nodes.first, n2);
 
     eg.erase_edge(e121);
-//
-//    adjacent_nodes = eg.adjacent_nodes(n1);
-//    BOOST_CHECK_EQUAL(*adjacent_nodes.first, n2);
-//
-//    BOOST_CHECK_EQUAL(eg.degree(n1), 1);
+
+    adjacent_nodes = eg.adjacent_nodes(n1);
+    BOOST_CHECK_EQUAL(*adjacent_nodes.first, n2);
+    BOOST_CHECK_EQUAL(*eg.edges(n1).first, e122);
+    BOOST_CHECK_EQUAL(eg.degree(n1), 1);
+
+    // erasing by node ids erases all parallel edges
+    eg.insert_edge(n1, n2);
+    eg.erase_edge(n2, n1);
+    BOOST_CHECK_EQUAL(eg.num_edges(), 0);
+    BOOST_CHECK_EQUAL(eg.degree(n1), 0);
+    BOOST_CHECK_EQUAL(eg.degree(n2), 0);
+}
+
+BOOST_AUTO_TEST_CASE(TombstonedIdsTest)
+{
+    smpl::ExperienceGraph eg;
+    std::vector<smpl::ExperienceGraph::node_id> n;
+    for (int i = 0; i < 5; ++i) {
+        n.push_back(eg.insert_node(smpl::RobotState(1, (double)i)));
+    }
+    std::vector<smpl::ExperienceGraph::edge_id> e;
+    for (int i = 0; i < 4; ++i) {
+        e.push_back(eg.insert_edge(n[i], n[i + 1]));
+    }
+
+    // erasure leaves the ids of the remaining nodes and edges unchanged
+    eg.erase_node(n[1]);
+    BOOST_CHECK_EQUAL(eg.num_nodes(), 4);
+    BOOST_CHECK_EQUAL(eg.num_edges(), 2);
+    BOOST_CHECK_EQUAL(eg.node_id_bound(), 5);
+    BOOST_CHECK_EQUAL(eg.edge_id_bound(), 4);
+    BOOST_CHECK(IteratedAllNodes(eg));
+    BOOST_CHECK(IteratedAllEdges(eg));
+    BOOST_CHECK_EQUAL(std::distance(eg.nodes().first, eg.nodes().second), 4);
+    BOOST_CHECK_EQUAL(*eg.nodes().first, n[0]);
+    BOOST_CHECK_EQUAL(*++eg.nodes().first, n[2]);
+    BOOST_CHECK_EQUAL(*--eg.edges().second, e[3]);
+    BOOST_CHECK_EQUAL(eg.source(e[2]), n[2]);
+    BOOST_CHECK_EQUAL(eg.target(e[3]), n[4]);
+    BOOST_CHECK_EQUAL(eg.degree(n[0]), 0);
+    BOOST_CHECK_EQUAL(eg.degree(n[2]), 1);
+    BOOST_CHECK_THROW(eg.erase_node(n[1]), std::out_of_range);
+    BOOST_CHECK_THROW(eg.erase_edge(e[0]), std::out_of_range);
+    BOOST_CHECK_THROW(eg.insert_edge(n[0], n[1]), std::out_of_range);
+
+    // erased nodes are not found by nearest-neighbor queries
+    smpl::ExperienceGraph::node_id nearest;
+    BOOST_CHECK(eg.nearest_node(smpl::RobotState(1, 1.0), nearest));
+    BOOST_CHECK(nearest == n[0] || nearest == n[2]);
+
+    // once erased ids outnumber the remaining ids, they are released
+    eg.erase_edge(e[2]);
+    BOOST_CHECK_EQUAL(eg.num_edges(), 1);
+    BOOST_CHECK_EQUAL(eg.edge_id_bound(), 1);
+    BOOST_CHECK_EQUAL(eg.node_id_bound(), 4);
+    BOOST_CHECK(IteratedAllNodes(eg));
+    BOOST_CHECK(IteratedAllEdges(eg));
+    BOOST_CHECK_EQUAL(eg.state(eg.source(0))[0], 3.0);
+    BOOST_CHECK_EQUAL(eg.state(eg.target(0))[0], 4.0);
+    BOOST_CHECK(eg.nearest_node(smpl::RobotState(1, 1.2), nearest));
+    BOOST_CHECK_EQUAL(eg.state(nearest)[0], 2.0);
+}
+
+// Return the ids of all nodes within a radius of a state, by brute force
+std::vector<smpl::ExperienceGraph::node_id> NodesWithin(
+    const smpl::ExperienceGraph& eg,
+    const smpl::RobotState& state,
+    double radius)
+{
+    std::vector<smpl::ExperienceGraph::node_id> ids;
+    auto nodes = eg.nodes();
+    for (auto it = nodes.first; it != nodes.second; ++it) {
+        double d = 0.0;
+        for (size_t i = 0; i < state.size(); ++i) {
+            const double di = eg.state(*it)[i] - state[i];
+            d += di * di;
+        }
+        if (d <= radius * radius) {
+            ids.push_back(*it);
+        }
+    }
+    return ids;
+}
+
+BOOST_AUTO_TEST_CASE(NearestNodesTest)
+{
+    smpl::ExperienceGraph eg;
+
+    smpl::ExperienceGraph::node_id n;
+    BOOST_CHECK(!eg.nearest_node(smpl::RobotState(3, 0.0), n));
+
+    // a random walk, as in a demonstrated path, followed by duplicate states
+    std::default_random_engine rng(1234);
+    std::uniform_real_distribution<double> step(-0.1, 0.1);
+    smpl::RobotState state(3, 0.0);
+    for (int i = 0; i < 1000; ++i) {
+        for (double& v : state) {
+            v += step(rng);
+        }
+        eg.insert_node(state);
+    }
+    for (int i = 0; i < 100; ++i) {
+        eg.insert_node(state);
+    }
+
+    std::uniform_real_distribution<double> coord(-2.0, 2.0);
+    for (int i = 0; i < 100; ++i) {
+        smpl::RobotState q = { coord(rng), coord(rng), coord(rng) };
+
+        std::vector<smpl::ExperienceGraph::node_id> ids;
+        eg.nearest_nodes(q, 0.5, ids);
+        std::sort(ids.begin(), ids.end());
+        BOOST_CHECK(ids == NodesWithin(eg, q, 0.5));
+
+        BOOST_CHECK(eg.nearest_node(q, n));
+        std::vector<smpl::ExperienceGraph::node_id> nearer;
+        double d = 0.0;
+        for (size_t j = 0; j < q.size(); ++j) {
+            d += (eg.state(n)[j] - q[j]) * (eg.state(n)[j] - q[j]);
+        }
+        nearer = NodesWithin(eg, q, std::sqrt(d) * (1.0 - 1e-9));
+        BOOST_CHECK(nearer.empty());
+    }
+
+    // erased nodes are skipped until erasing more than half of the nodes
+    // compacts the graph and renumbers the remaining nodes
+    for (int count : { 100, 500 }) {
+        for (int i = 0; i < count; ++i) {
+            eg.erase_node(*eg.nodes().first);
+        }
+        const smpl::ExperienceGraph::node_id first = *eg.nodes().first;
+        smpl::RobotState q = eg.state(first);
+        std::vector<smpl::ExperienceGraph::node_id> ids;
+        eg.nearest_nodes(q, 0.3, ids);
+        std::sort(ids.begin(), ids.end());
+        BOOST_CHECK(ids == NodesWithin(eg, q, 0.3));
+        BOOST_CHECK(std::find(ids.begin(), ids.end(), first) != ids.end());
+        BOOST_CHECK(eg.nearest_node(q, n));
+        BOOST_CHECK(n == first || eg.state(n) == q);
+    }
+    BOOST_CHECK_EQUAL(eg.num_nodes(), 500);
+    BOOST_CHECK_LT(eg.node_id_bound(), 1100);
+}
+
+BOOST_AUTO_TEST_CASE(EdgeWaypointsTest)
+{
+    smpl::ExperienceGraph eg;
+    smpl::ExperienceGraph::node_id n1 = eg.insert_node(smpl::RobotState(2, 0.0));
+    smpl::ExperienceGraph::node_id n2 = eg.insert_node(smpl::RobotState(2, 1.0));
+
+    std::vector<smpl::RobotState> path = { { 0.25, 0.25 }, { 0.5, 0.5 } };
+    smpl::ExperienceGraph::edge_id e1 = eg.insert_edge(n1, n2);
+    smpl::ExperienceGraph::edge_id e2 = eg.insert_edge(n1, n2, path);
+
+    BOOST_CHECK_EQUAL(eg.waypoint_count(e1), 0);
+    BOOST_CHECK_EQUAL(eg.waypoint_count(e2), 2);
+    BOOST_CHECK_EQUAL(eg.waypoint(e2, 1)[0], 0.5);
+
+    eg.erase_edge(e1);
+    eg.compact();
+    e2 = *eg.edges().first;
+
+    std::vector<smpl::RobotState> waypoints;
+    eg.waypoints(e2, waypoints);
+    BOOST_CHECK(waypoints == path);
+
+    BOOST_CHECK_THROW(
+            eg.insert_edge(n1, n2, { smpl::RobotState(3, 0.0) }),
+            std::invalid_argument);
+}
+
+// Compare the graph against a simple model under a random sequence of
+// insertions and erasures. Node ids may change when the graph is compacted, so
+// nodes are identified by their states.
+BOOST_AUTO_TEST_CASE(RandomEditsTest)
+{
+    struct ModelEdge
+    {
+        double u;
+        double v;
+        std::vector<smpl::RobotState> waypoints;
+
+        bool operator==(const ModelEdge& o) const
+        {
+            return std::tie(u, v, waypoints) == std::tie(o.u, o.v, o.waypoints);
+        }
+
+        bool operator<(const ModelEdge& o) const
+        {
+            return std::tie(u, v, waypoints) < std::tie(o.u, o.v, o.waypoints);
+        }
+    };
+
+    smpl::ExperienceGraph eg;
+    size_t node_count = 0;
+    std::vector<ModelEdge> edges;
+
+    auto nth_node = [&](size_t i) {
+        auto it = eg.nodes().first;
+        std::advance(it, i);
+        return *it;
+    };
+    auto nth_edge = [&](size_t i) {
+        auto it = eg.edges().first;
+        std::advance(it, i);
+        return *it;
+    };
+    auto model_edge = [&](smpl::ExperienceGraph::edge_id e) {
+        ModelEdge m;
+        m.u = eg.state(eg.source(e))[0];
+        m.v = eg.state(eg.target(e))[0];
+        eg.waypoints(e, m.waypoints);
+        return m;
+    };
+    std::default_random_engine rng(1234);
+    for (int i = 0; i < 2000; ++i) {
+        const int op = std::uniform_int_distribution<int>(0, 9)(rng);
+        if (op < 3 || node_count == 0) {
+            eg.insert_node(smpl::RobotState(2, (double)i));
+            ++node_count;
+        } else if (op < 7) {
+            std::uniform_int_distribution<size_t> node(0, node_count - 1);
+            const smpl::ExperienceGraph::node_id u = nth_node(node(rng));
+            const smpl::ExperienceGraph::node_id v = nth_node(node(rng));
+            ModelEdge e;
+            e.u = eg.state(u)[0];
+            e.v = eg.state(v)[0];
+            const int wp_count = std::uniform_int_distribution<int>(0, 3)(rng);
+            for (int w = 0; w < wp_count; ++w) {
+                e.waypoints.push_back(smpl::RobotState(2, (double)(i + w)));
+            }
+            eg.insert_edge(u, v, e.waypoints);
+            edges.push_back(e);
+        } else if (op < 9 && !edges.empty()) {
+            std::uniform_int_distribution<size_t> edge(0, edges.size() - 1);
+            const smpl::ExperienceGraph::edge_id eid = nth_edge(edge(rng));
+            const ModelEdge e = model_edge(eid);
+            eg.erase_edge(eid);
+            auto it = std::find(edges.begin(), edges.end(), e);
+            BOOST_REQUIRE(it != edges.end());
+            edges.erase(it);
+        } else {
+            std::uniform_int_distribution<size_t> node(0, node_count - 1);
+            const smpl::ExperienceGraph::node_id nid = nth_node(node(rng));
+            const double s = eg.state(nid)[0];
+            eg.erase_node(nid);
+            --node_count;
+            auto it = std::remove_if(edges.begin(), edges.end(),
+                    [&](const ModelEdge& e) { return e.u == s || e.v == s; });
+            edges.erase(it, edges.end());
+        }
+
+        BOOST_REQUIRE_EQUAL(eg.num_nodes(), node_count);
+        BOOST_REQUIRE_EQUAL(eg.num_edges(), edges.size());
+        BOOST_REQUIRE_LE(eg.node_id_bound(), 2 * node_count);
+        BOOST_REQUIRE_LE(eg.edge_id_bound(), 2 * edges.size());
+    }
+
+    std::vector<ModelEdge> found;
+    auto eit = eg.edges();
+    for (auto it = eit.first; it != eit.second; ++it) {
+        found.push_back(model_edge(*it));
+    }
+    std::sort(found.begin(), found.end());
+    std::sort(edges.begin(), edges.end());
+    BOOST_CHECK(found == edges);
+
+    // every edge appears in the adjacency lists of both of its nodes
+    auto nit = eg.nodes();
+    for (auto n = nit.first; n != nit.second; ++n) {
+        size_t degree = 0;
+        auto eit = eg.edges(*n);
+        auto ait = eg.adjacent_nodes(*n);
+        for ( ; eit.first != eit.second; ++eit.first, ++ait.first) {
+            const smpl::ExperienceGraph::edge_id e = *eit.first;
+            BOOST_CHECK(
+                    (eg.source(e) == *n && eg.target(e) == *ait.first) ||
+                    (eg.target(e) == *n && eg.source(e) == *ait.first));
+            ++degree;
+        }
+        const double s = eg.state(*n)[0];
+        const size_t expected = std::count_if(edges.begin(), edges.end(),
+                [&](const ModelEdge& e) { return e.u == s || e.v == s; });
+        BOOST_CHECK_EQUAL(degree, expected);
+        BOOST_CHECK_EQUAL(eg.degree(*n), expected);
+    }
 }
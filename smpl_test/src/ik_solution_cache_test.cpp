@@ -0,0 +1,367 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+// standard includes
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#define BOOST_TEST_MODULE IKSolutionCacheTest
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+// system includes
+#include <smpl/collision_checker.h>
+#include <smpl/planning_params.h>
+#include <smpl/robot_model.h>
+#include <smpl/graph/ik_solution_cache.h>
+#include <smpl/graph/workspace_lattice_base.h>
+
+namespace smpl = sbpl::motion;
+
+BOOST_AUTO_TEST_CASE(HitMissTest)
+{
+    smpl::IKSolutionCache cache(4);
+
+    bool found;
+    smpl::RobotState solution;
+    BOOST_CHECK(!cache.lookup({ 1, 2, 3 }, found, solution));
+
+    cache.insert({ 1, 2, 3 }, true, { 0.1, 0.2 });
+    cache.insert({ 4, 5, 6 }, false, smpl::RobotState());
+
+    BOOST_REQUIRE(cache.lookup({ 1, 2, 3 }, found, solution));
+    BOOST_CHECK(found);
+    BOOST_CHECK(solution == smpl::RobotState({ 0.1, 0.2 }));
+
+    // failed solves are cached as well
+    BOOST_REQUIRE(cache.lookup({ 4, 5, 6 }, found, solution));
+    BOOST_CHECK(!found);
+
+    BOOST_CHECK(!cache.lookup({ 1, 2, 4 }, found, solution));
+
+    const smpl::IKSolutionCache::Stats stats = cache.stats();
+    BOOST_CHECK_EQUAL(stats.hits, 2);
+    BOOST_CHECK_EQUAL(stats.misses, 2);
+    BOOST_CHECK_EQUAL(stats.evictions, 0);
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(LRUEvictionTest)
+{
+    smpl::IKSolutionCache cache(2);
+
+    bool found;
+    smpl::RobotState solution;
+    cache.insert({ 0 }, true, { 0.0 });
+    cache.insert({ 1 }, true, { 1.0 });
+
+    // touch { 0 } so that { 1 } is the least recently used entry
+    BOOST_REQUIRE(cache.lookup({ 0 }, found, solution));
+
+    cache.insert({ 2 }, true, { 2.0 });
+    BOOST_CHECK_EQUAL(cache.size(), 2);
+    BOOST_CHECK_EQUAL(cache.stats().evictions, 1);
+    BOOST_CHECK(cache.lookup({ 0 }, found, solution));
+    BOOST_CHECK(!cache.lookup({ 1 }, found, solution));
+    BOOST_CHECK(cache.lookup({ 2 }, found, solution));
+
+    // shrinking the cache evicts the least recently used entries
+    cache.setCapacity(1);
+    BOOST_CHECK_EQUAL(cache.size(), 1);
+    BOOST_CHECK(cache.lookup({ 2 }, found, solution));
+    BOOST_CHECK(!cache.lookup({ 0 }, found, solution));
+
+    // a cache without capacity stores nothing
+    cache.setCapacity(0);
+    cache.insert({ 3 }, true, { 3.0 });
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+}
+
+// A three-joint arm whose ik solution for the first joint flips with the sign
+// of the seed, as for the elbow of an arm, and whose last joint is redundant.
+// Only the planning link pose's x coordinate is meaningful.
+class BranchingArmModel :
+    public smpl::ForwardKinematicsInterface,
+    public smpl::InverseKinematicsInterface,
+    public smpl::RedundantManipulatorInterface
+{
+public:
+
+    int ik_count = 0;
+
+    // whether the model identifies the branch of each seed
+    bool report_branches = false;
+
+    BranchingArmModel() { setPlanningJoints({ "j0", "j1", "j2" }); }
+
+    double minPosLimit(int jidx) const override { return -M_PI; }
+    double maxPosLimit(int jidx) const override { return M_PI; }
+    bool hasPosLimit(int jidx) const override { return true; }
+    bool isContinuous(int jidx) const override { return false; }
+    double velLimit(int jidx) const override { return 0.0; }
+    double accLimit(int jidx) const override { return 0.0; }
+
+    bool checkJointLimits(
+        const smpl::RobotState& state,
+        bool verbose = false) override
+    {
+        return true;
+    }
+
+    bool computeFK(
+        const smpl::RobotState& state,
+        const std::string& name,
+        std::vector<double>& pose) override
+    {
+        return computePlanningLinkFK(state, pose);
+    }
+
+    bool computePlanningLinkFK(
+        const smpl::RobotState& state,
+        std::vector<double>& pose) override
+    {
+        pose.assign(6, 0.0);
+        pose[0] = std::fabs(state[0]);
+        return true;
+    }
+
+    bool computeIK(
+        const std::vector<double>& pose,
+        const smpl::RobotState& start,
+        smpl::RobotState& solution,
+        smpl::ik_option::IkOption option) override
+    {
+        return computeFastIK(pose, start, solution);
+    }
+
+    bool computeIK(
+        const std::vector<double>& pose,
+        const smpl::RobotState& start,
+        std::vector<smpl::RobotState>& solutions,
+        smpl::ik_option::IkOption option) override
+    {
+        solutions.resize(1);
+        return computeFastIK(pose, start, solutions[0]);
+    }
+
+    const int redundantVariableCount() const override { return 1; }
+    const int redundantVariableIndex(int rvidx) const override { return 2; }
+
+    bool computeFastIK(
+        const std::vector<double>& pose,
+        const smpl::RobotState& start,
+        smpl::RobotState& solution) override
+    {
+        ++ik_count;
+        solution = start;
+        solution[0] = start[0] >= 0.0 ? pose[0] : -pose[0];
+        return true;
+    }
+
+    int ikSolutionBranch(const smpl::RobotState& state) const override
+    {
+        if (!report_branches) {
+            return -1;
+        }
+        return state[0] >= 0.0 ? 0 : 1;
+    }
+
+    smpl::Extension* getExtension(size_t class_code) override
+    {
+        if (class_code == smpl::GetClassCode<smpl::RobotModel>() ||
+            class_code == smpl::GetClassCode<smpl::ForwardKinematicsInterface>() ||
+            class_code == smpl::GetClassCode<smpl::InverseKinematicsInterface>() ||
+            class_code == smpl::GetClassCode<smpl::RedundantManipulatorInterface>())
+        {
+            return this;
+        }
+        return nullptr;
+    }
+};
+
+class NullCollisionChecker : public smpl::CollisionChecker
+{
+public:
+
+    bool isStateValid(
+        const smpl::RobotState& state,
+        bool verbose,
+        bool visualize,
+        double& dist) override
+    {
+        return true;
+    }
+
+    bool isStateToStateValid(
+        const smpl::RobotState& start,
+        const smpl::RobotState& finish,
+        int& path_length,
+        int& num_checks,
+        double& dist) override
+    {
+        return true;
+    }
+
+    bool interpolatePath(
+        const smpl::RobotState& start,
+        const smpl::RobotState& finish,
+        std::vector<smpl::RobotState>& path) override
+    {
+        path = { start, finish };
+        return true;
+    }
+};
+
+// Exposes the workspace -> robot conversions of WorkspaceLatticeBase
+class TestWorkspaceLattice : public smpl::WorkspaceLatticeBase
+{
+public:
+
+    using WorkspaceLatticeBase::WorkspaceLatticeBase;
+    using WorkspaceLatticeBase::stateWorkspaceToRobot;
+
+    int getStartStateID() const override { return 0; }
+    int getGoalStateID() const override { return 1; }
+
+    bool extractPath(
+        const std::vector<int>& ids,
+        std::vector<smpl::RobotState>& path) override
+    {
+        return false;
+    }
+
+    void GetSuccs(
+        int state_id,
+        std::vector<int>* succs,
+        std::vector<int>* costs) override
+    { }
+
+    void GetPreds(
+        int state_id,
+        std::vector<int>* preds,
+        std::vector<int>* costs) override
+    { }
+
+    void PrintState(int state_id, bool verbose, FILE* f = nullptr) override { }
+
+    smpl::Extension* getExtension(size_t class_code) override
+    {
+        if (class_code == smpl::GetClassCode<smpl::RobotPlanningSpace>()) {
+            return this;
+        }
+        return nullptr;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(SeedSensitivityTest)
+{
+    smpl::PlanningParams params;
+    params.addParam("ik_cache_size", 100);
+    params.addParam("ik_cache_seed_res", 0.05);
+
+    BranchingArmModel robot;
+    NullCollisionChecker checker;
+    TestWorkspaceLattice lattice(&robot, &checker, &params);
+
+    smpl::WorkspaceLatticeBase::Params wparams;
+    wparams.res_x = wparams.res_y = wparams.res_z = 0.1;
+    wparams.R_count = wparams.P_count = wparams.Y_count = 36;
+    wparams.free_angle_res = { 10.0 * M_PI / 180.0 };
+    BOOST_REQUIRE(lattice.init(wparams));
+
+    const smpl::WorkspaceState state = { 0.55, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+
+    // seeds on either branch of the first joint produce different solutions
+    smpl::RobotState up, down;
+    BOOST_REQUIRE(lattice.stateWorkspaceToRobot(state, { 0.5, 0.0, 0.0 }, up));
+    BOOST_REQUIRE(lattice.stateWorkspaceToRobot(state, { -0.5, 0.0, 0.0 }, down));
+    BOOST_CHECK_EQUAL(robot.ik_count, 2);
+    BOOST_CHECK_CLOSE(up[0], 0.55, 1e-6);
+    BOOST_CHECK_CLOSE(down[0], -0.55, 1e-6);
+
+    // the same seed is served from the cache
+    smpl::RobotState again;
+    BOOST_REQUIRE(lattice.stateWorkspaceToRobot(state, { -0.5, 0.0, 0.0 }, again));
+    BOOST_CHECK_EQUAL(robot.ik_count, 2);
+    BOOST_CHECK(again == down);
+
+    // as are seeds within the same bin, and poses within the same cell
+    smpl::WorkspaceState nearby = state;
+    nearby[0] += 0.01;
+    BOOST_REQUIRE(lattice.stateWorkspaceToRobot(nearby, { -0.51, 0.0, 0.0 }, again));
+    BOOST_CHECK_EQUAL(robot.ik_count, 2);
+
+    // seeds in different bins are solved separately
+    BOOST_REQUIRE(lattice.stateWorkspaceToRobot(state, { -0.7, 0.0, 0.0 }, again));
+    BOOST_CHECK_EQUAL(robot.ik_count, 3);
+}
+
+BOOST_AUTO_TEST_CASE(SolutionBranchTest)
+{
+    smpl::PlanningParams params;
+    params.addParam("ik_cache_size", 100);
+    params.addParam("ik_cache_seed_res", 0.05);
+
+    BranchingArmModel robot;
+    robot.report_branches = true;
+    NullCollisionChecker checker;
+    TestWorkspaceLattice lattice(&robot, &checker, &params);
+
+    smpl::WorkspaceLatticeBase::Params wparams;
+    wparams.res_x = wparams.res_y = wparams.res_z = 0.1;
+    wparams.R_count = wparams.P_count = wparams.Y_count = 36;
+    wparams.free_angle_res = { 10.0 * M_PI / 180.0 };
+    BOOST_REQUIRE(lattice.init(wparams));
+
+    const smpl::WorkspaceState state = { 0.55, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+
+    smpl::RobotState up, down;
+    BOOST_REQUIRE(lattice.stateWorkspaceToRobot(state, { 0.5, 0.0, 0.0 }, up));
+    BOOST_REQUIRE(lattice.stateWorkspaceToRobot(state, { -0.5, 0.0, 0.0 }, down));
+    BOOST_CHECK_EQUAL(robot.ik_count, 2);
+    BOOST_CHECK_CLOSE(up[0], 0.55, 1e-6);
+    BOOST_CHECK_CLOSE(down[0], -0.55, 1e-6);
+
+    // distant seeds on the same branch share a solution
+    smpl::RobotState again;
+    BOOST_REQUIRE(lattice.stateWorkspaceToRobot(state, { -0.7, 0.3, 0.0 }, again));
+    BOOST_CHECK_EQUAL(robot.ik_count, 2);
+    BOOST_CHECK(again == down);
+
+    BOOST_REQUIRE(lattice.stateWorkspaceToRobot(state, { 1.2, -0.4, 0.0 }, again));
+    BOOST_CHECK_EQUAL(robot.ik_count, 2);
+    BOOST_CHECK(again == up);
+
+    // seeds with different redundant variables are solved separately
+    BOOST_REQUIRE(lattice.stateWorkspaceToRobot(state, { -0.5, 0.0, 1.0 }, again));
+    BOOST_CHECK_EQUAL(robot.ik_count, 3);
+}
@@ -0,0 +1,312 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+// standard includes
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#define BOOST_TEST_MODULE KDLRobotModelTest
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+// system includes
+#include <kdl/chainfksolverpos_recursive.hpp>
+#include <kdl/frames.hpp>
+#include <kdl/jntarray.hpp>
+#include <sbpl_kdl_robot_model/kdl_robot_model.h>
+
+namespace smpl = sbpl::motion;
+
+// A serial arm with joints about alternating axes, a fixed joint in the middle
+// of the chain, and a continuous joint
+const char* const urdf_string = R"(
+<robot name="arm">
+  <link name="base_link"/>
+  <link name="link1"/>
+  <link name="link2"/>
+  <link name="link3"/>
+  <link name="link3_mount"/>
+  <link name="link4"/>
+  <link name="link5"/>
+  <link name="link6"/>
+  <link name="tool_link"/>
+  <joint name="joint1" type="revolute">
+    <parent link="base_link"/>
+    <child link="link1"/>
+    <origin xyz="0 0 0.3" rpy="0 0 0"/>
+    <axis xyz="0 0 1"/>
+    <limit lower="-2.5" upper="2.5" effort="10" velocity="1"/>
+  </joint>
+  <joint name="joint2" type="revolute">
+    <parent link="link1"/>
+    <child link="link2"/>
+    <origin xyz="0.1 0 0.1" rpy="0 0.2 0"/>
+    <axis xyz="0 1 0"/>
+    <limit lower="-1.5" upper="1.5" effort="10" velocity="1"/>
+  </joint>
+  <joint name="joint3" type="continuous">
+    <parent link="link2"/>
+    <child link="link3"/>
+    <origin xyz="0.4 0 0" rpy="0.1 0 0"/>
+    <axis xyz="1 0 0"/>
+    <limit effort="10" velocity="1"/>
+  </joint>
+  <joint name="joint3_mount" type="fixed">
+    <parent link="link3"/>
+    <child link="link3_mount"/>
+    <origin xyz="0.05 0.02 0" rpy="0 0 0.3"/>
+  </joint>
+  <joint name="joint4" type="revolute">
+    <parent link="link3_mount"/>
+    <child link="link4"/>
+    <origin xyz="0.3 0 0" rpy="0 0 0"/>
+    <axis xyz="0 1 0"/>
+    <limit lower="-2.0" upper="2.0" effort="10" velocity="1"/>
+  </joint>
+  <joint name="joint5" type="revolute">
+    <parent link="link4"/>
+    <child link="link5"/>
+    <origin xyz="0.2 0 0" rpy="0 0 0"/>
+    <axis xyz="1 0 0"/>
+    <limit lower="-3.0" upper="3.0" effort="10" velocity="1"/>
+  </joint>
+  <joint name="joint6" type="revolute">
+    <parent link="link5"/>
+    <child link="link6"/>
+    <origin xyz="0.1 0 0" rpy="0 0 0"/>
+    <axis xyz="0 0.6 0.8"/>
+    <limit lower="-2.0" upper="2.0" effort="10" velocity="1"/>
+  </joint>
+  <joint name="tool_joint" type="fixed">
+    <parent link="link6"/>
+    <child link="tool_link"/>
+    <origin xyz="0.15 0 0" rpy="0 0 0"/>
+  </joint>
+</robot>
+)";
+
+const std::vector<std::string> planning_joints = {
+    "joint1", "joint2", "joint3", "joint4", "joint5", "joint6"
+};
+
+// Expose the cached chain forward kinematics for comparison against KDL
+class TestRobotModel : public smpl::KDLRobotModel
+{
+public:
+
+    using KDLRobotModel::computeChainFK;
+
+    const KDL::Chain& chain() const { return kchain_; }
+};
+
+struct KDLRobotModelFixture
+{
+    TestRobotModel model;
+    std::unique_ptr<KDL::ChainFkSolverPos_recursive> fk_solver;
+    std::mt19937 rng;
+
+    KDLRobotModelFixture() : rng(1)
+    {
+        BOOST_REQUIRE(model.init(
+                urdf_string, planning_joints, "base_link", "tool_link"));
+        BOOST_REQUIRE(model.setPlanningLink("tool_link"));
+        fk_solver.reset(new KDL::ChainFkSolverPos_recursive(model.chain()));
+    }
+
+    // Return a random configuration, exceeding the limits of the continuous
+    // joint to exercise angle normalization
+    std::vector<double> randomConfig()
+    {
+        std::vector<double> q(planning_joints.size());
+        for (size_t i = 0; i < q.size(); ++i) {
+            double lo, hi;
+            if (model.isContinuous(i)) {
+                lo = -2.0 * M_PI;
+                hi = 2.0 * M_PI;
+            } else {
+                lo = model.minPosLimit(i);
+                hi = model.maxPosLimit(i);
+            }
+            q[i] = std::uniform_real_distribution<double>(lo, hi)(rng);
+        }
+        return q;
+    }
+
+    // Return the pose of the root of a segment, computed by KDL without
+    // caching
+    KDL::Frame referenceFK(const std::vector<double>& q, int segment)
+    {
+        KDL::JntArray jnt_pos(q.size());
+        for (size_t i = 0; i < q.size(); ++i) {
+            jnt_pos(i) = q[i];
+        }
+        KDL::Frame f;
+        BOOST_REQUIRE(fk_solver->JntToCart(jnt_pos, f, segment) >= 0);
+        return f;
+    }
+
+    int planningSegment() const
+    {
+        const KDL::Chain& chain = model.chain();
+        for (unsigned int i = 0; i < chain.getNrOfSegments(); ++i) {
+            if (chain.getSegment(i).getName() == model.getPlanningLink()) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    // Check the cached pose of every segment root, visiting the segments in
+    // the given order
+    void checkChainFK(
+        const std::vector<double>& q,
+        const std::vector<int>& segments)
+    {
+        for (int s : segments) {
+            KDL::Frame f;
+            BOOST_REQUIRE(model.computeChainFK(q, s, f));
+            BOOST_CHECK_MESSAGE(
+                    KDL::Equal(f, referenceFK(q, s), 1e-9),
+                    "segment " << s << " pose differs from KDL");
+        }
+    }
+
+    // Check a pose { x, y, z, R, P, Y } against a frame
+    void checkPose(const std::vector<double>& pose, const KDL::Frame& f)
+    {
+        BOOST_REQUIRE_EQUAL(pose.size(), 6);
+        const KDL::Frame pf(
+                KDL::Rotation::RPY(pose[3], pose[4], pose[5]),
+                KDL::Vector(pose[0], pose[1], pose[2]));
+        BOOST_CHECK(KDL::Equal(pf, f, 1e-9));
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(ChainFKMatchesKDLTest, KDLRobotModelFixture)
+{
+    const int segment_count = (int)model.chain().getNrOfSegments();
+    std::vector<int> forward;
+    for (int s = 0; s <= segment_count; ++s) {
+        forward.push_back(s);
+    }
+    const std::vector<int> backward(forward.rbegin(), forward.rend());
+
+    KDL::Frame f;
+    BOOST_CHECK(!model.computeChainFK(randomConfig(), -1, f));
+    BOOST_CHECK(!model.computeChainFK(randomConfig(), segment_count + 1, f));
+
+    for (int i = 0; i < 100; ++i) {
+        // all joints change
+        std::vector<double> q = randomConfig();
+        checkChainFK(q, backward);
+        checkChainFK(q, forward);
+
+        // the same configuration, entirely cached
+        checkChainFK(q, { segment_count, 0, segment_count / 2 });
+
+        // only one joint changes, invalidating the segments after it
+        for (size_t j = 0; j < q.size(); ++j) {
+            const std::vector<double> r = randomConfig();
+            q[j] = r[j];
+            checkChainFK(q, { segment_count });
+            q[j] = r[(j + 1) % r.size()];
+            checkChainFK(q, { 0, (int)j, segment_count, 1 });
+        }
+
+        // a shallow query after a change leaves the deeper segments to be
+        // computed by a later query of the same configuration
+        q = randomConfig();
+        checkChainFK(q, { 1 });
+        q.back() = randomConfig().back();
+        checkChainFK(q, { segment_count / 2, segment_count });
+
+        // a change to a continuous joint by a full turn does not change the
+        // normalized configuration
+        for (size_t j = 0; j < q.size(); ++j) {
+            if (model.isContinuous(j)) {
+                q[j] += 2.0 * M_PI;
+            }
+        }
+        checkChainFK(q, backward);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(BatchFKMatchesKDLTest, KDLRobotModelFixture)
+{
+    const int planning_segment = planningSegment();
+    BOOST_REQUIRE_GE(planning_segment, 0);
+
+    // a non-identity transform to the planning frame
+    const KDL::Frame T_kinematics_to_planning(
+            KDL::Rotation::RPY(0.1, -0.2, 0.3), KDL::Vector(1.0, -0.5, 0.2));
+    model.setKinematicsToPlanningTransform(T_kinematics_to_planning, "map");
+
+    for (int i = 0; i < 20; ++i) {
+        // states sharing leading joint positions, as the successors of a
+        // lattice state do, interleaved with unrelated and repeated states
+        std::vector<std::vector<double>> states;
+        const std::vector<double> parent = randomConfig();
+        for (size_t j = 0; j < parent.size(); ++j) {
+            std::vector<double> succ = parent;
+            succ[j] += 0.1;
+            states.push_back(succ);
+            succ[j] -= 0.2;
+            states.push_back(succ);
+            states.push_back(randomConfig());
+        }
+        states.push_back(parent);
+        states.push_back(parent);
+
+        std::vector<std::vector<double>> poses;
+        BOOST_REQUIRE(model.computeBatchPlanningLinkFK(states, poses));
+        BOOST_REQUIRE_EQUAL(poses.size(), states.size());
+        for (size_t s = 0; s < states.size(); ++s) {
+            checkPose(
+                    poses[s],
+                    T_kinematics_to_planning * referenceFK(states[s], planning_segment));
+        }
+
+        // single queries following a batch see the cache left by the batch
+        std::vector<double> pose;
+        for (size_t s = states.size(); s-- > 0; ) {
+            BOOST_REQUIRE(model.computePlanningLinkFK(states[s], pose));
+            checkPose(
+                    pose,
+                    T_kinematics_to_planning * referenceFK(states[s], planning_segment));
+        }
+    }
+
+    std::vector<std::vector<double>> poses(3);
+    BOOST_CHECK(model.computeBatchPlanningLinkFK({ }, poses));
+    BOOST_CHECK(poses.empty());
+}
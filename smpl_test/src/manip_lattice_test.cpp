@@ -0,0 +1,337 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+// standard includes
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#define BOOST_TEST_MODULE ManipLatticeTest
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+// system includes
+#include <smpl/collision_checker.h>
+#include <smpl/planning_params.h>
+#include <smpl/robot_model.h>
+#include <smpl/graph/action_space.h>
+#include <smpl/graph/manip_lattice.h>
+
+namespace smpl = sbpl::motion;
+
+// A planar arm with two unit-length links
+class PlanarArmModel : public smpl::ForwardKinematicsInterface
+{
+public:
+
+    PlanarArmModel() { setPlanningJoints({ "shoulder", "elbow" }); }
+
+    double minPosLimit(int jidx) const override { return -M_PI; }
+    double maxPosLimit(int jidx) const override { return M_PI; }
+    bool hasPosLimit(int jidx) const override { return true; }
+    bool isContinuous(int jidx) const override { return false; }
+    double velLimit(int jidx) const override { return 0.0; }
+    double accLimit(int jidx) const override { return 0.0; }
+
+    bool checkJointLimits(
+        const smpl::RobotState& state,
+        bool verbose = false) override
+    {
+        for (size_t i = 0; i < state.size(); ++i) {
+            if (state[i] < minPosLimit(i) || state[i] > maxPosLimit(i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool computeFK(
+        const smpl::RobotState& state,
+        const std::string& name,
+        std::vector<double>& pose) override
+    {
+        return computePlanningLinkFK(state, pose);
+    }
+
+    bool computePlanningLinkFK(
+        const smpl::RobotState& state,
+        std::vector<double>& pose) override
+    {
+        pose.assign(6, 0.0);
+        pose[0] = std::cos(state[0]) + std::cos(state[0] + state[1]);
+        pose[1] = std::sin(state[0]) + std::sin(state[0] + state[1]);
+        pose[5] = state[0] + state[1];
+        return true;
+    }
+
+    smpl::Extension* getExtension(size_t class_code) override
+    {
+        if (class_code == smpl::GetClassCode<smpl::RobotModel>() ||
+            class_code == smpl::GetClassCode<smpl::ForwardKinematicsInterface>())
+        {
+            return this;
+        }
+        return nullptr;
+    }
+};
+
+// Rejects motions that bring the tip of the planar arm within a disc. Each
+// instance counts its own checks, so instances must not be shared between
+// threads.
+class DiscCollisionChecker : public smpl::CollisionChecker
+{
+public:
+
+    int check_count = 0;
+
+    bool isStateValid(
+        const smpl::RobotState& state,
+        bool verbose,
+        bool visualize,
+        double& dist) override
+    {
+        ++check_count;
+        std::vector<double> pose;
+        m_model.computePlanningLinkFK(state, pose);
+        const double dx = pose[0] - 1.0;
+        const double dy = pose[1] - 1.0;
+        dist = std::sqrt(dx * dx + dy * dy) - 0.5;
+        return dist > 0.0;
+    }
+
+    bool isStateToStateValid(
+        const smpl::RobotState& start,
+        const smpl::RobotState& finish,
+        int& path_length,
+        int& num_checks,
+        double& dist) override
+    {
+        std::vector<smpl::RobotState> path;
+        interpolatePath(start, finish, path);
+        path_length = (int)path.size();
+        num_checks = 0;
+        for (const smpl::RobotState& state : path) {
+            ++num_checks;
+            if (!isStateValid(state, false, false, dist)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool interpolatePath(
+        const smpl::RobotState& start,
+        const smpl::RobotState& finish,
+        std::vector<smpl::RobotState>& path) override
+    {
+        const int steps = 8;
+        path.resize(steps + 1);
+        for (int i = 0; i <= steps; ++i) {
+            const double t = (double)i / (double)steps;
+            path[i].resize(start.size());
+            for (size_t j = 0; j < start.size(); ++j) {
+                path[i][j] = (1.0 - t) * start[j] + t * finish[j];
+            }
+        }
+        return true;
+    }
+
+private:
+
+    PlanarArmModel m_model;
+};
+
+// Moves one joint by a fixed step in either direction
+class JointStepActionSpace : public smpl::ActionSpace
+{
+public:
+
+    JointStepActionSpace(smpl::RobotPlanningSpace* pspace) :
+        ActionSpace(pspace)
+    { }
+
+    bool apply(
+        const smpl::RobotState& parent,
+        std::vector<smpl::Action>& actions) override
+    {
+        actions.clear();
+        for (size_t j = 0; j < parent.size(); ++j) {
+            for (double step : { -0.2, 0.2 }) {
+                smpl::RobotState succ = parent;
+                succ[j] += step;
+                actions.push_back(smpl::Action(1, succ));
+            }
+        }
+        return true;
+    }
+};
+
+struct LatticeFixture
+{
+    smpl::PlanningParams params;
+    PlanarArmModel robot;
+    DiscCollisionChecker checker;
+    std::vector<std::unique_ptr<PlanarArmModel>> thread_robots;
+    std::vector<std::unique_ptr<DiscCollisionChecker>> thread_checkers;
+    std::unique_ptr<smpl::ManipLattice> lattice;
+
+    explicit LatticeFixture(int extra_threads)
+    {
+        lattice.reset(new smpl::ManipLattice(&robot, &checker, &params));
+        BOOST_REQUIRE(lattice->init({ 0.2, 0.2 }));
+        BOOST_REQUIRE(lattice->setActionSpace(
+                std::make_shared<JointStepActionSpace>(lattice.get())));
+
+        std::vector<smpl::RobotModel*> robots;
+        std::vector<smpl::CollisionChecker*> checkers;
+        for (int i = 0; i < extra_threads; ++i) {
+            thread_robots.emplace_back(new PlanarArmModel);
+            thread_checkers.emplace_back(new DiscCollisionChecker);
+            robots.push_back(thread_robots.back().get());
+            checkers.push_back(thread_checkers.back().get());
+        }
+        BOOST_REQUIRE(lattice->setSuccessorThreadContexts(robots, checkers));
+        BOOST_REQUIRE_EQUAL(lattice->successorThreadCount(), extra_threads + 1);
+
+        smpl::GoalConstraint goal;
+        goal.type = smpl::GoalType::JOINT_STATE_GOAL;
+        goal.angles = { 3.0, 0.0 };
+        goal.angle_tolerances = { 0.05, 0.05 };
+        BOOST_REQUIRE(lattice->setStart({ -1.0, 0.2 }));
+        BOOST_REQUIRE(lattice->setGoal(goal));
+    }
+};
+
+// Expand states in breadth-first order from the start state, recording the
+// successors and costs of each expansion
+void ExpandBreadthFirst(
+    smpl::ManipLattice& lattice,
+    int max_expansions,
+    std::vector<std::vector<int>>& succs,
+    std::vector<std::vector<int>>& costs)
+{
+    std::vector<int> open = { lattice.getStartStateID() };
+    std::vector<bool> seen;
+    for (size_t i = 0; i < open.size() && (int)i < max_expansions; ++i) {
+        std::vector<int> s, c;
+        lattice.GetSuccs(open[i], &s, &c);
+        for (int succ_id : s) {
+            if (succ_id >= (int)seen.size()) {
+                seen.resize(succ_id + 1, false);
+            }
+            if (!seen[succ_id]) {
+                seen[succ_id] = true;
+                open.push_back(succ_id);
+            }
+        }
+        succs.push_back(std::move(s));
+        costs.push_back(std::move(c));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ParallelSuccessorsMatchSerialTest)
+{
+    LatticeFixture serial(0);
+    LatticeFixture parallel(3);
+
+    std::vector<std::vector<int>> serial_succs, serial_costs;
+    std::vector<std::vector<int>> parallel_succs, parallel_costs;
+    ExpandBreadthFirst(*serial.lattice, 500, serial_succs, serial_costs);
+    ExpandBreadthFirst(*parallel.lattice, 500, parallel_succs, parallel_costs);
+
+    BOOST_REQUIRE_EQUAL(serial_succs.size(), parallel_succs.size());
+    for (size_t i = 0; i < serial_succs.size(); ++i) {
+        BOOST_CHECK(serial_succs[i] == parallel_succs[i]);
+        BOOST_CHECK(serial_costs[i] == parallel_costs[i]);
+    }
+
+    // the obstacle must actually reject some actions for the comparison to
+    // cover invalid successors
+    size_t action_count = 0;
+    size_t succ_count = 0;
+    for (const auto& s : serial_succs) {
+        action_count += 4;
+        succ_count += s.size();
+    }
+    BOOST_CHECK_LT(succ_count, action_count);
+
+    // the additional threads must have checked some of the actions
+    int thread_check_count = 0;
+    for (const auto& checker : parallel.thread_checkers) {
+        thread_check_count += checker->check_count;
+    }
+    BOOST_CHECK_GT(thread_check_count, 0);
+}
+
+BOOST_AUTO_TEST_CASE(BatchSuccessorsMatchSerialTest)
+{
+    LatticeFixture serial(0);
+    LatticeFixture parallel(3);
+
+    std::vector<std::vector<int>> serial_succs, serial_costs;
+    ExpandBreadthFirst(*serial.lattice, 50, serial_succs, serial_costs);
+
+    // expand the same states, in the same order, as one batch per level
+    std::vector<int> level = { parallel.lattice->getStartStateID() };
+    std::vector<bool> seen;
+    std::vector<std::vector<int>> batch_succs, batch_costs;
+    while (batch_succs.size() < serial_succs.size()) {
+        const size_t remaining = serial_succs.size() - batch_succs.size();
+        if (level.size() > remaining) {
+            level.resize(remaining);
+        }
+
+        std::vector<std::vector<int>> s, c;
+        parallel.lattice->GetBatchSuccs(level, &s, &c);
+
+        std::vector<int> next;
+        for (size_t i = 0; i < level.size(); ++i) {
+            for (int succ_id : s[i]) {
+                if (succ_id >= (int)seen.size()) {
+                    seen.resize(succ_id + 1, false);
+                }
+                if (!seen[succ_id]) {
+                    seen[succ_id] = true;
+                    next.push_back(succ_id);
+                }
+            }
+            batch_succs.push_back(std::move(s[i]));
+            batch_costs.push_back(std::move(c[i]));
+        }
+        BOOST_REQUIRE(!next.empty() || batch_succs.size() == serial_succs.size());
+        level = std::move(next);
+    }
+
+    for (size_t i = 0; i < serial_succs.size(); ++i) {
+        BOOST_CHECK(serial_succs[i] == batch_succs[i]);
+        BOOST_CHECK(serial_costs[i] == batch_costs[i]);
+    }
+}
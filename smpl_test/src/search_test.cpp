@@ -0,0 +1,445 @@
+////////////////////////////////////////////////////////////////////////////////
+// Copyright (c) 2017, Andrew Dornbush
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     1. Redistributions of source code must retain the above copyright notice
+//        this list of conditions and the following disclaimer.
+//     2. Redistributions in binary form must reproduce the above copyright
+//        notice, this list of conditions and the following disclaimer in the
+//        documentation and/or other materials provided with the distribution.
+//     3. Neither the name of the copyright holder nor the names of its
+//        contributors may be used to endorse or promote products derived from
+//        this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+////////////////////////////////////////////////////////////////////////////////
+
+/// \author Andrew Dornbush
+
+// standard includes
+#include <cstdlib>
+#include <queue>
+#include <random>
+#include <vector>
+
+#define BOOST_TEST_MODULE SearchTest
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+// system includes
+#include <sbpl/discrete_space_information/environment.h>
+#include <sbpl/heuristics/heuristic.h>
+#include <sbpl/planners/planner.h>
+#include <smpl/graph/robot_planning_space.h>
+#include <smpl/heuristic/robot_heuristic.h>
+#include <smpl/search/arastar.h>
+#include <smpl/search/parallel_astar.h>
+
+namespace smpl = sbpl::motion;
+
+// A 4-connected grid with randomly blocked cells, where each move costs 10
+class GridSpace :
+    public DiscreteSpaceInformation,
+    public smpl::BatchSuccessorsExtension,
+    public smpl::ChangedEdgesExtension
+{
+public:
+
+    static const int MoveCost = 10;
+
+    GridSpace(int width, int height, double blocked_fraction, unsigned seed) :
+        m_width(width),
+        m_height(height),
+        m_blocked(width * height, false)
+    {
+        std::mt19937 gen(seed);
+        std::bernoulli_distribution blocked(blocked_fraction);
+        for (size_t i = 0; i < m_blocked.size(); ++i) {
+            m_blocked[i] = blocked(gen);
+        }
+    }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int stateCount() const { return m_width * m_height; }
+
+    bool blocked(int state_id) const { return m_blocked[state_id]; }
+
+    void setBlocked(int state_id, bool blocked)
+    {
+        if (m_blocked[state_id] != blocked) {
+            m_blocked[state_id] = blocked;
+            m_changed_cells.push_back(state_id);
+        }
+    }
+
+    int distance(int a, int b) const
+    {
+        return MoveCost * (
+                std::abs(a % m_width - b % m_width) +
+                std::abs(a / m_width - b / m_width));
+    }
+
+    // cost of the cheapest path between two cells, or -1 if none exists
+    int shortestPathCost(int start, int goal) const
+    {
+        if (m_blocked[start] || m_blocked[goal]) {
+            return -1;
+        }
+        std::vector<int> cost(stateCount(), -1);
+        std::queue<int> q;
+        cost[start] = 0;
+        q.push(start);
+        std::vector<int> succs, costs;
+        while (!q.empty()) {
+            const int s = q.front();
+            q.pop();
+            if (s == goal) {
+                return cost[s];
+            }
+            getNeighbors(s, &succs, &costs);
+            for (int t : succs) {
+                if (cost[t] < 0) {
+                    cost[t] = cost[s] + MoveCost;
+                    q.push(t);
+                }
+            }
+        }
+        return -1;
+    }
+
+    void getNeighbors(
+        int state_id,
+        std::vector<int>* succs,
+        std::vector<int>* costs) const
+    {
+        succs->clear();
+        costs->clear();
+        const int x = state_id % m_width;
+        const int y = state_id / m_width;
+        const int dx[] = { 1, -1, 0, 0 };
+        const int dy[] = { 0, 0, 1, -1 };
+        for (int i = 0; i < 4; ++i) {
+            const int nx = x + dx[i];
+            const int ny = y + dy[i];
+            if (nx < 0 || ny < 0 || nx >= m_width || ny >= m_height) {
+                continue;
+            }
+            const int n = ny * m_width + nx;
+            if (m_blocked[n]) {
+                continue;
+            }
+            succs->push_back(n);
+            costs->push_back(MoveCost);
+        }
+    }
+
+    /// \name Required Public Functions from DiscreteSpaceInformation
+    ///@{
+    bool InitializeEnv(const char* sEnvFile) override { return true; }
+    bool InitializeMDPCfg(MDPConfig* MDPCfg) override { return true; }
+    int GetFromToHeuristic(int from_id, int to_id) override { return 0; }
+    int GetGoalHeuristic(int state_id) override { return 0; }
+    int GetStartHeuristic(int state_id) override { return 0; }
+    void GetSuccs(
+        int state_id,
+        std::vector<int>* succs,
+        std::vector<int>* costs) override
+    {
+        getNeighbors(state_id, succs, costs);
+    }
+    void GetPreds(
+        int state_id,
+        std::vector<int>* preds,
+        std::vector<int>* costs) override
+    {
+        getNeighbors(state_id, preds, costs);
+    }
+    void SetAllActionsandAllOutcomes(CMDPSTATE* state) override { }
+    void SetAllPreds(CMDPSTATE* state) override { }
+    int SizeofCreatedEnv() override { return stateCount(); }
+    void PrintState(int state_id, bool verbose, FILE* fout = NULL) override { }
+    void PrintEnv_Config(FILE* fout) override { }
+    ///@}
+
+    /// \name Required Public Functions from BatchSuccessorsExtension
+    ///@{
+    void GetBatchSuccs(
+        const std::vector<int>& state_ids,
+        std::vector<std::vector<int>>* succs,
+        std::vector<std::vector<int>>* costs) override
+    {
+        ++batch_count;
+        succs->resize(state_ids.size());
+        costs->resize(state_ids.size());
+        for (size_t i = 0; i < state_ids.size(); ++i) {
+            getNeighbors(state_ids[i], &(*succs)[i], &(*costs)[i]);
+        }
+    }
+    ///@}
+
+    /// \name Required Public Functions from ChangedEdgesExtension
+    ///@{
+    void getChangedEdgeSources(std::vector<int>& state_ids) override
+    {
+        // the edges into a changed cell leave its neighbors
+        state_ids.clear();
+        std::vector<int> succs, costs;
+        for (int cell : m_changed_cells) {
+            const bool blocked = m_blocked[cell];
+            m_blocked[cell] = false;
+            getNeighbors(cell, &succs, &costs);
+            m_blocked[cell] = blocked;
+            state_ids.insert(state_ids.end(), succs.begin(), succs.end());
+            state_ids.push_back(cell);
+        }
+        m_changed_cells.clear();
+    }
+    ///@}
+
+    /// \name Required Public Functions from Extension
+    ///@{
+    smpl::Extension* getExtension(size_t class_code) override
+    {
+        if (class_code == smpl::GetClassCode<smpl::BatchSuccessorsExtension>() ||
+            class_code == smpl::GetClassCode<smpl::ChangedEdgesExtension>())
+        {
+            return this;
+        }
+        return nullptr;
+    }
+    ///@}
+
+    int batch_count = 0;
+
+private:
+
+    int m_width;
+    int m_height;
+    std::vector<bool> m_blocked;
+    std::vector<int> m_changed_cells;
+};
+
+const int GridSpace::MoveCost;
+
+// Manhattan distance to the goal cell. The distance between arbitrary cells is
+// only reported when constructed as a pairwise heuristic.
+class ManhattanHeuristic :
+    public Heuristic,
+    public smpl::PairwiseHeuristicExtension
+{
+public:
+
+    ManhattanHeuristic(GridSpace* space, bool pairwise) :
+        Heuristic(space),
+        m_space(space),
+        m_pairwise(pairwise),
+        m_goal(0)
+    { }
+
+    void setGoal(int goal) { m_goal = goal; }
+
+    int GetGoalHeuristic(int state_id) override
+    {
+        return m_space->distance(state_id, m_goal);
+    }
+
+    int GetStartHeuristic(int state_id) override { return 0; }
+
+    int GetFromToHeuristic(int from_id, int to_id) override
+    {
+        if (to_id == m_goal) {
+            return m_space->distance(from_id, to_id);
+        }
+        return m_pairwise ? m_space->distance(from_id, to_id) : 0;
+    }
+
+    smpl::Extension* getExtension(size_t class_code) override
+    {
+        if (m_pairwise &&
+            class_code == smpl::GetClassCode<smpl::PairwiseHeuristicExtension>())
+        {
+            return this;
+        }
+        return nullptr;
+    }
+
+private:
+
+    GridSpace* m_space;
+    bool m_pairwise;
+    int m_goal;
+};
+
+// Solve a query with a planner at a fixed suboptimality bound. Returns the cost
+// of the solution, or -1 if no solution was found.
+int Solve(SBPLPlanner& planner, int start, int goal, double eps)
+{
+    planner.set_start(start);
+    planner.set_goal(goal);
+
+    ReplanParams params(60.0);
+    params.initial_eps = eps;
+    params.final_eps = eps;
+    params.return_first_solution = false;
+
+    std::vector<int> solution;
+    int cost;
+    if (!planner.replan(&solution, params, &cost)) {
+        return -1;
+    }
+
+    BOOST_CHECK_EQUAL(solution.front(), start);
+    BOOST_CHECK_EQUAL(solution.back(), goal);
+    return cost;
+}
+
+void CompareWithARAStar(bool pairwise, double eps)
+{
+    GridSpace space(100, 100, 0.25, 1);
+    ManhattanHeuristic heuristic(&space, pairwise);
+
+    sbpl::ParallelAStar pase(&space, &heuristic);
+    pase.setBatchSize(16);
+    sbpl::ARAStar arastar(&space, &heuristic);
+
+    std::mt19937 gen(2);
+    std::uniform_int_distribution<int> cells(0, space.stateCount() - 1);
+    int solved_count = 0;
+    for (int i = 0; i < 50; ++i) {
+        const int start = cells(gen);
+        const int goal = cells(gen);
+        if (space.blocked(start) || space.blocked(goal)) {
+            continue;
+        }
+
+        heuristic.setGoal(goal);
+        arastar.force_planning_from_scratch();
+        const int optimal_cost = space.shortestPathCost(start, goal);
+        const int pase_cost = Solve(pase, start, goal, eps);
+        const int arastar_cost = Solve(arastar, start, goal, eps);
+
+        BOOST_CHECK_EQUAL(pase_cost < 0, arastar_cost < 0);
+        BOOST_CHECK_EQUAL(pase_cost < 0, optimal_cost < 0);
+        if (pase_cost < 0 || arastar_cost < 0) {
+            continue;
+        }
+        ++solved_count;
+
+        if (eps == 1.0) {
+            BOOST_CHECK_EQUAL(pase_cost, arastar_cost);
+        }
+        BOOST_CHECK_GE(pase_cost, optimal_cost);
+        BOOST_CHECK_LE(pase_cost, eps * optimal_cost);
+        BOOST_CHECK_LE(arastar_cost, eps * optimal_cost);
+    }
+
+    BOOST_CHECK_GT(solved_count, 10);
+    BOOST_CHECK_GT(space.batch_count, 0);
+}
+
+BOOST_AUTO_TEST_CASE(ParallelAStarMatchesARAStarOptimalTest)
+{
+    CompareWithARAStar(true, 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(ParallelAStarMatchesARAStarSuboptimalTest)
+{
+    CompareWithARAStar(true, 2.5);
+}
+
+BOOST_AUTO_TEST_CASE(ParallelAStarSerialModeTest)
+{
+    CompareWithARAStar(false, 1.0);
+    CompareWithARAStar(false, 2.5);
+}
+
+// Repair a search after blocking or unblocking cells and compare the cost of
+// its solution with that of a search started from scratch
+void CompareRepairWithScratch(bool block, bool on_path)
+{
+    GridSpace space(60, 60, 0.2, 3);
+    ManhattanHeuristic heuristic(&space, true);
+
+    sbpl::ARAStar repaired(&space, &heuristic);
+    repaired.setIncrementalRepair(true);
+    sbpl::ARAStar scratch(&space, &heuristic);
+
+    std::mt19937 gen(4);
+    std::uniform_int_distribution<int> cells(0, space.stateCount() - 1);
+    int repair_count = 0;
+    for (int i = 0; i < 20; ++i) {
+        const int start = cells(gen);
+        const int goal = cells(gen);
+        if (space.blocked(start) || space.blocked(goal) ||
+            space.shortestPathCost(start, goal) < 0)
+        {
+            continue;
+        }
+
+        heuristic.setGoal(goal);
+        repaired.force_planning_from_scratch();
+        BOOST_REQUIRE_GE(Solve(repaired, start, goal, 1.0), 0);
+
+        // change a few cells, either along the solution or anywhere
+        for (int j = 0; j < 5; ++j) {
+            int cell;
+            if (on_path) {
+                std::vector<int> path;
+                int cost;
+                scratch.force_planning_from_scratch();
+                scratch.set_start(start);
+                scratch.set_goal(goal);
+                ReplanParams params(60.0);
+                params.initial_eps = 1.0;
+                params.final_eps = 1.0;
+                if (!scratch.replan(&path, params, &cost) || path.size() < 3) {
+                    break;
+                }
+                cell = path[1 + gen() % (path.size() - 2)];
+            } else {
+                cell = cells(gen);
+            }
+            if (cell == start || cell == goal) {
+                continue;
+            }
+            space.setBlocked(cell, block ? true : !space.blocked(cell));
+        }
+
+        std::vector<int> sources;
+        space.getChangedEdgeSources(sources);
+        repaired.costs_changed(smpl::ChangedEdgesQuery(std::move(sources)));
+
+        scratch.force_planning_from_scratch();
+        const int repaired_cost = Solve(repaired, start, goal, 1.0);
+        const int scratch_cost = Solve(scratch, start, goal, 1.0);
+        BOOST_CHECK_EQUAL(repaired_cost, scratch_cost);
+        BOOST_CHECK_EQUAL(repaired_cost, space.shortestPathCost(start, goal));
+        ++repair_count;
+    }
+
+    BOOST_CHECK_GT(repair_count, 5);
+}
+
+BOOST_AUTO_TEST_CASE(ARAStarRepairAddObstacleTest)
+{
+    CompareRepairWithScratch(true, true);
+}
+
+BOOST_AUTO_TEST_CASE(ARAStarRepairToggleObstacleTest)
+{
+    CompareRepairWithScratch(false, false);
+}